@@ -0,0 +1,836 @@
+/**
+ * BplusTree is a B+tree with the same add, find, findRange and
+ * remove as Btree. Btree is a binary tree, so a find follows a
+ * pointer (and takes a cache miss) for every level, and there are
+ * about 20 of those in a tree with a million things in it. Here the
+ * inner nodes are 256 bytes, four cache lines, and hold as many keys
+ * as fit (15 doubles) in a sorted array. A find only has to touch a
+ * handful of levels, and picking the child in each one is a few
+ * vector compares rather than a branch per key.
+ *
+ * All the keys and values live in the leaves, which are 512 bytes
+ * and linked to each other in order, so findRange reads straight
+ * through memory instead of hopping around the tree.
+ *
+ * Keys get added at the end of a node a lot (that's what reading an
+ * SP3 file in order does), so when a node fills up and the new key
+ * goes on its end, the old node is left full and the new one starts
+ * out nearly empty. Otherwise they're split down the middle.
+ *
+ * The pointers findRange hands back are into the leaves, so they're
+ * only good until the next add or remove. Btree's stay good.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _H_BPLUS_TREE
+#define _H_BPLUS_TREE
+
+#include "node_allocator.h"
+#include <boost/type_traits/has_trivial_destructor.hpp>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * Picks the child to go down in an inner node: the number of keys
+ * that are less than or equal to key. The keys are sorted, so
+ * counting them gets the same answer as a binary search, without
+ * any branches to mispredict. This one works on anything with a <,
+ * the ones after it do doubles and ints with SSE2.
+ */
+
+template <typename KeyType>
+struct BplusKeySearch {
+  static int upperBound(const KeyType *keys, int count, const KeyType &key)
+  {
+    int below = 0;
+    for (int i = 0; i < count; i++) {
+      below += !(key < keys[i]);
+    }
+    return below;
+  }
+};
+
+#ifdef __SSE2__
+
+template <>
+struct BplusKeySearch<double> {
+  static int upperBound(const double *keys, int count, double key)
+  {
+    __m128d wanted = _mm_set1_pd(key);
+    int below = 0;
+    int i = 0;
+    for (; i + 2 <= count; i += 2) {
+      below += __builtin_popcount(_mm_movemask_pd(_mm_cmple_pd(_mm_loadu_pd(keys + i), wanted)));
+    }
+    if (i < count) {
+      below += (keys[i] <= key);
+    }
+    return below;
+  }
+};
+
+template <>
+struct BplusKeySearch<int> {
+  static int upperBound(const int *keys, int count, int key)
+  {
+    __m128i wanted = _mm_set1_epi32(key);
+    int above = 0;
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+      __m128i greater = _mm_cmpgt_epi32(_mm_loadu_si128((const __m128i *) (keys + i)), wanted);
+      above += __builtin_popcount(_mm_movemask_epi8(greater)) / 4;
+    }
+    for (; i < count; i++) {
+      above += (keys[i] > key);
+    }
+    return count - above;
+  }
+};
+
+#endif
+
+template <typename KeyType, typename ValType, typename Allocator = NodeArena>
+class BplusTree {
+ public:
+  typedef std::vector<std::pair<KeyType, ValType> *> RangeType;
+  typedef std::pair<KeyType, ValType> EntryType;
+
+  enum { CACHE_LINE = 64, INNER_BYTES = 4 * CACHE_LINE, LEAF_BYTES = 8 * CACHE_LINE };
+
+  /**
+   * However many fit, but never less than 4 so splits and merges
+   * still work for big keys. Nodes only fill or empty down to
+   * half before they're split or merged.
+   */
+
+  enum {
+    INNER_FIT = (INNER_BYTES - sizeof(int) - sizeof(void *)) / (sizeof(KeyType) + sizeof(void *)),
+    INNER_KEYS = INNER_FIT < 4 ? 4 : INNER_FIT,
+    INNER_MIN = INNER_KEYS / 2,
+    LEAF_FIT = (LEAF_BYTES - sizeof(int) - 2 * sizeof(void *)) / sizeof(EntryType),
+    LEAF_ENTRIES = LEAF_FIT < 4 ? 4 : LEAF_FIT,
+    LEAF_MIN = LEAF_ENTRIES / 2,
+    MAX_LEVELS = 64
+  };
+
+ protected:
+
+  struct Node {
+  };
+
+  struct Inner : public Node {
+    int count; // keys, there's one more child than that
+    KeyType keys[INNER_KEYS];
+    Node *children[INNER_KEYS + 1];
+  };
+
+  struct Leaf : public Node {
+    int count;
+    Leaf *next;
+    Leaf *previous;
+    EntryType entries[LEAF_ENTRIES];
+  };
+
+  typedef BplusKeySearch<KeyType> Search;
+
+  Node *root;
+  int levels; // 1 when the root is a leaf
+  size_t entries;
+  Leaf *head;
+  Leaf *tail;
+  Allocator innerNodes;
+  Allocator leafNodes;
+
+  // Not copyable, it owns the nodes
+  BplusTree(const BplusTree &);
+  BplusTree &operator=(const BplusTree &);
+
+  Inner *newInner()
+  {
+    Inner *inner = new (innerNodes.allocate()) Inner();
+    inner->count = 0;
+    return inner;
+  }
+
+  Leaf *newLeaf()
+  {
+    Leaf *leaf = new (leafNodes.allocate()) Leaf();
+    leaf->count = 0;
+    leaf->next = (Leaf *) NULL;
+    leaf->previous = (Leaf *) NULL;
+    return leaf;
+  }
+
+  void destroy(Inner *inner)
+  {
+    inner->~Inner();
+    innerNodes.deallocate(inner);
+  }
+
+  void destroy(Leaf *leaf)
+  {
+    leaf->~Leaf();
+    leafNodes.deallocate(leaf);
+  }
+
+  /**
+   * Where key is or would go in a leaf
+   */
+
+  static int lowerBound(const Leaf *leaf, const KeyType &key)
+  {
+    int low = 0;
+    int high = leaf->count;
+    while (low < high) {
+      int middle = (low + high) / 2;
+      if (leaf->entries[middle].first < key) {
+        low = middle + 1;
+      } else {
+        high = middle;
+      }
+    }
+    return low;
+  }
+
+  /**
+   * Go down to the leaf key belongs in, remembering which inner
+   * nodes and children it went through.
+   */
+
+  Leaf *descend(const KeyType &key, Inner **path, int *slot) const
+  {
+    Node *node = root;
+    for (int level = 0; level < levels - 1; level++) {
+      Inner *inner = static_cast<Inner *>(node);
+      int at = Search::upperBound(inner->keys, inner->count, key);
+      path[level] = inner;
+      slot[level] = at;
+      node = inner->children[at];
+    }
+    return static_cast<Leaf *>(node);
+  }
+
+  Leaf *descend(const KeyType &key) const
+  {
+    Node *node = root;
+    for (int level = 0; level < levels - 1; level++) {
+      Inner *inner = static_cast<Inner *>(node);
+      node = inner->children[Search::upperBound(inner->keys, inner->count, key)];
+    }
+    return static_cast<Leaf *>(node);
+  }
+
+  static void insertEntry(Leaf *leaf, int at, const KeyType &key, const ValType &val)
+  {
+    for (int i = leaf->count; i > at; i--) {
+      leaf->entries[i] = leaf->entries[i - 1];
+    }
+    leaf->entries[at].first = key;
+    leaf->entries[at].second = val;
+    leaf->count++;
+  }
+
+  static void eraseEntry(Leaf *leaf, int at)
+  {
+    for (int i = at + 1; i < leaf->count; i++) {
+      leaf->entries[i - 1] = leaf->entries[i];
+    }
+    leaf->count--;
+    // Don't hang on to whatever the last one had in it
+    leaf->entries[leaf->count] = EntryType();
+  }
+
+  /**
+   * Put separator and the child to its right into inner at at
+   */
+
+  static void insertChild(Inner *inner, int at, const KeyType &separator, Node *child)
+  {
+    for (int i = inner->count; i > at; i--) {
+      inner->keys[i] = inner->keys[i - 1];
+      inner->children[i + 1] = inner->children[i];
+    }
+    inner->keys[at] = separator;
+    inner->children[at + 1] = child;
+    inner->count++;
+  }
+
+  /**
+   * Take out the key at at and the child to its right
+   */
+
+  static void eraseChild(Inner *inner, int at)
+  {
+    for (int i = at + 1; i < inner->count; i++) {
+      inner->keys[i - 1] = inner->keys[i];
+      inner->children[i] = inner->children[i + 1];
+    }
+    inner->count--;
+  }
+
+  /**
+   * A leaf split, and right needs to go in its parent next to it.
+   * That can split the parent too, all the way up to the root.
+   */
+
+  void addChild(Inner **path, int *slot, KeyType separator, Node *child)
+  {
+    for (int level = levels - 2; level >= 0; level--) {
+      Inner *inner = path[level];
+      int at = slot[level];
+      if (inner->count < INNER_KEYS) {
+        insertChild(inner, at, separator, child);
+        return;
+      }
+
+      // Full. Line everything up as if it fit, then cut it in two
+      // around the key that moves up.
+      KeyType keys[INNER_KEYS + 1];
+      Node *children[INNER_KEYS + 2];
+      for (int i = 0, from = 0; i <= INNER_KEYS; i++) {
+        keys[i] = (i == at) ? separator : inner->keys[from++];
+      }
+      for (int i = 0, from = 0; i <= INNER_KEYS + 1; i++) {
+        children[i] = (i == at + 1) ? child : inner->children[from++];
+      }
+      int middle = (at == INNER_KEYS) ? INNER_KEYS - 1 : (INNER_KEYS + 1) / 2;
+      Inner *right = newInner();
+      inner->count = middle;
+      for (int i = 0; i < middle; i++) {
+        inner->keys[i] = keys[i];
+        inner->children[i] = children[i];
+      }
+      inner->children[middle] = children[middle];
+      right->count = INNER_KEYS - middle;
+      for (int i = 0; i < right->count; i++) {
+        right->keys[i] = keys[middle + 1 + i];
+        right->children[i] = children[middle + 1 + i];
+      }
+      right->children[right->count] = children[INNER_KEYS + 1];
+      separator = keys[middle];
+      child = right;
+    }
+
+    Inner *top = newInner();
+    top->count = 1;
+    top->keys[0] = separator;
+    top->children[0] = root;
+    top->children[1] = child;
+    root = top;
+    levels++;
+  }
+
+  /**
+   * leaf, child slot of parent, is under half full. Borrow an entry
+   * from a neighbor with some to spare, or merge with one that
+   * doesn't. Returns true if parent lost a child.
+   */
+
+  bool fixLeaf(Leaf *leaf, Inner *parent, int slot)
+  {
+    Leaf *left = slot > 0 ? static_cast<Leaf *>(parent->children[slot - 1]) : (Leaf *) NULL;
+    Leaf *right = slot < parent->count ? static_cast<Leaf *>(parent->children[slot + 1]) : (Leaf *) NULL;
+    if (left && left->count > LEAF_MIN) {
+      insertEntry(leaf, 0, left->entries[left->count - 1].first, left->entries[left->count - 1].second);
+      eraseEntry(left, left->count - 1);
+      parent->keys[slot - 1] = leaf->entries[0].first;
+      return false;
+    }
+    if (right && right->count > LEAF_MIN) {
+      insertEntry(leaf, leaf->count, right->entries[0].first, right->entries[0].second);
+      eraseEntry(right, 0);
+      parent->keys[slot] = right->entries[0].first;
+      return false;
+    }
+    // Neither has any to spare, so the two fit in one
+    if (left) {
+      mergeLeaves(left, leaf);
+      eraseChild(parent, slot - 1);
+    } else {
+      mergeLeaves(leaf, right);
+      eraseChild(parent, slot);
+    }
+    return true;
+  }
+
+  /**
+   * Move everything in right onto the end of left and get rid of
+   * right
+   */
+
+  void mergeLeaves(Leaf *left, Leaf *right)
+  {
+    for (int i = 0; i < right->count; i++) {
+      left->entries[left->count++] = right->entries[i];
+    }
+    left->next = right->next;
+    if (right->next) {
+      right->next->previous = left;
+    } else {
+      tail = left;
+    }
+    destroy(right);
+  }
+
+  /**
+   * Same as fixLeaf, for an inner node. Keys rotate through the
+   * parent, since the separators there have to stay right.
+   */
+
+  bool fixInner(Inner *inner, Inner *parent, int slot)
+  {
+    Inner *left = slot > 0 ? static_cast<Inner *>(parent->children[slot - 1]) : (Inner *) NULL;
+    Inner *right = slot < parent->count ? static_cast<Inner *>(parent->children[slot + 1]) : (Inner *) NULL;
+    if (left && left->count > INNER_MIN) {
+      for (int i = inner->count; i > 0; i--) {
+        inner->keys[i] = inner->keys[i - 1];
+      }
+      for (int i = inner->count + 1; i > 0; i--) {
+        inner->children[i] = inner->children[i - 1];
+      }
+      inner->keys[0] = parent->keys[slot - 1];
+      inner->children[0] = left->children[left->count];
+      inner->count++;
+      parent->keys[slot - 1] = left->keys[left->count - 1];
+      left->count--;
+      return false;
+    }
+    if (right && right->count > INNER_MIN) {
+      inner->keys[inner->count] = parent->keys[slot];
+      inner->children[inner->count + 1] = right->children[0];
+      inner->count++;
+      parent->keys[slot] = right->keys[0];
+      for (int i = 1; i < right->count; i++) {
+        right->keys[i - 1] = right->keys[i];
+      }
+      for (int i = 1; i <= right->count; i++) {
+        right->children[i - 1] = right->children[i];
+      }
+      right->count--;
+      return false;
+    }
+    if (left) {
+      mergeInners(left, parent->keys[slot - 1], inner);
+      eraseChild(parent, slot - 1);
+    } else {
+      mergeInners(inner, parent->keys[slot], right);
+      eraseChild(parent, slot);
+    }
+    return true;
+  }
+
+  void mergeInners(Inner *left, const KeyType &separator, Inner *right)
+  {
+    left->keys[left->count] = separator;
+    for (int i = 0; i < right->count; i++) {
+      left->keys[left->count + 1 + i] = right->keys[i];
+      left->children[left->count + 1 + i] = right->children[i];
+    }
+    left->children[left->count + 1 + right->count] = right->children[right->count];
+    left->count += 1 + right->count;
+    destroy(right);
+  }
+
+  /**
+   * Inner nodes, recursively. It only goes as deep as the tree has
+   * levels, which is never many.
+   */
+
+  void destroyBelow(Inner *inner, int level)
+  {
+    for (int i = 0; i <= inner->count; i++) {
+      if (level < levels - 2) {
+        destroyBelow(static_cast<Inner *>(inner->children[i]), level + 1);
+      }
+    }
+    destroy(inner);
+  }
+
+  void destroyAll()
+  {
+    bool trivial = boost::has_trivial_destructor<KeyType>::value && boost::has_trivial_destructor<ValType>::value;
+    if (root && !(Allocator::BULK_RELEASE && trivial)) {
+      Leaf *leaf = head;
+      while (leaf) {
+        Leaf *next = leaf->next;
+        destroy(leaf);
+        leaf = next;
+      }
+      if (levels > 1) {
+        destroyBelow(static_cast<Inner *>(root), 0);
+      }
+    }
+    root = (Node *) NULL;
+    head = tail = (Leaf *) NULL;
+    levels = 0;
+    entries = 0;
+    innerNodes.releaseAll();
+    leafNodes.releaseAll();
+  }
+
+ public:
+  ValType NOT_FOUND;
+
+  /**
+   * Create with the value to be used as "NOT_FOUND"
+   */
+
+  BplusTree(ValType nf) : root((Node *) NULL), levels(0), entries(0), head((Leaf *) NULL), tail((Leaf *) NULL), innerNodes(sizeof(Inner), CACHE_LINE), leafNodes(sizeof(Leaf), CACHE_LINE), NOT_FOUND(nf)
+  {
+  }
+
+  virtual ~BplusTree()
+  {
+    destroyAll();
+  }
+
+  /**
+   * The lowest key in the tree
+   */
+
+  KeyType begin() throw(std::string)
+  {
+    if (!head) {
+      throw std::string("Can't call begin before adding any nodes");
+    }
+    return head->entries[0].first;
+  }
+
+  /**
+   * The highest key in the tree
+   */
+
+  KeyType end() throw(std::string)
+  {
+    if (!tail) {
+      throw std::string("Can't call end before adding any nodes");
+    }
+    return tail->entries[tail->count - 1].first;
+  }
+
+  void add(KeyType key, ValType val) throw(std::string)
+  {
+    if (!root) {
+      Leaf *leaf = newLeaf();
+      insertEntry(leaf, 0, key, val);
+      root = head = tail = leaf;
+      levels = 1;
+      entries = 1;
+      return;
+    }
+
+    Inner *path[MAX_LEVELS];
+    int slot[MAX_LEVELS];
+    Leaf *leaf = descend(key, path, slot);
+    int at = lowerBound(leaf, key);
+    if (at < leaf->count && !(key < leaf->entries[at].first)) {
+      throw std::string("Attempt to add the same value to the btree twice.");
+    }
+    entries++;
+    if (leaf->count < LEAF_ENTRIES) {
+      insertEntry(leaf, at, key, val);
+      return;
+    }
+
+    // Split, leaving this one full if the new key goes on the end
+    int keep = (at == leaf->count) ? leaf->count : (leaf->count + 1) / 2;
+    Leaf *right = newLeaf();
+    for (int i = keep; i < leaf->count; i++) {
+      right->entries[right->count++] = leaf->entries[i];
+      leaf->entries[i] = EntryType();
+    }
+    leaf->count = keep;
+    right->next = leaf->next;
+    right->previous = leaf;
+    if (leaf->next) {
+      leaf->next->previous = right;
+    } else {
+      tail = right;
+    }
+    leaf->next = right;
+    if (at < keep) {
+      insertEntry(leaf, at, key, val);
+    } else {
+      insertEntry(right, at - keep, key, val);
+    }
+    addChild(path, slot, right->entries[0].first, right);
+  }
+
+  ValType find(KeyType key)
+  {
+    if (!root) {
+      return NOT_FOUND;
+    }
+    Leaf *leaf = descend(key);
+    int at = lowerBound(leaf, key);
+    if (at < leaf->count && !(key < leaf->entries[at].first)) {
+      return leaf->entries[at].second;
+    }
+    return NOT_FOUND;
+  }
+
+  /**
+   * Everything from start to end, including both, in order
+   */
+
+  void findRange(RangeType &range, KeyType start, KeyType end)
+  {
+    if (!root) {
+      return;
+    }
+    Leaf *leaf = descend(start);
+    int at = lowerBound(leaf, start);
+    while (leaf) {
+      for (; at < leaf->count; at++) {
+        if (end < leaf->entries[at].first) {
+          return;
+        }
+        range.push_back(&leaf->entries[at]);
+      }
+      leaf = leaf->next;
+      at = 0;
+    }
+  }
+
+  /**
+   * Cursor and ReverseCursor work like Btree's: walk from start to
+   * end (or end to start) without building a vector. They read
+   * straight along the leaves. An add or remove makes them no good.
+   */
+
+  class Cursor {
+    friend class BplusTree;
+    Leaf *leaf;
+    int at;
+    KeyType last;
+
+    Cursor(Leaf *leaf, int at, const KeyType &last) : leaf(leaf), at(at), last(last)
+    {
+      settle();
+    }
+
+    // Step over the end of a leaf, and stop past last
+    void settle()
+    {
+      if (leaf && at >= leaf->count) {
+        leaf = leaf->next;
+        at = 0;
+      }
+      if (leaf && last < leaf->entries[at].first) {
+        leaf = (Leaf *) NULL;
+      }
+    }
+
+   public:
+    Cursor() : leaf((Leaf *) NULL), at(0)
+    {
+    }
+
+    bool done() const
+    {
+      return !leaf;
+    }
+
+    EntryType &operator*() const
+    {
+      return leaf->entries[at];
+    }
+
+    EntryType *operator->() const
+    {
+      return &leaf->entries[at];
+    }
+
+    Cursor &operator++()
+    {
+      at++;
+      settle();
+      return *this;
+    }
+  };
+
+  class ReverseCursor {
+    friend class BplusTree;
+    Leaf *leaf;
+    int at;
+    KeyType first;
+
+    ReverseCursor(Leaf *leaf, int at, const KeyType &first) : leaf(leaf), at(at), first(first)
+    {
+      settle();
+    }
+
+    void settle()
+    {
+      if (leaf && at < 0) {
+        leaf = leaf->previous;
+        at = leaf ? leaf->count - 1 : 0;
+      }
+      if (leaf && leaf->entries[at].first < first) {
+        leaf = (Leaf *) NULL;
+      }
+    }
+
+   public:
+    ReverseCursor() : leaf((Leaf *) NULL), at(0)
+    {
+    }
+
+    bool done() const
+    {
+      return !leaf;
+    }
+
+    EntryType &operator*() const
+    {
+      return leaf->entries[at];
+    }
+
+    EntryType *operator->() const
+    {
+      return &leaf->entries[at];
+    }
+
+    ReverseCursor &operator++()
+    {
+      at--;
+      settle();
+      return *this;
+    }
+  };
+
+  Cursor range(KeyType start, KeyType end) const
+  {
+    if (!root) {
+      return Cursor();
+    }
+    Leaf *leaf = descend(start);
+    return Cursor(leaf, lowerBound(leaf, start), end);
+  }
+
+  ReverseCursor reverseRange(KeyType start, KeyType end) const
+  {
+    if (!root) {
+      return ReverseCursor();
+    }
+    Leaf *leaf = descend(end);
+    int at = lowerBound(leaf, end);
+    if (at < leaf->count && !(end < leaf->entries[at].first)) {
+      at++;
+    }
+    return ReverseCursor(leaf, at - 1, start);
+  }
+
+  /**
+   * Call visitor with each entry from start to end, in order, until
+   * it returns false. Returns how many it got called with.
+   */
+
+  template <typename Visitor>
+  size_t visitRange(KeyType start, KeyType end, Visitor &visitor)
+  {
+    size_t visited = 0;
+    for (Cursor cursor = range(start, end); !cursor.done(); ++cursor) {
+      visited++;
+      if (!visitor(*cursor)) {
+        break;
+      }
+    }
+    return visited;
+  }
+
+  ValType remove(KeyType key)
+  {
+    if (!root) {
+      return NOT_FOUND;
+    }
+    Inner *path[MAX_LEVELS];
+    int slot[MAX_LEVELS];
+    Leaf *leaf = descend(key, path, slot);
+    int at = lowerBound(leaf, key);
+    if (at >= leaf->count || key < leaf->entries[at].first) {
+      return NOT_FOUND;
+    }
+    ValType removed = leaf->entries[at].second;
+    eraseEntry(leaf, at);
+    entries--;
+
+    if (levels == 1) {
+      if (leaf->count == 0) {
+        destroy(leaf);
+        root = (Node *) NULL;
+        head = tail = (Leaf *) NULL;
+        levels = 0;
+      }
+      return removed;
+    }
+    if (leaf->count >= LEAF_MIN || !fixLeaf(leaf, path[levels - 2], slot[levels - 2])) {
+      return removed;
+    }
+
+    // The parent lost a child, which might leave it short too
+    for (int level = levels - 2; level > 0; level--) {
+      Inner *inner = path[level];
+      if (inner->count >= INNER_MIN || !fixInner(inner, path[level - 1], slot[level - 1])) {
+        return removed;
+      }
+    }
+    Inner *top = static_cast<Inner *>(root);
+    if (top->count == 0) {
+      root = top->children[0];
+      destroy(top);
+      levels--;
+    }
+    return removed;
+  }
+
+  size_t size() const
+  {
+    return entries;
+  }
+
+  /**
+   * How many levels the tree has, 0 if it's empty
+   */
+
+  int height() const
+  {
+    return levels;
+  }
+
+  /**
+   * How many leaves there are, for seeing how full they're packed
+   */
+
+  size_t leafCount() const
+  {
+    size_t count = 0;
+    Leaf *leaf = head;
+    while (leaf) {
+      count++;
+      leaf = leaf->next;
+    }
+    return count;
+  }
+
+};
+
+#endif
@@ -1,6 +1,10 @@
 /**
  * This is a simple btree class.
  *
+ * Nodes come from the tree's Allocator (see node_allocator.h), which
+ * is a NodeArena unless you ask for something else. Destroying the
+ * tree doesn't recurse, so a big one can't run you out of stack.
+ *
  * Copyright 2011 Bruce Ide
  * Licensed under the Apache License, Version 2.0 (the "License");
  * you may not use this file except in compliance with the License.
@@ -15,31 +19,211 @@
  * limitations under the License.
  */
 
+#ifndef _H_BTREE
+#define _H_BTREE
+
+#include "node_allocator.h"
+#include <boost/type_traits/has_trivial_destructor.hpp>
+#include <algorithm>
+#include <new>
 #include <string>
 #include <utility>
 #include <vector>
 #include <iostream>
 #include <stdlib.h>
 
-template <typename KeyType, typename ValType> class Btree;
+/**
+ * Which node a lookup wants when the key it's after isn't in the
+ * tree: none (BtreeExact), the closest one before it (BtreeFloor) or
+ * the closest one after it (BtreeCeil). Btree::lookup takes one of
+ * these as a template parameter, so each kind of lookup compiles to
+ * its own loop with the choice made at compile time. So does Btree
+ * itself, for what find means: BtreeExact unless you say otherwise
+ * (TimeTree says BtreeFloor.)
+ */
+
+struct BtreeExact {
+  enum { BELOW = false, ABOVE = false };
+};
+
+struct BtreeFloor {
+  enum { BELOW = true, ABOVE = false };
+};
+
+struct BtreeCeil {
+  enum { BELOW = false, ABOVE = true };
+};
+
+template <typename KeyType, typename ValType, typename Allocator = NodeArena, typename Lookup = BtreeExact> class Btree;
 
 /**
  * BtreeNode contains the guts of the btree. Most of the actual
  * work in the tree takes place here.
+ *
+ * It's an AVL tree: every node knows the height of the subtree under
+ * it, and no node's two subtrees are ever more than one apart in
+ * height. Adds and removes fix the heights up on the way back toward
+ * the root, rotating wherever that's been broken, and stop as soon
+ * as a subtree comes out the same height it went in. So both of them
+ * are O(log n), even for keys that show up in order.
+ *
+ * Nothing in here is virtual, so a node is just its pair, its links
+ * and its height, with no vtable pointer. Looking things up is the
+ * tree's job (see BtreeExact and friends above.)
  */
 
-template <typename KeyType, typename ValType>
+template <typename KeyType, typename ValType, typename Allocator = NodeArena, typename Lookup = BtreeExact>
 class BtreeNode {
+  friend class Btree<KeyType, ValType, Allocator, Lookup>; // For tearing the tree down
+
  protected:
-  typedef BtreeNode<KeyType, ValType> MyBtreeNode;
-  typedef Btree<KeyType,ValType> MyBtree;
+  typedef BtreeNode<KeyType, ValType, Allocator, Lookup> MyBtreeNode;
+  typedef Btree<KeyType, ValType, Allocator, Lookup> MyBtree;
   std::pair<KeyType, ValType> keyVal;
   MyBtreeNode *left;
   MyBtreeNode *right;
   MyBtreeNode *parent;
-  int leftBalance;
-  int rightBalance;
-  Btree<KeyType,ValType> *owner;
+  int height; // Of the subtree starting here, 1 for a leaf
+  size_t size; // How many nodes are in the subtree starting here
+  MyBtree *owner;
+
+  static int heightOf(MyBtreeNode *node)
+  {
+    return node ? node->height : 0;
+  }
+
+  static size_t sizeOf(MyBtreeNode *node)
+  {
+    return node ? node->size : 0;
+  }
+
+  /**
+   * Work out height and size from the children's, which have to be
+   * right
+   */
+
+  void fixSubtree()
+  {
+    int leftHeight = heightOf(left);
+    int rightHeight = heightOf(right);
+    height = (leftHeight > rightHeight ? leftHeight : rightHeight) + 1;
+    size = sizeOf(left) + sizeOf(right) + 1;
+  }
+
+  /**
+   * A node was added (1) or taken out (-1) somewhere under this one,
+   * so this one and everything above it is that much bigger. Has to
+   * happen before any rotating, which works sizes out from the
+   * children.
+   */
+
+  void resize(int change)
+  {
+    MyBtreeNode *node = this;
+    while (node) {
+      node->size += change;
+      node = node->parent;
+    }
+  }
+
+  /**
+   * Where the pointer to this node lives, in the parent or the tree
+   */
+
+  MyBtreeNode **above()
+  {
+    if (parent) {
+      if (this == parent->left) {
+        return &parent->left;
+      }
+      return &parent->right;
+    }
+    return &owner->root;
+  }
+
+  /**
+   * Walk from here up to the root fixing heights, and rotating
+   * wherever a node's subtrees are more than one apart. Stops as
+   * soon as a subtree ends up the height it was before, since
+   * nothing above it can have changed.
+   */
+
+  void retrace()
+  {
+    MyBtreeNode *node = this;
+    while (node) {
+      int oldHeight = node->height;
+      MyBtreeNode *up = node->parent;
+      node->fixSubtree();
+      int balance = node->balanced();
+      if (balance > 1) {
+        if (node->left->balanced() < 0) {
+          node->left->rotateLeft();
+        }
+        node->rotateRight();
+        node = node->parent;
+      } else if (balance < -1) {
+        if (node->right->balanced() > 0) {
+          node->right->rotateRight();
+        }
+        node->rotateLeft();
+        node = node->parent;
+      }
+      if (node->height == oldHeight) {
+        break;
+      }
+      node = up;
+    }
+  }
+
+  /**
+   * Take this node out of the tree and free it, handing back its
+   * value. Only this node's pair goes away; every other node keeps
+   * its pair where it is, so pointers to them stay good.
+   */
+
+  ValType unlink()
+  {
+    ValType removed = keyVal.second;
+    MyBtreeNode *up = parent;
+    if (left && right) {
+      // The next one up has no left child. Lift it out of where it
+      // is and put it where this one was, links, height, size and
+      // all, then fix up from where it used to be.
+      MyBtreeNode *next = right;
+      while (next->left) {
+        next = next->left;
+      }
+      up = next;
+      if (next->parent != this) {
+        up = next->parent;
+        up->left = next->right;
+        if (next->right) {
+          next->right->parent = up;
+        }
+        next->right = right;
+        right->parent = next;
+      }
+      next->left = left;
+      left->parent = next;
+      *above() = next;
+      next->parent = parent;
+      next->height = height;
+      next->size = size;
+    } else {
+      MyBtreeNode *child = left ? left : right;
+      *above() = child;
+      if (child) {
+        child->parent = up;
+      }
+    }
+    if (up) {
+      up->resize(-1);
+      up->retrace();
+    }
+    owner->destroyNode(this);
+    return removed;
+  }
 
  public:
 
@@ -47,7 +231,7 @@ class BtreeNode {
    * Set up a node, but you still have to add it!
    */
 
-  BtreeNode(KeyType key, ValType val, Btree<KeyType,ValType> *owner) 
+  BtreeNode(KeyType key, ValType val, MyBtree *owner) 
     {
       keyVal.first = key;
       keyVal.second = val;
@@ -55,52 +239,49 @@ class BtreeNode {
       left = (MyBtreeNode *) NULL;
       right = (MyBtreeNode *) NULL;
       parent = (MyBtreeNode *) NULL;
-      owner = (MyBtree *) NULL;
-      leftBalance = 0;
-      rightBalance = 0;
+      height = 1;
+      size = 1;
     }
 
   /**
-   * Recursively delete the entire tree!
+   * This used to recursively delete the entire tree, but that
+   * recursion is as deep as the tree is. The tree takes care of the
+   * children now (see Btree::destroyAll.)
    */
 
-  virtual ~BtreeNode()
+  ~BtreeNode()
     {
-      if (left) {
-        delete left;
-      }
-      if (right) {
-        delete right;
-      }
     }
 
   /**
    * recalcBalance does a full tree traverse to recalculate all the
-   * node balances. This will be pretty heavy for large trees, so
-   * I suggest avoiding it as much as possible.
+   * node heights (and sizes), and returns this one's. Adds and
+   * removes keep them right, so you should only need this if you've
+   * been poking around in the tree yourself.
    */
 
-  virtual int recalcBalance()
+  int recalcBalance()
   {
     if (left) {
-      leftBalance = left->recalcBalance() + 1;
-    } else {
-      leftBalance = 0;
+      left->recalcBalance();
     }
     if (right) {
-      rightBalance = right->recalcBalance() + 1;
-    } else {
-      rightBalance = 0;
+      right->recalcBalance();
     }
-    return balanced();
+    fixSubtree();
+    return height;
   }
 
-  virtual int balanced()
+  /**
+   * How much taller the left side is than the right
+   */
+
+  int balanced()
   {
-    return leftBalance - rightBalance;
+    return heightOf(left) - heightOf(right);
   }
 
-  virtual bool isBalanced()
+  bool isBalanced()
   {
     bool isLeft = true;
     bool isRight = true;
@@ -117,23 +298,18 @@ class BtreeNode {
     return isLeft && isRight && isMe;
   }
 
-  virtual void rotateLeft()
+  int getHeight()
+  {
+    return height;
+  }
+
+  void rotateLeft()
   {
     MyBtreeNode *pivot = right;
     if (NULL == pivot) {
       return; // can't rotate left
     }
-    MyBtreeNode **above;
-    if (parent) {
-      if (this == parent->left) {
-        above = &parent->left;
-      } else {
-        above = &parent->right;
-      }
-    } else {
-      above = &owner->root;
-    }
-    *above = pivot;
+    *above() = pivot;
     pivot->parent = parent;
     right = pivot->left;
     if (right) {
@@ -141,26 +317,17 @@ class BtreeNode {
     }
     pivot->left = this;
     parent = pivot;
-    pivot->recalcBalance();
+    fixSubtree();
+    pivot->fixSubtree();
   }
 
-  virtual void rotateRight()
+  void rotateRight()
   {
     MyBtreeNode *pivot = left;
     if (NULL == pivot) {
       return; // can't rotate right
     }
-    MyBtreeNode **above;
-    if (parent) {
-      if (this == parent->left) {
-        above = &parent->left;
-      } else {
-        above = &parent->right;
-      }
-    } else {
-      above = &owner->root;
-    }
-    *above = pivot;
+    *above() = pivot;
     pivot->parent = parent;
     left = pivot->right;
     if (left) {
@@ -168,22 +335,23 @@ class BtreeNode {
     }
     pivot->right = this;
     parent = pivot;
-    pivot->recalcBalance();
+    fixSubtree();
+    pivot->fixSubtree();
   }
 
   /**
    * printBalance, for debugging.
    */
 
-  virtual void printBalance()
+  void printBalance()
   {
     std::cout << "Node: " << keyVal.first;
     if (parent) {
       std::cout << " Parent: " << parent->keyVal.first;
     }
     std::cout << std::endl;
-    std::cout << "      Left Balance:  " << leftBalance << std::endl;
-    std::cout << "      Right Balance: " << rightBalance << std::endl << std::endl;
+    std::cout << "      Left Height:  " << heightOf(left) << std::endl;
+    std::cout << "      Right Height: " << heightOf(right) << std::endl << std::endl;
     if (left) {
       left->printBalance();
     }
@@ -192,193 +360,398 @@ class BtreeNode {
     }    
   }
 
-  virtual void rebalance()
+  /**
+   * Fix up the whole subtree from the bottom up, in case it's been
+   * messed with. Adds and removes don't need this.
+   */
+
+  void rebalance()
   {
-    // recalcBalance();
-    int nodeBalance = balanced();
     if (left) {
       left->rebalance();
     }
     if (right) {
       right->rebalance();
     }
-    if (nodeBalance < -1) {
-      rotateLeft();
-    } else if (nodeBalance > 1) {
-      rotateRight();
+    fixSubtree();
+    MyBtreeNode *top = this;
+    while (abs(top->balanced()) > 1) {
+      MyBtreeNode *heavy = top->balanced() > 1 ? top->left : top->right;
+      if (heavy == top->left) {
+        if (heavy->balanced() < 0) {
+          heavy->rotateLeft();
+        }
+        top->rotateRight();
+      } else {
+        if (heavy->balanced() > 0) {
+          heavy->rotateRight();
+        }
+        top->rotateLeft();
+      }
+      top = top->parent;
     }
   }
 
   /**
-   * Add a new node to the tree, using recursion!
+   * Add a new node somewhere under this one, then balance things
+   * back out on the way up.
    */
 
-  virtual void add(BtreeNode *aNode) throw(std::string)
+  void add(BtreeNode *aNode) throw(std::string)
   {
     KeyType nodeVal = aNode->keyVal.first;
-    if (nodeVal < keyVal.first) {
-      if (left) {
-        left->add(aNode);
+    MyBtreeNode *at = this;
+    while (true) {
+      MyBtreeNode **branch;
+      if (nodeVal < at->keyVal.first) {
+        branch = &at->left;
+      } else if (at->keyVal.first < nodeVal) {
+        branch = &at->right;
       } else {
-        left = aNode;
-        aNode->parent = this;
+        // No matter what I do here someone's going to hate it, so
+        // I'm just going to throw.
+        throw std::string("Attempt to add the same value to the btree twice.");
       }
-      leftBalance++;
-    } else if (nodeVal > keyVal.first) {
-      if (right) {
-        right->add(aNode);
-      } else {
-        right = aNode;
-        aNode->parent = this;
+      if (NULL == *branch) {
+        *branch = aNode;
+        aNode->parent = at;
+        break;
       }
-      rightBalance++;
-    } else {
-      // No matter what I do here someone's going to hate it, so
-      // I'm just going to throw.
-      throw std::string("Attempt to add the same value to the btree twice.");
-    }
-    if (abs(balanced()) > 1) {
-      rebalance();
+      at = *branch;
     }
+    at->resize(1);
+    at->retrace();
   }
 
   /**
    * remove removes a node from the tree. Aaah, you thought I was
    * going to leave you hanging with only a way to recursively
    * delete the entire tree? :-D
-   *
-   * I think if I move the left node up to this one and then call
-   * add with the right node, it should work out OK. It could leave
-   * the tree pretty unbalanced, but I can work on that later.
    */
 
-  virtual ValType remove(KeyType key)
+  ValType remove(KeyType key)
   {
-    if (key < keyVal.first) {
-      if (left) {
-        leftBalance--;
-        return left->remove(key);
+    MyBtreeNode *at = this;
+    while (at) {
+      if (key < at->keyVal.first) {
+        at = at->left;
+      } else if (at->keyVal.first < key) {
+        at = at->right;
       } else {
-        return owner->NOT_FOUND;
+        return at->unlink();
       }
-    } else if (key > keyVal.first) {
-      if (right) {
-        rightBalance--;
-        return right->remove(key);
-      } else {
-        return owner->NOT_FOUND;
-      }
-    } else {
-      MyBtreeNode **parentBranch = (MyBtreeNode **) NULL;
-      ValType removed = keyVal.second;
-      if (!parent) {
-        parentBranch = &(owner->root);
-        (*parentBranch)->parent = (MyBtreeNode *)NULL;
-      } else {
-        if (this == parent->left) {
-          parentBranch = &(parent->left);
+    }
+    return owner->NOT_FOUND;
+  }
+};
+
+/**
+ * Btree holds all your nodes and handles creating and manipulating
+ * them for you.
+ */
+
+template<typename KeyType, typename ValType, typename Allocator, typename Lookup>
+class Btree {
+  friend class BtreeNode<KeyType, ValType, Allocator, Lookup>; // So I don't have to make root public
+  typedef BtreeNode<KeyType, ValType, Allocator, Lookup> NodeType;
+
+ protected:
+  NodeType *root;
+  KeyType lowest;
+  KeyType highest;
+  bool firstAdd;
+  Allocator nodes;
+
+  /**
+   * Build a node in memory from the allocator
+   */
+
+  template <typename Node>
+  Node *createNode(KeyType key, ValType val)
+  {
+    return new (nodes.allocate()) Node(key, val, this);
+  }
+
+  void destroyNode(NodeType *node)
+  {
+    node->~NodeType();
+    nodes.deallocate(node);
+  }
+
+  /**
+   * Get rid of every node without recursing. Each left child gets
+   * rotated up until the node on top has none, then that one goes
+   * and its right child takes its place, so the whole thing is
+   * one pass with no stack. If the nodes don't need destructors run
+   * and the allocator can free them all at once, it doesn't even
+   * need that.
+   */
+
+  void destroyAll()
+  {
+    bool trivial = boost::has_trivial_destructor<KeyType>::value && boost::has_trivial_destructor<ValType>::value;
+    if (!(Allocator::BULK_RELEASE && trivial)) {
+      NodeType *node = root;
+      while (node) {
+        NodeType *next;
+        if (node->left) {
+          next = node->left;
+          node->left = next->right;
+          next->right = node;
         } else {
-          parentBranch = &(parent->right);
+          next = node->right;
+          destroyNode(node);
         }
+        node = next;
       }
-      if (left) {
-        *parentBranch = left;
-        if (right) {
-          (*parentBranch)->add(right);
-        }
-        // Prevent recursive delete of previously owned nodes
-        left = (MyBtreeNode *) NULL;
-        right = (MyBtreeNode *) NULL;
-        delete this;
-      } else if (right) {
-        *parentBranch = right;
-        left = (MyBtreeNode *) NULL;
-        right = (MyBtreeNode *) NULL;
-        delete this;
-      } else {
-        *parentBranch = (MyBtreeNode *) NULL;
-        delete this;
+    }
+    root = (NodeType *) NULL;
+    nodes.releaseAll();
+  }
+
+  /**
+   * Every node, in key order, without recursing
+   */
+
+  void collectNodes(std::vector<NodeType *> &out)
+  {
+    std::vector<NodeType *> stack;
+    NodeType *node = root;
+    while (node || !stack.empty()) {
+      while (node) {
+        stack.push_back(node);
+        node = node->left;
       }
-      return removed;
+      node = stack.back();
+      stack.pop_back();
+      out.push_back(node);
+      node = node->right;
     }
-    return owner->NOT_FOUND;
   }
 
   /**
-   * Find is the fun one!
+   * Hang count sorted nodes off parent as a perfectly balanced
+   * subtree and return its top. The middle one goes on top, so the
+   * two sides never differ by more than one node and every height
+   * comes out the way the AVL code expects. It only recurses as deep
+   * as the tree is tall.
+   */
+
+  static NodeType *linkBalanced(NodeType **sorted, size_t count, NodeType *parent)
+  {
+    if (count == 0) {
+      return (NodeType *) NULL;
+    }
+    size_t middle = count / 2;
+    NodeType *node = sorted[middle];
+    node->parent = parent;
+    node->left = linkBalanced(sorted, middle, node);
+    node->right = linkBalanced(sorted + middle + 1, count - middle - 1, node);
+    node->fixSubtree();
+    return node;
+  }
+
+  /**
+   * The next node in key order, or NULL. It's a walk down the right
+   * subtree or up the parents, and over a whole scan every edge gets
+   * walked twice at most, so it's O(1) on average.
+   */
+
+  static NodeType *nextNode(NodeType *node)
+  {
+    if (node->right) {
+      node = node->right;
+      while (node->left) {
+        node = node->left;
+      }
+      return node;
+    }
+    while (node->parent && node == node->parent->right) {
+      node = node->parent;
+    }
+    return node->parent;
+  }
+
+  static NodeType *previousNode(NodeType *node)
+  {
+    if (node->left) {
+      node = node->left;
+      while (node->right) {
+        node = node->right;
+      }
+      return node;
+    }
+    while (node->parent && node == node->parent->left) {
+      node = node->parent;
+    }
+    return node->parent;
+  }
+
+  /**
+   * Straight down from the root, no recursion. Returns the node with
+   * key in it, or if there isn't one, whichever one Match asks for
+   * (or NULL.)
    */
 
-  virtual ValType find(KeyType toFind)
+  template <typename Match>
+  NodeType *lookupNode(const KeyType &key) const
   {
-    if (toFind < keyVal.first) {
-      if (left) {
-        return left->find(toFind);
+    NodeType *node = root;
+    NodeType *found = (NodeType *) NULL;
+    while (node) {
+      if (key < node->keyVal.first) {
+        if (Match::ABOVE) {
+          found = node;
+        }
+        node = node->left;
+      } else if (node->keyVal.first < key) {
+        if (Match::BELOW) {
+          found = node;
+        }
+        node = node->right;
       } else {
-        return owner->NOT_FOUND;
+        return node;
       }
-    } else if (keyVal.first < toFind) {
-      if (right) {
-        return right->find(toFind);
+    }
+    return found;
+  }
+
+  /**
+   * How many keys are less than key (or equal to it, if OrEqual)
+   */
+
+  template <bool OrEqual>
+  size_t countBefore(const KeyType &key) const
+  {
+    size_t count = 0;
+    NodeType *node = root;
+    while (node) {
+      bool before = OrEqual ? !(key < node->keyVal.first) : node->keyVal.first < key;
+      if (before) {
+        count += NodeType::sizeOf(node->left) + 1;
+        node = node->right;
       } else {
-        return owner->NOT_FOUND;
+        node = node->left;
       }
-    } else {
-      return keyVal.second;
     }
+    return count;
   }
 
-  typedef std::vector<std::pair<KeyType, ValType> *> RangeType;
+  static std::pair<KeyType, ValType> &pairOf(NodeType *node)
+  {
+    return node->keyVal;
+  }
 
+ public:
   /**
-   * We're going to take find, and we're going to go one further.
+   * Cursor walks the pairs from one key to another in order without
+   * building a vector of them first, so a scan over millions of
+   * nodes doesn't allocate anything:
+   *
+   *   Btree<double, int>::Cursor cursor = tree.range(start, end);
+   *   for (; !cursor.done(); ++cursor) {
+   *     cursor->first, cursor->second...
+   *   }
+   *
+   * Adding to or removing from the tree while you've got one out
+   * makes it no good.
    */
 
-  virtual void findRange(RangeType &range, KeyType start, KeyType end)
-  {
-    if (keyVal.first >= start) {
-      // No need to go left if it's less
-      if (left) {
-        left->findRange(range, start, end);
+  class Cursor {
+    friend class Btree;
+    NodeType *node;
+    KeyType last;
+
+    Cursor(NodeType *node, const KeyType &last) : node(node), last(last)
+    {
+      if (node && last < pairOf(node).first) {
+        this->node = (NodeType *) NULL;
       }
     }
 
-    if (keyVal.first >= start && keyVal.first <= end) {
-      range.push_back(&keyVal);
+   public:
+    Cursor() : node((NodeType *) NULL)
+    {
+    }
+
+    bool done() const
+    {
+      return !node;
+    }
+
+    std::pair<KeyType, ValType> &operator*() const
+    {
+      return pairOf(node);
     }
 
-    if (keyVal.first <= end) {
-      // No need to go right if it's greater
-      if (right) {
-        right->findRange(range, start, end);
+    std::pair<KeyType, ValType> *operator->() const
+    {
+      return &pairOf(node);
+    }
+
+    Cursor &operator++()
+    {
+      node = nextNode(node);
+      if (node && last < pairOf(node).first) {
+        node = (NodeType *) NULL;
       }
+      return *this;
     }
-  }
-};
+  };
 
-/**
- * Btree holds all your nodes and handles creating and manipulating
- * them for you.
- */
+  /**
+   * The same, from the end of the range back to the start
+   */
 
-template<typename KeyType, typename ValType>
-class Btree {
-  friend class BtreeNode<KeyType, ValType>; // So I don't have to make root public
-  typedef BtreeNode<KeyType, ValType> NodeType;
+  class ReverseCursor {
+    friend class Btree;
+    NodeType *node;
+    KeyType first;
 
- protected:
-  NodeType *root;
-  KeyType lowest;
-  KeyType highest;
-  bool firstAdd;
+    ReverseCursor(NodeType *node, const KeyType &first) : node(node), first(first)
+    {
+      if (node && pairOf(node).first < first) {
+        this->node = (NodeType *) NULL;
+      }
+    }
+
+   public:
+    ReverseCursor() : node((NodeType *) NULL)
+    {
+    }
+
+    bool done() const
+    {
+      return !node;
+    }
+
+    std::pair<KeyType, ValType> &operator*() const
+    {
+      return pairOf(node);
+    }
+
+    std::pair<KeyType, ValType> *operator->() const
+    {
+      return &pairOf(node);
+    }
+
+    ReverseCursor &operator++()
+    {
+      node = previousNode(node);
+      if (node && pairOf(node).first < first) {
+        node = (NodeType *) NULL;
+      }
+      return *this;
+    }
+  };
 
- public:
   ValType NOT_FOUND;
 
   /**
    * Create with the value to be used as "NOT_FOUND"
    */
 
-  Btree(ValType nf) : NOT_FOUND(nf)
+  Btree(ValType nf) : nodes(sizeof(NodeType)), NOT_FOUND(nf)
   {
     firstAdd = true;
     root = (NodeType *) NULL;
@@ -386,7 +759,7 @@ class Btree {
 
   virtual ~Btree()
     {
-      delete root;
+      destroyAll();
     }
 
   /**
@@ -394,7 +767,7 @@ class Btree {
    * returns the lowesat thing you've added to the tree.
    */
   
-  virtual KeyType begin() throw(std::string)
+  KeyType begin() throw(std::string)
   {
     if (firstAdd) {
       throw std::string("Can't call begin before adding any nodes");
@@ -406,7 +779,7 @@ class Btree {
    * end returns the largest thing you've added to the tree.
    */
 
-  virtual KeyType end() throw(std::string)
+  KeyType end() throw(std::string)
   {
     if (firstAdd) {
       throw std::string("Can't call end before adding any nodes");
@@ -414,7 +787,7 @@ class Btree {
     return highest;
   }
 
-  virtual void add(KeyType key, ValType val) throw(std::string)
+  void add(KeyType key, ValType val) throw(std::string)
   {
     if (firstAdd) {
       firstAdd = false;
@@ -428,56 +801,263 @@ class Btree {
       highest = key;
     }
 
-    BtreeNode<KeyType,ValType> *toAdd = new BtreeNode<KeyType,ValType>(key, val, this);
+    NodeType *toAdd = createNode<NodeType>(key, val);
     if (root) {
-      root->add(toAdd); // Can throw
+      try {
+        root->add(toAdd);
+      } catch (std::string &) {
+        destroyNode(toAdd);
+        throw;
+      }
     } else {
       root = toAdd;
     }
   }
 
-  virtual ValType remove(KeyType key)
+  /**
+   * Build an empty tree out of a range of pairs that's already sorted
+   * by key, with no key in it twice. It's O(n): no searching and no
+   * rotating, the nodes just get linked up balanced in one pass. It
+   * throws if the tree already has something in it (use mergeSorted
+   * for that) or the range isn't sorted, and leaves the tree alone.
+   */
+
+  template <typename Iterator>
+  void bulkLoad(Iterator first, Iterator last) throw(std::string)
   {
     if (root) {
-      return root->remove(key);
-    } else {
-      return NOT_FOUND;
+      throw std::string("Can't bulk load a tree that isn't empty");
     }
+    mergeSorted(first, last);
   }
-  
-  virtual ValType find(KeyType key)
+
+  /**
+   * Add a sorted range of pairs to whatever's in the tree already, in
+   * O(n + m). The tree's nodes get walked in order and merged with
+   * the new ones, then the whole lot gets relinked balanced. If the
+   * range isn't sorted or has a key the tree already has, it throws
+   * and the tree is the way it was.
+   */
+
+  template <typename Iterator>
+  void mergeSorted(Iterator first, Iterator last) throw(std::string)
+  {
+    std::vector<NodeType *> added;
+    try {
+      while (first != last) {
+        if (!added.empty() && !(added.back()->keyVal.first < first->first)) {
+          throw std::string("Range to merge isn't sorted, or has a key in it twice");
+        }
+        added.push_back(createNode<NodeType>(first->first, first->second));
+        first++;
+      }
+    } catch (...) {
+      for (size_t i = 0; i < added.size(); i++) {
+        destroyNode(added[i]);
+      }
+      throw;
+    }
+    if (added.empty()) {
+      return;
+    }
+
+    std::vector<NodeType *> existing;
+    collectNodes(existing);
+    std::vector<NodeType *> merged;
+    merged.reserve(existing.size() + added.size());
+    size_t i = 0, j = 0;
+    while (i < existing.size() && j < added.size()) {
+      if (existing[i]->keyVal.first < added[j]->keyVal.first) {
+        merged.push_back(existing[i++]);
+      } else if (added[j]->keyVal.first < existing[i]->keyVal.first) {
+        merged.push_back(added[j++]);
+      } else {
+        for (size_t k = 0; k < added.size(); k++) {
+          destroyNode(added[k]);
+        }
+        throw std::string("Key to merge is already in the tree");
+      }
+    }
+    merged.insert(merged.end(), existing.begin() + i, existing.end());
+    merged.insert(merged.end(), added.begin() + j, added.end());
+
+    root = linkBalanced(&merged[0], merged.size(), (NodeType *) NULL);
+    lowest = merged.front()->keyVal.first;
+    highest = merged.back()->keyVal.first;
+    firstAdd = false;
+  }
+
+  ValType remove(KeyType key)
   {
     if (root) {
-      return root->find(key);
+      return root->remove(key);
     } else {
       return NOT_FOUND;
     }
   }
+  
+  /**
+   * The value for key, or NOT_FOUND. If the tree's Lookup is
+   * BtreeFloor or BtreeCeil, the closest key before or after it
+   * does too.
+   */
+
+  ValType find(KeyType key) const
+  {
+    return lookup<Lookup>(key);
+  }
+
+  /**
+   * The value for the biggest key that isn't more than key, or
+   * NOT_FOUND if they're all bigger
+   */
+
+  ValType floor(KeyType key) const
+  {
+    return lookup<BtreeFloor>(key);
+  }
+
+  /**
+   * The value for the smallest key that isn't less than key, or
+   * NOT_FOUND if they're all smaller
+   */
+
+  ValType ceil(KeyType key) const
+  {
+    return lookup<BtreeCeil>(key);
+  }
+
+  template <typename Match>
+  ValType lookup(KeyType key) const
+  {
+    NodeType *node = lookupNode<Match>(key);
+    return node ? node->keyVal.second : NOT_FOUND;
+  }
 
   typedef std::vector<std::pair<KeyType, ValType> *> RangeType;
   
-  virtual void findRange(RangeType &range, KeyType start, KeyType end)
+  void findRange(RangeType &range, KeyType start, KeyType end)
   {
-    if (root) {
-      root->findRange(range, start, end);
+    for (Cursor cursor = this->range(start, end); !cursor.done(); ++cursor) {
+      range.push_back(&*cursor);
     }
   }
 
-  virtual void printBalance()
+  /**
+   * Everything from start to end, including both, first to last or
+   * last to first
+   */
+
+  Cursor range(KeyType start, KeyType end) const
+  {
+    return Cursor(lookupNode<BtreeCeil>(start), end);
+  }
+
+  ReverseCursor reverseRange(KeyType start, KeyType end) const
+  {
+    return ReverseCursor(lookupNode<BtreeFloor>(end), start);
+  }
+
+  /**
+   * Call visitor with each pair from start to end, in order, until
+   * it returns false. Returns how many it got called with.
+   *
+   *   bool visitor(std::pair<KeyType, ValType> &)
+   */
+
+  template <typename Visitor>
+  size_t visitRange(KeyType start, KeyType end, Visitor &visitor)
+  {
+    size_t visited = 0;
+    for (Cursor cursor = range(start, end); !cursor.done(); ++cursor) {
+      visited++;
+      if (!visitor(*cursor)) {
+        break;
+      }
+    }
+    return visited;
+  }
+
+  void printBalance()
   {
     root->printBalance();
   }
 
-  virtual void rebalance()
+  void rebalance()
   {
     root->recalcBalance();
     root->rebalance();
   }
 
-  virtual bool isBalanced()
+  bool isBalanced()
   {
     root->recalcBalance();
     return root->isBalanced();
   }
+
+  /**
+   * How many levels the tree has, 0 if it's empty
+   */
+
+  int height()
+  {
+    return root ? root->getHeight() : 0;
+  }
+
+  /**
+   * How many keys are in the tree
+   */
+
+  size_t size() const
+  {
+    return NodeType::sizeOf(root);
+  }
+
+  /**
+   * How many keys are less than key. It's one trip down the tree,
+   * adding up the sizes of the left subtrees it goes past.
+   */
+
+  size_t rank(KeyType key) const
+  {
+    return countBefore<false>(key);
+  }
+
+  /**
+   * The k'th smallest pair in the tree, counting from 0, or NULL if
+   * there aren't that many. Good until it's removed.
+   */
+
+  std::pair<KeyType, ValType> *select(size_t k) const
+  {
+    NodeType *node = root;
+    while (node) {
+      size_t leftSize = NodeType::sizeOf(node->left);
+      if (k < leftSize) {
+        node = node->left;
+      } else if (k == leftSize) {
+        return &node->keyVal;
+      } else {
+        k -= leftSize + 1;
+        node = node->right;
+      }
+    }
+    return (std::pair<KeyType, ValType> *) NULL;
+  }
+
+  /**
+   * How many keys there are from start to end, including both, the
+   * same as findRange would find but without finding them
+   */
+
+  size_t countRange(KeyType start, KeyType end) const
+  {
+    if (end < start) {
+      return 0;
+    }
+    return countBefore<true>(end) - countBefore<false>(start);
+  }
   
 };
+
+#endif
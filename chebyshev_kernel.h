@@ -0,0 +1,210 @@
+/**
+ * Chebyshev series evaluation for a row of queries at once, written
+ * once for any of the lanes in simd_lanes.h. Only chebyshev_orbit.cpp
+ * and the instruction set specific chebyshev_orbit_*.cpp files should
+ * include this, and like the other kernels it sticks to plain arrays.
+ *
+ * Each query has its own series (one set of x, y and z coefficients)
+ * and its own tau in [-1, 1]. Clenshaw's recurrence gets the value,
+ *
+ *   b(k) = c(k) + 2 tau b(k + 1) - b(k + 2)
+ *   f    = c(0) + tau b(1) - b(2)
+ *
+ * and differentiating it term by term gets the derivative without
+ * a second set of coefficients:
+ *
+ *   d(k) = 2 b(k + 1) + 2 tau d(k + 1) - d(k + 2)
+ *   f'   = b(1) + tau d(1) - d(2)
+ *
+ * which times rate (dtau/dt, and whatever units the caller wants)
+ * is the velocity.
+ *
+ * When a whole row is using the same series, which is what happens
+ * when one satellite is asked for lots of times, each coefficient
+ * gets broadcast to every lane. Otherwise the row's coefficients get
+ * transposed into lanes first, so every lane still runs the same
+ * recurrence.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _H_CHEBYSHEV_KERNEL
+#define _H_CHEBYSHEV_KERNEL
+
+#include "simd_lanes.h"
+#include <stddef.h>
+
+enum { CHEBYSHEV_MAX_TERMS = 24 };
+
+/**
+ * The queries, one array per column. coefficients[i] points at
+ * query i's series: terms[i] x coefficients, then as many y, then
+ * as many z. Nothing has to be padded; the loop does that itself.
+ */
+
+struct ChebyshevRows {
+  const double *const *coefficients;
+  const int *terms;
+  const double *tau;
+  const double *rate;
+  size_t count;
+  double *x, *y, *z;
+  double *dx, *dy, *dz;
+};
+
+/**
+ * Coefficient at, for a row where every lane has the same series
+ */
+
+template <typename L>
+struct BroadcastCoefficients {
+  const double *series;
+
+  BroadcastCoefficients(const double *series) : series(series) {}
+
+  typename L::Value get(int at) const
+  {
+    return L::set(series[at]);
+  }
+};
+
+/**
+ * Coefficient at, for a row of different series. Shorter series get
+ * padded out with zeros, which doesn't change what they come to.
+ */
+
+template <typename L>
+struct GatheredCoefficients {
+  double rows[3 * CHEBYSHEV_MAX_TERMS][L::WIDTH];
+
+  GatheredCoefficients(const double *const *series, const int *terms, int most)
+  {
+    for (int axis = 0; axis < 3; axis++) {
+      for (int k = 0; k < most; k++) {
+        for (size_t j = 0; j < (size_t) L::WIDTH; j++) {
+          rows[axis * most + k][j] = (k < terms[j]) ? series[j][axis * terms[j] + k] : 0.0;
+        }
+      }
+    }
+  }
+
+  typename L::Value get(int at) const
+  {
+    return L::load(rows[at]);
+  }
+};
+
+/**
+ * One axis' worth of Clenshaw, for the terms coefficients starting
+ * at first
+ */
+
+template <typename L, typename C>
+static inline void clenshawLanes(const C &source, int first, int terms, typename L::Value tau,
+                                 typename L::Value &value, typename L::Value &derivative)
+{
+  typedef typename L::Value V;
+  V zero = L::set(0.0);
+  V twoTau = tau + tau;
+  V b1 = zero, b2 = zero, d1 = zero, d2 = zero;
+  for (int k = terms - 1; k >= 1; k--) {
+    V b0 = source.get(first + k) + twoTau * b1 - b2;
+    V d0 = b1 + b1 + twoTau * d1 - d2;
+    b2 = b1;
+    b1 = b0;
+    d2 = d1;
+    d1 = d0;
+  }
+  value = source.get(first) + tau * b1 - b2;
+  derivative = b1 + tau * d1 - d2;
+}
+
+template <typename L, typename C>
+static inline void chebyshevLanes(const C &source, int terms, const double *taus, const double *rates,
+                                  double *out[6])
+{
+  typedef typename L::Value V;
+  V tau = L::load(taus);
+  V rate = L::load(rates);
+  for (int axis = 0; axis < 3; axis++) {
+    V value, derivative;
+    clenshawLanes<L>(source, axis * terms, terms, tau, value, derivative);
+    L::store(out[axis], value);
+    L::store(out[axis + 3], derivative * rate);
+  }
+}
+
+/**
+ * Run all the queries through, WIDTH at a time. The last few get
+ * copied into a full row padded out with copies of the last query,
+ * so nothing reads or writes past the ends of the arrays and the
+ * row can still be broadcast if the real ones could.
+ */
+
+template <typename L>
+static inline void chebyshevLoop(const ChebyshevRows &rows)
+{
+  for (size_t i = 0; i < rows.count; i += L::WIDTH) {
+    const double *series[L::WIDTH];
+    int terms[L::WIDTH];
+    double tau[L::WIDTH];
+    double rate[L::WIDTH];
+    double result[6][L::WIDTH];
+    bool full = (i + L::WIDTH <= rows.count);
+    bool same = true;
+    int most = 0;
+    for (size_t j = 0; j < (size_t) L::WIDTH; j++) {
+      size_t at = (i + j < rows.count) ? i + j : rows.count - 1;
+      series[j] = rows.coefficients[at];
+      terms[j] = rows.terms[at];
+      tau[j] = rows.tau[at];
+      rate[j] = rows.rate[at];
+      same = same && series[j] == series[0] && terms[j] == terms[0];
+      most = (terms[j] > most) ? terms[j] : most;
+    }
+
+    double *out[6] = { result[0], result[1], result[2], result[3], result[4], result[5] };
+    if (full) {
+      out[0] = rows.x + i;
+      out[1] = rows.y + i;
+      out[2] = rows.z + i;
+      out[3] = rows.dx + i;
+      out[4] = rows.dy + i;
+      out[5] = rows.dz + i;
+    }
+    if (same) {
+      chebyshevLanes<L>(BroadcastCoefficients<L>(series[0]), most, tau, rate, out);
+    } else {
+      chebyshevLanes<L>(GatheredCoefficients<L>(series, terms, most), most, tau, rate, out);
+    }
+    for (size_t j = 0; !full && i + j < rows.count; j++) {
+      rows.x[i + j] = result[0][j];
+      rows.y[i + j] = result[1][j];
+      rows.z[i + j] = result[2][j];
+      rows.dx[i + j] = result[3][j];
+      rows.dy[i + j] = result[4][j];
+      rows.dz[i + j] = result[5][j];
+    }
+  }
+}
+
+/**
+ * One of these per instruction set, each in its own object file
+ */
+
+void chebyshevScalar(const ChebyshevRows &rows);
+void chebyshevAvx2(const ChebyshevRows &rows);
+void chebyshevAvx512(const ChebyshevRows &rows);
+
+#endif
@@ -0,0 +1,140 @@
+/**
+ * ChebyshevOrbit: the plain version of the Chebyshev loop, and
+ * picking which version to run.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "chebyshev_orbit.h"
+#include "chebyshev_kernel.h"
+#include <boost/static_assert.hpp>
+#include <limits>
+
+BOOST_STATIC_ASSERT(ChebyshevOrbit::MAX_DEGREE + 1 <= CHEBYSHEV_MAX_TERMS);
+
+void chebyshevScalar(const ChebyshevRows &rows)
+{
+  chebyshevLoop<ScalarLanes>(rows);
+}
+
+namespace {
+
+  /**
+   * Queries go through the kernel this many at a time, so the
+   * columns it wants can live on the stack
+   */
+
+  enum { CHUNK = 256 };
+
+  struct Chunk {
+    const double *coefficients[CHUNK];
+    int terms[CHUNK];
+    double tau[CHUNK];
+    double rate[CHUNK];
+    bool found[CHUNK];
+    size_t count;
+  };
+
+  void run(Chunk &chunk, size_t first, double *x, double *y, double *z, double *dx, double *dy, double *dz,
+           SimdDispatch::Implementation use)
+  {
+    ChebyshevRows rows = { chunk.coefficients, chunk.terms, chunk.tau, chunk.rate, chunk.count,
+                           x + first, y + first, z + first, dx + first, dy + first, dz + first };
+    switch (use) {
+    case SimdDispatch::AVX512:
+      chebyshevAvx512(rows);
+      break;
+    case SimdDispatch::AVX2:
+      chebyshevAvx2(rows);
+      break;
+    default:
+      chebyshevScalar(rows);
+    }
+    double nan = std::numeric_limits<double>::quiet_NaN();
+    for (size_t i = 0; i < chunk.count; i++) {
+      if (!chunk.found[i]) {
+        x[first + i] = y[first + i] = z[first + i] = nan;
+        dx[first + i] = dy[first + i] = dz[first + i] = nan;
+      }
+    }
+  }
+
+  /**
+   * Query i in chunk is outside the fit
+   */
+
+  void nothing(Chunk &chunk, size_t i)
+  {
+    static const double zero[3] = { 0.0, 0.0, 0.0 };
+    chunk.found[i] = false;
+    chunk.coefficients[i] = zero;
+    chunk.terms[i] = 1;
+    chunk.tau[i] = 0.0;
+    chunk.rate[i] = 0.0;
+  }
+
+}
+
+size_t ChebyshevOrbit::evaluate(const double *times, size_t count, double *x, double *y, double *z,
+                                double *dx, double *dy, double *dz, Implementation use) const
+{
+  use = resolve(use);
+  Chunk chunk;
+  size_t found = 0;
+  long at = -1;
+  for (size_t first = 0; first < count; first += CHUNK) {
+    chunk.count = (count - first < (size_t) CHUNK) ? count - first : (size_t) CHUNK;
+    for (size_t i = 0; i < chunk.count; i++) {
+      double time = times[first + i];
+      // Sorted times are mostly in the same segment as the last one
+      if (at < 0 || time < segments[at].start || time > segments[at].end) {
+        at = find(time);
+      }
+      if (at < 0) {
+        nothing(chunk, i);
+        continue;
+      }
+      setUp(at, time, chunk.coefficients[i], chunk.terms[i], chunk.tau[i], chunk.rate[i]);
+      chunk.found[i] = true;
+      found++;
+    }
+    run(chunk, first, x, y, z, dx, dy, dz, use);
+  }
+  return found;
+}
+
+size_t ChebyshevOrbit::evaluate(const ChebyshevOrbit *const *orbits, size_t count, double time,
+                                double *x, double *y, double *z, double *dx, double *dy, double *dz,
+                                Implementation use)
+{
+  use = resolve(use);
+  Chunk chunk;
+  size_t found = 0;
+  for (size_t first = 0; first < count; first += CHUNK) {
+    chunk.count = (count - first < (size_t) CHUNK) ? count - first : (size_t) CHUNK;
+    for (size_t i = 0; i < chunk.count; i++) {
+      const ChebyshevOrbit *orbit = orbits[first + i];
+      long at = orbit ? orbit->find(time) : -1;
+      if (at < 0) {
+        nothing(chunk, i);
+        continue;
+      }
+      orbit->setUp(at, time, chunk.coefficients[i], chunk.terms[i], chunk.tau[i], chunk.rate[i]);
+      chunk.found[i] = true;
+      found++;
+    }
+    run(chunk, first, x, y, z, dx, dy, dz, use);
+  }
+  return found;
+}
@@ -0,0 +1,573 @@
+/**
+ * ChebyshevOrbit fits a satellite's ephemeris with Chebyshev series,
+ * the way the JPL planetary ephemerides do it: the data is cut into
+ * segments of a fixed length of time (6 hours by default, lined up
+ * on multiples of that since the epoch, so every satellite's
+ * segments line up too) and x, y and z over each one get a series
+ * of a fixed degree. Where it's good, evaluating it is a few dozen
+ * multiply-adds no matter how much data went in, with no window
+ * to find and no weights to work out, and the velocity comes out
+ * of the same coefficients.
+ *
+ * Each segment is a least squares fit to the positions AND the
+ * velocities of the epochs in it, so the series' derivative agrees
+ * with the velocities, not just the series with the positions.
+ * How far off the fit is at the epochs it was fit to is kept for
+ * each segment (positionError in meters, velocityError in meters
+ * per second), which is about as good a bound as the data can give;
+ * if it's not good enough, raise the degree or shorten the segments.
+ * A segment with too few epochs for the degree gets a lower one.
+ *
+ * Like GeodeticBatch, evaluating lots of times at once runs 4 or 8
+ * of them at a time on a CPU with AVX2 or AVX-512 (see
+ * chebyshev_kernel.h.) So do lots of satellites at one time.
+ *
+ * ChebyshevEphemeris is the set of them for a whole EphemerisCache.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _H_CHEBYSHEV_ORBIT
+#define _H_CHEBYSHEV_ORBIT
+
+#include "ephemeris_cache.h"
+#include "ephemeris_line.h"
+#include "epoch_index.h"
+#include "orbit_interpolator.h"
+#include "simd_dispatch.h"
+#include <map>
+#include <string>
+#include <vector>
+#include <math.h>
+#include <stddef.h>
+
+/**
+ * Which instruction set to use comes from SimdDispatch, same as
+ * GeodeticBatch.
+ */
+
+class ChebyshevOrbit : public SimdDispatch {
+ public:
+  enum { MAX_DEGREE = 23, VELOCITY_WEIGHT = 100 };
+
+  struct Segment {
+    double start;
+    double end;
+    int terms;
+    size_t samples;
+    double positionError;
+    double velocityError;
+  };
+
+ private:
+  int degree;
+  double span;
+  double velocityScale;
+  std::vector<Segment> segments;
+  // Each segment gets 3 * (degree + 1) of these: its x series, then
+  // y, then z, each segment.terms long
+  std::vector<double> coefficients;
+
+  /**
+   * T(k) and T'(k) at tau for k up to terms - 1. T'(k) is k U(k - 1),
+   * and the U's go by the same recurrence as the T's.
+   */
+
+  static void basis(double tau, int terms, double *t, double *dt)
+  {
+    double u0 = 1.0;
+    double u1 = 2.0 * tau;
+    t[0] = 1.0;
+    dt[0] = 0.0;
+    if (terms > 1) {
+      t[1] = tau;
+      dt[1] = 1.0;
+    }
+    for (int k = 2; k < terms; k++) {
+      t[k] = 2.0 * tau * t[k - 1] - t[k - 2];
+      dt[k] = k * u1;
+      double u2 = 2.0 * tau * u1 - u0;
+      u0 = u1;
+      u1 = u2;
+    }
+  }
+
+  /**
+   * Least squares for a rows x columns (row major, rows >= columns)
+   * against three right hand sides at once, by Householder QR. a
+   * and b get used up. solution gets the x, y and z answers one
+   * after the other, columns long each.
+   */
+
+  static void leastSquares(std::vector<double> &a, size_t rows, size_t columns, std::vector<double> &b, double *solution)
+  {
+    std::vector<double> diagonal(columns, 0.0);
+    for (size_t k = 0; k < columns; k++) {
+      double norm = 0.0;
+      for (size_t i = k; i < rows; i++) {
+        norm += a[i * columns + k] * a[i * columns + k];
+      }
+      norm = ::sqrt(norm);
+      if (norm == 0.0) {
+        continue;
+      }
+      double alpha = (a[k * columns + k] > 0.0) ? -norm : norm;
+      diagonal[k] = alpha;
+      // The reflector goes where column k was
+      a[k * columns + k] -= alpha;
+      double length = 0.0;
+      for (size_t i = k; i < rows; i++) {
+        length += a[i * columns + k] * a[i * columns + k];
+      }
+      for (size_t j = k + 1; j < columns; j++) {
+        double dot = 0.0;
+        for (size_t i = k; i < rows; i++) {
+          dot += a[i * columns + k] * a[i * columns + j];
+        }
+        double f = 2.0 * dot / length;
+        for (size_t i = k; i < rows; i++) {
+          a[i * columns + j] -= f * a[i * columns + k];
+        }
+      }
+      for (size_t c = 0; c < 3; c++) {
+        double dot = 0.0;
+        for (size_t i = k; i < rows; i++) {
+          dot += a[i * columns + k] * b[i * 3 + c];
+        }
+        double f = 2.0 * dot / length;
+        for (size_t i = k; i < rows; i++) {
+          b[i * 3 + c] -= f * a[i * columns + k];
+        }
+      }
+    }
+    for (size_t c = 0; c < 3; c++) {
+      double *x = solution + c * columns;
+      for (long k = (long) columns - 1; k >= 0; k--) {
+        double sum = b[k * 3 + c];
+        for (size_t j = k + 1; j < columns; j++) {
+          sum -= a[k * columns + j] * x[j];
+        }
+        x[k] = (diagonal[k] == 0.0) ? 0.0 : sum / diagonal[k];
+      }
+    }
+  }
+
+  static double tauOf(const Segment &segment, double time)
+  {
+    double half = (segment.end - segment.start) / 2.0;
+    return (half > 0.0) ? (time - segment.start - half) / half : 0.0;
+  }
+
+  static double halfOf(const Segment &segment)
+  {
+    double half = (segment.end - segment.start) / 2.0;
+    return (half > 0.0) ? half : 1.0;
+  }
+
+  /**
+   * What the kernel needs to evaluate segment at at time
+   */
+
+  void setUp(long at, double time, const double *&series, int &terms, double &tau, double &rate) const
+  {
+    const Segment &segment = segments[at];
+    series = &coefficients[at * 3 * (degree + 1)];
+    terms = segment.terms;
+    tau = tauOf(segment, time);
+    rate = 1.0 / (halfOf(segment) * velocityScale);
+  }
+
+  void fitSegment(const double *times, EphemerisLine *lines, size_t count)
+  {
+    Segment segment;
+    segment.start = times[0];
+    segment.end = times[count - 1];
+    segment.samples = count;
+    segment.terms = (2 * count < (size_t) degree + 1) ? (int) (2 * count) : degree + 1;
+    double half = halfOf(segment);
+    int terms = segment.terms;
+
+    // A row for each position and one for each velocity. The
+    // velocity rows are in meters too: how far off the velocity is
+    // over VELOCITY_WEIGHT seconds. SP3 velocities don't quite agree
+    // with their positions (by a few tenths of a mm/s in the NGA
+    // files), so weighting them much more than that drags the
+    // positions off by meters.
+    std::vector<double> a(2 * count * terms);
+    std::vector<double> b(2 * count * 3);
+    double t[MAX_DEGREE + 1];
+    double dt[MAX_DEGREE + 1];
+    for (size_t i = 0; i < count; i++) {
+      basis(tauOf(segment, times[i]), terms, t, dt);
+      EphemerisLine &line = lines[i];
+      Ecef &p = line.getPosition();
+      for (int k = 0; k < terms; k++) {
+        a[(2 * i) * terms + k] = t[k];
+        a[(2 * i + 1) * terms + k] = dt[k] * VELOCITY_WEIGHT / half;
+      }
+      b[(2 * i) * 3] = p.getX();
+      b[(2 * i) * 3 + 1] = p.getY();
+      b[(2 * i) * 3 + 2] = p.getZ();
+      b[(2 * i + 1) * 3] = line.getDx() * velocityScale * VELOCITY_WEIGHT;
+      b[(2 * i + 1) * 3 + 1] = line.getDy() * velocityScale * VELOCITY_WEIGHT;
+      b[(2 * i + 1) * 3 + 2] = line.getDz() * velocityScale * VELOCITY_WEIGHT;
+    }
+    size_t offset = segments.size() * 3 * (degree + 1);
+    coefficients.resize(offset + 3 * (degree + 1), 0.0);
+    double *series = &coefficients[offset];
+    leastSquares(a, 2 * count, terms, b, series);
+
+    // How close it came
+    segment.positionError = 0.0;
+    segment.velocityError = 0.0;
+    for (size_t i = 0; i < count; i++) {
+      basis(tauOf(segment, times[i]), terms, t, dt);
+      EphemerisLine &line = lines[i];
+      Ecef &p = line.getPosition();
+      double want[6] = { p.getX(), p.getY(), p.getZ(), line.getDx(), line.getDy(), line.getDz() };
+      double position = 0.0;
+      double velocity = 0.0;
+      for (int axis = 0; axis < 3; axis++) {
+        double value = 0.0;
+        double derivative = 0.0;
+        for (int k = 0; k < terms; k++) {
+          value += series[axis * terms + k] * t[k];
+          derivative += series[axis * terms + k] * dt[k];
+        }
+        position += (value - want[axis]) * (value - want[axis]);
+        double off = derivative / half - want[axis + 3] * velocityScale;
+        velocity += off * off;
+      }
+      segment.positionError = fmax(segment.positionError, ::sqrt(position));
+      segment.velocityError = fmax(segment.velocityError, ::sqrt(velocity));
+    }
+    segments.push_back(segment);
+  }
+
+ public:
+
+  /**
+   * degree is capped at MAX_DEGREE. velocityScale is what a unit of
+   * a line's velocity is in meters per second, same as
+   * OrbitInterpolator.
+   */
+
+  ChebyshevOrbit(int degree = 14, double span = 6 * 3600.0, double velocityScale = OrbitInterpolator::sp3VelocityScale()) : degree(degree), span(span), velocityScale(velocityScale)
+  {
+    if (this->degree < 1) {
+      this->degree = 1;
+    }
+    if (this->degree > MAX_DEGREE) {
+      this->degree = MAX_DEGREE;
+    }
+  }
+
+  /**
+   * Fit the epochs in times and lines (parallel arrays sorted by
+   * time, like the ones in an EpochIndex), throwing out whatever
+   * was fit before. Each segment also takes the first epoch at or
+   * past its end, if that's in the next span, and the next segment
+   * starts there. So neighbouring segments share an epoch and there's
+   * no hole between them, whether or not the epochs line up with the
+   * span. Returns the number of segments.
+   */
+
+  size_t fit(const double *times, EphemerisLine *lines, size_t count)
+  {
+    segments.clear();
+    coefficients.clear();
+    size_t i = 0;
+    bool shared = false;
+    long k = (count > 0) ? (long) ::floor(times[0] / span) : 0;
+    while (i < count) {
+      // Skip over segments with nothing in them
+      long at = (long) ::floor(times[i] / span);
+      k = (at > k) ? at : k;
+      double boundary = (k + 1) * span;
+      size_t j = i;
+      while (j + 1 < count && times[j + 1] < boundary) {
+        j++;
+      }
+      // The first one at or past the boundary goes in both
+      size_t next = j + 1;
+      size_t last = (next < count && times[next] <= boundary + span) ? next : j;
+      // Unless it's all this one would have, since the last one has it
+      if (!(shared && last == i)) {
+        fitSegment(times + i, lines + i, last - i + 1);
+      }
+      if (last + 1 == count) {
+        break;
+      }
+      shared = (last == next);
+      k++;
+      i = next;
+    }
+    return segments.size();
+  }
+
+  size_t fit(EpochIndex<EphemerisLine> &epochs)
+  {
+    return fit(epochs.timeData(), epochs.valueData(), epochs.size());
+  }
+
+  /**
+   * Fit everything the cache has for satellite. Returns the number
+   * of segments, 0 if there's no such satellite.
+   */
+
+  size_t fit(EphemerisCache &cache, const std::string &satellite)
+  {
+    EpochIndex<EphemerisLine> epochs;
+    if (!cache.copy(satellite, epochs)) {
+      segments.clear();
+      coefficients.clear();
+      return 0;
+    }
+    return fit(epochs);
+  }
+
+  int getDegree() const
+  {
+    return degree;
+  }
+
+  double getSpan() const
+  {
+    return span;
+  }
+
+  size_t segmentCount() const
+  {
+    return segments.size();
+  }
+
+  const Segment &segment(size_t at) const
+  {
+    return segments[at];
+  }
+
+  /**
+   * The segment time is in, or -1 if it isn't in any of them
+   */
+
+  long find(double time) const
+  {
+    size_t low = 0;
+    size_t high = segments.size();
+    while (low < high) {
+      size_t middle = low + (high - low) / 2;
+      if (segments[middle].end < time) {
+        low = middle + 1;
+      } else {
+        high = middle;
+      }
+    }
+    return (low < segments.size() && segments[low].start <= time) ? (long) low : -1;
+  }
+
+  /**
+   * Worst fit error over all the segments, in meters and meters per
+   * second
+   */
+
+  double maxPositionError() const
+  {
+    double worst = 0.0;
+    for (size_t i = 0; i < segments.size(); i++) {
+      worst = fmax(worst, segments[i].positionError);
+    }
+    return worst;
+  }
+
+  double maxVelocityError() const
+  {
+    double worst = 0.0;
+    for (size_t i = 0; i < segments.size(); i++) {
+      worst = fmax(worst, segments[i].velocityError);
+    }
+    return worst;
+  }
+
+  /**
+   * Bytes of coefficients
+   */
+
+  size_t bytes() const
+  {
+    return coefficients.size() * sizeof(double) + segments.size() * sizeof(Segment);
+  }
+
+  /**
+   * Position and velocity at count times, into the six arrays. The
+   * velocities are in the same units as the lines that were fit.
+   * Times don't have to be sorted, but it's a bit quicker if they
+   * are. Times outside the fit come out NaN. Returns how many
+   * didn't.
+   */
+
+  size_t evaluate(const double *times, size_t count, double *x, double *y, double *z,
+                  double *dx, double *dy, double *dz, Implementation use = AUTO) const;
+
+  /**
+   * Where the satellite is at time, like
+   * EphemerisCache::interpolate. Returns false if time is outside
+   * the fit.
+   */
+
+  bool evaluate(double time, EphemerisLine &result, Implementation use = AUTO) const
+  {
+    double v[6];
+    if (evaluate(&time, 1, &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], use) == 0) {
+      return false;
+    }
+    result = EphemerisLine(v[0], v[1], v[2], v[3], v[4], v[5], time);
+    return true;
+  }
+
+  /**
+   * The positions and velocities of count satellites at one time.
+   * Satellites that aren't fit at that time (or are NULL) come out
+   * NaN. Returns how many didn't.
+   */
+
+  static size_t evaluate(const ChebyshevOrbit *const *orbits, size_t count, double time,
+                         double *x, double *y, double *z, double *dx, double *dy, double *dz,
+                         Implementation use = AUTO);
+
+};
+
+/**
+ * A ChebyshevOrbit for every satellite in an EphemerisCache, all with
+ * the same degree and span
+ */
+
+class ChebyshevEphemeris {
+  typedef std::map<std::string, ChebyshevOrbit> Orbits;
+  Orbits orbits;
+  int degree;
+  double span;
+  double velocityScale;
+
+ public:
+
+  ChebyshevEphemeris(int degree = 14, double span = 6 * 3600.0, double velocityScale = OrbitInterpolator::sp3VelocityScale()) : degree(degree), span(span), velocityScale(velocityScale)
+  {
+  }
+
+  /**
+   * Fit every satellite in cache, replacing any that were fit
+   * before. Returns the number of satellites.
+   */
+
+  size_t fit(EphemerisCache &cache)
+  {
+    std::vector<std::string> names;
+    cache.satelliteNames(names);
+    for (size_t i = 0; i < names.size(); i++) {
+      ChebyshevOrbit orbit(degree, span, velocityScale);
+      if (orbit.fit(cache, names[i]) > 0) {
+        orbits[names[i]] = orbit;
+      }
+    }
+    return names.size();
+  }
+
+  /**
+   * The satellite's orbit, or NULL if it hasn't been fit
+   */
+
+  const ChebyshevOrbit *find(const std::string &satellite) const
+  {
+    Orbits::const_iterator it = orbits.find(satellite);
+    return (it == orbits.end()) ? (const ChebyshevOrbit *) NULL : &it->second;
+  }
+
+  void satelliteNames(std::vector<std::string> &names) const
+  {
+    Orbits::const_iterator it = orbits.begin();
+    for (; it != orbits.end(); it++) {
+      names.push_back(it->first);
+    }
+  }
+
+  size_t size() const
+  {
+    return orbits.size();
+  }
+
+  double maxPositionError() const
+  {
+    double worst = 0.0;
+    Orbits::const_iterator it = orbits.begin();
+    for (; it != orbits.end(); it++) {
+      worst = fmax(worst, it->second.maxPositionError());
+    }
+    return worst;
+  }
+
+  double maxVelocityError() const
+  {
+    double worst = 0.0;
+    Orbits::const_iterator it = orbits.begin();
+    for (; it != orbits.end(); it++) {
+      worst = fmax(worst, it->second.maxVelocityError());
+    }
+    return worst;
+  }
+
+  size_t bytes() const
+  {
+    size_t total = 0;
+    Orbits::const_iterator it = orbits.begin();
+    for (; it != orbits.end(); it++) {
+      total += it->second.bytes();
+    }
+    return total;
+  }
+
+  /**
+   * Every satellite that's fit at time, in name order, into names
+   * and lines. Returns how many that was.
+   */
+
+  size_t evaluate(double time, std::vector<std::string> &names, std::vector<EphemerisLine> &lines,
+                  ChebyshevOrbit::Implementation use = ChebyshevOrbit::AUTO) const
+  {
+    std::vector<const ChebyshevOrbit *> all;
+    std::vector<std::string> allNames;
+    Orbits::const_iterator it = orbits.begin();
+    for (; it != orbits.end(); it++) {
+      all.push_back(&it->second);
+      allNames.push_back(it->first);
+    }
+    if (all.empty()) {
+      return 0;
+    }
+    std::vector<double> v(6 * all.size());
+    size_t n = all.size();
+    ChebyshevOrbit::evaluate(&all[0], n, time, &v[0], &v[n], &v[2 * n], &v[3 * n], &v[4 * n], &v[5 * n], use);
+    size_t found = 0;
+    for (size_t i = 0; i < n; i++) {
+      if (!isnan(v[i])) {
+        names.push_back(allNames[i]);
+        lines.push_back(EphemerisLine(v[i], v[n + i], v[2 * n + i], v[3 * n + i], v[4 * n + i], v[5 * n + i], time));
+        found++;
+      }
+    }
+    return found;
+  }
+
+};
+
+#endif
@@ -0,0 +1,25 @@
+/**
+ * The AVX2 version of the Chebyshev loop. This is the only file
+ * built with -mavx2 -mfma, and it only gets called after
+ * ChebyshevOrbit has checked the CPU can run it.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "chebyshev_kernel.h"
+
+void chebyshevAvx2(const ChebyshevRows &rows)
+{
+  chebyshevLoop<Avx2Lanes>(rows);
+}
@@ -0,0 +1,473 @@
+/**
+ * CompressedEpochBlock packs a run of epochs (a satellite's day, say)
+ * into a bit stream about a sixth the size of the arrays they came
+ * out of, and unpacks them again exactly. It's what EphemerisCache's
+ * cold tier keeps old data in.
+ *
+ * Each epoch is eight doubles: its time, and the seven in its
+ * EphemerisLine. They're packed a column at a time, so every value
+ * sits next to the same value from the epoch before, in the spirit
+ * of Facebook's Gorilla:
+ *
+ * Most columns are decimals that came out of a text file, and they
+ * get turned back into integers: the value times 10^scale, rounded.
+ * The integer is predicted from the ones before it by extending a
+ * polynomial through them (order 2 is delta of delta, which is what
+ * times need; smooth orbits do better with 3 or 4), and only the
+ * difference from the prediction is stored. Whatever the integer
+ * doesn't get back exactly goes in a correction to the double's bits,
+ * which is almost always 0. So nothing is lost even if the numbers
+ * aren't really decimals.
+ *
+ * A column that won't go that way is stored the way Gorilla does
+ * floats: each value's bits XORed with the one before.
+ *
+ * Either way what's left is a stream of small numbers, written with
+ * Gorilla's scheme: one bit for a 0, or the meaningful bits in the
+ * same window as the number before, or a new window.
+ *
+ * The scale and prediction order get picked per column per block, by
+ * trying them.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _H_COMPRESSED_EPOCH_BLOCK
+#define _H_COMPRESSED_EPOCH_BLOCK
+
+#include "ephemeris_line.h"
+#include "epoch_index.h"
+#include <boost/static_assert.hpp>
+#include <vector>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+class CompressedEpochBlock {
+ public:
+  enum { COLUMNS = 8, MAX_SCALE = 12, MAX_ORDER = 7 };
+
+  // encode and decode read a line as the COLUMNS - 1 doubles after
+  // the time, packed
+  BOOST_STATIC_ASSERT(sizeof(EphemerisLine) == (COLUMNS - 1) * sizeof(double));
+
+ protected:
+  enum { RAW = 0, DECIMAL = 1 };
+
+  /**
+   * Appends bits to a vector of words, lowest bit first
+   */
+
+  class BitWriter {
+    std::vector<uint64_t> &words;
+    int used; // Bits used in the last word
+
+  public:
+    BitWriter(std::vector<uint64_t> &words) : words(words), used(64)
+    {
+    }
+
+    void write(uint64_t value, int n)
+    {
+      if (n == 0) {
+        return;
+      }
+      if (n < 64) {
+        value &= (1ULL << n) - 1;
+      }
+      if (used == 64) {
+        words.push_back(0);
+        used = 0;
+      }
+      int room = 64 - used;
+      words.back() |= value << used;
+      if (n <= room) {
+        used += n;
+      } else {
+        words.push_back(value >> room);
+        used = n - room;
+      }
+    }
+  };
+
+  /**
+   * Stands in for a BitWriter when all the encoder wants to know is
+   * how long something would come out
+   */
+
+  class BitCounter {
+  public:
+    size_t bits;
+
+    BitCounter() : bits(0)
+    {
+    }
+
+    void write(uint64_t, int n)
+    {
+      bits += n;
+    }
+  };
+
+  class BitReader {
+    const uint64_t *words;
+    size_t at;
+
+  public:
+    BitReader(const uint64_t *words) : words(words), at(0)
+    {
+    }
+
+    uint64_t read(int n)
+    {
+      if (n == 0) {
+        return 0;
+      }
+      size_t word = at >> 6;
+      int offset = at & 63;
+      uint64_t value = words[word] >> offset;
+      if (offset + n > 64) {
+        value |= words[word + 1] << (64 - offset);
+      }
+      at += n;
+      return n < 64 ? value & ((1ULL << n) - 1) : value;
+    }
+  };
+
+  /**
+   * Gorilla's encoding for a stream of mostly small numbers. A 0 is
+   * one bit. Anything else is its meaningful bits, either inside the
+   * window the last one opened ("10") or in a new window ("11", then
+   * 6 bits of leading zeros, 6 bits of length.) trailing says whether
+   * trailing zeros count as meaningless, which they only do for XORed
+   * floats. A new window also gets opened when the number is a lot
+   * smaller than the window, since that pays for itself.
+   */
+
+  class Window {
+    int lead;
+    int trail;
+    bool trailing;
+
+  public:
+    Window(bool trailing) : lead(-1), trail(0), trailing(trailing)
+    {
+    }
+
+    template <typename Sink>
+    void put(Sink &out, uint64_t value)
+    {
+      if (value == 0) {
+        out.write(0, 1);
+        return;
+      }
+      int newLead = __builtin_clzll(value);
+      int newTrail = trailing ? __builtin_ctzll(value) : 0;
+      if (lead >= 0 && newLead >= lead && newTrail >= trail && newLead - lead < 12) {
+        out.write(1, 2);
+        out.write(value >> trail, 64 - lead - trail);
+        return;
+      }
+      lead = newLead;
+      trail = newTrail;
+      int length = 64 - lead - trail;
+      out.write(3, 2);
+      out.write(lead, 6);
+      out.write(length - 1, 6);
+      out.write(value >> trail, length);
+    }
+
+    uint64_t get(BitReader &in)
+    {
+      if (in.read(1) == 0) {
+        return 0;
+      }
+      if (in.read(1) == 1) {
+        lead = in.read(6);
+        int length = in.read(6) + 1;
+        trail = 64 - lead - length;
+      }
+      return in.read(64 - lead - trail) << trail;
+    }
+  };
+
+  static const double *powersOfTen()
+  {
+    static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12 };
+    return powers;
+  }
+
+  static uint64_t bitsOf(double value)
+  {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+  }
+
+  static double fromBits(uint64_t bits)
+  {
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+  static uint64_t zigzag(int64_t value)
+  {
+    return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+  }
+
+  static int64_t unzigzag(uint64_t value)
+  {
+    return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+  }
+
+  /**
+   * Extend a polynomial of the given order through the last order
+   * values (newest first in previous) to guess the next one. The
+   * coefficients are a row of Pascal's triangle with alternating
+   * signs. Early in the block there aren't enough values yet, so the
+   * order drops to however many there are.
+   */
+
+  static int64_t predict(const int64_t *previous, int order)
+  {
+    static const int64_t coefficients[MAX_ORDER + 1][MAX_ORDER] = {
+      { 0, 0, 0, 0, 0, 0, 0 },
+      { 1, 0, 0, 0, 0, 0, 0 },
+      { 2, -1, 0, 0, 0, 0, 0 },
+      { 3, -3, 1, 0, 0, 0, 0 },
+      { 4, -6, 4, -1, 0, 0, 0 },
+      { 5, -10, 10, -5, 1, 0, 0 },
+      { 6, -15, 20, -15, 6, -1, 0 },
+      { 7, -21, 35, -35, 21, -7, 1 }
+    };
+    int64_t guess = 0;
+    for (int i = 0; i < order; i++) {
+      guess += coefficients[order][i] * previous[i];
+    }
+    return guess;
+  }
+
+  /**
+   * Whether every value fits in 53 bits at scale. If one doesn't, the
+   * integer can't be turned back into the same double.
+   */
+
+  static bool fits(const double *values, size_t count, int scale)
+  {
+    double power = powersOfTen()[scale];
+    for (size_t i = 0; i < count; i++) {
+      if (!(fabs(values[i] * power) < 9007199254740992.0)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  template <typename Sink>
+  static void encodeDecimal(Sink &out, const double *values, size_t count, int scale, int order)
+  {
+    double power = powersOfTen()[scale];
+    Window residuals(false);
+    Window corrections(false);
+    int64_t previous[MAX_ORDER] = { 0 };
+    for (size_t i = 0; i < count; i++) {
+      int64_t value = llround(values[i] * power);
+      int usable = (int) i < order ? (int) i : order;
+      residuals.put(out, zigzag(value - predict(previous, usable)));
+      corrections.put(out, zigzag((int64_t) (bitsOf(values[i]) - bitsOf((double) value / power))));
+      memmove(previous + 1, previous, (MAX_ORDER - 1) * sizeof(int64_t));
+      previous[0] = value;
+    }
+  }
+
+  template <typename Sink>
+  static void encodeRaw(Sink &out, const double *values, size_t count)
+  {
+    Window xors(true);
+    uint64_t previous = 0;
+    for (size_t i = 0; i < count; i++) {
+      uint64_t bits = bitsOf(values[i]);
+      xors.put(out, bits ^ previous);
+      previous = bits;
+    }
+  }
+
+  /**
+   * Work out the cheapest way to store a column and store it
+   */
+
+  static void encodeColumn(BitWriter &out, const double *values, size_t count)
+  {
+    BitCounter raw;
+    encodeRaw(raw, values, count);
+    size_t best = raw.bits;
+    // Pick the scale with a cubic, which is about right for anything
+    // smooth, then the order at that scale
+    int scale = -1;
+    for (int trying = 0; trying <= MAX_SCALE && fits(values, count, trying); trying++) {
+      BitCounter decimal;
+      encodeDecimal(decimal, values, count, trying, 3);
+      if (decimal.bits < best) {
+        best = decimal.bits;
+        scale = trying;
+      }
+    }
+    int bestOrder = scale >= 0 ? 3 : -1;
+    for (int order = 0; scale >= 0 && order <= MAX_ORDER; order++) {
+      BitCounter decimal;
+      encodeDecimal(decimal, values, count, scale, order);
+      if (decimal.bits < best) {
+        best = decimal.bits;
+        bestOrder = order;
+      }
+    }
+    if (bestOrder < 0) {
+      out.write(RAW, 1);
+      encodeRaw(out, values, count);
+    } else {
+      out.write(DECIMAL, 1);
+      out.write(scale, 4);
+      out.write(bestOrder, 3);
+      encodeDecimal(out, values, count, scale, bestOrder);
+    }
+  }
+
+  /**
+   * Unpack a column into values, which are COLUMNS apart
+   */
+
+  static void decodeColumn(BitReader &in, double *values, size_t count)
+  {
+    if (in.read(1) == RAW) {
+      Window xors(true);
+      uint64_t previous = 0;
+      for (size_t i = 0; i < count; i++) {
+        previous ^= xors.get(in);
+        values[i * COLUMNS] = fromBits(previous);
+      }
+      return;
+    }
+    double power = powersOfTen()[in.read(4)];
+    int order = in.read(3);
+    Window residuals(false);
+    Window corrections(false);
+    int64_t previous[MAX_ORDER] = { 0 };
+    for (size_t i = 0; i < count; i++) {
+      int usable = (int) i < order ? (int) i : order;
+      int64_t value = predict(previous, usable) + unzigzag(residuals.get(in));
+      uint64_t correction = (uint64_t) unzigzag(corrections.get(in));
+      values[i * COLUMNS] = fromBits(bitsOf((double) value / power) + correction);
+      memmove(previous + 1, previous, (MAX_ORDER - 1) * sizeof(int64_t));
+      previous[0] = value;
+    }
+  }
+
+  std::vector<uint64_t> words;
+  size_t count;
+  double first;
+  double last;
+
+ public:
+
+  CompressedEpochBlock() : count(0), first(0.0), last(0.0)
+  {
+  }
+
+  /**
+   * Pack count epochs, in time order. Replaces whatever was in here.
+   */
+
+  void encode(const double *times, const EphemerisLine *lines, size_t count)
+  {
+    words.clear();
+    this->count = count;
+    if (count == 0) {
+      return;
+    }
+    first = times[0];
+    last = times[count - 1];
+    std::vector<double> column(count);
+    BitWriter out(words);
+    encodeColumn(out, times, count);
+    const double *raw = (const double *) lines;
+    for (int c = 1; c < COLUMNS; c++) {
+      for (size_t i = 0; i < count; i++) {
+        column[i] = raw[i * (COLUMNS - 1) + c - 1];
+      }
+      encodeColumn(out, &column[0], count);
+    }
+    std::vector<uint64_t>(words).swap(words); // No spare capacity
+  }
+
+  /**
+   * Unpack onto the end of an index. Everything in here has to come
+   * after what's already in it.
+   */
+
+  void decode(EpochIndex<EphemerisLine> &into) const
+  {
+    if (count == 0) {
+      return;
+    }
+    std::vector<double> table(count * COLUMNS);
+    BitReader in(&words[0]);
+    for (int c = 0; c < COLUMNS; c++) {
+      decodeColumn(in, &table[c], count);
+    }
+    into.reserve(into.size() + count);
+    EphemerisLine line(0, 0, 0, 0, 0, 0);
+    for (size_t i = 0; i < count; i++) {
+      memcpy((void *) &line, &table[i * COLUMNS + 1], sizeof(line));
+      into.add(table[i * COLUMNS], line);
+    }
+  }
+
+  size_t size() const
+  {
+    return count;
+  }
+
+  bool empty() const
+  {
+    return count == 0;
+  }
+
+  /**
+   * The first and last times in the block
+   */
+
+  double begin() const
+  {
+    return first;
+  }
+
+  double end() const
+  {
+    return last;
+  }
+
+  /**
+   * About how much memory it takes, all told
+   */
+
+  size_t bytes() const
+  {
+    return sizeof(*this) + words.capacity() * sizeof(uint64_t);
+  }
+
+};
+
+#endif
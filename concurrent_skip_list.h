@@ -0,0 +1,446 @@
+/**
+ * ConcurrentSkipList is an ordered map any number of threads can use
+ * at once. It has find, floor and ceil like Btree, plus add and
+ * remove.
+ *
+ * It's a lazy skip list (Herlihy, Lev, Luchangco and Shavit). Lookups
+ * take no locks at all, they just walk the lists. Adds and removes
+ * lock only the handful of nodes around the one they're changing, so
+ * adds in different parts of the list don't get in each other's way.
+ * A node is in the map from when it's linked into the bottom list
+ * until it's marked for removal.
+ *
+ * A removed node can't be freed right away, because a reader might
+ * be standing on it. It goes to an EpochReclaimer, which frees it
+ * once every thread that was reading at the time has finished.
+ *
+ * ConcurrentTimeTree is the same thing with a find that works like
+ * TimeTree's.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _H_CONCURRENT_SKIP_LIST
+#define _H_CONCURRENT_SKIP_LIST
+
+#include "epoch_reclaimer.h"
+#include <boost/atomic.hpp>
+#include <boost/thread/thread.hpp>
+#include <new>
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+template <typename KeyType, typename ValType>
+class ConcurrentSkipList {
+ public:
+  /**
+   * Each level up has a quarter as many nodes, so 16 levels is plenty
+   * for 4 billion of them.
+   */
+
+  enum { MAX_LEVELS = 16 };
+
+ protected:
+  struct Node;
+  typedef boost::atomic<Node *> Link;
+
+  struct Node {
+    KeyType key;
+    ValType val;
+    int top; // Highest level it's in
+    boost::atomic<bool> locked;
+    boost::atomic<bool> marked;      // Removed, or being removed
+    boost::atomic<bool> fullyLinked; // In every level it's going in
+    Link next[1];                    // top + 1 of them really
+
+    Node(const KeyType &key, const ValType &val, int top) : key(key), val(val), top(top), locked(false), marked(false), fullyLinked(false)
+    {
+    }
+
+    void lock()
+    {
+      while (locked.exchange(true, boost::memory_order_acquire)) {
+        boost::this_thread::yield();
+      }
+    }
+
+    void unlock()
+    {
+      locked.store(false, boost::memory_order_release);
+    }
+  };
+
+  Node *head; // Holds no key, comes before everything
+  boost::atomic<size_t> count;
+  boost::atomic<uint64_t> seed;
+  EpochReclaimer reclaimer;
+
+  // Not copyable
+  ConcurrentSkipList(const ConcurrentSkipList &);
+  ConcurrentSkipList &operator=(const ConcurrentSkipList &);
+
+  static Node *newNode(const KeyType &key, const ValType &val, int top)
+  {
+    void *memory = ::operator new(sizeof(Node) + top * sizeof(Link));
+    Node *node = new (memory) Node(key, val, top);
+    for (int level = 1; level <= top; level++) {
+      new (&node->next[level]) Link((Node *) NULL);
+    }
+    node->next[0].store((Node *) NULL);
+    return node;
+  }
+
+  static void destroyNode(void *memory)
+  {
+    Node *node = (Node *) memory;
+    node->~Node();
+    ::operator delete(memory);
+  }
+
+  /**
+   * How high a new node goes: each level up is a 1 in 4 chance. Every
+   * thread just takes the next number off the same counter and
+   * scrambles it (splitmix64) so nobody needs a lock for it.
+   */
+
+  int randomLevel()
+  {
+    uint64_t x = seed.fetch_add(0x9e3779b97f4a7c15ULL, boost::memory_order_relaxed);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    int level = 0;
+    while (level < MAX_LEVELS - 1 && (x & 3) == 0) {
+      level++;
+      x >>= 2;
+    }
+    return level;
+  }
+
+  /**
+   * Fill in the last node before key and the first one at or after
+   * it on every level, and return the highest level key itself was
+   * found on, or -1.
+   */
+
+  int search(const KeyType &key, Node **preds, Node **succs) const
+  {
+    int found = -1;
+    Node *pred = head;
+    for (int level = MAX_LEVELS - 1; level >= 0; level--) {
+      Node *curr = pred->next[level].load(boost::memory_order_acquire);
+      while (curr && curr->key < key) {
+        pred = curr;
+        curr = pred->next[level].load(boost::memory_order_acquire);
+      }
+      if (found == -1 && curr && !(key < curr->key)) {
+        found = level;
+      }
+      preds[level] = pred;
+      succs[level] = curr;
+    }
+    return found;
+  }
+
+  /**
+   * The last node before key on the bottom level, and the one after
+   * it. Only ever goes forward.
+   */
+
+  Node *bottom(const KeyType &key, Node **after) const
+  {
+    Node *pred = head;
+    Node *curr = (Node *) NULL;
+    for (int level = MAX_LEVELS - 1; level >= 0; level--) {
+      curr = pred->next[level].load(boost::memory_order_acquire);
+      while (curr && curr->key < key) {
+        pred = curr;
+        curr = pred->next[level].load(boost::memory_order_acquire);
+      }
+    }
+    *after = curr;
+    return pred;
+  }
+
+  static void unlockAll(Node **preds, int highest)
+  {
+    Node *previous = (Node *) NULL;
+    for (int level = 0; level <= highest; level++) {
+      if (preds[level] != previous) {
+        preds[level]->unlock();
+        previous = preds[level];
+      }
+    }
+  }
+
+  bool present(const Node *node) const
+  {
+    return node && !node->marked.load(boost::memory_order_acquire);
+  }
+
+ public:
+  ValType NOT_FOUND;
+
+  /**
+   * Create with the value to be used as "NOT_FOUND"
+   */
+
+  ConcurrentSkipList(ValType nf) : count(0), seed(0), NOT_FOUND(nf)
+  {
+    head = newNode(KeyType(), nf, MAX_LEVELS - 1);
+    head->fullyLinked.store(true);
+  }
+
+  /**
+   * Nobody else can be using it by now
+   */
+
+  virtual ~ConcurrentSkipList()
+  {
+    Node *node = head;
+    while (node) {
+      Node *next = node->next[0].load();
+      destroyNode(node);
+      node = next;
+    }
+  }
+
+  /**
+   * Put key in. Throws if it's already there, like Btree.
+   */
+
+  void add(KeyType key, ValType val) throw(std::string)
+  {
+    EpochReclaimer::Guard guard(reclaimer);
+    int top = randomLevel();
+    Node *preds[MAX_LEVELS];
+    Node *succs[MAX_LEVELS];
+    while (true) {
+      int found = search(key, preds, succs);
+      if (found != -1) {
+        Node *there = succs[found];
+        if (!there->marked.load(boost::memory_order_acquire)) {
+          throw std::string("Attempt to add the same value to the skip list twice.");
+        }
+        // It's on its way out, wait for it to go
+        boost::this_thread::yield();
+        continue;
+      }
+
+      // Lock everything that's going to point at the new node, and
+      // make sure nothing changed while we weren't looking
+      int highest = -1;
+      bool valid = true;
+      Node *previous = (Node *) NULL;
+      for (int level = 0; valid && level <= top; level++) {
+        Node *pred = preds[level];
+        Node *succ = succs[level];
+        if (pred != previous) {
+          pred->lock();
+          highest = level;
+          previous = pred;
+        }
+        valid = !pred->marked.load() && (!succ || !succ->marked.load()) && pred->next[level].load() == succ;
+      }
+      if (!valid) {
+        unlockAll(preds, highest);
+        continue;
+      }
+
+      Node *node = newNode(key, val, top);
+      for (int level = 0; level <= top; level++) {
+        node->next[level].store(succs[level], boost::memory_order_relaxed);
+      }
+      for (int level = 0; level <= top; level++) {
+        preds[level]->next[level].store(node, boost::memory_order_release);
+      }
+      node->fullyLinked.store(true, boost::memory_order_release);
+      unlockAll(preds, highest);
+      count.fetch_add(1);
+      return;
+    }
+  }
+
+  /**
+   * Take key out, and hand back its value (or NOT_FOUND)
+   */
+
+  ValType remove(KeyType key)
+  {
+    EpochReclaimer::Guard guard(reclaimer);
+    Node *victim = (Node *) NULL;
+    bool isMarked = false;
+    int top = -1;
+    Node *preds[MAX_LEVELS];
+    Node *succs[MAX_LEVELS];
+    while (true) {
+      int found = search(key, preds, succs);
+      if (!isMarked) {
+        if (found == -1) {
+          return NOT_FOUND;
+        }
+        victim = succs[found];
+        // Only take it out once it's all the way in, and from the
+        // level it goes up to, so every level gets unlinked
+        if (!victim->fullyLinked.load(boost::memory_order_acquire) || victim->top != found) {
+          if (victim->marked.load()) {
+            return NOT_FOUND;
+          }
+          boost::this_thread::yield();
+          continue;
+        }
+        top = victim->top;
+        victim->lock();
+        if (victim->marked.load()) {
+          victim->unlock();
+          return NOT_FOUND;
+        }
+        victim->marked.store(true, boost::memory_order_release);
+        isMarked = true;
+      }
+
+      int highest = -1;
+      bool valid = true;
+      Node *previous = (Node *) NULL;
+      for (int level = 0; valid && level <= top; level++) {
+        Node *pred = preds[level];
+        if (pred != previous) {
+          pred->lock();
+          highest = level;
+          previous = pred;
+        }
+        valid = !pred->marked.load() && pred->next[level].load() == victim;
+      }
+      if (!valid) {
+        unlockAll(preds, highest);
+        continue;
+      }
+
+      for (int level = top; level >= 0; level--) {
+        preds[level]->next[level].store(victim->next[level].load(), boost::memory_order_release);
+      }
+      ValType removed = victim->val;
+      victim->unlock();
+      unlockAll(preds, highest);
+      count.fetch_sub(1);
+      reclaimer.retire(victim, &destroyNode);
+      return removed;
+    }
+  }
+
+  /**
+   * The value for key, or NOT_FOUND
+   */
+
+  ValType find(KeyType key)
+  {
+    EpochReclaimer::Guard guard(reclaimer);
+    Node *after;
+    bottom(key, &after);
+    if (present(after) && !(key < after->key)) {
+      return after->val;
+    }
+    return NOT_FOUND;
+  }
+
+  /**
+   * The value for the biggest key that isn't more than key, or
+   * NOT_FOUND if they're all bigger. If the one before key is in the
+   * middle of being removed, it waits for that to finish and looks
+   * again, since whatever's before that one is what it wants.
+   */
+
+  ValType floor(KeyType key)
+  {
+    EpochReclaimer::Guard guard(reclaimer);
+    while (true) {
+      Node *after;
+      Node *before = bottom(key, &after);
+      if (present(after) && !(key < after->key)) {
+        return after->val;
+      }
+      if (before == head) {
+        return NOT_FOUND;
+      }
+      if (present(before)) {
+        return before->val;
+      }
+      boost::this_thread::yield();
+    }
+  }
+
+  /**
+   * The value for the smallest key that isn't less than key, or
+   * NOT_FOUND if they're all smaller
+   */
+
+  ValType ceil(KeyType key)
+  {
+    EpochReclaimer::Guard guard(reclaimer);
+    Node *after;
+    bottom(key, &after);
+    while (after && !present(after)) {
+      after = after->next[0].load(boost::memory_order_acquire);
+    }
+    return after ? after->val : NOT_FOUND;
+  }
+
+  /**
+   * How many keys are in it. With other threads adding and removing,
+   * that's only a rough idea.
+   */
+
+  size_t size() const
+  {
+    return count.load();
+  }
+
+  /**
+   * Free whatever removed nodes nobody's looking at any more. It
+   * happens on its own every so often, too.
+   */
+
+  void reclaim()
+  {
+    reclaimer.reclaim();
+  }
+
+  size_t pendingReclaim()
+  {
+    return reclaimer.pending();
+  }
+
+};
+
+/**
+ * A ConcurrentSkipList whose find gets the value for the closest key
+ * at or before the one asked for, like TimeTree's.
+ */
+
+template <typename KeyType, typename ValType>
+class ConcurrentTimeTree : public ConcurrentSkipList<KeyType, ValType> {
+ public:
+  ConcurrentTimeTree(ValType nf) : ConcurrentSkipList<KeyType, ValType>(nf)
+  {
+  }
+
+  ValType find(KeyType key)
+  {
+    return this->floor(key);
+  }
+
+};
+
+#endif
@@ -55,14 +55,22 @@ class Ecef {
 
  Ecef(const Ecef &toCopy) : x(toCopy.x), y(toCopy.y), z(toCopy.z) {}
 
+  Ecef &operator=(const Ecef &toCopy)
+  {
+    x = toCopy.x;
+    y = toCopy.y;
+    z = toCopy.z;
+    return *this;
+  }
+
   Ecef(LatlongInterface &ll, double ae = 6378137.0, double ee=0.00669437999014)
     {
-      double pi = atan2(1,1) * 4;
+      const double pi = 3.14159265358979323846; // Same as atan2(1,1) * 4, without the atan2
       double slat = sin(ll.getLat() * pi / 180);
       double clat = cos(ll.getLat() * pi / 180);
       double slon = sin(ll.getLong() * pi / 180);
       double clon = cos(ll.getLong() * pi / 180);
-      double n = ae / sqrt(1.0 - ee * pow(slat, 2));
+      double n = ae / sqrt(1.0 - ee * (slat * slat));
       x = (n + ll.getAlt()) * clat * clon;
       y = (n + ll.getAlt()) * clat * slon;
       z = (n * (1.0 - ee) + ll.getAlt()) * slat;
@@ -99,9 +107,15 @@ class Latlong : public LatlongInterface {
 
   }
 
+  /**
+   * Converts one point, iterating until it's within tolerance. If
+   * you've got a lot of them, GeodeticBatch (geodetic.h) does whole
+   * arrays at once and is a lot faster.
+   */
+
   Latlong(Ecef &xyz, double ae = 6378137.0, double ee = 0.00669437999014, double tolerance = 0.0000000001)
     {
-      double pi = atan2(1.0, 1.0) * 4;
+      const double pi = 3.14159265358979323846;
       double diff = 2 * tolerance;
       double t = ee * xyz.getZ();
       double n = 0.0;
@@ -111,7 +125,7 @@ class Latlong : public LatlongInterface {
       longitude = atan2(xyz.getY(), xyz.getX()) * 180 / pi;
       while(diff > tolerance) {
         double zT = xyz.getZ() + t;
-        nph = sqrt(pow(xyz.getX(), 2) + pow(xyz.getY(), 2) + pow(zT, 2));
+        nph = sqrt(xyz.getX() * xyz.getX() + xyz.getY() * xyz.getY() + zT * zT);
         sinPhi = zT / nph;
         n = ae / sqrt(1 - ee * sinPhi * sinPhi);
         double told = t;
@@ -4,7 +4,8 @@
  * To run:
  * 1) Snag the latest ephemeris file from http://earth-info.nga.mil/GandG/sathtml/PEexe.html
  * 2) Use lharc (lha -e) to extract it
- * 3) Run ./demo FILENAME.eph
+ * 3) Run ./demo FILENAME.eph (or several files, or a directory of them,
+ *    or a snapshot made with sp3_ingest)
  * 4) Fire up google earth and load demo.kml
  * 5) Double click on a satellite
  *
@@ -59,22 +60,57 @@ AppContext *DemoHandler::context = new AppContext();
 int main(int argc, char *argv[])
 {
 
-  if (argc != 2) {
-    std::cout << "usage: demo filename" << std::endl;
-    std::cout << "Filename is a SP3-format ephemeris file." << std::endl;
+  if (argc < 2) {
+    std::cout << "usage: demo filename|directory [filename|directory...]" << std::endl;
+    std::cout << "Files are SP3-format ephemeris files. Directories get all" << std::endl;
+    std::cout << "their files read. If files overlap, the later one wins." << std::endl;
+    std::cout << "The first snapshot file from sp3_ingest gets mapped, not read," << std::endl;
+    std::cout << "later ones get merged into it, and the SP3 files go on top." << std::endl;
   } else {
     DemoHandler::context->cache = new EphemerisCache();
-    EphemerisCacheBuilder listener(DemoHandler::context->cache);
-    EphemerisLineBuilder builder;
-    builder.registerListener(&listener);
-    Sp3Reader reader(argv[1], &builder);
-    std::cout << "Reading ephemeris file " << argv[1] << "...";
-    reader.read();
-    std::cout << " done." << std::endl << "Setting up server..." << std::endl;
-    SocketServer<DemoHandler> server(12345);
-    boost::thread *serverThread = server.start();
-    std::cout << "done. Ready for connections." << std::endl;
-    serverThread->join();
+    Sp3Loader loader;
+    bool mapped = false;
+    for (int i = 1; i < argc; i++) {
+      if (EphemerisSnapshot::isSnapshot(argv[i])) {
+        try {
+          // Only the first one can be mapped; mapping another would
+          // throw away the satellites they share.
+          if (!mapped) {
+            DemoHandler::context->cache->mapSnapshot(argv[i]);
+            mapped = true;
+            std::cout << "Mapped snapshot " << argv[i] << std::endl;
+          } else {
+            DemoHandler::context->cache->mergeSnapshot(argv[i]);
+            std::cout << "Merged snapshot " << argv[i] << std::endl;
+          }
+        } catch (std::string &error) {
+          std::cout << error << std::endl;
+        }
+      } else if (!loader.addPath(argv[i])) {
+        std::cout << "Can't find " << argv[i] << std::endl;
+      }
+    }
+    if (loader.fileCount() > 0) {
+      std::cout << "Reading " << loader.fileCount() << " ephemeris files...";
+      std::cout.flush();
+      size_t loaded = loader.load(*DemoHandler::context->cache);
+      std::cout << " done. " << loaded << " records, " << loader.duplicateCount() << " duplicates, ";
+      std::cout << loader.failedCount() << " unreadable files." << std::endl;
+    }
+    std::cout << "Setting up server..." << std::endl;
+    DemoHandler::context->snapshots = new KmlSnapshotCache(DemoHandler::context->cache);
+    DemoHandler::context->snapshots->start();
+    DemoHandler::context->tracks = new KmlTrackPool(DemoHandler::context->cache);
+    DemoHandler::context->tracks->start();
+    {
+      // Handlers go when the server does, and they need the track pool
+      EpollServer<DemoHandler> server(12345);
+      server.start();
+      std::cout << "done. Ready for connections." << std::endl;
+      server.join();
+    }
+    delete DemoHandler::context->tracks;
+    delete DemoHandler::context->snapshots;
     delete DemoHandler::context->cache;
     delete DemoHandler::context;
   }
@@ -18,99 +18,272 @@
 #ifndef _H_DEMO
 #define _H_DEMO
 
-#include "ephemeris_line_builder.h"
 #include "ephemeris_cache.h"
+#include "orbit_interpolator.h"
 #include "coordinates.h"
-#include "sp3_reader.h"
-#include "socket_server.h"
-#include <boost/date_time/posix_time/posix_time.hpp>
+#include "sp3_mapped_reader.h"
+#include "sp3_loader.h"
+#include "epoll_server.h"
+#include "http_request.h"
+#include "kml_snapshot_cache.h"
+#include "kml_track_pool.h"
 #include <iostream>
-#include <sstream>
 #include <vector>
 #include <string>
-#include <iomanip>
-#include <ext/stdio_filebuf.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
-class EphemerisCacheBuilder : public EphemerisBuilderListener {
-  EphemerisCache *target;
+struct AppContext {
+  EphemerisCache *cache;
+  KmlSnapshotCache *snapshots;
+  KmlTrackPool *tracks;
+};
+
+/**
+ * Serves up KML for all the satellites to anyone who asks. Runs on
+ * an EpollServer loop, so it answers from what it's been handed
+ * instead of reading the socket itself.
+ *
+ * A plain GET gets the prerendered snapshot for *NOW* - 2 days. Query
+ * parameters ask for something more particular, rendered just for
+ * that request:
+ *
+ *   t=       when, in seconds since 1970 or like 2011-10-01T00:00:00Z
+ *   sats=    which satellites, comma separated
+ *   BBOX=    west,south,east,north in degrees, the way google earth's
+ *            viewFormat sends it; only satellites over that box
+ *   format=  kml (the default) or csv
+ *
+ * /track?begin=...&end=...&step=... gets every satellite's track
+ * over that range instead, for google earth's time slider. begin
+ * and end are times like t, and step is in seconds. The tracks get
+ * rendered by the KmlTrackPool's threads and streamed out as they're
+ * done.
+ *
+ * Anything it can't make sense of gets a 400 saying why.
+ */
+
+class DemoHandler : public KmlTrackListener {
+  EpollServer<DemoHandler> *owner;
+  int fdes;
+  HttpRequest request;
+  KmlSnapshotCache::SnapshotPtr sending;
+  // For answers that are just for this connection
+  KmlSelection selection;
+  KmlWriter writer;
+  OrbitInterpolator interpolator;
+  KmlTrackPool::TrackPtr track;
+  KmlTrackPool::Chunk chunk;
+  bool trackKeepAlive;
+  std::string error;
+
+  enum { MAX_SATELLITES = 64 };
+
+ public:
+  static AppContext *context;
 
-public:
-  EphemerisCacheBuilder(EphemerisCache *target) : target(target)
+  DemoHandler(EpollServer<DemoHandler> *owner, int fdes) : owner(owner), fdes(fdes), trackKeepAlive(false)
   {
   }
-  
-  void notify(EphemerisLine &data, std::string &satelliteName)
+
+  ~DemoHandler()
   {
-    target->add(satelliteName, new EphemerisLine(data));
+    if (track) {
+      context->tracks->cancel(track);
+    }
   }
 
-};
+  /**
+   * Wait for a whole request, then answer it. HTTP/1.1 clients keep the
+   * connection open for their next poll unless they say
+   * "Connection: close"; HTTP/1.0 ones get hung up on unless they
+   * say "Connection: keep-alive". Requests that come in behind it
+   * wait until the answer's gone.
+   */
 
-struct AppContext {
-  EphemerisCache *cache;
-};
+  size_t received(const char *data, size_t length, EpollOutput &out)
+  {
+    // An answer is still going out, so the next request waits until it's sent
+    if (out.pending() > 0 || track) {
+      return 0;
+    }
+    sending.reset();
+    HttpRequest::Status status = request.parse(data, length);
+    if (status == HttpRequest::INCOMPLETE) {
+      return 0;
+    }
+    if (status == HttpRequest::BAD) {
+      // No telling where the next request would start, so that's it
+      badRequest(request.error(), false, out);
+      request.reset();
+      return length;
+    }
+    size_t used = request.size();
+    bool keepAlive = request.keepAlive();
+    if (request.method() != "GET") {
+      badRequest("only GET is supported", keepAlive, out);
+    } else if (request.path() == "/track") {
+      startTrack(keepAlive, out);
+    } else if (request.has("t") || request.has("sats") || request.has("BBOX") || request.has("format")) {
+      sendSelection(keepAlive, out);
+    } else {
+      sendSnapshot(keepAlive, out);
+    }
+    request.reset();
+    return used;
+  }
 
-class DemoHandler {
-  SocketServer<DemoHandler> *owner;
-  int fdes;
-  std::string buffer;
- public:
-  static AppContext *context;
+  /**
+   * Everybody polling gets the same prerendered snapshot, and
+   * holding on to it keeps it around until it's been sent
+   */
 
-  DemoHandler(SocketServer<DemoHandler> *owner, int fdes) : owner(owner), fdes(fdes)
+  void sendSnapshot(bool keepAlive, EpollOutput &out)
   {
+    sending = context->snapshots->current();
+    const std::string &header = sending->header(keepAlive);
+    out.reference(header.data(), header.size());
+    if (sending->fileDescriptor() >= 0) {
+      out.sendFile(sending->fileDescriptor(), 0, sending->size());
+    } else {
+      out.reference(sending->body(), sending->size());
+    }
+    if (!keepAlive) {
+      out.closeWhenDone();
+    }
   }
 
-  void operator()()
+  /**
+   * Render what the query asks for. The writer isn't touched again
+   * until it's been sent, since the next request waits for that.
+   */
+
+  void sendSelection(bool keepAlive, EpollOutput &out)
   {
-    std::string buffer;
-    __gnu_cxx::stdio_filebuf<char> buf_in(fdes, std::ios_base::in, 1);
-    __gnu_cxx::stdio_filebuf<char> buf_out(fdes, std::ios_base::out, 1);
-    std::istream stream_in(&buf_in);
-    std::ostream stream_out(&buf_out);
-    getline(stream_in, buffer); // http get line from google earth
-    std::vector<std::string> satelliteNames;
-    context->cache->satelliteNames(satelliteNames);
-    std::vector<std::string>::iterator name = satelliteNames.begin();
-    stream_out << "HTTP/1.0 200 OK" << std::endl;
-    stream_out << "Content-Type: application/vnd.google-earth.kml+xml" << std::endl << std::endl;
-
-    stream_out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>" << std::endl;
-    stream_out << "<kml xmlns=\"http://www.opengis.net/kml/2.2\">" << std::endl;
-    stream_out << "<Document>" << std::endl;
-
-    time_t now = time((time_t) NULL);
-    now -= (2*86400);
-    while(name != satelliteNames.end()) {
-      EphemerisLine *current = context->cache->get(*name, (double) now);
-      if (NULL == current) {
-        stream_out << "No Records Found" << std::endl;
-        break;
-     } else {
-        stream_out << std::setprecision(18);
-        Latlong ll(current->getPosition()); // Convert from ECEF for Google Earth
-        
-        stream_out << "<Placemark>" << std::endl;
-        stream_out << "   <name>" << *name << "</name>" << std::endl;
-        stream_out << "   <description>GPS Satellite</description>" << std::endl;
-        stream_out << "   <Point>" << std::endl;
-        stream_out << "      <extrude>1</extrude>" << std::endl;
-        stream_out << "      <altitudeMode>relativeToGround</altitudeMode>" << std::endl;
-        stream_out << "      <coordinates>" << ll.getLat() << ",";
-        stream_out << ll.getLong() << "," << ll.getAlt();
-        stream_out << "</coordinates>" << std::endl;
-        stream_out << "   </Point>" << std::endl;
-        stream_out << "</Placemark>" << std::endl;
-        name++;
+    HttpRequest::Slice format;
+    selection.csv = false;
+    if (request.parameter("format", format)) {
+      if (format == "csv") {
+        selection.csv = true;
+      } else if (format != "kml") {
+        badRequest("format has to be kml or csv", keepAlive, out);
+        return;
       }
     }
+    selection.time = context->snapshots->now();
+    if (request.has("t") && !request.time("t", selection.time)) {
+      badRequest("t has to be seconds since 1970 or a time like 2011-10-01T00:00:00Z", keepAlive, out);
+      return;
+    }
+    HttpRequest::Slice sats[MAX_SATELLITES];
+    size_t count = request.list("sats", sats, MAX_SATELLITES);
+    if (count > MAX_SATELLITES || (count == 0 && request.has("sats"))) {
+      badRequest("sats has to be a list of up to 64 satellites", keepAlive, out);
+      return;
+    }
+    selection.names.resize(count);
+    for (size_t i = 0; i < count; i++) {
+      selection.names[i].assign(sats[i].data, sats[i].length);
+    }
+    selection.boxed = request.has("BBOX");
+    if (selection.boxed && !request.box("BBOX", selection.west, selection.south, selection.east, selection.north)) {
+      badRequest("BBOX has to be west,south,east,north in degrees", keepAlive, out);
+      return;
+    }
+
+    context->snapshots->write(selection, writer, interpolator);
+    writer.httpHeader(keepAlive, selection.csv);
+    out.reference(writer.headerData(), writer.headerSize());
+    out.reference(writer.data(), writer.size());
+    if (!keepAlive) {
+      out.closeWhenDone();
+    }
+  }
+
+  /**
+   * Start the tracks the query asks for going out, or say what's
+   * wrong with it. HTTP/1.0 clients don't understand chunks, so they
+   * get the document as-is and hung up on at the end.
+   */
+
+  void startTrack(bool keepAlive, EpollOutput &out)
+  {
+    double begin = NAN, end = NAN, step = NAN;
+    if ((request.has("begin") && !request.time("begin", begin)) ||
+        (request.has("end") && !request.time("end", end))) {
+      badRequest("begin and end have to be seconds since 1970 or times like 2011-10-01T00:00:00Z", keepAlive, out);
+      return;
+    }
+    request.number("step", step);
+    size_t points;
+    std::string problem = KmlTrackPool::check(begin, end, step, points);
+    if (!problem.empty()) {
+      badRequest(problem.c_str(), keepAlive, out);
+      return;
+    }
+    bool chunked = request.http11();
+    trackKeepAlive = keepAlive && chunked;
+    track = context->tracks->submit(begin, end, step, chunked, trackKeepAlive, this);
+    // An HTTP/1.0 client may shut its side once it's asked
+    out.expectMore();
+  }
 
-    stream_out << "</Document>" << std::endl;
-    stream_out << "</kml>" << std::endl << std::endl;
-    stream_out.flush();
-    boost::this_thread::sleep(boost::posix_time::seconds(3));
-    close(fdes);
+  /**
+   * 400, with why in the body
+   */
+
+  void badRequest(const char *problem, bool keepAlive, EpollOutput &out)
+  {
+    char length[32];
+    snprintf(length, sizeof(length), "%lu", (unsigned long) (strlen(problem) + 1));
+    error = "HTTP/1.1 400 Bad Request\r\n"
+      "Content-Type: text/plain\r\n"
+      "Content-Length: ";
+    error += length;
+    error += keepAlive ? "\r\nConnection: keep-alive\r\n\r\n" : "\r\nConnection: close\r\n\r\n";
+    error += problem;
+    error += "\n";
+    out.reference(error.data(), error.size());
+    if (!keepAlive) {
+      out.closeWhenDone();
+    }
+  }
+
+  /**
+   * Send the next piece of track, if there's one ready. Once it's
+   * all gone, the next request can go.
+   */
+
+  bool writable(EpollOutput &out)
+  {
+    if (!track) {
+      return false;
+    }
+    // Whatever we sent last time is gone now
+    chunk.reset();
+    bool finished;
+    if (context->tracks->take(track, chunk, finished)) {
+      out.reference(chunk->data(), chunk->size());
+      return true;
+    }
+    if (finished) {
+      track.reset();
+      out.expectMore(false);
+      if (!trackKeepAlive) {
+        out.closeWhenDone();
+      }
+    }
+    return false;
+  }
+
+  /**
+   * From a KmlTrackPool thread, so just get the loop to call writable
+   */
+
+  void trackReady()
+  {
+    owner->resume(fdes);
   }
 
 };
@@ -1,8 +1,36 @@
 /**
  * This object caches ephemeris lines and can be called upon to
- * retrieve them for a given time. This object will delete
- * ephemeris lines put into it when it is deleted, so there's 
- * no need to track that yourself.
+ * retrieve them for a given time. This object takes ownership of
+ * ephemeris lines put into it, so there's no need to track
+ * that yourself.
+ *
+ * It's safe to read from any number of threads while one or more
+ * threads add to it. Readers never lock: each satellite's data is
+ * published as a read-only snapshot, and adding to a satellite
+ * publishes a new snapshot with an atomic pointer swap. Appends go
+ * onto the end of the arrays the old snapshot is looking at (it
+ * can't see them) and only when the arrays fill up, or something
+ * gets inserted in the middle, do they get copied. Old snapshots are
+ * freed once every reader thread has moved on from them (see
+ * epoch_reclaimer.h.)
+ *
+ * That means a line you get back stays put until the SAME thread
+ * calls into the cache again, no matter what other threads do.
+ *
+ * A cache can also serve satellites straight out of a snapshot file
+ * (see ephemeris_snapshot.h) with mapSnapshot. Their snapshots just
+ * point into the mapping. The first time one of them gets added to,
+ * its arrays get copied out of the file and it carries on like any
+ * other satellite. saveSnapshot writes one.
+ *
+ * Old data can go in a compressed cold tier to save memory (see
+ * compressBefore.) Each satellite's epochs before a given time get
+ * packed a day to a CompressedEpochBlock, at about a sixth the size.
+ * The cold tier gets published along with the rest of the snapshot,
+ * so lookups in that range don't wait on writers either. They unpack
+ * the block they need into a small LRU of recently used days (which
+ * has a lock of its own) and work from that, so the first lookup in
+ * a day is slow and the rest aren't much slower than usual.
  *
  * Copyright 2011 Bruce Ide
  * Licensed under the Apache License, Version 2.0 (the "License");
@@ -21,141 +49,1066 @@
 #ifndef _H_EPHEMERIS_CACHE
 #define _H_EPHEMERIS_CACHE
 
+#include "compressed_epoch_block.h"
 #include "coordinates.h"
 #include "ephemeris_line.h"
+#include "ephemeris_snapshot.h"
+#include "epoch_index.h"
+#include "epoch_reclaimer.h"
+#include "orbit_interpolator.h"
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <list>
 #include <map>
 #include <string>
 #include <time.h>
 #include <iostream>
 #include <vector>
-#include "time_tree.h"
 
 
 class EphemerisCache {
 
-  class SatelliteTreeDeallocator {
-  public:
+  /**
+   * Each satellite's lines are stored by value in an EpochIndex, one
+   * contiguous array per satellite, so a lookup is a search over an
+   * array of times and one step over to the line. Only writers
+   * touch the index itself.
+   */
+
+  typedef EpochIndex<EphemerisLine> SatelliteIndex;
+
+  /**
+   * What readers get to see of a satellite: the first count entries
+   * of its arrays, and their spacing as of when it was published.
+   * cold is the cold tier, with the older epochs in it (everything
+   * before times[0], or everything if count is 0), or NULL if there
+   * aren't any. Never changes once it's published.
+   */
 
-    void operator()(EphemerisLine *value) { delete value;}
+  struct ColdTier;
 
+  struct SatelliteSnapshot {
+    const double *times;
+    EphemerisLine *lines;
+    size_t count;
+    double step;
+    bool regular;
+    const ColdTier *cold;
   };
-  
-  
-  typedef TimeTree<double, EphemerisLine *, SatelliteTreeDeallocator> SatelliteTree;
-  typedef std::map<std::string, SatelliteTree *> SatelliteMap;
-  typedef std::map<std::string, double> IntervalMap;
-  SatelliteMap satellites;
+
+  enum { DAY = 86400, COLD_CACHE_BLOCKS = 64 };
+
   /**
-   * intervals tracks coordinate intervals. If you request a time
-   * later than the latest coordinate + the interval for that satellite,
-   * "not found" should be returned.
+   * A day of one satellite's epochs in the cold tier. The id is what
+   * the LRU knows it by, and is never used twice, so a block that's
+   * been replaced can't be mistaken for the new one.
    */
-  IntervalMap intervals; 
+
+  struct ColdBlock {
+    unsigned long id;
+    CompressedEpochBlock block;
+
+    ColdBlock() : id(nextBlockId())
+    {
+    }
+  };
+
+  typedef std::vector<const ColdBlock *> ColdBlocks;
 
   /**
-   * (re)calculates the average data interval of your ephemeris points.
-   * This is really only to provide "not found" points past the end
-   * of the file, but I guess that's fairly useful information. I
-   * could add a flag to not do this if I don't query that space
-   * that often. Will have to see...
+   * A satellite's cold blocks, oldest day first, with count epochs in
+   * them. Like a snapshot, it never changes once it's published;
+   * writers change a copy and publish that (see setCold.) The blocks
+   * belong to the satellite, not to this.
    */
 
-  double calcInterval(const std::string &satellite) {
-    SatelliteMap::iterator iter = satellites.find(satellite);
-    double retval = 0.0;
-    if (iter != satellites.end()) {
-      double timeAccum = 0.0;
-      double lastTime = 0.0;
-      long nelems = 0;
-      SatelliteTree *tree = iter->second;
-      SatelliteTree::RangeType treeRange;
-      SatelliteTree::RangeType::iterator rangeIter;
-      tree->findRange(treeRange, tree->begin(), tree->end());
-      rangeIter = treeRange.begin();
-      while(rangeIter != treeRange.end()) {
-        if (lastTime == 0.0) {
-          lastTime = (*rangeIter)->first;
-          rangeIter++;
-          continue;
+  struct ColdTier {
+    ColdBlocks blocks;
+    size_t count;
+
+    ColdTier() : count(0)
+    {
+    }
+  };
+
+  /**
+   * A cold block that's been unpacked, in the LRU
+   */
+
+  struct HotBlock {
+    unsigned long id;
+    SatelliteIndex *epochs;
+  };
+
+  typedef std::list<HotBlock> HotBlocks;
+  typedef std::map<unsigned long, HotBlocks::iterator> HotIndex;
+
+  /**
+   * inFile means current points into a mapped snapshot file and
+   * storage is still empty. cold is the cold tier as of the last
+   * publish, or NULL.
+   */
+
+  struct Satellite {
+    boost::atomic<const SatelliteSnapshot *> current;
+    SatelliteIndex *storage;
+    bool inFile;
+    ColdTier *cold;
+
+    Satellite() : current((const SatelliteSnapshot *) NULL), storage(new SatelliteIndex()), inFile(false), cold((ColdTier *) NULL)
+    {
+    }
+
+    ~Satellite()
+    {
+      delete current.load();
+      delete storage;
+      if (cold) {
+        for (size_t i = 0; i < cold->blocks.size(); i++) {
+          delete cold->blocks[i];
         }
-        nelems++;
-        timeAccum += (*rangeIter)->first - lastTime;
-        lastTime = (*rangeIter)->first;
-        rangeIter++;
+        delete cold;
+      }
+    }
+  };
+
+  /**
+   * One run of a satellite's epochs in order: a cold block, unpacked,
+   * or the uncompressed ones
+   */
+
+  struct Segment {
+    const double *times;
+    EphemerisLine *lines;
+    size_t count;
+  };
+
+  typedef std::map<std::string, Satellite *> SatelliteMap;
+
+  static unsigned long nextBlockId()
+  {
+    static boost::atomic<unsigned long> ids(0);
+    return ++ids;
+  }
+
+  boost::atomic<const SatelliteMap *> satellites;
+  boost::mutex writeLock; // Only writers take this
+  // Snapshot files being served from. They stay mapped until the
+  // cache goes away, since old snapshots might still point into them.
+  std::vector<boost::shared_ptr<EphemerisSnapshot> > files;
+  // Cold blocks taken out of a tier since the last setCold
+  ColdBlocks dropped;
+  // Recently unpacked cold blocks, most recently used first, and
+  // where to find each one in there. Readers and writers both take
+  // hotLock to use them.
+  boost::mutex hotLock;
+  HotBlocks hotBlocks;
+  HotIndex hotIndex;
+  size_t hotBlockLimit;
+  // Old snapshots, maps and indexes wait here until no reader can
+  // still be looking at them
+  EpochReclaimer reclaimer;
+
+  // Not copyable
+  EphemerisCache(const EphemerisCache &);
+  EphemerisCache &operator=(const EphemerisCache &);
+
+  /**
+   * Tell the writers this thread is done with whatever it looked at
+   * before and is about to look at things as of now.
+   */
+
+  void pin()
+  {
+    reclaimer.repin();
+  }
+
+  const SatelliteSnapshot *snapshot(const std::string &satellite)
+  {
+    pin();
+    const SatelliteMap *current = satellites.load();
+    SatelliteMap::const_iterator sat = current->find(satellite);
+    if (sat == current->end()) {
+      return (const SatelliteSnapshot *) NULL;
+    }
+    return sat->second->current.load();
+  }
+
+  static EphemerisLine *lookup(const SatelliteSnapshot *found, double time, double interval)
+  {
+    EphemerisLine *retval = (EphemerisLine *) NULL;
+    long at = SatelliteIndex::find(found->times, found->count, found->step, found->regular, time);
+    if (at != SatelliteIndex::NOT_FOUND) {
+      retval = &found->lines[at];
+      /*
+       * Past the last data point, the last line is only good for
+       * one data interval. With a single point we don't know the
+       * interval, so it's good forever, same as it always was.
+       */
+      if (time > found->times[found->count - 1] && found->count > 1 &&
+          time > retval->getTime() + interval) {
+        retval = (EphemerisLine *) NULL;
       }
-      retval = timeAccum / (double) nelems;
-      intervals[satellite] = retval;
     }
     return retval;
   }
 
+  /**
+   * The rest of these are for writers, and expect writeLock to be
+   * held.
+   */
+
+  template <typename T> void retire(T *object)
+  {
+    reclaimer.retire((void *) object, &EpochReclaimer::destroy<T>);
+  }
+
+  void publish(Satellite *sat)
+  {
+    SatelliteSnapshot *snap = new SatelliteSnapshot;
+    bool empty = sat->storage->empty();
+    snap->times = empty ? (const double *) NULL : sat->storage->timeData();
+    snap->lines = empty ? (EphemerisLine *) NULL : sat->storage->valueData();
+    snap->count = sat->storage->size();
+    snap->step = sat->storage->getStep();
+    snap->regular = sat->storage->isRegular();
+    snap->cold = sat->cold;
+    const SatelliteSnapshot *old = sat->current.exchange(snap);
+    if (old) {
+      retire(old);
+    }
+  }
+
+  Satellite *findOrCreate(const std::string &satellite)
+  {
+    const SatelliteMap *current = satellites.load();
+    SatelliteMap::const_iterator sat = current->find(satellite);
+    if (sat != current->end()) {
+      return sat->second;
+    }
+    SatelliteMap *updated = new SatelliteMap(*current);
+    Satellite *created = new Satellite();
+    (*updated)[satellite] = created;
+    satellites.store(updated);
+    retire(current);
+    return created;
+  }
+
+  /**
+   * Copy a satellite that's being served from a file into its own
+   * storage, so it can be changed. Readers carry on with the file
+   * until the next publish.
+   */
+
+  void copyOutOfFile(Satellite *sat)
+  {
+    const SatelliteSnapshot *mapped = sat->current.load();
+    sat->storage->reserve(mapped->count * 2 + 16);
+    for (size_t i = 0; i < mapped->count; i++) {
+      sat->storage->add(mapped->times[i], mapped->lines[i]);
+    }
+    sat->inFile = false;
+  }
+
+  /**
+   * The satellite called name, or NULL
+   */
+
+  Satellite *existing(const std::string &name)
+  {
+    const SatelliteMap *current = satellites.load();
+    SatelliteMap::const_iterator sat = current->find(name);
+    return sat == current->end() ? (Satellite *) NULL : sat->second;
+  }
+
+  static long dayOf(double time)
+  {
+    return (long) ::floor(time / DAY);
+  }
+
+  /**
+   * Which of a tier's cold blocks time goes in: the last one that
+   * starts at or before it, or the first if it's before them all.
+   */
+
+  static size_t coldBlockFor(const ColdTier *cold, double time)
+  {
+    size_t low = 0;
+    size_t high = cold->blocks.size();
+    while (high - low > 1) {
+      size_t middle = (low + high) / 2;
+      if (cold->blocks[middle]->block.begin() <= time) {
+        low = middle;
+      } else {
+        high = middle;
+      }
+    }
+    return low;
+  }
+
+  /**
+   * Expects hotLock to be held. Blocks that fall off the end get
+   * retired like anything else readers might be looking at.
+   */
+
+  void trimHotBlocks()
+  {
+    while (hotBlocks.size() > hotBlockLimit) {
+      hotIndex.erase(hotBlocks.back().id);
+      retire(hotBlocks.back().epochs);
+      hotBlocks.pop_back();
+    }
+  }
+
+  /**
+   * A cold block, unpacked. Comes out of the LRU if it's there, and
+   * goes in it if it isn't. The unpacking happens without hotLock, so
+   * two readers might both unpack the same day; the second one just
+   * throws its copy away.
+   */
+
+  SatelliteIndex *unpack(const ColdBlock *cold)
+  {
+    {
+      boost::mutex::scoped_lock lock(hotLock);
+      HotIndex::iterator found = hotIndex.find(cold->id);
+      if (found != hotIndex.end()) {
+        hotBlocks.splice(hotBlocks.begin(), hotBlocks, found->second);
+        return found->second->epochs;
+      }
+    }
+    SatelliteIndex *epochs = new SatelliteIndex();
+    cold->block.decode(*epochs);
+    boost::mutex::scoped_lock lock(hotLock);
+    HotIndex::iterator found = hotIndex.find(cold->id);
+    if (found != hotIndex.end()) {
+      delete epochs;
+      hotBlocks.splice(hotBlocks.begin(), hotBlocks, found->second);
+      return found->second->epochs;
+    }
+    HotBlock hot;
+    hot.id = cold->id;
+    hot.epochs = epochs;
+    hotBlocks.push_front(hot);
+    hotIndex[hot.id] = hotBlocks.begin();
+    trimHotBlocks();
+    return epochs;
+  }
+
+  /**
+   * Drop a cold block from the LRU, when it's been replaced
+   */
+
+  void forget(unsigned long blockId)
+  {
+    boost::mutex::scoped_lock lock(hotLock);
+    HotIndex::iterator found = hotIndex.find(blockId);
+    if (found != hotIndex.end()) {
+      retire(found->second->epochs);
+      hotBlocks.erase(found->second);
+      hotIndex.erase(found);
+    }
+  }
+
+  /**
+   * A copy of a satellite's cold tier for a writer to change, and
+   * then hand to setCold
+   */
+
+  static ColdTier *draftCold(const Satellite *sat)
+  {
+    return sat->cold ? new ColdTier(*sat->cold) : new ColdTier();
+  }
+
+  /**
+   * Make draft the satellite's cold tier and publish it. Blocks that
+   * came out of the old one get retired after that, since readers
+   * could find them until then.
+   */
+
+  void setCold(Satellite *sat, ColdTier *draft)
+  {
+    if (draft->blocks.empty()) {
+      delete draft;
+      draft = (ColdTier *) NULL;
+    }
+    ColdTier *old = sat->cold;
+    sat->cold = draft;
+    publish(sat);
+    if (old) {
+      retire(old);
+    }
+    for (size_t i = 0; i < dropped.size(); i++) {
+      forget(dropped[i]->id);
+      retire(dropped[i]);
+    }
+    dropped.clear();
+  }
+
+  void packCold(ColdTier *draft, SatelliteIndex &epochs)
+  {
+    if (epochs.empty()) {
+      return;
+    }
+    ColdBlock *packed = new ColdBlock();
+    packed->block.encode(epochs.timeData(), epochs.valueData(), epochs.size());
+    draft->blocks.push_back(packed);
+    draft->count += epochs.size();
+  }
+
+  /**
+   * Replace the draft's cold block at with epochs, packed up
+   */
+
+  void repackCold(ColdTier *draft, size_t at, SatelliteIndex &epochs)
+  {
+    ColdBlock *packed = new ColdBlock();
+    packed->block.encode(epochs.timeData(), epochs.valueData(), epochs.size());
+    draft->count += epochs.size() - draft->blocks[at]->block.size();
+    dropped.push_back(draft->blocks[at]);
+    draft->blocks[at] = packed;
+  }
+
+  /**
+   * Put a line into the cold tier, by unpacking its day and packing
+   * it up again
+   */
+
+  bool storeCold(Satellite *sat, EphemerisLine &line, bool replace) throw(std::string)
+  {
+    double time = line.getTime();
+    size_t at = coldBlockFor(sat->cold, time);
+    SatelliteIndex epochs;
+    sat->cold->blocks[at]->block.decode(epochs);
+    long found = epochs.find(time);
+    bool exists = (found != SatelliteIndex::NOT_FOUND && epochs.time(found) == time);
+    if (exists && !replace) {
+      throw std::string("Attempt to add the same epoch to the cache twice.");
+    }
+    epochs.put(time, line);
+    ColdTier *draft = draftCold(sat);
+    repackCold(draft, at, epochs);
+    setCold(sat, draft);
+    return exists;
+  }
+
+  /**
+   * putAll's cold part: every epoch from first on that goes in the
+   * cold tier, a block at a time. Returns where it got up to.
+   */
+
+  size_t storeAllCold(Satellite *sat, const double *times, const EphemerisLine *lines, size_t first, size_t count, size_t &replaced)
+  {
+    size_t i = first;
+    if (!sat->cold || times[i] > sat->cold->blocks.back()->block.end()) {
+      return i;
+    }
+    ColdTier *draft = draftCold(sat);
+    double coldEnd = draft->blocks.back()->block.end();
+    while (i < count && times[i] <= coldEnd) {
+      size_t at = coldBlockFor(draft, times[i]);
+      SatelliteIndex epochs;
+      draft->blocks[at]->block.decode(epochs);
+      for (; i < count && times[i] <= coldEnd; i++) {
+        if (at + 1 < draft->blocks.size() && times[i] >= draft->blocks[at + 1]->block.begin()) {
+          break;
+        }
+        if (epochs.put(times[i], lines[i])) {
+          replaced++;
+        }
+      }
+      repackCold(draft, at, epochs);
+    }
+    setCold(sat, draft);
+    return i;
+  }
+
+  /**
+   * Average spacing over everything a satellite has, cold and not
+   */
+
+  static double coldInterval(const SatelliteSnapshot *snap)
+  {
+    const ColdTier *cold = snap->cold;
+    size_t total = (cold ? cold->count : 0) + snap->count;
+    if (!cold || total < 2) {
+      return snap->count ? SatelliteIndex::interval(snap->times, snap->count) : 0.0;
+    }
+    double last = snap->count ? snap->times[snap->count - 1] : cold->blocks.back()->block.end();
+    return (last - cold->blocks.front()->block.begin()) / (double) (total - 1);
+  }
+
+  /**
+   * Append all of a satellite's epochs, cold and not, to all
+   */
+
+  void unpackAll(const Satellite *sat, SatelliteIndex &all)
+  {
+    const SatelliteSnapshot *snap = sat->current.load();
+    all.reserve(all.size() + (sat->cold ? sat->cold->count : 0) + snap->count);
+    for (size_t i = 0; sat->cold && i < sat->cold->blocks.size(); i++) {
+      sat->cold->blocks[i]->block.decode(all);
+    }
+    for (size_t i = 0; i < snap->count; i++) {
+      all.add(snap->times[i], snap->lines[i]);
+    }
+  }
+
+  /**
+   * get, for a time outside the satellite's uncompressed epochs
+   */
+
+  EphemerisLine *coldGet(const SatelliteSnapshot *snap, double time)
+  {
+    const ColdTier *cold = snap->cold;
+    if (snap->count > 0 && time >= snap->times[0]) {
+      // Past the end goes by the interval over all of it, cold or not
+      return lookup(snap, time, coldInterval(snap));
+    }
+    if (time < cold->blocks.front()->block.begin()) {
+      return (EphemerisLine *) NULL;
+    }
+    size_t at = coldBlockFor(cold, time);
+    SatelliteIndex *epochs = unpack(cold->blocks[at]);
+    EphemerisLine *line = &epochs->value(epochs->find(time));
+    // Past the end of everything, same rule as lookup
+    if (snap->count == 0 && at + 1 == cold->blocks.size() && time > epochs->end() && cold->count > 1 &&
+        time > line->getTime() + coldInterval(snap)) {
+      return (EphemerisLine *) NULL;
+    }
+    return line;
+  }
+
+  /**
+   * Segment s of a cold satellite: its cold blocks in order, then its
+   * uncompressed epochs
+   */
+
+  Segment segment(const SatelliteSnapshot *snap, size_t s)
+  {
+    Segment seg;
+    if (s < snap->cold->blocks.size()) {
+      SatelliteIndex *epochs = unpack(snap->cold->blocks[s]);
+      seg.times = epochs->timeData();
+      seg.lines = epochs->valueData();
+      seg.count = epochs->size();
+    } else {
+      seg.times = snap->times;
+      seg.lines = snap->lines;
+      seg.count = snap->count;
+    }
+    return seg;
+  }
+
+  /**
+   * interpolate, for when some of the points around time might be
+   * cold. Usually they're all in the one block, and the interpolator
+   * works straight off its arrays. Near the edge of a block, the
+   * MAX_POINTS epochs either side of time get copied into a window
+   * from wherever they are. Either way the interpolator gets the
+   * same points it would have if nothing were cold.
+   */
+
+  bool coldInterpolate(const SatelliteSnapshot *snap, double time, EphemerisLine &result, OrbitInterpolator &interpolator)
+  {
+    const ColdTier *cold = snap->cold;
+    size_t uncompressed = cold->blocks.size();
+    size_t s = (snap->count > 0 && time >= snap->times[0]) ? uncompressed : coldBlockFor(cold, time);
+    Segment seg = segment(snap, s);
+    long at = SatelliteIndex::floorSearch(seg.times, seg.count, time);
+    if (at == SatelliteIndex::NOT_FOUND) {
+      return false; // Before all of it
+    }
+    size_t margin = OrbitInterpolator::MAX_POINTS;
+    if ((size_t) at >= margin && at + margin < seg.count) {
+      return interpolator.interpolate(seg.times, seg.lines, seg.count, time, result);
+    }
+
+    // Back up to where the window starts, then take it in order
+    size_t i = at;
+    for (size_t back = margin - 1; back > 0; back--) {
+      if (i > 0) {
+        i--;
+      } else if (s > 0) {
+        seg = segment(snap, --s);
+        i = seg.count - 1;
+      } else {
+        break;
+      }
+    }
+    SatelliteIndex window;
+    window.reserve(2 * margin);
+    while (window.size() < 2 * margin) {
+      if (i < seg.count) {
+        window.add(seg.times[i], seg.lines[i]);
+        i++;
+      } else if (s < uncompressed) {
+        seg = segment(snap, ++s);
+        i = 0;
+      } else {
+        break;
+      }
+    }
+    return !window.empty() && interpolator.interpolate(window.timeData(), window.valueData(), window.size(), time, result);
+  }
+
+  /**
+   * Put a line in, copying the satellite's arrays first if readers
+   * could see the change.
+   */
+
+  bool store(const std::string &satellite, EphemerisLine &line, bool replace) throw(std::string)
+  {
+    boost::mutex::scoped_lock lock(writeLock);
+    Satellite *sat = findOrCreate(satellite);
+    if (sat->inFile) {
+      copyOutOfFile(sat);
+    }
+    double time = line.getTime();
+    if (sat->cold && time <= sat->cold->blocks.back()->block.end()) {
+      return storeCold(sat, line, replace);
+    }
+    SatelliteIndex *storage = sat->storage;
+    bool appending = storage->empty() || time > storage->end();
+    bool exists = false;
+    if (!appending) {
+      long at = storage->find(time);
+      exists = (at != SatelliteIndex::NOT_FOUND && storage->time(at) == time);
+      if (exists && !replace) {
+        throw std::string("Attempt to add the same epoch to the cache twice.");
+      }
+    }
+    SatelliteIndex *old = (SatelliteIndex *) NULL;
+    if (sat->current.load() != NULL && !(appending && storage->size() < storage->capacity())) {
+      old = storage;
+      storage = new SatelliteIndex();
+      storage->reserve(old->size() * 2 + 16);
+      *storage = *old;
+      sat->storage = storage;
+    }
+    storage->put(time, line);
+    publish(sat);
+    if (old) {
+      retire(old);
+    }
+    return exists;
+  }
+
+  /**
+   * putAll's uncompressed part. Appends that fit go on the end of the
+   * arrays; anything else gets merged with what's there into new ones.
+   * Either way it's one pass and one publish.
+   */
+
+  void storeAll(Satellite *sat, const double *times, const EphemerisLine *lines, size_t first, size_t count, size_t &replaced)
+  {
+    SatelliteIndex *storage = sat->storage;
+    size_t adding = count - first;
+    if (!sat->inFile && (storage->empty() || times[first] > storage->end()) &&
+        (sat->current.load() == NULL || storage->size() + adding <= storage->capacity())) {
+      storage->reserve(storage->size() + adding);
+      for (size_t i = first; i < count; i++) {
+        storage->add(times[i], lines[i]);
+      }
+      publish(sat);
+      return;
+    }
+
+    // What readers can see now is what gets merged with
+    const SatelliteSnapshot *snap = sat->current.load();
+    const double *oldTimes = snap ? snap->times : (const double *) NULL;
+    const EphemerisLine *oldLines = snap ? snap->lines : (const EphemerisLine *) NULL;
+    size_t oldCount = snap ? snap->count : 0;
+    SatelliteIndex *merged = new SatelliteIndex();
+    merged->reserve((oldCount + adding) * 2 + 16);
+    size_t o = 0;
+    size_t n = first;
+    while (o < oldCount || n < count) {
+      if (n == count || (o < oldCount && oldTimes[o] < times[n])) {
+        merged->add(oldTimes[o], oldLines[o]);
+        o++;
+        continue;
+      }
+      if (o < oldCount && oldTimes[o] == times[n]) {
+        replaced++;
+        o++;
+      }
+      merged->add(times[n], lines[n]);
+      n++;
+    }
+    SatelliteIndex *old = storage;
+    sat->storage = merged;
+    sat->inFile = false;
+    publish(sat);
+    retire(old);
+  }
+
 public:
   EphemerisLine *NOT_FOUND;
 
-  EphemerisCache() { NOT_FOUND = (EphemerisLine *) NULL; }
+  EphemerisCache() : satellites(new SatelliteMap()), hotBlockLimit(COLD_CACHE_BLOCKS)
+  {
+    NOT_FOUND = (EphemerisLine *) NULL;
+  }
+
   ~EphemerisCache() 
   {
-    SatelliteMap::iterator sats = satellites.begin();
-    while (sats != satellites.end()) {
+    const SatelliteMap *current = satellites.load();
+    SatelliteMap::const_iterator sats = current->begin();
+    while (sats != current->end()) {
       delete sats->second;
       sats++;
     }
+    delete current;
+    HotBlocks::iterator hot = hotBlocks.begin();
+    while (hot != hotBlocks.end()) {
+      delete hot->epochs;
+      hot++;
+    }
   }
 
   /**
    * Note that if you want this function to work correctly,
-   * you'll need to set your time in your EphemerisLine
+   * you'll need to set your time in your EphemerisLine.
+   *
+   * The cache copies the line into its own storage and deletes the
+   * one you passed in, so as before there's no need to track it
+   * yourself (and you shouldn't touch it after you've added it.)
    */
 
   void add(const std::string &satellite, EphemerisLine *line)
   {
-    SatelliteMap::iterator sat = satellites.find(satellite);
-    SatelliteTree *found = NULL;
-    if (sat == satellites.end()) {
-      SatelliteTree *newSat = new SatelliteTree(NOT_FOUND);
-      satellites[satellite] = newSat;
-      intervals[satellite] = 0.0;
-      found = newSat;
-    } else {
-      found = sat->second;
+    add(satellite, *line);
+    delete line;
+  }
+
+  /**
+   * Add a copy of the line without having to allocate one first.
+   * Adding the same satellite and time twice throws.
+   */
+
+  void add(const std::string &satellite, EphemerisLine &line)
+  {
+    store(satellite, line, false);
+  }
+
+  /**
+   * put adds the line, or replaces the one that's already there for
+   * that satellite and time (add would throw.) Returns true if it
+   * replaced one.
+   */
+
+  bool put(const std::string &satellite, EphemerisLine &line)
+  {
+    return store(satellite, line, true);
+  }
+
+  /**
+   * putAll is put for a whole run of one satellite's lines at once:
+   * count lines, with their times in times, in order with no time
+   * twice. Where the satellite already has a time, the new line wins.
+   * Readers see all of them show up at once. Unlike a put per line,
+   * the satellite's arrays get copied at most once, so merging a
+   * day that overlaps what's there costs one pass over both. Returns
+   * how many lines replaced ones already there, and throws (before
+   * putting anything) if times isn't in order.
+   */
+
+  size_t putAll(const std::string &satellite, const double *times, const EphemerisLine *lines, size_t count) throw(std::string)
+  {
+    for (size_t i = 1; i < count; i++) {
+      if (!(times[i - 1] < times[i])) {
+        throw std::string("putAll needs times in order with no repeats.");
+      }
     }
-    found->add(line->getTime(), line);
+    boost::mutex::scoped_lock lock(writeLock);
+    if (count == 0) {
+      return 0;
+    }
+    Satellite *sat = findOrCreate(satellite);
+    size_t replaced = 0;
+    size_t first = storeAllCold(sat, times, lines, 0, count, replaced);
+    if (first < count) {
+      storeAll(sat, times, lines, first, count, replaced);
+    }
+    return replaced;
   }
 
   /**
-   * Get gets the EphemerisLine for the satellite for a given
-   * time. Returns NULL if not found.
+   * adopt moves every satellite out of source and into this cache,
+   * replacing any satellites here with the same name, all at once.
+   * Readers see either all of the old data or all of the new. This
+   * is how you swap in a freshly loaded day without stopping
+   * anybody: load it into a cache of its own, then adopt it. Don't
+   * read from source while you do this; it's empty afterwards.
    */
 
-  EphemerisLine *get(const std::string &satellite, double time)
+  void adopt(EphemerisCache &source)
   {
-    EphemerisLine *retval = (EphemerisLine *) NULL;
-    SatelliteMap::iterator sat = satellites.find(satellite);
-    SatelliteTree *found = NULL;
-    if (sat != satellites.end()) {
-      found = sat->second;
-      double dataInterval = 0.0;
-      /*
-       * We really only need to know the data interval if we're
-       * querying past the end of the data points we have.
-       */
-      if (time > found->end()) {
-        IntervalMap::iterator intr = intervals.find(satellite);
-        if (intr == intervals.end() || intr->second == 0.0) {
-          dataInterval = calcInterval(satellite);
-        } else {
-          dataInterval = intr->second;
-        }
-        retval = found->find(time);
-        if (time > retval->getTime() + dataInterval) {
-          retval = (EphemerisLine *) NULL;
-        }
+    boost::mutex::scoped_lock sourceLock(source.writeLock);
+    boost::mutex::scoped_lock lock(writeLock);
+    const SatelliteMap *incoming = source.satellites.load();
+    const SatelliteMap *current = satellites.load();
+    SatelliteMap *updated = new SatelliteMap(*current);
+    std::vector<Satellite *> replaced;
+    SatelliteMap::const_iterator it = incoming->begin();
+    while (it != incoming->end()) {
+      SatelliteMap::iterator existing = updated->find(it->first);
+      if (existing != updated->end()) {
+        replaced.push_back(existing->second);
+        existing->second = it->second;
       } else {
-        retval = found->find(time);
+        (*updated)[it->first] = it->second;
+      }
+      it++;
+    }
+    source.satellites.store(new SatelliteMap());
+    source.retire(incoming);
+    files.insert(files.end(), source.files.begin(), source.files.end());
+    satellites.store(updated);
+    retire(current);
+    for (size_t i = 0; i < replaced.size(); i++) {
+      retire(replaced[i]);
+    }
+  }
+
+  /**
+   * mapSnapshot maps a snapshot file and serves every satellite in it
+   * straight from the mapping, replacing any satellites here with the
+   * same name, all at once like adopt. Nothing gets read in: only the
+   * directory is looked at until somebody asks for a satellite. With
+   * verify, the whole file gets checksummed first. Throws saying
+   * what's wrong if the file won't do, and leaves the cache alone.
+   */
+
+  void mapSnapshot(const std::string &filename, bool verify = false) throw(std::string)
+  {
+    boost::shared_ptr<EphemerisSnapshot> file(new EphemerisSnapshot());
+    file->open(filename, verify);
+    boost::mutex::scoped_lock lock(writeLock);
+    const SatelliteMap *current = satellites.load();
+    SatelliteMap *updated = new SatelliteMap(*current);
+    std::vector<Satellite *> replaced;
+    for (size_t i = 0; i < file->satelliteCount(); i++) {
+      Satellite *sat = new Satellite();
+      SatelliteSnapshot *snap = new SatelliteSnapshot;
+      snap->times = file->times(i);
+      snap->lines = file->lines(i);
+      snap->count = file->count(i);
+      snap->step = file->step(i);
+      snap->regular = file->regular(i);
+      snap->cold = (const ColdTier *) NULL;
+      sat->current.store(snap);
+      sat->inFile = true;
+      Satellite *&slot = (*updated)[file->name(i)];
+      if (slot) {
+        replaced.push_back(slot);
+      }
+      slot = sat;
+    }
+    files.push_back(file);
+    satellites.store(updated);
+    retire(current);
+    for (size_t i = 0; i < replaced.size(); i++) {
+      retire(replaced[i]);
+    }
+  }
+
+  /**
+   * mergeSnapshot is mapSnapshot for a cache that already has data
+   * you want to keep. The file gets mapped into a cache of its own
+   * and every epoch in it put into this one, so satellites it shares
+   * with this cache keep the times the file doesn't have, and the
+   * file wins where both have the same time. Each satellite gets
+   * merged in one pass with putAll. Unlike mapSnapshot it copies the
+   * file's data into the cache. Throws like mapSnapshot if the file
+   * won't do, before anything's been put.
+   */
+
+  void mergeSnapshot(const std::string &filename, bool verify = false) throw(std::string)
+  {
+    EphemerisCache incoming;
+    incoming.mapSnapshot(filename, verify);
+    std::vector<std::string> names;
+    incoming.satelliteNames(names);
+    for (size_t i = 0; i < names.size(); i++) {
+      EpochIndex<EphemerisLine> epochs;
+      if (incoming.copy(names[i], epochs) && !epochs.empty()) {
+        putAll(names[i], epochs.timeData(), epochs.valueData(), epochs.size());
       }
     }
-    
-    return retval;
+  }
+
+  /**
+   * Write everything in the cache out as a snapshot file that
+   * mapSnapshot can serve from later. Cold satellites get unpacked
+   * to go in it. Writers wait while it's being written; readers
+   * don't. Throws if the file can't be written.
+   */
+
+  void saveSnapshot(const std::string &filename) throw(std::string)
+  {
+    boost::mutex::scoped_lock lock(writeLock);
+    EphemerisSnapshotWriter writer;
+    std::list<SatelliteIndex> unpacked; // Has to last until it's written
+    const SatelliteMap *current = satellites.load();
+    SatelliteMap::const_iterator it = current->begin();
+    while (it != current->end()) {
+      const Satellite *sat = it->second;
+      const SatelliteSnapshot *snap = sat->current.load();
+      if (snap && sat->cold) {
+        unpacked.push_back(SatelliteIndex());
+        SatelliteIndex &all = unpacked.back();
+        unpackAll(sat, all);
+        writer.add(it->first, all.timeData(), all.valueData(), all.size(), all.getStep(), all.isRegular());
+      } else if (snap) {
+        writer.add(it->first, snap->times, snap->lines, snap->count, snap->step, snap->regular);
+      }
+      it++;
+    }
+    writer.write(filename);
+  }
+
+  /**
+   * Move every satellite's epochs before time into the cold tier,
+   * packed a day (UTC) to a block. Returns how many epochs moved.
+   * Lookups before time still work, just slower; adds before time
+   * unpack the day and pack it up again. Doing it again with a later
+   * time moves more.
+   */
+
+  size_t compressBefore(double time)
+  {
+    boost::mutex::scoped_lock lock(writeLock);
+    size_t moved = 0;
+    const SatelliteMap *current = satellites.load();
+    SatelliteMap::const_iterator it = current->begin();
+    for (; it != current->end(); it++) {
+      Satellite *sat = it->second;
+      if (sat->inFile) {
+        copyOutOfFile(sat);
+      }
+      SatelliteIndex *storage = sat->storage;
+      long at = storage->find(time);
+      if (at == SatelliteIndex::NOT_FOUND) {
+        continue;
+      }
+      size_t split = storage->time(at) < time ? at + 1 : at;
+      if (split == 0) {
+        continue;
+      }
+
+      // If the last cold day isn't over, it gets packed again with
+      // the rest of itself
+      SatelliteIndex day;
+      ColdTier *draft = draftCold(sat);
+      if (!draft->blocks.empty() && dayOf(draft->blocks.back()->block.end()) == dayOf(storage->time(0))) {
+        draft->blocks.back()->block.decode(day);
+        draft->count -= day.size();
+        dropped.push_back(draft->blocks.back());
+        draft->blocks.pop_back();
+      }
+      for (size_t i = 0; i < split; i++) {
+        if (!day.empty() && dayOf(storage->time(i)) != dayOf(day.end())) {
+          packCold(draft, day);
+          day = SatelliteIndex();
+        }
+        day.add(storage->time(i), storage->value(i));
+      }
+      packCold(draft, day);
+      moved += split;
+
+      SatelliteIndex *remaining = new SatelliteIndex();
+      remaining->reserve((storage->size() - split) * 2 + 16);
+      for (size_t i = split; i < storage->size(); i++) {
+        remaining->add(storage->time(i), storage->value(i));
+      }
+      sat->storage = remaining;
+      setCold(sat, draft);
+      retire(storage);
+    }
+    return moved;
+  }
+
+  /**
+   * How much memory the cold tier is taking, not counting the LRU
+   */
+
+  size_t coldBytes()
+  {
+    boost::mutex::scoped_lock lock(writeLock);
+    size_t bytes = 0;
+    const SatelliteMap *current = satellites.load();
+    SatelliteMap::const_iterator it = current->begin();
+    for (; it != current->end(); it++) {
+      const ColdTier *cold = it->second->cold;
+      for (size_t i = 0; cold && i < cold->blocks.size(); i++) {
+        bytes += cold->blocks[i]->block.bytes();
+      }
+    }
+    return bytes;
+  }
+
+  /**
+   * How many unpacked cold days to keep around. The default is
+   * COLD_CACHE_BLOCKS.
+   */
+
+  void setColdCacheBlocks(size_t blocks)
+  {
+    boost::mutex::scoped_lock lock(hotLock);
+    hotBlockLimit = blocks > 0 ? blocks : 1;
+    trimHotBlocks();
+  }
+
+  /**
+   * Get gets the EphemerisLine for the satellite for a given
+   * time. Returns NULL if not found. The line belongs to the
+   * cache. It's good until this thread calls into the cache again.
+   */
+
+  EphemerisLine *get(const std::string &satellite, double time)
+  {
+    const SatelliteSnapshot *found = snapshot(satellite);
+    if (!found) {
+      return (EphemerisLine *) NULL;
+    }
+    if (found->cold && (found->count == 0 || time < found->times[0] || time > found->times[found->count - 1])) {
+      return coldGet(found, time);
+    }
+    return lookup(found, time, SatelliteIndex::interval(found->times, found->count));
+  }
+
+  /**
+   * interpolate works out where the satellite is at exactly time,
+   * rather than where it was at the last data point, and puts it
+   * in result. It returns false if the satellite isn't there or
+   * time isn't inside its data. Use your own interpolator to pick
+   * the method and number of points, and to keep its weights
+   * around between calls (it's much faster when you ask for every
+   * satellite at the same time in a row.)
+   */
+
+  bool interpolate(const std::string &satellite, double time, EphemerisLine &result, OrbitInterpolator &interpolator)
+  {
+    const SatelliteSnapshot *found = snapshot(satellite);
+    if (!found) {
+      return false;
+    }
+    // Near or before the start of the uncompressed epochs, the points
+    // either side might be cold
+    size_t margin = OrbitInterpolator::MAX_POINTS;
+    if (found->cold && (found->count <= margin || time < found->times[margin])) {
+      return coldInterpolate(found, time, result, interpolator);
+    }
+    return interpolator.interpolate(found->times, found->lines, found->count, time, result);
+  }
+
+  bool interpolate(const std::string &satellite, double time, EphemerisLine &result)
+  {
+    OrbitInterpolator interpolator;
+    return interpolate(satellite, time, result, interpolator);
   }
 
   /**
@@ -168,29 +1121,74 @@ public:
 
   double getDataInterval(std::string &satellite)
   {
-    IntervalMap::iterator found = intervals.find(satellite);
+    const SatelliteSnapshot *found = snapshot(satellite);
     double retval = 0.0;
-    if (found == intervals.end() || found->second == 0.0) {
-      retval = calcInterval(satellite);
-    } else {
-      retval = found->second;
+    if (found && found->cold) {
+      retval = coldInterval(found);
+    } else if (found) {
+      retval = SatelliteIndex::interval(found->times, found->count);
     }
     return retval;
   }
 
+  /**
+   * Copy every epoch the satellite has, compressed or not, onto the
+   * end of into. Returns false if there's no such satellite. Meant
+   * for things that want to chew through all of a satellite's data
+   * at once, like fitting it; writers wait while it copies.
+   */
+
+  bool copy(const std::string &satellite, EpochIndex<EphemerisLine> &into)
+  {
+    boost::mutex::scoped_lock lock(writeLock);
+    Satellite *sat = existing(satellite);
+    if (!sat || !sat->current.load()) {
+      return false;
+    }
+    unpackAll(sat, into);
+    return true;
+  }
+
   /**
    * Put list of satellite names into a std::vector<std::string>
    */
 
   void satelliteNames(std::vector<std::string> &names)
   {
-    SatelliteMap::iterator it = satellites.begin();
-    while(it != satellites.end()) {
-      names.push_back(it->first);
+    pin();
+    const SatelliteMap *current = satellites.load();
+    SatelliteMap::const_iterator it = current->begin();
+    while(it != current->end()) {
+      if (it->second->current.load()) {
+        names.push_back(it->first);
+      }
       it++;
     }
   }
 
+  /**
+   * A reader thread that's going to go idle for a long time can
+   * call this to say it's done with everything it got from the
+   * cache, so the memory can be freed without waiting for its next
+   * read.
+   */
+
+  void quiesce()
+  {
+    reclaimer.release();
+  }
+
+  /**
+   * Free whatever old snapshots no reader can still be looking at.
+   * Writers do this on their own every so often; call it if you've
+   * just finished a big update and want the memory back now.
+   */
+
+  void reclaim()
+  {
+    reclaimer.reclaim();
+  }
+
 };
 
 #endif
@@ -53,6 +53,16 @@ class EphemerisLine {
 
   }
 
+  EphemerisLine &operator=(const EphemerisLine &line)
+  {
+    position = line.position;
+    dx = line.dx;
+    dy = line.dy;
+    dz = line.dz;
+    currentTime = line.currentTime;
+    return *this;
+  }
+
 
   Ecef &getPosition() 
   {
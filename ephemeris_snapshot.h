@@ -0,0 +1,430 @@
+/**
+ * EphemerisSnapshot is a binary file holding everything an
+ * EphemerisCache knows, laid out so the cache can map it and serve
+ * straight out of it without reading it in. Parsing a few months of
+ * SP3 takes minutes; mapping one of these takes about as long as
+ * opening it, and the pages come in as satellites get asked for.
+ * Every process that maps the same file shares one copy of it in the
+ * page cache.
+ *
+ * The file is:
+ *
+ *   Header        magic, version, layout checks, checksums
+ *   Entry[]       one per satellite: name, epoch count, step,
+ *                 and where its two arrays are
+ *   data          for each satellite, its times (doubles) and then
+ *                 its lines (EphemerisLines, byte for byte), each
+ *                 array starting on a 64 byte boundary
+ *
+ * There are no pointers in it, only offsets from the start of the
+ * file, so it doesn't matter where it gets mapped. It's written in
+ * the byte order and with the EphemerisLine layout of the machine
+ * that wrote it; the header records both and open refuses a file
+ * that doesn't match.
+ *
+ * There are two checksums. One covers the header and directory and
+ * is checked on every open, which is cheap and catches a file that's
+ * been truncated or isn't a snapshot. The other covers all the data,
+ * and reading all the data is exactly what mapping is trying to
+ * avoid, so that one's only checked when you ask (verify.) The
+ * ingest tool verifies every file it writes.
+ *
+ * EphemerisSnapshotWriter writes them. It writes to a temporary file
+ * and renames it over the real one at the end, so a server mapping
+ * the old file never sees a half written one. Do the same if you're
+ * copying them around: truncating or rewriting a snapshot that's
+ * mapped pulls the pages out from under whoever is serving it.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _H_EPHEMERIS_SNAPSHOT
+#define _H_EPHEMERIS_SNAPSHOT
+
+#include "ephemeris_line.h"
+#include "mapped_file.h"
+#include <boost/static_assert.hpp>
+#include <boost/type_traits/is_polymorphic.hpp>
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// Lines get written out and mapped back in as raw bytes, which only
+// works as long as there's no vtable pointer in them
+BOOST_STATIC_ASSERT(!boost::is_polymorphic<EphemerisLine>::value);
+
+class EphemerisSnapshot {
+ public:
+  enum { VERSION = 1, NAME_LENGTH = 32, ALIGNMENT = 64 };
+
+  static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+  struct Header {
+    char magic[8];       // "EPHSNAP" and a NUL
+    uint32_t version;
+    uint32_t byteOrder;  // BYTE_ORDER_MARK as the writer saw it
+    uint32_t lineSize;   // sizeof(EphemerisLine) for the writer
+    uint32_t satellites;
+    uint64_t fileSize;
+    uint64_t dataOffset;
+    uint64_t dataChecksum;
+    uint64_t headerChecksum; // Header (with this as 0) and directory
+    char reserved[16];
+  };
+
+  struct Entry {
+    char name[NAME_LENGTH]; // NUL padded
+    uint64_t count;
+    uint64_t times;         // Offset of count doubles
+    uint64_t lines;         // Offset of count EphemerisLines
+    double step;
+    uint32_t regular;
+    uint32_t reserved;
+  };
+
+  /**
+   * FNV-1a, but a word at a time instead of a byte at a time, so it
+   * keeps up with the disk. Everything in the file is a multiple of
+   * 8 bytes long, so there's never a partial word. Pass the last
+   * result back in as hash to keep going over more data.
+   */
+
+  static const uint64_t CHECKSUM_START = 0xcbf29ce484222325ULL;
+
+  static uint64_t checksum(const void *data, size_t length, uint64_t hash = CHECKSUM_START)
+  {
+    const char *bytes = (const char *) data;
+    for (size_t i = 0; i + 8 <= length; i += 8) {
+      uint64_t word;
+      memcpy(&word, bytes + i, 8);
+      hash = (hash ^ word) * 0x100000001b3ULL;
+    }
+    return hash;
+  }
+
+  static uint64_t headerChecksum(const Header &header, const Entry *entries)
+  {
+    Header copy = header;
+    copy.headerChecksum = 0;
+    uint64_t hash = checksum(&copy, sizeof(copy));
+    return checksum(entries, header.satellites * sizeof(Entry), hash);
+  }
+
+  static void stamp(Header &header)
+  {
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "EPHSNAP", 8);
+    header.version = VERSION;
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.lineSize = sizeof(EphemerisLine);
+  }
+
+ protected:
+  MappedFile file;
+  const Header *header;
+  const Entry *entries;
+
+  // Not copyable, it owns the mapping
+  EphemerisSnapshot(const EphemerisSnapshot &);
+  EphemerisSnapshot &operator=(const EphemerisSnapshot &);
+
+  static bool fits(uint64_t offset, uint64_t count, uint64_t size, uint64_t fileSize)
+  {
+    return offset % 8 == 0 && offset <= fileSize && count <= (fileSize - offset) / size;
+  }
+
+  void fail(const std::string &filename, const std::string &why) throw(std::string)
+  {
+    close();
+    throw filename + ": " + why;
+  }
+
+ public:
+
+  EphemerisSnapshot() : header((const Header *) NULL), entries((const Entry *) NULL)
+  {
+  }
+
+  /**
+   * True if filename starts like a snapshot. Doesn't check anything
+   * else; open does that.
+   */
+
+  static bool isSnapshot(const std::string &filename)
+  {
+    FILE *in = fopen(filename.c_str(), "rb");
+    if (!in) {
+      return false;
+    }
+    char magic[8];
+    bool matches = fread(magic, 1, 8, in) == 8 && 0 == memcmp(magic, "EPHSNAP", 8);
+    fclose(in);
+    return matches;
+  }
+
+  /**
+   * Map filename and check that it's a snapshot this program can
+   * read, and that the header and directory are intact. With verify
+   * it also reads the whole thing and checks the data checksum.
+   * Throws saying what's wrong if anything is.
+   *
+   * It's mapped copy-on-write, so the lines can be handed out as
+   * non-const like the cache's own. Writing to one never reaches the
+   * file.
+   */
+
+  void open(const std::string &filename, bool verify = false) throw(std::string)
+  {
+    close();
+    if (!file.open(filename, false, true)) {
+      fail(filename, "can't open or map it");
+    }
+    uint64_t size = file.size();
+    header = (const Header *) file.begin();
+    if (size < sizeof(Header) || memcmp(header->magic, "EPHSNAP", 8)) {
+      fail(filename, "not an ephemeris snapshot");
+    }
+    if (header->version != VERSION) {
+      fail(filename, "unsupported snapshot version");
+    }
+    if (header->byteOrder != BYTE_ORDER_MARK || header->lineSize != sizeof(EphemerisLine)) {
+      fail(filename, "snapshot was written on a different kind of machine");
+    }
+    if (header->fileSize != size || !fits(sizeof(Header), header->satellites, sizeof(Entry), size)) {
+      fail(filename, "snapshot is truncated");
+    }
+    entries = (const Entry *) (file.begin() + sizeof(Header));
+    if (headerChecksum(*header, entries) != header->headerChecksum) {
+      fail(filename, "snapshot header checksum doesn't match");
+    }
+    for (uint32_t i = 0; i < header->satellites; i++) {
+      const Entry &entry = entries[i];
+      if (entry.count == 0 || memchr(entry.name, 0, NAME_LENGTH) == NULL ||
+          !fits(entry.times, entry.count, sizeof(double), size) ||
+          !fits(entry.lines, entry.count, sizeof(EphemerisLine), size)) {
+        fail(filename, "snapshot directory is corrupt");
+      }
+    }
+    if (verify && !intact()) {
+      fail(filename, "snapshot data checksum doesn't match");
+    }
+  }
+
+  void close()
+  {
+    file.close();
+    header = (const Header *) NULL;
+    entries = (const Entry *) NULL;
+  }
+
+  bool isOpen() const
+  {
+    return header != NULL;
+  }
+
+  /**
+   * Check the data checksum. Touches every page of the file.
+   */
+
+  bool intact() const
+  {
+    if (!header || header->dataOffset > file.size()) {
+      return false;
+    }
+    uint64_t hash = checksum(file.begin() + header->dataOffset, file.size() - header->dataOffset);
+    return hash == header->dataChecksum;
+  }
+
+  size_t satelliteCount() const
+  {
+    return header ? header->satellites : 0;
+  }
+
+  /**
+   * The rest of these are about the i'th satellite in the file,
+   * which come in name order.
+   */
+
+  std::string name(size_t i) const
+  {
+    return std::string(entries[i].name);
+  }
+
+  size_t count(size_t i) const
+  {
+    return entries[i].count;
+  }
+
+  const double *times(size_t i) const
+  {
+    return (const double *) (file.begin() + entries[i].times);
+  }
+
+  EphemerisLine *lines(size_t i) const
+  {
+    return (EphemerisLine *) (file.begin() + entries[i].lines);
+  }
+
+  double step(size_t i) const
+  {
+    return entries[i].step;
+  }
+
+  bool regular(size_t i) const
+  {
+    return entries[i].regular != 0;
+  }
+
+};
+
+/**
+ * Collects satellites' arrays and writes them out as a snapshot.
+ * It only holds on to the pointers you give it, so they have to stay
+ * put until write is done.
+ */
+
+class EphemerisSnapshotWriter {
+  struct Pending {
+    std::string name;
+    const double *times;
+    const EphemerisLine *lines;
+    size_t count;
+    double step;
+    bool regular;
+  };
+
+  std::vector<Pending> satellites;
+
+  static uint64_t aligned(uint64_t offset)
+  {
+    return (offset + EphemerisSnapshot::ALIGNMENT - 1) / EphemerisSnapshot::ALIGNMENT * EphemerisSnapshot::ALIGNMENT;
+  }
+
+  /**
+   * Write length bytes and add them to the checksum
+   */
+
+  static bool put(FILE *out, const void *data, size_t length, uint64_t &hash)
+  {
+    hash = EphemerisSnapshot::checksum(data, length, hash);
+    return length == 0 || fwrite(data, 1, length, out) == length;
+  }
+
+  static bool pad(FILE *out, uint64_t &at, uint64_t to, uint64_t &hash)
+  {
+    static const char zeros[EphemerisSnapshot::ALIGNMENT] = { 0 };
+    size_t length = to - at;
+    at = to;
+    return put(out, zeros, length, hash);
+  }
+
+ public:
+
+  /**
+   * Add a satellite. Satellites have to be added in name order, with
+   * no name twice; the cache's map hands them over that way anyway.
+   * Satellites with no epochs are skipped.
+   */
+
+  void add(const std::string &name, const double *times, const EphemerisLine *lines, size_t count, double step, bool regular) throw(std::string)
+  {
+    if (name.size() >= EphemerisSnapshot::NAME_LENGTH) {
+      throw std::string("Satellite name too long for a snapshot: ") + name;
+    }
+    if (!satellites.empty() && !(satellites.back().name < name)) {
+      throw std::string("Satellites have to be added to a snapshot in name order");
+    }
+    if (count == 0) {
+      return;
+    }
+    Pending pending;
+    pending.name = name;
+    pending.times = times;
+    pending.lines = lines;
+    pending.count = count;
+    pending.step = step;
+    pending.regular = regular;
+    satellites.push_back(pending);
+  }
+
+  /**
+   * Write everything added so far to filename, replacing it if it's
+   * there. Throws if it can't.
+   */
+
+  void write(const std::string &filename) throw(std::string)
+  {
+    EphemerisSnapshot::Header header;
+    EphemerisSnapshot::stamp(header);
+    header.satellites = satellites.size();
+
+    std::vector<EphemerisSnapshot::Entry> entries(satellites.size());
+    uint64_t offset = aligned(sizeof(header) + entries.size() * sizeof(EphemerisSnapshot::Entry));
+    header.dataOffset = offset;
+    for (size_t i = 0; i < satellites.size(); i++) {
+      EphemerisSnapshot::Entry &entry = entries[i];
+      memset(&entry, 0, sizeof(entry));
+      strncpy(entry.name, satellites[i].name.c_str(), EphemerisSnapshot::NAME_LENGTH);
+      entry.count = satellites[i].count;
+      entry.step = satellites[i].step;
+      entry.regular = satellites[i].regular ? 1 : 0;
+      entry.times = offset;
+      offset = aligned(offset + entry.count * sizeof(double));
+      entry.lines = offset;
+      offset = aligned(offset + entry.count * sizeof(EphemerisLine));
+    }
+    header.fileSize = offset;
+
+    std::string temporary = filename + ".tmp";
+    FILE *out = fopen(temporary.c_str(), "wb");
+    if (!out) {
+      throw std::string("Can't create ") + temporary;
+    }
+    // The header goes in once the data checksum is known
+    uint64_t ignored = 0;
+    bool ok = put(out, &header, sizeof(header), ignored);
+    if (!entries.empty()) {
+      ok = ok && put(out, &entries[0], entries.size() * sizeof(EphemerisSnapshot::Entry), ignored);
+    }
+    uint64_t at = sizeof(header) + entries.size() * sizeof(EphemerisSnapshot::Entry);
+    ok = ok && pad(out, at, header.dataOffset, ignored);
+
+    uint64_t hash = EphemerisSnapshot::CHECKSUM_START;
+    for (size_t i = 0; ok && i < satellites.size(); i++) {
+      const Pending &sat = satellites[i];
+      ok = put(out, sat.times, sat.count * sizeof(double), hash);
+      at += sat.count * sizeof(double);
+      ok = ok && pad(out, at, entries[i].lines, hash);
+      ok = ok && put(out, sat.lines, sat.count * sizeof(EphemerisLine), hash);
+      at += sat.count * sizeof(EphemerisLine);
+      ok = ok && pad(out, at, aligned(at), hash);
+    }
+    header.dataChecksum = hash;
+    header.headerChecksum = entries.empty() ? EphemerisSnapshot::headerChecksum(header, (const EphemerisSnapshot::Entry *) NULL) : EphemerisSnapshot::headerChecksum(header, &entries[0]);
+    ok = ok && 0 == fseek(out, 0, SEEK_SET) && put(out, &header, sizeof(header), ignored);
+    ok = ok && 0 == fflush(out) && 0 == fsync(fileno(out));
+    ok = (0 == fclose(out)) && ok;
+    if (!ok || 0 != rename(temporary.c_str(), filename.c_str())) {
+      unlink(temporary.c_str());
+      throw std::string("Can't write ") + filename;
+    }
+  }
+
+};
+
+#endif
@@ -0,0 +1,295 @@
+/**
+ * EpochIndex keeps time-keyed values in two parallel, sorted arrays
+ * (one of times, one of values) instead of a tree of nodes. SP3
+ * files hand us epochs in order at a fixed interval, so nearly every
+ * add is an append and most finds can be answered with a bit of
+ * arithmetic instead of a search.
+ *
+ * Finds work like a TimeTree: they return the latest epoch at or
+ * before the time you ask for. So if you have 2,4,6 and 8 in the
+ * index, a find on 3 returns the position of 2 and a find on 42
+ * returns the position of 8. A find before the first epoch returns
+ * NOT_FOUND.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _H_EPOCH_INDEX
+#define _H_EPOCH_INDEX
+
+#include <string>
+#include <vector>
+#include <stddef.h>
+
+template <typename ValType>
+class EpochIndex {
+  std::vector<double> times;
+  std::vector<ValType> values;
+  /**
+   * step is the spacing between the first two epochs. regular stays
+   * true for as long as every epoch we've seen is exactly step
+   * after the one before it, which lets find skip the search.
+   */
+  double step;
+  bool regular;
+
+  /**
+   * Recheck spacing after something got inserted out of order.
+   * This should be rare enough that a full pass doesn't matter.
+   */
+
+  void recalcSpacing()
+  {
+    step = 0.0;
+    regular = true;
+    if (times.size() > 1) {
+      step = times[1] - times[0];
+      for (size_t i = 2; i < times.size(); i++) {
+        if (times[i] - times[i - 1] != step) {
+          regular = false;
+          break;
+        }
+      }
+    }
+  }
+
+ public:
+  enum { NOT_FOUND = -1 };
+
+  EpochIndex() : step(0.0), regular(true)
+  {
+  }
+
+  /**
+   * floorSearch returns the position of the largest time in
+   * the array which is <= toFind, or NOT_FOUND. The loop body
+   * compiles down to a conditional move, so there's no branch
+   * for the predictor to get wrong.
+   */
+
+  static long floorSearch(const double *times, size_t count, double toFind)
+  {
+    if (count == 0 || !(toFind >= times[0])) {
+      return NOT_FOUND;
+    }
+    const double *base = times;
+    size_t len = count;
+    while (len > 1) {
+      size_t half = len / 2;
+      base = (base[half] <= toFind) ? base + half : base;
+      len -= half;
+    }
+    return base - times;
+  }
+
+  /**
+   * Add a value at a time. Appending (which is what you'll be doing
+   * if you're reading a SP3 file) is O(1). Adding in the middle
+   * works but has to shift everything after it. Adding the same
+   * time twice throws, same as the btree does.
+   */
+
+  void add(double time, const ValType &val) throw(std::string)
+  {
+    if (times.empty() || time > times.back()) {
+      if (times.size() == 1) {
+        step = time - times[0];
+      } else if (times.size() > 1 && time - times.back() != step) {
+        regular = false;
+      }
+      times.push_back(time);
+      values.push_back(val);
+      return;
+    }
+    long at = floorSearch(&times[0], times.size(), time);
+    if (at != NOT_FOUND && times[at] == time) {
+      throw std::string("Attempt to add the same epoch to the index twice.");
+    }
+    times.insert(times.begin() + (at + 1), time);
+    values.insert(values.begin() + (at + 1), val);
+    recalcSpacing();
+  }
+
+  /**
+   * put is add for when you don't care if the time is already
+   * there. If it is, the value gets replaced and you get true back.
+   */
+
+  bool put(double time, const ValType &val)
+  {
+    if (!times.empty() && time <= times.back()) {
+      long at = floorSearch(&times[0], times.size(), time);
+      if (at != NOT_FOUND && times[at] == time) {
+        values[at] = val;
+        return true;
+      }
+    }
+    add(time, val);
+    return false;
+  }
+
+  /**
+   * find returns the position of the latest epoch at or before
+   * toFind, or NOT_FOUND if toFind is before the first epoch.
+   */
+
+  long find(double toFind) const
+  {
+    if (times.empty()) {
+      return NOT_FOUND;
+    }
+    return find(&times[0], times.size(), step, regular, toFind);
+  }
+
+  /**
+   * The guts of find, for when you've got the first count entries
+   * of an index's arrays and its spacing, but not the index itself.
+   */
+
+  static long find(const double *times, size_t count, double step, bool regular, double toFind)
+  {
+    // Written so a NaN toFind fails it too, and never reaches the cast below
+    if (count == 0 || !(toFind >= times[0])) {
+      return NOT_FOUND;
+    }
+    if (regular && count > 1) {
+      // Evenly spaced, so just work out where it should be
+      double offset = (toFind - times[0]) / step;
+      size_t guess = (offset >= (double) (count - 1)) ? count - 1 : (size_t) offset;
+      if (times[guess] <= toFind && (guess + 1 == count || times[guess + 1] > toFind)) {
+        return guess;
+      }
+    }
+    return floorSearch(times, count, toFind);
+  }
+
+  size_t size() const
+  {
+    return times.size();
+  }
+
+  bool empty() const
+  {
+    return times.empty();
+  }
+
+  /**
+   * How many epochs fit before the arrays have to move. Appending
+   * while size() < capacity() never moves anything that's already
+   * there.
+   */
+
+  size_t capacity() const
+  {
+    return times.capacity() < values.capacity() ? times.capacity() : values.capacity();
+  }
+
+  void reserve(size_t count)
+  {
+    times.reserve(count);
+    values.reserve(count);
+  }
+
+  double time(size_t at) const
+  {
+    return times[at];
+  }
+
+  ValType &value(size_t at)
+  {
+    return values[at];
+  }
+
+  const ValType &value(size_t at) const
+  {
+    return values[at];
+  }
+
+  /**
+   * Raw access to the two arrays, for things like the interpolator
+   * that want to walk a window of epochs. Don't hold on to these
+   * across adds.
+   */
+
+  const double *timeData() const
+  {
+    return &times[0];
+  }
+
+  ValType *valueData()
+  {
+    return &values[0];
+  }
+
+  /**
+   * begin and end return the first and last times in the index,
+   * same as the btree. They throw if nothing has been added yet.
+   */
+
+  double begin() const throw(std::string)
+  {
+    if (times.empty()) {
+      throw std::string("Can't call begin before adding any epochs");
+    }
+    return times.front();
+  }
+
+  double end() const throw(std::string)
+  {
+    if (times.empty()) {
+      throw std::string("Can't call end before adding any epochs");
+    }
+    return times.back();
+  }
+
+  /**
+   * interval is the average spacing between epochs, which is
+   * exactly what EphemerisCache used to compute by walking the
+   * whole tree. With fewer than two epochs there isn't one, so
+   * you get 0.
+   */
+
+  double interval() const
+  {
+    if (times.empty()) {
+      return 0.0;
+    }
+    return interval(&times[0], times.size());
+  }
+
+  static double interval(const double *times, size_t count)
+  {
+    if (count < 2) {
+      return 0.0;
+    }
+    return (times[count - 1] - times[0]) / (double) (count - 1);
+  }
+
+  /**
+   * True if every epoch is the same distance from the one before.
+   */
+
+  bool isRegular() const
+  {
+    return regular;
+  }
+
+  double getStep() const
+  {
+    return step;
+  }
+
+};
+
+#endif
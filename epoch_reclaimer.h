@@ -0,0 +1,324 @@
+/**
+ * EpochReclaimer frees things that have been taken out of a shared
+ * structure once no thread can still be looking at them.
+ * EphemerisCache and ConcurrentSkipList both use it.
+ *
+ * Every thread that reads gets a slot. While it's inside a Guard, its
+ * slot holds the epoch it started in; outside it holds 0. Retiring
+ * something stamps it with the current epoch and moves the epoch
+ * along, and it gets freed once every thread that's inside a Guard
+ * started after that.
+ *
+ * Anything you got out of the structure is good until your Guard
+ * goes away. A structure that would rather hand out things that are
+ * good until the same thread calls in again (EphemerisCache does)
+ * calls repin at the start of every read instead, and release when
+ * the thread's going to be idle a while.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _H_EPOCH_RECLAIMER
+#define _H_EPOCH_RECLAIMER
+
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+#include <vector>
+#include <limits.h>
+
+class EpochReclaimer {
+
+  /**
+   * The padding keeps readers from sharing a cache line with each
+   * other.
+   */
+
+  struct ReaderSlot {
+    boost::atomic<unsigned long> epoch;
+    boost::atomic<bool> inUse;
+    char padding[64];
+
+    ReaderSlot() : epoch(0), inUse(true)
+    {
+    }
+  };
+
+  /**
+   * Lives in thread local storage. When the thread exits, its slot
+   * goes back to the pool. The slot is shared so that doesn't blow
+   * up if the reclaimer is already gone. depth lets Guards nest.
+   */
+
+  class ReaderHandle {
+  public:
+    unsigned long owner;
+    boost::shared_ptr<ReaderSlot> slot;
+    int depth;
+
+    ReaderHandle(unsigned long owner, boost::shared_ptr<ReaderSlot> slot) : owner(owner), slot(slot), depth(0)
+    {
+    }
+
+    ~ReaderHandle()
+    {
+      slot->epoch.store(0);
+      slot->inUse.store(false);
+    }
+  };
+
+  struct Retired {
+    void *object;
+    void (*destroy)(void *);
+    unsigned long epoch;
+  };
+
+  enum { RECLAIM_BATCH = 64 };
+
+  boost::atomic<unsigned long> globalEpoch;
+  unsigned long id;
+  boost::mutex slotLock;
+  std::vector<boost::shared_ptr<ReaderSlot> > slots;
+  boost::thread_specific_ptr<ReaderHandle> reader;
+  boost::mutex retiredLock;
+  std::vector<Retired> retired;
+
+  // Not copyable
+  EpochReclaimer(const EpochReclaimer &);
+  EpochReclaimer &operator=(const EpochReclaimer &);
+
+  static unsigned long nextId()
+  {
+    static boost::atomic<unsigned long> ids(0);
+    return ++ids;
+  }
+
+  /**
+   * thread_specific_ptr goes by address, so a handle left over from
+   * a reclaimer that used to live at this one's address doesn't
+   * count.
+   */
+
+  ReaderHandle *handle()
+  {
+    ReaderHandle *current = reader.get();
+    if (!current || current->owner != id) {
+      boost::mutex::scoped_lock lock(slotLock);
+      boost::shared_ptr<ReaderSlot> slot;
+      std::vector<boost::shared_ptr<ReaderSlot> >::iterator it = slots.begin();
+      while (it != slots.end()) {
+        if (!(*it)->inUse.load()) {
+          (*it)->inUse.store(true);
+          slot = *it;
+          break;
+        }
+        it++;
+      }
+      if (!slot) {
+        slots.push_back(boost::shared_ptr<ReaderSlot>(new ReaderSlot()));
+        slot = slots.back();
+      }
+      current = new ReaderHandle(id, slot);
+      reader.reset(current);
+    }
+    return current;
+  }
+
+  /**
+   * Write down the epoch this thread is starting in. If the epoch
+   * moves between reading it and writing it down, whoever moved it
+   * might have missed seeing this thread, so go again.
+   */
+
+  void stamp(ReaderHandle *current)
+  {
+    unsigned long epoch = globalEpoch.load();
+    while (true) {
+      current->slot->epoch.store(epoch);
+      unsigned long now = globalEpoch.load();
+      if (now == epoch) {
+        break;
+      }
+      epoch = now;
+    }
+  }
+
+  void pin()
+  {
+    ReaderHandle *current = handle();
+    if (current->depth++ == 0) {
+      stamp(current);
+    }
+  }
+
+  void unpin()
+  {
+    ReaderHandle *current = reader.get();
+    if (--current->depth == 0) {
+      current->slot->epoch.store(0);
+    }
+  }
+
+  unsigned long oldestReader()
+  {
+    boost::mutex::scoped_lock lock(slotLock);
+    unsigned long oldest = ULONG_MAX;
+    std::vector<boost::shared_ptr<ReaderSlot> >::iterator it = slots.begin();
+    while (it != slots.end()) {
+      unsigned long epoch = (*it)->epoch.load();
+      if (epoch != 0 && epoch < oldest) {
+        oldest = epoch;
+      }
+      it++;
+    }
+    return oldest;
+  }
+
+  /**
+   * Expects retiredLock to be held
+   */
+
+  void reclaimRetired()
+  {
+    unsigned long oldest = oldestReader();
+    size_t kept = 0;
+    for (size_t i = 0; i < retired.size(); i++) {
+      if (retired[i].epoch < oldest) {
+        retired[i].destroy(retired[i].object);
+      } else {
+        retired[kept++] = retired[i];
+      }
+    }
+    retired.resize(kept);
+  }
+
+ public:
+  /**
+   * Stay inside one of these while you're looking at anything the
+   * reclaimer looks after.
+   */
+
+  class Guard {
+    EpochReclaimer &owner;
+
+    Guard(const Guard &);
+    Guard &operator=(const Guard &);
+
+  public:
+    Guard(EpochReclaimer &owner) : owner(owner)
+    {
+      owner.pin();
+    }
+
+    ~Guard()
+    {
+      owner.unpin();
+    }
+  };
+
+  /**
+   * A function to hand retire for things that came from new
+   */
+
+  template <typename T> static void destroy(void *object)
+  {
+    delete (T *) object;
+  }
+
+  EpochReclaimer() : globalEpoch(1), id(nextId())
+  {
+  }
+
+  /**
+   * Nobody can be using anything by now, so everything goes
+   */
+
+  ~EpochReclaimer()
+  {
+    for (size_t i = 0; i < retired.size(); i++) {
+      retired[i].destroy(retired[i].object);
+    }
+  }
+
+  /**
+   * Say this thread is done with everything it got before and is
+   * about to look at things as of now. It stays that way, holding on
+   * to whatever it finds, until it calls repin or release again.
+   * Inside a Guard this does nothing, since the Guard's still
+   * holding on to older things.
+   */
+
+  void repin()
+  {
+    ReaderHandle *current = handle();
+    if (current->depth == 0) {
+      stamp(current);
+    }
+  }
+
+  /**
+   * Say this thread isn't looking at anything, outside a Guard
+   */
+
+  void release()
+  {
+    ReaderHandle *current = reader.get();
+    if (current && current->owner == id && current->depth == 0) {
+      current->slot->epoch.store(0);
+    }
+  }
+
+  /**
+   * object is out of the structure, so nobody new can find it. Call
+   * destroyer on it once everybody that might have found it before
+   * is done.
+   */
+
+  void retire(void *object, void (*destroyer)(void *))
+  {
+    Retired r;
+    r.object = object;
+    r.destroy = destroyer;
+    r.epoch = globalEpoch.fetch_add(1);
+    boost::mutex::scoped_lock lock(retiredLock);
+    retired.push_back(r);
+    if (retired.size() >= RECLAIM_BATCH) {
+      reclaimRetired();
+    }
+  }
+
+  /**
+   * Free whatever can be freed right now
+   */
+
+  void reclaim()
+  {
+    boost::mutex::scoped_lock lock(retiredLock);
+    reclaimRetired();
+  }
+
+  /**
+   * How many things are waiting to be freed
+   */
+
+  size_t pending()
+  {
+    boost::mutex::scoped_lock lock(retiredLock);
+    return retired.size();
+  }
+
+};
+
+#endif
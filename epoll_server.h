@@ -0,0 +1,890 @@
+/**
+ * EpollServer is SocketServer for when you've got a lot of clients.
+ * Instead of kicking off a thread for every connection, it runs a
+ * fixed number of event loops (one per core by default), each with
+ * its own epoll set, and every connection lives on one loop for its
+ * whole life. Sockets are non-blocking, and each connection only
+ * buffers so much input before it gets cut off.
+ *
+ * By default all the loops share one listening socket and the kernel
+ * wakes up one of them per new connection. If you pass reusePort,
+ * each loop gets its own listening socket on the same port
+ * (SO_REUSEPORT) and the kernel spreads connections across them.
+ *
+ * Usage:
+ * 1) Create a handler class whose constructor takes an
+ *    EpollServer<YourClass> *owner and an int file descriptor. One of
+ *    these gets created for each connection. (This is the same as the
+ *    SocketServer service class.)
+ * 2) Instead of operator(), give it:
+ *
+ *    size_t received(const char *data, size_t length, EpollOutput &out)
+ *
+ *    which gets called with whatever's arrived that you haven't used
+ *    yet. Return how many bytes you used; the rest gets handed back
+ *    to you when more shows up, so you can wait for a whole request.
+ *    You'll get called again right away if you used something and
+ *    there's more left (pipelined requests.) Put whatever you want
+ *    to send in out (see EpollOutput.)
+ *
+ *    bool writable(EpollOutput &out)
+ *
+ *    which gets called when everything you've put in out has been
+ *    sent. If you're streaming something out, put the next piece in
+ *    out and return true. Otherwise return false. If the next piece
+ *    isn't ready yet (another thread is making it), return false and
+ *    have that thread call owner->resume(fdes) once it is; writable
+ *    gets called again from the connection's loop. Call
+ *    out.expectMore() while that's going on, or a client that's
+ *    shut down its side gets hung up on in between. It can also get
+ *    called when there's nothing new, so just return false then.
+ * 3) Create an EpollServer with this class as a template, start it
+ *    and join it.
+ * 4) Handlers run on their loop's thread, so different connections
+ *    get handled at the same time. Lock anything shared you write to,
+ *    and don't block, or you'll hold up everybody else on that loop.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _H_EPOLL_SERVER
+#define _H_EPOLL_SERVER
+
+#include <boost/atomic.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <map>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE (1u << 28)
+#endif
+
+#ifndef SO_REUSEPORT
+#define SO_REUSEPORT 15
+#endif
+
+/**
+ * Where a handler puts what it wants sent. Anything you write gets
+ * copied into a buffer that's reused for the life of the
+ * connection, so after the first response or two it stops
+ * allocating. If you've already got the bytes somewhere that will
+ * stay put until they've gone out (you'll know, because writable
+ * gets called), use reference instead and they won't be copied at
+ * all. Files (say, a response rendered ahead of time) can be queued
+ * with sendFile, and go out with sendfile(), so the bytes never
+ * pass through user space. Everything queued in memory goes out
+ * together in one sendmsg.
+ */
+
+class EpollOutput {
+  /**
+   * A piece of the output. Copied pieces live in buffer, at offset,
+   * since buffer can move as it grows. Referenced ones point
+   * straight at the caller's memory. File pieces have file set, and
+   * start at offset in the file.
+   */
+  struct Segment {
+    const char *external;
+    size_t offset;
+    size_t length;
+    int file;
+  };
+
+  enum { MAX_IOV = 64 };
+
+  std::vector<char> buffer;
+  std::vector<Segment> segments;
+  size_t current;     // First segment that isn't all sent
+  size_t currentSent; // How much of that one has gone
+  size_t queued;      // Bytes in all the segments from current on
+  bool closing;
+  bool more;
+
+  const char *segmentData(const Segment &segment)
+  {
+    return segment.external ? segment.external : &buffer[segment.offset];
+  }
+
+ public:
+
+  EpollOutput() : current(0), currentSent(0), queued(0), closing(false), more(false)
+  {
+  }
+
+  void write(const char *data, size_t length)
+  {
+    if (length == 0) {
+      return;
+    }
+    // Tack it on to the last piece if that was copied too
+    if (!segments.empty() && !segments.back().external && segments.back().file < 0 &&
+        segments.back().offset + segments.back().length == buffer.size()) {
+      segments.back().length += length;
+    } else {
+      Segment segment;
+      segment.external = (const char *) NULL;
+      segment.offset = buffer.size();
+      segment.length = length;
+      segment.file = -1;
+      segments.push_back(segment);
+    }
+    buffer.insert(buffer.end(), data, data + length);
+    queued += length;
+  }
+
+  void write(const std::string &data)
+  {
+    write(data.data(), data.size());
+  }
+
+  /**
+   * Send length bytes at data without copying them. They have to
+   * stay where they are, unchanged, until writable gets called.
+   */
+
+  void reference(const char *data, size_t length)
+  {
+    if (length == 0) {
+      return;
+    }
+    Segment segment;
+    segment.external = data;
+    segment.offset = 0;
+    segment.length = length;
+    segment.file = -1;
+    segments.push_back(segment);
+    queued += length;
+  }
+
+  /**
+   * Send length bytes of file starting at offset, with sendfile.
+   * The file has to stay open, and that part of it unchanged, until
+   * writable gets called.
+   */
+
+  void sendFile(int file, size_t offset, size_t length)
+  {
+    if (length == 0) {
+      return;
+    }
+    Segment segment;
+    segment.external = (const char *) NULL;
+    segment.offset = offset;
+    segment.length = length;
+    segment.file = file;
+    segments.push_back(segment);
+    queued += length;
+  }
+
+  /**
+   * Close the connection once everything's been sent.
+   */
+
+  void closeWhenDone()
+  {
+    closing = true;
+  }
+
+  bool isClosing()
+  {
+    return closing;
+  }
+
+  /**
+   * Say there's more to send that isn't ready yet, and that resume
+   * will get called once it is. A client that's shut down its side
+   * still gets it; without this, it gets hung up on as soon as
+   * everything queued has gone. Call it again with false once the
+   * last piece is in.
+   */
+
+  void expectMore(bool expecting = true)
+  {
+    more = expecting;
+  }
+
+  bool expectingMore()
+  {
+    return more;
+  }
+
+  /**
+   * How much is still waiting to go out.
+   */
+
+  size_t pending()
+  {
+    return queued;
+  }
+
+  /**
+   * Send as much as the socket will take. Returns false if the
+   * connection is broken.
+   */
+
+  bool flush(int fdes)
+  {
+    while (queued > 0) {
+      ssize_t wrote;
+      if (segments[current].file >= 0) {
+        off_t offset = segments[current].offset + currentSent;
+        wrote = sendfile(fdes, segments[current].file, &offset, segments[current].length - currentSent);
+      } else {
+        // Everything in memory up to the next file goes in one call
+        iovec iov[MAX_IOV];
+        int count = 0;
+        size_t i = current;
+        for (; i < segments.size() && segments[i].file < 0 && count < MAX_IOV; i++, count++) {
+          size_t skip = (i == current) ? currentSent : 0;
+          iov[count].iov_base = (void *) (segmentData(segments[i]) + skip);
+          iov[count].iov_len = segments[i].length - skip;
+        }
+        msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = iov;
+        message.msg_iovlen = count;
+        // If a file's next, hold this for it so they share packets
+        wrote = sendmsg(fdes, &message, MSG_NOSIGNAL | (i < segments.size() ? MSG_MORE : 0));
+      }
+      if (wrote < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+      }
+      if (wrote == 0) {
+        // A file that got shorter than we were told
+        return false;
+      }
+      queued -= wrote;
+      size_t left = wrote;
+      while (left > 0) {
+        size_t rest = segments[current].length - currentSent;
+        if (left < rest) {
+          currentSent += left;
+          break;
+        }
+        left -= rest;
+        current++;
+        currentSent = 0;
+      }
+    }
+    buffer.clear();
+    segments.clear();
+    current = 0;
+    currentSent = 0;
+    return true;
+  }
+
+};
+
+template <typename Handler>
+class EpollServer {
+ public:
+  enum { DEFAULT_PORT = 12345, DEFAULT_INPUT_LIMIT = 16384, DEFAULT_IDLE_SECONDS = 60 };
+
+ protected:
+  enum { BACKLOG = 1024, MAX_EVENTS = 256, READ_SIZE = 4096, OUTPUT_HIGH_WATER = 1048576, LINGER_SECONDS = 5 };
+
+  /**
+   * Everything a loop knows about one connection.
+   */
+
+  struct Connection {
+    int fdes;
+    Handler *handler;
+    std::vector<char> input;
+    EpollOutput output;
+    time_t lastActive;
+    /**
+     * Set once we've sent everything and shut down our side. We're
+     * just waiting for the client to hang up.
+     */
+    bool draining;
+    /**
+     * Set when the client has shut down its side. We finish sending
+     * whatever it asked for and then close.
+     */
+    bool peerClosed;
+
+    Connection(EpollServer<Handler> *owner, int fdes) : fdes(fdes), handler(new Handler(owner, fdes)), lastActive(time(NULL)), draining(false), peerClosed(false)
+    {
+    }
+
+    ~Connection()
+    {
+      delete handler;
+      close(fdes);
+    }
+  };
+
+  class EventLoop {
+    EpollServer<Handler> *owner;
+    int epollFd;
+    int wakeFd;
+    int listenFd;
+    bool ownsListener;
+    typedef std::map<int, Connection *> ConnectionMap;
+    ConnectionMap connections;
+    // Connections other threads have asked to have writable called
+    boost::mutex resumeLock;
+    std::vector<int> resumed;
+    time_t lastSweep;
+
+    void watch(Connection *conn)
+    {
+      epoll_event event;
+      memset(&event, 0, sizeof(event));
+      event.events = EPOLLIN | EPOLLRDHUP;
+      // Stop reading while there's a lot waiting to go out
+      if (!conn->draining && conn->output.pending() >= OUTPUT_HIGH_WATER) {
+        event.events = 0;
+      }
+      if (conn->peerClosed) {
+        event.events = 0;
+      }
+      if (conn->output.pending() > 0) {
+        event.events |= EPOLLOUT;
+      }
+      event.data.fd = conn->fdes;
+      epoll_ctl(epollFd, EPOLL_CTL_MOD, conn->fdes, &event);
+    }
+
+    void drop(Connection *conn)
+    {
+      epoll_ctl(epollFd, EPOLL_CTL_DEL, conn->fdes, NULL);
+      connections.erase(conn->fdes);
+      delete conn;
+    }
+
+    void acceptAll()
+    {
+      while (true) {
+        int fdes = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (0 > fdes) {
+          if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            perror("Error while accepting connections");
+            // Going to treat this as non-fatal
+          }
+          return;
+        }
+        int on = 1;
+        setsockopt(fdes, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        Connection *conn = new Connection(owner, fdes);
+        epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.fd = fdes;
+        if (0 > epoll_ctl(epollFd, EPOLL_CTL_ADD, fdes, &event)) {
+          delete conn;
+          continue;
+        }
+        connections[fdes] = conn;
+      }
+    }
+
+    /**
+     * Hand the handler what it hasn't used yet until it stops using
+     * any of it. Returns false if the connection should go away.
+     */
+
+    bool dispatch(Connection *conn)
+    {
+      size_t used = 0;
+      while (used < conn->input.size() && !conn->output.isClosing() &&
+             conn->output.pending() < OUTPUT_HIGH_WATER) {
+        size_t consumed = conn->handler->received(&conn->input[used], conn->input.size() - used, conn->output);
+        if (consumed == 0) {
+          break;
+        }
+        used += consumed;
+      }
+      conn->input.erase(conn->input.begin(), conn->input.begin() + used);
+      // Whatever's left is a partial request. If it's too big, give up.
+      return conn->input.size() < owner->inputLimit;
+    }
+
+    /**
+     * Send what's waiting, and let a streaming handler top it up.
+     * Returns false if the connection should go away.
+     *
+     * Once a closing connection has sent everything, only our side
+     * gets shut down. Closing the socket outright while the client
+     * still has data on its way to us makes the kernel send a reset,
+     * and that can throw away the end of the response before the
+     * client reads it. So we wait for the client to hang up (or for
+     * LINGER_SECONDS) before closing.
+     */
+
+    bool send(Connection *conn)
+    {
+      do {
+        if (!conn->output.flush(conn->fdes)) {
+          return false;
+        }
+      } while (conn->output.pending() == 0 && !conn->output.isClosing() &&
+               conn->handler->writable(conn->output));
+      if (conn->output.pending() == 0 && conn->output.isClosing() && !conn->draining) {
+        ::shutdown(conn->fdes, SHUT_WR);
+        conn->draining = true;
+        conn->input.clear();
+        conn->lastActive = time(NULL);
+      }
+      return true;
+    }
+
+    /**
+     * Handle requests and send the answers until we run out of
+     * complete requests or the socket won't take any more. A handler
+     * that only answers one request at a time gets the next one as
+     * soon as the last answer's gone. Returns false if the
+     * connection should go away.
+     */
+
+    bool serve(Connection *conn)
+    {
+      size_t before;
+      do {
+        before = conn->input.size();
+        if (!dispatch(conn) || !send(conn)) {
+          return false;
+        }
+      } while (conn->output.pending() == 0 && !conn->draining &&
+               !conn->input.empty() && conn->input.size() < before);
+      return true;
+    }
+
+    /**
+     * Throw away whatever the client sends until it hangs up.
+     */
+
+    void drain(Connection *conn)
+    {
+      char buf[READ_SIZE];
+      while (true) {
+        ssize_t got = recv(conn->fdes, buf, sizeof(buf), 0);
+        if (got > 0) {
+          continue;
+        }
+        if (got < 0 && errno == EINTR) {
+          continue;
+        }
+        if (got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+          drop(conn);
+        }
+        return;
+      }
+    }
+
+    /**
+     * A client that's shut down its side is done with once it's got
+     * everything it asked for, including anything the handler says
+     * is still coming.
+     */
+
+    bool finished(Connection *conn)
+    {
+      return conn->peerClosed && conn->output.pending() == 0 && !conn->output.expectingMore();
+    }
+
+    void readable(Connection *conn)
+    {
+      if (conn->draining) {
+        drain(conn);
+        return;
+      }
+      char buf[READ_SIZE];
+      bool open = true;
+      while (true) {
+        ssize_t got = recv(conn->fdes, buf, sizeof(buf), 0);
+        if (got > 0) {
+          conn->input.insert(conn->input.end(), buf, buf + got);
+          if (conn->input.size() >= owner->inputLimit) {
+            break;
+          }
+          continue;
+        }
+        if (got < 0 && errno == EINTR) {
+          continue;
+        }
+        if (got == 0) {
+          open = false;
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+          // Reset, so nothing more can go out either
+          drop(conn);
+          return;
+        }
+        break;
+      }
+      conn->lastActive = time(NULL);
+      // Closed from the other end still gets whatever it asked for
+      conn->peerClosed = !open;
+      if (!serve(conn) || finished(conn)) {
+        drop(conn);
+        return;
+      }
+      watch(conn);
+    }
+
+    void writable(Connection *conn)
+    {
+      conn->lastActive = time(NULL);
+      if (!send(conn)) {
+        drop(conn);
+        return;
+      }
+      // Output drained, there may be requests we stopped reading
+      if (conn->output.pending() == 0 && !conn->input.empty()) {
+        if (!serve(conn)) {
+          drop(conn);
+          return;
+        }
+      }
+      if (finished(conn)) {
+        drop(conn);
+        return;
+      }
+      watch(conn);
+    }
+
+    /**
+     * Let the handlers that asked for it top up their output. The
+     * descriptor might have been closed and reused since, in which
+     * case the new handler gets a writable it wasn't expecting.
+     */
+
+    void resumeAll()
+    {
+      std::vector<int> waiting;
+      {
+        boost::mutex::scoped_lock locked(resumeLock);
+        waiting.swap(resumed);
+      }
+      for (size_t i = 0; i < waiting.size(); i++) {
+        typename ConnectionMap::iterator found = connections.find(waiting[i]);
+        if (found != connections.end() && !found->second->draining) {
+          writable(found->second);
+        }
+      }
+    }
+
+    /**
+     * Drop connections that have been quiet too long. Timeouts are in
+     * whole seconds, so there's no point looking through all of them
+     * more than once a second, however many events come in.
+     */
+
+    void closeIdle()
+    {
+      time_t now = time(NULL);
+      if (now == lastSweep) {
+        return;
+      }
+      lastSweep = now;
+      time_t cutoff = now - owner->idleSeconds;
+      time_t lingerCutoff = now - LINGER_SECONDS;
+      std::vector<Connection *> idle;
+      typename ConnectionMap::iterator it = connections.begin();
+      while (it != connections.end()) {
+        if (it->second->lastActive < (it->second->draining ? lingerCutoff : cutoff)) {
+          idle.push_back(it->second);
+        }
+        it++;
+      }
+      for (size_t i = 0; i < idle.size(); i++) {
+        drop(idle[i]);
+      }
+    }
+
+  public:
+
+    EventLoop(EpollServer<Handler> *owner, int listenFd, bool ownsListener) : owner(owner), listenFd(listenFd), ownsListener(ownsListener), lastSweep(0)
+    {
+      epollFd = epoll_create1(EPOLL_CLOEXEC);
+      wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if (0 > epollFd || 0 > wakeFd) {
+        perror("Error creating event loop");
+        exit(1);
+      }
+      epoll_event event;
+      memset(&event, 0, sizeof(event));
+      event.events = EPOLLIN;
+      event.data.fd = wakeFd;
+      epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+      // Only one loop gets woken up per connection if they share
+      event.events = EPOLLIN | (ownsListener ? 0u : (uint32_t) EPOLLEXCLUSIVE);
+      event.data.fd = listenFd;
+      if (0 > epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event)) {
+        perror("Error watching listener");
+        exit(1);
+      }
+    }
+
+    ~EventLoop()
+    {
+      while (!connections.empty()) {
+        drop(connections.begin()->second);
+      }
+      close(epollFd);
+      close(wakeFd);
+      if (ownsListener) {
+        close(listenFd);
+      }
+    }
+
+    void wake()
+    {
+      uint64_t one = 1;
+      ssize_t ignored = ::write(wakeFd, &one, sizeof(one));
+      (void) ignored;
+    }
+
+    /**
+     * Call writable for fdes, if it's one of ours. Any thread.
+     */
+
+    void resume(int fdes)
+    {
+      {
+        boost::mutex::scoped_lock locked(resumeLock);
+        resumed.push_back(fdes);
+      }
+      wake();
+    }
+
+    void operator()()
+    {
+      epoll_event events[MAX_EVENTS];
+      while (!owner->done()) {
+        int count = epoll_wait(epollFd, events, MAX_EVENTS, 1000);
+        for (int i = 0; i < count && !owner->done(); i++) {
+          int fdes = events[i].data.fd;
+          if (fdes == listenFd) {
+            acceptAll();
+            continue;
+          }
+          if (fdes == wakeFd) {
+            uint64_t value;
+            ssize_t ignored = read(wakeFd, &value, sizeof(value));
+            (void) ignored;
+            resumeAll();
+            continue;
+          }
+          typename ConnectionMap::iterator found = connections.find(fdes);
+          if (found == connections.end()) {
+            continue;
+          }
+          Connection *conn = found->second;
+          if (events[i].events & EPOLLOUT) {
+            writable(conn);
+            if (connections.find(fdes) == connections.end()) {
+              continue;
+            }
+          }
+          if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+            readable(conn);
+          }
+        }
+        closeIdle();
+      }
+    }
+  };
+
+  /**
+   * boost::thread copies what it runs, so it gets one of these
+   * instead of the loop itself.
+   */
+
+  class LoopRunner {
+    EventLoop *loop;
+  public:
+    LoopRunner(EventLoop *loop) : loop(loop)
+    {
+    }
+
+    void operator()()
+    {
+      (*loop)();
+    }
+  };
+
+  int port;
+  unsigned int loopCount;
+  bool reusePort;
+  size_t inputLimit;
+  int idleSeconds;
+  boost::atomic<bool> shutdownFlag;
+  boost::atomic<bool> isReady;
+  int sharedListener;
+  std::vector<EventLoop *> loops;
+  boost::thread_group threads;
+
+  int createListener()
+  {
+    int sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (0 > sock) {
+      perror("Error creating socket");
+      exit(1);
+    }
+    int on = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (reusePort && 0 > setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on))) {
+      perror("Error setting SO_REUSEPORT");
+      exit(1);
+    }
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = INADDR_ANY;
+    if (0 > bind(sock, (sockaddr *) &addr, sizeof(sockaddr_in))) {
+      perror("Error binding to address");
+      exit(1);
+    }
+    if (0 > listen(sock, BACKLOG)) {
+      perror("Error setting up listen");
+      exit(1);
+    }
+    return sock;
+  }
+
+ public:
+
+  /**
+   * loops is how many event loops (and threads) to run. 0 means one
+   * per core.
+   */
+
+  EpollServer(int port = DEFAULT_PORT, unsigned int loops = 0, bool reusePort = false) : port(port), loopCount(loops), reusePort(reusePort), inputLimit(DEFAULT_INPUT_LIMIT), idleSeconds(DEFAULT_IDLE_SECONDS), shutdownFlag(false), isReady(false), sharedListener(-1)
+  {
+    if (loopCount == 0) {
+      loopCount = boost::thread::hardware_concurrency();
+    }
+    if (loopCount == 0) {
+      loopCount = 1;
+    }
+  }
+
+  ~EpollServer()
+  {
+    shutdown();
+    join();
+    for (size_t i = 0; i < loops.size(); i++) {
+      delete loops[i];
+    }
+    if (sharedListener >= 0) {
+      close(sharedListener);
+    }
+  }
+
+  /**
+   * A connection that's got this much unused input gets closed.
+   * Set it before you start.
+   */
+
+  void setInputLimit(size_t bytes)
+  {
+    inputLimit = bytes;
+  }
+
+  /**
+   * Connections that don't send or receive anything for this long
+   * get closed. Set it before you start.
+   */
+
+  void setIdleSeconds(int seconds)
+  {
+    idleSeconds = seconds;
+  }
+
+  void start()
+  {
+    if (!reusePort) {
+      sharedListener = createListener();
+    }
+    for (unsigned int i = 0; i < loopCount; i++) {
+      if (reusePort) {
+        loops.push_back(new EventLoop(this, createListener(), true));
+      } else {
+        loops.push_back(new EventLoop(this, sharedListener, false));
+      }
+    }
+    for (size_t i = 0; i < loops.size(); i++) {
+      threads.create_thread(LoopRunner(loops[i]));
+    }
+    isReady = true;
+  }
+
+  void join()
+  {
+    threads.join_all();
+  }
+
+  bool ready()
+  {
+    return isReady;
+  }
+
+  void shutdown()
+  {
+    shutdownFlag = true;
+    for (size_t i = 0; i < loops.size(); i++) {
+      loops[i]->wake();
+    }
+  }
+
+  bool done()
+  {
+    return shutdownFlag;
+  }
+
+  /**
+   * Have writable called again for the connection on fdes, from
+   * whichever loop it's on. Safe from any thread; this is how a
+   * handler's helper threads tell it they've got more to send.
+   */
+
+  void resume(int fdes)
+  {
+    for (size_t i = 0; i < loops.size(); i++) {
+      loops[i]->resume(fdes);
+    }
+  }
+
+  int getPort()
+  {
+    return port;
+  }
+
+};
+
+#endif
@@ -0,0 +1,250 @@
+/**
+ * FrozenTree is a read-only copy of a Btree (or anything sorted) for
+ * when the adding is done and it's all lookups from there on, which
+ * is what happens after a day of epochs gets loaded.
+ *
+ * The keys go in one array in Eytzinger order: the root is at 1, and
+ * the children of k are at 2k and 2k + 1, which is how a heap is laid
+ * out. A search is the same walk down a tree as always, but there
+ * are no pointers to chase. The next child is worked out from the
+ * compare with no branch. And since the nodes a few levels under k
+ * sit next to each other in memory, the search prefetches the ones
+ * it'll want a few levels before it gets there. The values are kept
+ * in their own array so they don't take up room in the cache lines
+ * the search is reading.
+ *
+ * find, floor and ceil work the same as Btree's, and FrozenTimeTree's
+ * find is a floor lookup like TimeTree's.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _H_FROZEN_TREE
+#define _H_FROZEN_TREE
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+template <typename KeyType, typename ValType>
+class FrozenTree {
+ public:
+  enum { CACHE_LINE = 64 };
+
+ protected:
+  /**
+   * How many keys fit in a cache line. The 2^n nodes n levels under
+   * k start at k * 2^n, so fetching keys + k * LINE_KEYS gets a line
+   * full of k's descendants that far down.
+   */
+
+  enum { LINE_KEYS = sizeof(KeyType) >= CACHE_LINE ? 1 : CACHE_LINE / sizeof(KeyType) };
+
+  // Room for the keys plus enough to slide them onto a cache line
+  std::vector<KeyType> keyStore;
+  std::vector<ValType> values;
+  // keys[1] is the root, keys[0] isn't used
+  KeyType *keys;
+  size_t count;
+
+  // Not copyable, keys points into its own keyStore
+  FrozenTree(const FrozenTree &);
+  FrozenTree &operator=(const FrozenTree &);
+
+  /**
+   * Put the sorted keys and values where they go in Eytzinger order,
+   * by walking the implicit tree in order. Only recurses as deep as
+   * the tree is tall.
+   */
+
+  size_t place(const std::vector<std::pair<KeyType, ValType> > &sorted, size_t next, size_t k)
+  {
+    if (k <= count) {
+      next = place(sorted, next, 2 * k);
+      keys[k] = sorted[next].first;
+      values[k] = sorted[next].second;
+      next++;
+      next = place(sorted, next, 2 * k + 1);
+    }
+    return next;
+  }
+
+  void build(const std::vector<std::pair<KeyType, ValType> > &sorted)
+  {
+    count = sorted.size();
+    keyStore.assign(count + 1 + LINE_KEYS, KeyType());
+    values.assign(count + 1, NOT_FOUND);
+    // Line keys[0] up with a cache line, so each group of children
+    // the search prefetches is in as few lines as possible
+    size_t skip = 0;
+    while (skip < LINE_KEYS && ((uintptr_t) &keyStore[skip]) % CACHE_LINE != 0) {
+      skip++;
+    }
+    if (skip == LINE_KEYS) {
+      skip = 0;
+    }
+    keys = &keyStore[skip];
+    place(sorted, 0, 1);
+  }
+
+  /**
+   * Go all the way down, to the right whenever the key at k is before
+   * key (or not after it, if OrEqual). The bits of where it ends up
+   * are the turns it took, 1 for right.
+   */
+
+  template <bool OrEqual>
+  size_t descend(const KeyType &key) const
+  {
+    size_t k = 1;
+    while (k <= count) {
+      __builtin_prefetch(keys + k * LINE_KEYS);
+      bool right = OrEqual ? !(key < keys[k]) : keys[k] < key;
+      k = 2 * k + right;
+    }
+    return k;
+  }
+
+  /**
+   * Where the last key that isn't after key is, or 0 if there isn't
+   * one. That's the last place the search went right, so drop the
+   * trailing lefts (0s) and then that right.
+   */
+
+  size_t floorIndex(const KeyType &key) const
+  {
+    size_t k = descend<true>(key);
+    return k >> __builtin_ffsll((long long) k);
+  }
+
+  /**
+   * Where the first key that isn't before key is, or 0. That's the
+   * last place the search went left.
+   */
+
+  size_t ceilIndex(const KeyType &key) const
+  {
+    size_t k = descend<false>(key);
+    return k >> __builtin_ffsll((long long) ~k);
+  }
+
+ public:
+  ValType NOT_FOUND;
+
+  /**
+   * Create with the value to be used as "NOT_FOUND"
+   */
+
+  FrozenTree(ValType nf) : keys((KeyType *) NULL), count(0), NOT_FOUND(nf)
+  {
+  }
+
+  /**
+   * Replace what's in here with a range of pairs sorted by key, with
+   * no key in it twice. Throws and leaves it alone if they aren't.
+   */
+
+  template <typename Iterator>
+  void load(Iterator first, Iterator last) throw(std::string)
+  {
+    std::vector<std::pair<KeyType, ValType> > sorted;
+    while (first != last) {
+      if (!sorted.empty() && !(sorted.back().first < first->first)) {
+        throw std::string("Range to freeze isn't sorted, or has a key in it twice");
+      }
+      sorted.push_back(std::make_pair(first->first, first->second));
+      first++;
+    }
+    build(sorted);
+  }
+
+  /**
+   * Replace what's in here with everything in a Btree or TimeTree.
+   * Later changes to the tree don't show up here.
+   */
+
+  template <typename Tree>
+  void freeze(Tree &tree)
+  {
+    std::vector<std::pair<KeyType, ValType> > sorted;
+    if (tree.height() > 0) {
+      typename Tree::Cursor cursor = tree.range(tree.begin(), tree.end());
+      for (; !cursor.done(); ++cursor) {
+        sorted.push_back(*cursor);
+      }
+    }
+    build(sorted);
+  }
+
+  /**
+   * The value for key, or NOT_FOUND
+   */
+
+  ValType find(KeyType key) const
+  {
+    size_t k = floorIndex(key);
+    return (k && !(keys[k] < key)) ? values[k] : NOT_FOUND;
+  }
+
+  /**
+   * The value for the biggest key that isn't more than key, or
+   * NOT_FOUND if they're all bigger
+   */
+
+  ValType floor(KeyType key) const
+  {
+    size_t k = floorIndex(key);
+    return k ? values[k] : NOT_FOUND;
+  }
+
+  /**
+   * The value for the smallest key that isn't less than key, or
+   * NOT_FOUND if they're all smaller
+   */
+
+  ValType ceil(KeyType key) const
+  {
+    size_t k = ceilIndex(key);
+    return k ? values[k] : NOT_FOUND;
+  }
+
+  size_t size() const
+  {
+    return count;
+  }
+
+};
+
+/**
+ * A frozen TimeTree: find gets the value for the closest key at or
+ * before the one asked for.
+ */
+
+template <typename KeyType, typename ValType>
+class FrozenTimeTree : public FrozenTree<KeyType, ValType> {
+ public:
+  FrozenTimeTree(ValType nf) : FrozenTree<KeyType, ValType>(nf)
+  {
+  }
+
+  ValType find(KeyType key) const
+  {
+    return this->floor(key);
+  }
+
+};
+
+#endif
@@ -0,0 +1,42 @@
+/**
+ * Batch geodetic conversion: the plain version, and picking which
+ * version to run.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "geodetic.h"
+#include "geodetic_kernel.h"
+
+void geodeticScalar(const double *x, const double *y, const double *z, size_t count,
+                    double *lat, double *lon, double *alt, double ae, double ee)
+{
+  geodeticLoop<ScalarLanes>(x, y, z, count, lat, lon, alt, ae, ee);
+}
+
+void GeodeticBatch::convert(const double *x, const double *y, const double *z, size_t count,
+                            double *lat, double *lon, double *alt, double ae, double ee,
+                            Implementation use)
+{
+  switch (resolve(use)) {
+  case AVX512:
+    geodeticAvx512(x, y, z, count, lat, lon, alt, ae, ee);
+    break;
+  case AVX2:
+    geodeticAvx2(x, y, z, count, lat, lon, alt, ae, ee);
+    break;
+  default:
+    geodeticScalar(x, y, z, count, lat, lon, alt, ae, ee);
+  }
+}
@@ -0,0 +1,58 @@
+/**
+ * GeodeticBatch converts a whole array of ECEF points to latitude,
+ * longitude and altitude at once. Latlong(Ecef &) iterates until it
+ * converges, one point at a time; this does two Bowring iterations
+ * on the reduced latitude for every point, which needs nothing but
+ * multiplies, divides and square roots until one atan2 at the end,
+ * so it vectorizes. On a CPU with AVX2 or AVX-512 it does 4 or 8
+ * points at a time. It agrees with Latlong to well under a
+ * millimeter from the ground out past GPS orbits.
+ *
+ * The points go in and come out as separate arrays for each
+ * coordinate (x[], y[], z[] rather than an array of Ecefs), which
+ * is what lets a vector load pick up 4 or 8 of them at once.
+ * Latitude and longitude come out in degrees and altitude in
+ * meters, same as Latlong.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _H_GEODETIC
+#define _H_GEODETIC
+
+#include "simd_dispatch.h"
+#include <stddef.h>
+
+/**
+ * Which instruction set to use comes from SimdDispatch, so
+ * GeodeticBatch::AVX2, GeodeticBatch::supported() and friends work.
+ */
+
+class GeodeticBatch : public SimdDispatch {
+ public:
+
+  /**
+   * Convert count points. The output arrays can't overlap the
+   * input ones. ae and ee are the ellipsoid's semi-major axis and
+   * eccentricity squared, WGS84 by default like Latlong.
+   */
+
+  static void convert(const double *x, const double *y, const double *z, size_t count,
+                      double *lat, double *lon, double *alt,
+                      double ae = 6378137.0, double ee = 0.00669437999014,
+                      Implementation use = AUTO);
+
+};
+
+#endif
@@ -0,0 +1,26 @@
+/**
+ * The AVX-512 version of the batch geodetic conversion. This is
+ * the only file built with -mavx512f, and it only gets called after
+ * geodetic.cpp has checked the CPU can run it.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "geodetic_kernel.h"
+
+void geodeticAvx512(const double *x, const double *y, const double *z, size_t count,
+                    double *lat, double *lon, double *alt, double ae, double ee)
+{
+  geodeticLoop<Avx512Lanes>(x, y, z, count, lat, lon, alt, ae, ee);
+}
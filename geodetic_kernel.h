@@ -0,0 +1,126 @@
+/**
+ * The ECEF to geodetic conversion itself, written once for any of
+ * the lanes in simd_lanes.h. Only geodetic.cpp and the instruction
+ * set specific geodetic_*.cpp files should include this.
+ *
+ * It's Bowring's method run on the reduced latitude (beta), kept as
+ * a sine and cosine instead of an angle so no trig is needed while
+ * iterating:
+ *
+ *   start with tan(beta) = (a z) / (b p)
+ *   tan(phi)  = (z + e'^2 b sin^3(beta)) / (p - e^2 a cos^3(beta))
+ *   tan(beta) = (b / a) tan(phi), and go around again.
+ *
+ * where p is the distance from the polar axis. Two rounds are well
+ * under a millimeter from the surface out to GPS altitudes. The
+ * altitude comes from
+ *
+ *   h = p cos(phi) + z sin(phi) - a sqrt(1 - e^2 sin^2(phi))
+ *
+ * which doesn't blow up near the poles like p / cos(phi) - N does.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _H_GEODETIC_KERNEL
+#define _H_GEODETIC_KERNEL
+
+#include "simd_lanes.h"
+#include <stddef.h>
+
+enum { GEODETIC_ITERATIONS = 2 };
+
+template <typename L>
+static inline void geodeticLanes(const double *xs, const double *ys, const double *zs,
+                                 double *lats, double *lons, double *alts, double ae, double ee)
+{
+  typedef typename L::Value V;
+  const double RAD_TO_DEG = 57.29577951308232087680;
+  double be = ae * ::sqrt(1.0 - ee);
+  double ep2 = ee / (1.0 - ee);
+
+  V x = L::load(xs);
+  V y = L::load(ys);
+  V z = L::load(zs);
+  V a = L::set(ae);
+  V b = L::set(be);
+  V p = L::sqrt(x * x + y * y);
+
+  V sinBeta = a * z;
+  V cosBeta = b * p;
+  V num = z;
+  V den = p;
+  for (int i = 0; i < GEODETIC_ITERATIONS; i++) {
+    V r = L::sqrt(sinBeta * sinBeta + cosBeta * cosBeta);
+    sinBeta = sinBeta / r;
+    cosBeta = cosBeta / r;
+    num = z + L::set(ep2 * be) * sinBeta * sinBeta * sinBeta;
+    den = p - L::set(ee * ae) * cosBeta * cosBeta * cosBeta;
+    sinBeta = b * num;
+    cosBeta = a * den;
+  }
+
+  V r = L::sqrt(num * num + den * den);
+  V sinPhi = num / r;
+  V cosPhi = den / r;
+  V alt = p * cosPhi + z * sinPhi - a * L::sqrt(L::set(1.0) - L::set(ee) * sinPhi * sinPhi);
+
+  L::store(lats, atan2Lanes<L>(num, den) * L::set(RAD_TO_DEG));
+  L::store(lons, atan2Lanes<L>(y, x) * L::set(RAD_TO_DEG));
+  L::store(alts, alt);
+}
+
+/**
+ * Run the whole arrays through, WIDTH at a time. The last few get
+ * copied into a full row padded out with a point on the equator,
+ * so nothing reads or writes past the ends of the arrays.
+ */
+
+template <typename L>
+static inline void geodeticLoop(const double *x, const double *y, const double *z, size_t count,
+                                double *lat, double *lon, double *alt, double ae, double ee)
+{
+  size_t i = 0;
+  for (; i + L::WIDTH <= count; i += L::WIDTH) {
+    geodeticLanes<L>(x + i, y + i, z + i, lat + i, lon + i, alt + i, ae, ee);
+  }
+  if (i < count) {
+    double row[6][L::WIDTH];
+    for (size_t j = 0; j < (size_t) L::WIDTH; j++) {
+      bool real = (i + j < count);
+      row[0][j] = real ? x[i + j] : ae;
+      row[1][j] = real ? y[i + j] : 0.0;
+      row[2][j] = real ? z[i + j] : 0.0;
+    }
+    geodeticLanes<L>(row[0], row[1], row[2], row[3], row[4], row[5], ae, ee);
+    for (size_t j = 0; i + j < count; j++) {
+      lat[i + j] = row[3][j];
+      lon[i + j] = row[4][j];
+      alt[i + j] = row[5][j];
+    }
+  }
+}
+
+/**
+ * One of these per instruction set, each in its own object file
+ */
+
+void geodeticScalar(const double *x, const double *y, const double *z, size_t count,
+                    double *lat, double *lon, double *alt, double ae, double ee);
+void geodeticAvx2(const double *x, const double *y, const double *z, size_t count,
+                  double *lat, double *lon, double *alt, double ae, double ee);
+void geodeticAvx512(const double *x, const double *y, const double *z, size_t count,
+                    double *lat, double *lon, double *alt, double ae, double ee);
+
+#endif
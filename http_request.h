@@ -0,0 +1,666 @@
+/**
+ * HttpRequest picks apart one HTTP/1.x request at a time, straight out
+ * of the buffer it arrived in, without allocating anything. Hand
+ * parse() everything that's come in so far, as many times as it
+ * takes; it picks up looking for the end of the headers where it left
+ * off last time. Once it says COMPLETE, the request is the first
+ * size() bytes, and anything after that is the next one. Call reset()
+ * before starting on that.
+ *
+ * The method and path point into what was last handed to parse, so
+ * they're only good until that changes. The query string gets decoded
+ * (%xx and +) into a fixed buffer in here, so parameters stay good
+ * until reset. Too much of anything (headers, parameters, a body) is
+ * a BAD request rather than a reason to allocate, and error() says
+ * what was wrong with it.
+ *
+ * Only what the demo server cares about comes out of the headers:
+ * the version, Connection and Content-Length. Requests with chunked
+ * bodies are turned down, since nothing here takes a body anyway.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _H_HTTP_REQUEST
+#define _H_HTTP_REQUEST
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+class HttpRequest {
+ public:
+  enum Status { INCOMPLETE, COMPLETE, BAD };
+
+  /**
+   * MAX_HEADER_BYTES is the most the request line and headers can
+   * come to, MAX_BODY the biggest body we'll skip over, and the
+   * decoded query has to fit in MAX_QUERY bytes and MAX_PARAMETERS
+   * parameters.
+   */
+  enum { MAX_HEADER_BYTES = 8192, MAX_BODY = 65536, MAX_QUERY = 2048, MAX_PARAMETERS = 32 };
+
+  /**
+   * Some bytes that live somewhere else. Not null terminated, except
+   * for parameter values.
+   */
+
+  struct Slice {
+    const char *data;
+    size_t length;
+
+    Slice() : data(""), length(0)
+    {
+    }
+
+    Slice(const char *data, size_t length) : data(data), length(length)
+    {
+    }
+
+    bool operator==(const char *text) const
+    {
+      return strlen(text) == length && 0 == memcmp(data, text, length);
+    }
+
+    bool operator!=(const char *text) const
+    {
+      return !(*this == text);
+    }
+  };
+
+ private:
+  struct Parameter {
+    size_t name;
+    size_t nameLength;
+    size_t value;
+    size_t valueLength;
+  };
+
+  Status status;
+  const char *base;
+  // Where the request starts, after any blank lines left over from the last one
+  size_t start;
+  bool started;
+  // How far the search for the end of the headers has got
+  size_t scanned;
+  // Offsets, since the buffer can move between calls
+  size_t headerBytes;
+  size_t bodyLength;
+  size_t methodAt, methodLength;
+  size_t pathAt, pathLength;
+  bool version11;
+  bool alive;
+  const char *problem;
+  char decoded[MAX_QUERY];
+  size_t decodedLength;
+  Parameter parameters[MAX_PARAMETERS];
+  size_t parameterCount;
+
+  Status fail(const char *why)
+  {
+    problem = why;
+    status = BAD;
+    return status;
+  }
+
+  static bool lineEnd(char c)
+  {
+    return c == '\r' || c == '\n';
+  }
+
+  static bool space(char c)
+  {
+    return c == ' ' || c == '\t';
+  }
+
+  /**
+   * These, and not <ctype.h>, since a plain char from the network can
+   * be negative, and the locale has no business here anyway
+   */
+
+  static bool digit(char c)
+  {
+    return c >= '0' && c <= '9';
+  }
+
+  static bool upper(char c)
+  {
+    return c >= 'A' && c <= 'Z';
+  }
+
+  static int hex(char c)
+  {
+    if (digit(c)) {
+      return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+      return c - 'a' + 10;
+    }
+    return (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+  }
+
+  /**
+   * True if the comma separated list at value has token in it,
+   * ignoring case
+   */
+
+  static bool hasToken(const char *value, size_t length, const char *token)
+  {
+    size_t tokenLength = strlen(token);
+    size_t at = 0;
+    while (at < length) {
+      while (at < length && (space(value[at]) || value[at] == ',')) {
+        at++;
+      }
+      size_t end = at;
+      while (end < length && value[end] != ',') {
+        end++;
+      }
+      size_t trimmed = end;
+      while (trimmed > at && space(value[trimmed - 1])) {
+        trimmed--;
+      }
+      if (trimmed - at == tokenLength && 0 == strncasecmp(value + at, token, tokenLength)) {
+        return true;
+      }
+      at = end;
+    }
+    return false;
+  }
+
+  /**
+   * Decode from..to of the query into the buffer, null terminated.
+   * Returns false if it doesn't fit or has a broken %xx in it.
+   */
+
+  bool decode(const char *from, const char *to, size_t &at, size_t &length)
+  {
+    at = decodedLength;
+    while (from < to) {
+      if (decodedLength + 1 >= MAX_QUERY) {
+        return false;
+      }
+      char c = *from++;
+      if (c == '+') {
+        c = ' ';
+      } else if (c == '%') {
+        if (to - from < 2 || hex(from[0]) < 0 || hex(from[1]) < 0) {
+          return false;
+        }
+        c = (char) (hex(from[0]) * 16 + hex(from[1]));
+        from += 2;
+      }
+      decoded[decodedLength++] = c;
+    }
+    if (decodedLength >= MAX_QUERY) {
+      return false;
+    }
+    length = decodedLength - at;
+    decoded[decodedLength++] = '\0';
+    return true;
+  }
+
+  Status readQuery(const char *query, const char *end)
+  {
+    while (query < end) {
+      const char *pairEnd = (const char *) memchr(query, '&', end - query);
+      if (!pairEnd) {
+        pairEnd = end;
+      }
+      if (pairEnd > query) {
+        if (parameterCount == MAX_PARAMETERS) {
+          return fail("too many query parameters");
+        }
+        const char *equals = (const char *) memchr(query, '=', pairEnd - query);
+        Parameter &parameter = parameters[parameterCount];
+        if (!decode(query, equals ? equals : pairEnd, parameter.name, parameter.nameLength) ||
+            !decode(equals ? equals + 1 : pairEnd, pairEnd, parameter.value, parameter.valueLength)) {
+          return fail("bad or too long query string");
+        }
+        parameterCount++;
+      }
+      query = pairEnd + 1;
+    }
+    return status;
+  }
+
+  /**
+   * METHOD SP target SP HTTP/1.x
+   */
+
+  Status readRequestLine(const char *line, const char *end)
+  {
+    const char *p = line;
+    while (p < end && upper(*p)) {
+      p++;
+    }
+    if (p == line || p == end || *p != ' ') {
+      return fail("bad request line");
+    }
+    methodAt = line - base;
+    methodLength = p - line;
+    const char *target = ++p;
+    while (p < end && *p != ' ') {
+      p++;
+    }
+    if (p == target || p == end || *target != '/') {
+      return fail("bad request target");
+    }
+    const char *targetEnd = p++;
+    if (end - p != 8 || 0 != memcmp(p, "HTTP/1.", 7) || !digit(p[7])) {
+      return fail("unsupported HTTP version");
+    }
+    version11 = (p[7] != '0');
+    alive = version11;
+
+    const char *fragment = (const char *) memchr(target, '#', targetEnd - target);
+    if (fragment) {
+      targetEnd = fragment;
+    }
+    const char *query = (const char *) memchr(target, '?', targetEnd - target);
+    pathAt = target - base;
+    pathLength = (query ? query : targetEnd) - target;
+    return query ? readQuery(query + 1, targetEnd) : status;
+  }
+
+  Status readHeader(const char *line, const char *end, bool &sawLength)
+  {
+    if (space(*line)) {
+      return fail("folded header");
+    }
+    const char *colon = (const char *) memchr(line, ':', end - line);
+    if (!colon || colon == line) {
+      return fail("bad header");
+    }
+    const char *value = colon + 1;
+    while (value < end && space(*value)) {
+      value++;
+    }
+    while (end > value && space(end[-1])) {
+      end--;
+    }
+    size_t nameLength = colon - line;
+    size_t valueLength = end - value;
+    if (nameLength == 10 && 0 == strncasecmp(line, "connection", 10)) {
+      if (hasToken(value, valueLength, "close")) {
+        alive = false;
+      } else if (hasToken(value, valueLength, "keep-alive")) {
+        alive = true;
+      }
+    } else if (nameLength == 14 && 0 == strncasecmp(line, "content-length", 14)) {
+      size_t length = 0;
+      for (const char *p = value; p < end; p++) {
+        if (!digit(*p) || length > MAX_BODY) {
+          return fail("bad Content-Length");
+        }
+        length = length * 10 + (*p - '0');
+      }
+      if (value == end || (sawLength && length != bodyLength)) {
+        return fail("bad Content-Length");
+      }
+      if (length > MAX_BODY) {
+        return fail("request body too big");
+      }
+      sawLength = true;
+      bodyLength = length;
+    } else if (nameLength == 17 && 0 == strncasecmp(line, "transfer-encoding", 17)) {
+      return fail("chunked request bodies aren't supported");
+    }
+    return status;
+  }
+
+  /**
+   * The whole head is there, from start to headerBytes. Go through
+   * it a line at a time; lines end in \n, with or without a \r.
+   */
+
+  Status readHead()
+  {
+    const char *line = base + start;
+    const char *end = base + headerBytes;
+    bool sawLength = false;
+    bool first = true;
+    while (line < end && status != BAD) {
+      const char *newline = (const char *) memchr(line, '\n', end - line);
+      const char *lineStop = newline;
+      if (lineStop > line && lineStop[-1] == '\r') {
+        lineStop--;
+      }
+      if (lineStop == line) {
+        break;
+      }
+      if (first) {
+        readRequestLine(line, lineStop);
+        first = false;
+      } else {
+        readHeader(line, lineStop, sawLength);
+      }
+      line = newline + 1;
+    }
+    return status;
+  }
+
+ public:
+
+  HttpRequest()
+  {
+    reset();
+  }
+
+  /**
+   * Get ready for the next request
+   */
+
+  void reset()
+  {
+    status = INCOMPLETE;
+    base = "";
+    start = 0;
+    started = false;
+    scanned = 0;
+    headerBytes = 0;
+    bodyLength = 0;
+    methodAt = methodLength = pathAt = pathLength = 0;
+    version11 = false;
+    alive = false;
+    problem = "";
+    decodedLength = 0;
+    parameterCount = 0;
+  }
+
+  /**
+   * Look at the first length bytes of data, which has to start with
+   * whatever it started with last time (more can have arrived on the
+   * end, and it can have moved.) Returns INCOMPLETE until there's a
+   * whole request there.
+   */
+
+  Status parse(const char *data, size_t length)
+  {
+    base = data;
+    if (status != INCOMPLETE) {
+      return status;
+    }
+    if (!headerBytes) {
+      // Blank lines before a request are allowed, and ignored
+      while (!started && scanned < length && lineEnd(data[scanned])) {
+        scanned++;
+      }
+      if (!started && scanned < length) {
+        started = true;
+        start = scanned;
+      } else if (!started && scanned > MAX_HEADER_BYTES) {
+        return fail("too many blank lines");
+      }
+      // The end of the head is a blank line, "\n\n" or "\n\r\n"
+      size_t i = scanned;
+      for (; i < length && !headerBytes; i++) {
+        if (data[i] != '\n') {
+          continue;
+        }
+        if (i + 1 == length || (data[i + 1] == '\r' && i + 2 == length)) {
+          // Can't tell yet
+          break;
+        }
+        if (data[i + 1] == '\n') {
+          headerBytes = i + 2;
+        } else if (data[i + 1] == '\r' && data[i + 2] == '\n') {
+          headerBytes = i + 3;
+        }
+      }
+      scanned = i;
+      if (!headerBytes) {
+        if (started && length - start > MAX_HEADER_BYTES) {
+          return fail("request headers too long");
+        }
+        return status;
+      }
+      if (headerBytes - start > MAX_HEADER_BYTES) {
+        return fail("request headers too long");
+      }
+      if (BAD == readHead()) {
+        return status;
+      }
+    }
+    if (length - headerBytes < bodyLength) {
+      return status;
+    }
+    status = COMPLETE;
+    return status;
+  }
+
+  /**
+   * The whole request, blank lines in front and body included
+   */
+
+  size_t size() const
+  {
+    return headerBytes + bodyLength;
+  }
+
+  /**
+   * What was wrong, if parse said BAD
+   */
+
+  const char *error() const
+  {
+    return problem;
+  }
+
+  Slice method() const
+  {
+    return Slice(base + methodAt, methodLength);
+  }
+
+  /**
+   * The target up to the query, as it was sent
+   */
+
+  Slice path() const
+  {
+    return Slice(base + pathAt, pathLength);
+  }
+
+  bool http11() const
+  {
+    return version11;
+  }
+
+  /**
+   * HTTP/1.1 unless it said "Connection: close", HTTP/1.0 only if it
+   * said "Connection: keep-alive"
+   */
+
+  bool keepAlive() const
+  {
+    return alive;
+  }
+
+  size_t contentLength() const
+  {
+    return bodyLength;
+  }
+
+  size_t parameterSize() const
+  {
+    return parameterCount;
+  }
+
+  /**
+   * The last value given for the query parameter called name (case
+   * doesn't matter), if there was one. It's null terminated.
+   */
+
+  bool parameter(const char *name, Slice &value) const
+  {
+    size_t nameLength = strlen(name);
+    for (size_t i = parameterCount; i > 0; i--) {
+      const Parameter &found = parameters[i - 1];
+      if (found.nameLength == nameLength && 0 == strncasecmp(decoded + found.name, name, nameLength)) {
+        value = Slice(decoded + found.value, found.valueLength);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool has(const char *name) const
+  {
+    Slice ignored;
+    return parameter(name, ignored);
+  }
+
+  /**
+   * Parameter name as a number. False if it isn't there, or isn't all
+   * number.
+   */
+
+  bool number(const char *name, double &value) const
+  {
+    Slice text;
+    return parameter(name, text) && parseNumber(text.data, text.data + text.length, value);
+  }
+
+  /**
+   * Parameter name as seconds since 1970: either that already, or a
+   * UTC time like 2011-10-01T00:00:00Z (the Z and the seconds are
+   * optional.)
+   */
+
+  bool time(const char *name, double &value) const
+  {
+    Slice text;
+    return parameter(name, text) && parseTime(text.data, text.length, value);
+  }
+
+  /**
+   * Split comma separated parameter name into up to most items (empty
+   * ones are skipped), and return how many there were. If there were
+   * more than most, that's what it returns, but only most get filled
+   * in.
+   */
+
+  size_t list(const char *name, Slice *items, size_t most) const
+  {
+    Slice text;
+    if (!parameter(name, text)) {
+      return 0;
+    }
+    size_t count = 0;
+    const char *at = text.data;
+    const char *end = text.data + text.length;
+    while (at < end) {
+      const char *comma = (const char *) memchr(at, ',', end - at);
+      if (!comma) {
+        comma = end;
+      }
+      if (comma > at) {
+        if (count < most) {
+          items[count] = Slice(at, comma - at);
+        }
+        count++;
+      }
+      at = comma + 1;
+    }
+    return count;
+  }
+
+  /**
+   * A bounding box the way google earth sends one,
+   * BBOX=west,south,east,north in degrees. West can be more than
+   * east, for a box across the 180th meridian.
+   */
+
+  bool box(const char *name, double &west, double &south, double &east, double &north) const
+  {
+    Slice items[5];
+    if (4 != list(name, items, 5)) {
+      return false;
+    }
+    double *values[] = { &west, &south, &east, &north };
+    for (int i = 0; i < 4; i++) {
+      if (!parseNumber(items[i].data, items[i].data + items[i].length, *values[i])) {
+        return false;
+      }
+    }
+    return west >= -180.0 && west <= 180.0 && east >= -180.0 && east <= 180.0 &&
+      south >= -90.0 && north <= 90.0 && south <= north;
+  }
+
+  /**
+   * from..to as a plain decimal number, like 12, -3.5 or 1e9. Has to
+   * be followed by something that isn't part of one, since strtod
+   * doesn't know where to stop. strtod would also take spaces, inf,
+   * nan and hex, so only digits, signs, points and exponents get as
+   * far as it, and what comes out has to be finite.
+   */
+
+  static bool parseNumber(const char *from, const char *to, double &value)
+  {
+    if (from == to || !(digit(*from) || *from == '-' || *from == '+' || *from == '.')) {
+      return false;
+    }
+    for (const char *p = from; p < to; p++) {
+      if (!digit(*p) && *p != '-' && *p != '+' && *p != '.' && *p != 'e' && *p != 'E') {
+        return false;
+      }
+    }
+    char *stop;
+    double got = strtod(from, &stop);
+    // Too big comes back as inf
+    if (stop != to || !isfinite(got)) {
+      return false;
+    }
+    value = got;
+    return true;
+  }
+
+  static bool parseTime(const char *text, size_t length, double &value)
+  {
+    if (!memchr(text, '-', length) || text[0] == '-') {
+      return parseNumber(text, text + length, value);
+    }
+    int year, month, day, hour, minute;
+    double second = 0.0;
+    int used = 0;
+    if (sscanf(text, "%4d-%2d-%2dT%2d:%2d:%lf%n", &year, &month, &day, &hour, &minute, &second, &used) != 6) {
+      second = 0.0;
+      if (sscanf(text, "%4d-%2d-%2dT%2d:%2d%n", &year, &month, &day, &hour, &minute, &used) != 5) {
+        return false;
+      }
+    }
+    if ((size_t) used < length && text[used] == 'Z') {
+      used++;
+    }
+    if ((size_t) used != length || month < 1 || month > 12 || day < 1 || day > 31 ||
+        hour < 0 || hour > 23 || minute < 0 || minute > 59 || !(second >= 0.0 && second < 61.0)) {
+      return false;
+    }
+    struct tm broken;
+    memset(&broken, 0, sizeof(broken));
+    broken.tm_year = year - 1900;
+    broken.tm_mon = month - 1;
+    broken.tm_mday = day;
+    broken.tm_hour = hour;
+    broken.tm_min = minute;
+    value = (double) timegm(&broken) + second;
+    return true;
+  }
+
+};
+
+#endif
@@ -0,0 +1,457 @@
+/**
+ * KmlSnapshotCache keeps the demo server's KML document rendered
+ * ahead of time. Every client asking for "now" gets the same
+ * document, so instead of working out every satellite's position
+ * for every request, time is cut into buckets (10 seconds by
+ * default) and each bucket's document is rendered once, into a
+ * memory-backed file. Handlers send that file with sendfile, so
+ * answering a poll doesn't compute or copy anything.
+ *
+ * A background thread renders the next bucket before it starts and
+ * throws away old ones. If a request shows up for a bucket that
+ * isn't ready (right after startup, say), it gets rendered on the
+ * spot.
+ *
+ * Snapshots are handed out as shared pointers, so one that's still
+ * being sent stays around after the cache is done with it.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _H_KML_SNAPSHOT_CACHE
+#define _H_KML_SNAPSHOT_CACHE
+
+#include "ephemeris_cache.h"
+#include "geodetic.h"
+#include "kml_writer.h"
+#include "orbit_interpolator.h"
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <map>
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * One rendered document. The body is in a memory-backed file if
+ * the system will give us one, otherwise it's kept in memory.
+ */
+
+class KmlSnapshot {
+  double snapshotTime;
+  int file;
+  std::string memory;
+  size_t length;
+  std::string keepAliveHeader;
+  std::string closeHeader;
+
+  // Not copyable, it owns the file
+  KmlSnapshot(const KmlSnapshot &);
+  KmlSnapshot &operator=(const KmlSnapshot &);
+
+ public:
+
+  /**
+   * Take a copy of what's in kml. Its header gets set up as a side
+   * effect.
+   */
+
+  KmlSnapshot(double time, KmlWriter &kml) : snapshotTime(time), file(-1), length(kml.size())
+  {
+    kml.httpHeader(true);
+    keepAliveHeader.assign(kml.headerData(), kml.headerSize());
+    kml.httpHeader(false);
+    closeHeader.assign(kml.headerData(), kml.headerSize());
+
+    file = memfd_create("kml-snapshot", MFD_CLOEXEC);
+    const char *data = kml.data();
+    size_t left = length;
+    while (file >= 0 && left > 0) {
+      ssize_t wrote = write(file, data, left);
+      if (wrote < 0 && errno == EINTR) {
+        continue;
+      }
+      if (wrote <= 0) {
+        close(file);
+        file = -1;
+        break;
+      }
+      data += wrote;
+      left -= wrote;
+    }
+    if (file < 0) {
+      memory.assign(kml.data(), kml.size());
+    }
+  }
+
+  ~KmlSnapshot()
+  {
+    if (file >= 0) {
+      close(file);
+    }
+  }
+
+  double time() const
+  {
+    return snapshotTime;
+  }
+
+  /**
+   * The body's file, or -1 if it's in memory (see body)
+   */
+
+  int fileDescriptor() const
+  {
+    return file;
+  }
+
+  const char *body() const
+  {
+    return memory.data();
+  }
+
+  size_t size() const
+  {
+    return length;
+  }
+
+  const std::string &header(bool keepAlive) const
+  {
+    return keepAlive ? keepAliveHeader : closeHeader;
+  }
+
+};
+
+/**
+ * What goes in a document that isn't the one everybody gets: when,
+ * which satellites (all of them if names is empty), only the ones
+ * inside a box if boxed is set, and whether it's CSV instead of KML.
+ * It also keeps the buffers rendering it takes, so a handler that
+ * hangs on to one doesn't allocate much the next time.
+ */
+
+struct KmlSelection {
+  double time;
+  std::vector<std::string> names;
+  bool boxed;
+  double west, south, east, north;
+  bool csv;
+
+  // Scratch space for KmlSnapshotCache::write
+  std::vector<std::string> all;
+  std::vector<const std::string *> found;
+  std::vector<double> x, y, z, lat, lon, alt;
+
+  KmlSelection() : time(0.0), boxed(false), west(-180.0), south(-90.0), east(180.0), north(90.0), csv(false)
+  {
+  }
+
+  /**
+   * Whether a place is in the box. West can be more than east, for a
+   * box across the 180th meridian.
+   */
+
+  bool inside(double longitude, double latitude) const
+  {
+    if (!boxed) {
+      return true;
+    }
+    if (latitude < south || latitude > north) {
+      return false;
+    }
+    if (west <= east) {
+      return longitude >= west && longitude <= east;
+    }
+    return longitude >= west || longitude <= east;
+  }
+};
+
+class KmlSnapshotCache {
+ public:
+  typedef boost::shared_ptr<const KmlSnapshot> SnapshotPtr;
+  enum { DEFAULT_BUCKET_SECONDS = 10, MAX_SNAPSHOTS = 16 };
+
+ private:
+  typedef std::map<double, SnapshotPtr> SnapshotMap;
+
+  EphemerisCache *cache;
+  double bucketSeconds;
+  double offsetSeconds;
+  SnapshotMap snapshots;
+  boost::mutex lock;
+  boost::condition_variable wakeup;
+  bool stopping;
+  boost::thread *renderThread;
+  size_t renders;
+
+  // Used by the render thread only
+  KmlWriter kml;
+  OrbitInterpolator interpolator;
+
+  /**
+   * boost::thread copies what it runs, so it gets one of these
+   * instead of the cache itself.
+   */
+
+  class RenderThread {
+    KmlSnapshotCache *owner;
+  public:
+    RenderThread(KmlSnapshotCache *owner) : owner(owner)
+    {
+    }
+
+    void operator()()
+    {
+      owner->renderAhead();
+    }
+  };
+
+  /**
+   * Make sure the bucket now is in and the next one is ready before
+   * it starts, and drop anything older than the one before now.
+   * Then sleep until halfway through the bucket and do it again.
+   */
+
+  void renderAhead()
+  {
+    boost::mutex::scoped_lock locked(lock);
+    while (!stopping) {
+      double current = bucketOf(now());
+      double buckets[] = { current, current + bucketSeconds };
+      for (int i = 0; i < 2 && !stopping; i++) {
+        if (snapshots.find(buckets[i]) == snapshots.end()) {
+          locked.unlock();
+          SnapshotPtr snapshot = render(buckets[i], kml, interpolator);
+          locked.lock();
+          snapshots.insert(std::make_pair(buckets[i], snapshot));
+        }
+      }
+      snapshots.erase(snapshots.begin(), snapshots.lower_bound(current - bucketSeconds));
+
+      double wait = (current + bucketSeconds / 2.0) - now();
+      if (wait <= 0.0) {
+        wait += bucketSeconds;
+      }
+      wakeup.timed_wait(locked, boost::posix_time::milliseconds((long) (wait * 1000.0)));
+    }
+  }
+
+  /**
+   * Every satellite at time into a new snapshot. Satellites with no
+   * data for that time are left out.
+   */
+
+  SnapshotPtr render(double time, KmlWriter &writer, OrbitInterpolator &interp)
+  {
+    KmlSelection everything;
+    everything.time = time;
+    write(everything, writer, interp);
+    SnapshotPtr snapshot(new KmlSnapshot(time, writer));
+    boost::mutex::scoped_lock locked(lock);
+    renders++;
+    return snapshot;
+  }
+
+ public:
+
+  /**
+   * Render what selection asks for into writer, without keeping it.
+   * Satellites with no data for that time are left out, as are ones
+   * that aren't in the cache at all.
+   */
+
+  void write(KmlSelection &selection, KmlWriter &writer, OrbitInterpolator &interp)
+  {
+    const std::vector<std::string> *names = &selection.names;
+    if (names->empty()) {
+      selection.all.clear();
+      cache->satelliteNames(selection.all);
+      names = &selection.all;
+    }
+    selection.found.clear();
+    selection.x.clear();
+    selection.y.clear();
+    selection.z.clear();
+    EphemerisLine interpolated(0, 0, 0, 0, 0, 0);
+    std::vector<std::string>::const_iterator name = names->begin();
+    while (name != names->end()) {
+      EphemerisLine *current = &interpolated;
+      if (!cache->interpolate(*name, selection.time, interpolated, interp)) {
+        // Off the end of the data, so fall back to the last point
+        current = cache->get(*name, selection.time);
+      }
+      if (NULL != current) {
+        selection.found.push_back(&*name);
+        selection.x.push_back(current->getPosition().getX());
+        selection.y.push_back(current->getPosition().getY());
+        selection.z.push_back(current->getPosition().getZ());
+      }
+      name++;
+    }
+
+    // Convert from ECEF for Google Earth, all at once
+    size_t count = selection.found.size();
+    selection.lat.resize(count);
+    selection.lon.resize(count);
+    selection.alt.resize(count);
+    if (count > 0) {
+      GeodeticBatch::convert(&selection.x[0], &selection.y[0], &selection.z[0], count,
+                             &selection.lat[0], &selection.lon[0], &selection.alt[0]);
+    }
+    writer.clear();
+    if (selection.csv) {
+      writer.beginCsv();
+    } else {
+      writer.beginDocument();
+    }
+    for (size_t i = 0; i < count; i++) {
+      if (!selection.inside(selection.lon[i], selection.lat[i])) {
+        continue;
+      }
+      if (selection.csv) {
+        writer.csvRow(*selection.found[i], selection.time, selection.lon[i], selection.lat[i], selection.alt[i]);
+      } else {
+        writer.placemark(*selection.found[i], selection.lon[i], selection.lat[i], selection.alt[i]);
+      }
+    }
+    if (!selection.csv) {
+      writer.endDocument();
+    }
+  }
+
+  /**
+   * offsetSeconds gets added to the clock to find the time to show,
+   * the demo shows two days ago, since that's what there's data for.
+   */
+
+  KmlSnapshotCache(EphemerisCache *cache, double bucketSeconds = DEFAULT_BUCKET_SECONDS, double offsetSeconds = -2 * 86400.0) : cache(cache), bucketSeconds(bucketSeconds), offsetSeconds(offsetSeconds), stopping(false), renderThread((boost::thread *) NULL), renders(0)
+  {
+    if (this->bucketSeconds <= 0.0) {
+      this->bucketSeconds = 1.0;
+    }
+  }
+
+  ~KmlSnapshotCache()
+  {
+    stop();
+  }
+
+  /**
+   * Start rendering ahead in the background.
+   */
+
+  void start()
+  {
+    if (!renderThread) {
+      stopping = false;
+      renderThread = new boost::thread(RenderThread(this));
+    }
+  }
+
+  void stop()
+  {
+    if (renderThread) {
+      {
+        boost::mutex::scoped_lock locked(lock);
+        stopping = true;
+      }
+      wakeup.notify_all();
+      renderThread->join();
+      delete renderThread;
+      renderThread = (boost::thread *) NULL;
+    }
+  }
+
+  /**
+   * The time to show right now
+   */
+
+  double now() const
+  {
+    return (double) ::time((time_t) NULL) + offsetSeconds;
+  }
+
+  /**
+   * The start of the bucket time is in
+   */
+
+  double bucketOf(double time) const
+  {
+    return floor(time / bucketSeconds) * bucketSeconds;
+  }
+
+  /**
+   * The snapshot for the bucket time is in, rendering it if it isn't
+   * there yet.
+   */
+
+  SnapshotPtr get(double time)
+  {
+    double bucket = bucketOf(time);
+    {
+      boost::mutex::scoped_lock locked(lock);
+      SnapshotMap::iterator found = snapshots.find(bucket);
+      if (found != snapshots.end()) {
+        return found->second;
+      }
+    }
+    KmlWriter writer;
+    OrbitInterpolator interp;
+    SnapshotPtr snapshot = render(bucket, writer, interp);
+    boost::mutex::scoped_lock locked(lock);
+    // Somebody else might have beaten us to it
+    snapshot = snapshots.insert(std::make_pair(bucket, snapshot)).first->second;
+    // Nobody's cleaning up if the render thread isn't running
+    while (snapshots.size() > MAX_SNAPSHOTS) {
+      snapshots.erase(snapshots.begin());
+    }
+    return snapshot;
+  }
+
+  SnapshotPtr current()
+  {
+    return get(now());
+  }
+
+  /**
+   * True if the bucket time is in has already been rendered
+   */
+
+  bool ready(double time)
+  {
+    boost::mutex::scoped_lock locked(lock);
+    return snapshots.find(bucketOf(time)) != snapshots.end();
+  }
+
+  /**
+   * How many snapshots have been rendered
+   */
+
+  size_t renderCount()
+  {
+    boost::mutex::scoped_lock locked(lock);
+    return renders;
+  }
+
+};
+
+#endif
@@ -0,0 +1,422 @@
+/**
+ * KmlTrackPool renders where every satellite was over a time range,
+ * as KML gx:Tracks, for the demo server to stream out. A week at a
+ * 30 second step is about 20,000 points per satellite, and well over
+ * a hundred megabytes of KML for all of them, so the document never
+ * gets rendered all at once. Each satellite's Placemark is its own
+ * piece, and a few worker threads render pieces in parallel, staying
+ * only a few pieces ahead of what's been sent. When the client is
+ * slow the workers wait for it; while they wait, they work on other
+ * requests.
+ *
+ * Pieces come out already framed for HTTP chunked encoding (or not,
+ * for HTTP/1.0 clients), starting with the HTTP header and ending
+ * with the last chunk, so whoever is sending them just sends them in
+ * order. They come out in whatever order the workers finish in,
+ * which doesn't matter to KML.
+ *
+ * The handler sending a track gets told when there's more to send
+ * through a KmlTrackListener. That gets called from a worker thread,
+ * with the pool locked, so it should only pass the word on (the demo
+ * handler calls EpollServer::resume) and not call back into the
+ * pool. Once cancel returns, it won't be called again.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _H_KML_TRACK_POOL
+#define _H_KML_TRACK_POOL
+
+#include "ephemeris_cache.h"
+#include "geodetic.h"
+#include "kml_writer.h"
+#include "orbit_interpolator.h"
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <deque>
+#include <list>
+#include <string>
+#include <vector>
+#include <math.h>
+#include <stdio.h>
+
+class KmlTrackListener {
+ public:
+  virtual ~KmlTrackListener()
+  {
+  }
+
+  virtual void trackReady() = 0;
+};
+
+/**
+ * One request's worth of tracks. Everything in here belongs to the
+ * pool and is only touched with the pool locked; the handler just
+ * holds on to it and hands it back.
+ */
+
+class KmlTrack {
+  friend class KmlTrackPool;
+
+  double begin;
+  double step;
+  size_t points;
+  bool chunked;
+  KmlTrackListener *listener;
+  std::vector<std::string> names;
+  size_t next;
+  size_t rendering;
+  size_t done;
+  bool cancelled;
+  std::deque<boost::shared_ptr<const std::string> > ready;
+
+  KmlTrack(double begin, double step, size_t points, bool chunked, KmlTrackListener *listener) : begin(begin), step(step), points(points), chunked(chunked), listener(listener), next(0), rendering(0), done(0), cancelled(false)
+  {
+  }
+
+  bool complete() const
+  {
+    return done == names.size() && ready.empty();
+  }
+};
+
+class KmlTrackPool {
+ public:
+  typedef boost::shared_ptr<KmlTrack> TrackPtr;
+  typedef boost::shared_ptr<const std::string> Chunk;
+
+  /**
+   * MAX_POINTS is the most times one request can ask for, per
+   * satellite. READ_AHEAD is how many pieces past the ones being
+   * rendered a request can have waiting to be sent.
+   */
+  enum { MAX_POINTS = 1000000, READ_AHEAD = 2 };
+
+ private:
+  EphemerisCache *cache;
+  unsigned int threadCount;
+  boost::mutex lock;
+  boost::condition_variable work;
+  bool stopping;
+  boost::thread_group *threads;
+  // Tracks that still have satellites nobody's started on
+  std::list<TrackPtr> waiting;
+
+  class Worker;
+  friend class Worker;
+
+  /**
+   * boost::thread copies what it runs, so the buffers a worker keeps
+   * between satellites get set up once it's running.
+   */
+
+  class Worker {
+    KmlTrackPool *owner;
+  public:
+    Worker(KmlTrackPool *owner) : owner(owner)
+    {
+    }
+
+    void operator()()
+    {
+      KmlWriter writer;
+      OrbitInterpolator interp;
+      std::vector<double> times, x, y, z, lat, lon, alt;
+      TrackPtr track;
+      size_t satellite;
+      while (owner->nextSatellite(track, satellite)) {
+        Chunk chunk = owner->render(*track, satellite, writer, interp, times, x, y, z, lat, lon, alt);
+        owner->finished(track, chunk);
+        track.reset();
+      }
+    }
+  };
+
+  /**
+   * How many pieces of one track can be rendered or rendering and
+   * not sent yet
+   */
+
+  size_t limit() const
+  {
+    return threadCount + READ_AHEAD;
+  }
+
+  /**
+   * Wait for a satellite to render. Tracks take turns, a satellite
+   * at a time, and the ones that are as far ahead as they're allowed
+   * to get are passed over. Returns false when the pool stops.
+   */
+
+  bool nextSatellite(TrackPtr &track, size_t &satellite)
+  {
+    boost::mutex::scoped_lock locked(lock);
+    while (!stopping) {
+      std::list<TrackPtr>::iterator it = waiting.begin();
+      while (it != waiting.end() && (*it)->ready.size() + (*it)->rendering >= limit()) {
+        it++;
+      }
+      if (it == waiting.end()) {
+        work.wait(locked);
+        continue;
+      }
+      track = *it;
+      waiting.erase(it);
+      satellite = track->next++;
+      track->rendering++;
+      if (track->next < track->names.size()) {
+        waiting.push_back(track);
+      }
+      return true;
+    }
+    return false;
+  }
+
+  void finished(const TrackPtr &track, const Chunk &chunk)
+  {
+    boost::mutex::scoped_lock locked(lock);
+    track->rendering--;
+    track->done++;
+    if (track->cancelled) {
+      return;
+    }
+    if (chunk) {
+      track->ready.push_back(chunk);
+    }
+    if (track->done == track->names.size()) {
+      track->ready.push_back(tail(track->chunked));
+    }
+    track->listener->trackReady();
+  }
+
+  /**
+   * One satellite's Placemark. Times the cache can't interpolate are
+   * left out, and a satellite with none at all doesn't get one.
+   */
+
+  Chunk render(const KmlTrack &track, size_t satellite, KmlWriter &writer, OrbitInterpolator &interp,
+               std::vector<double> &times, std::vector<double> &x, std::vector<double> &y, std::vector<double> &z,
+               std::vector<double> &lat, std::vector<double> &lon, std::vector<double> &alt)
+  {
+    const std::string &name = track.names[satellite];
+    times.clear();
+    x.clear();
+    y.clear();
+    z.clear();
+    EphemerisLine line(0, 0, 0, 0, 0, 0);
+    for (size_t i = 0; i < track.points; i++) {
+      double time = track.begin + i * track.step;
+      if (cache->interpolate(name, time, line, interp)) {
+        times.push_back(time);
+        x.push_back(line.getPosition().getX());
+        y.push_back(line.getPosition().getY());
+        z.push_back(line.getPosition().getZ());
+      }
+    }
+    if (times.empty()) {
+      return Chunk();
+    }
+    lat.resize(times.size());
+    lon.resize(times.size());
+    alt.resize(times.size());
+    GeodeticBatch::convert(&x[0], &y[0], &z[0], times.size(), &lat[0], &lon[0], &alt[0]);
+    writer.clear();
+    writer.trackPlacemark(name, &times[0], &lon[0], &lat[0], &alt[0], times.size());
+    return frame(writer.data(), writer.size(), track.chunked);
+  }
+
+  /**
+   * length bytes of data as a chunk, if it's being chunked
+   */
+
+  static Chunk frame(const char *data, size_t length, bool chunked, const std::string &before = std::string())
+  {
+    std::string *chunk = new std::string(before);
+    if (chunked) {
+      char size[32];
+      int sizeLength = snprintf(size, sizeof(size), "%lx\r\n", (unsigned long) length);
+      chunk->reserve(before.size() + sizeLength + length + 2);
+      chunk->append(size, sizeLength);
+      chunk->append(data, length);
+      chunk->append("\r\n");
+    } else {
+      chunk->append(data, length);
+    }
+    return Chunk(chunk);
+  }
+
+  static Chunk head(bool chunked, bool keepAlive)
+  {
+    KmlWriter writer;
+    writer.streamHeader(chunked, keepAlive);
+    writer.beginTrackDocument();
+    return frame(writer.data(), writer.size(), chunked, std::string(writer.headerData(), writer.headerSize()));
+  }
+
+  static Chunk tail(bool chunked)
+  {
+    KmlWriter writer;
+    writer.endDocument();
+    Chunk framed = frame(writer.data(), writer.size(), chunked);
+    if (!chunked) {
+      return framed;
+    }
+    // The zero length chunk says that's all
+    return Chunk(new std::string(*framed + "0\r\n\r\n"));
+  }
+
+ public:
+
+  KmlTrackPool(EphemerisCache *cache, unsigned int threads = boost::thread::hardware_concurrency()) : cache(cache), threadCount(threads ? threads : 1), stopping(false), threads((boost::thread_group *) NULL)
+  {
+  }
+
+  ~KmlTrackPool()
+  {
+    stop();
+  }
+
+  void start()
+  {
+    if (!threads) {
+      stopping = false;
+      threads = new boost::thread_group();
+      for (unsigned int i = 0; i < threadCount; i++) {
+        threads->create_thread(Worker(this));
+      }
+    }
+  }
+
+  /**
+   * Stop the workers. Anything that wasn't finished never will be,
+   * so stop the server first.
+   */
+
+  void stop()
+  {
+    if (threads) {
+      {
+        boost::mutex::scoped_lock locked(lock);
+        stopping = true;
+      }
+      work.notify_all();
+      threads->join_all();
+      delete threads;
+      threads = (boost::thread_group *) NULL;
+    }
+  }
+
+  /**
+   * Check a request for a track from begin to end (seconds since
+   * 1970) every step seconds, and work out how many times that is.
+   * Returns an empty string if it's alright, or what's wrong with it.
+   */
+
+  static std::string check(double begin, double end, double step, size_t &points)
+  {
+    points = 0;
+    if (!isfinite(begin) || !isfinite(end) || !isfinite(step)) {
+      return "begin, end and step have to be numbers";
+    }
+    if (end < begin) {
+      return "end is before begin";
+    }
+    if (!(step > 0.0)) {
+      return "step has to be more than zero";
+    }
+    double count = floor((end - begin) / step + 1e-9) + 1.0;
+    // Written so that NaN fails it too
+    if (!(count <= MAX_POINTS)) {
+      return "too many points, use a bigger step";
+    }
+    points = (size_t) count;
+    return std::string();
+  }
+
+  /**
+   * Start rendering every satellite's track from begin to end, every
+   * step seconds. The first piece (the HTTP header and the start of
+   * the document) is ready right away. Call check first; a request
+   * it doesn't like gets an empty document. HTTP/1.0 clients can't
+   * take chunks, so pass chunked false for them and hang up once
+   * it's sent.
+   */
+
+  TrackPtr submit(double begin, double end, double step, bool chunked, bool keepAlive, KmlTrackListener *listener)
+  {
+    size_t points;
+    if (!check(begin, end, step, points).empty()) {
+      points = 0;
+    }
+    TrackPtr track(new KmlTrack(begin, step, points, chunked, listener));
+    cache->satelliteNames(track->names);
+    track->ready.push_back(head(chunked, keepAlive));
+    if (track->names.empty()) {
+      track->ready.push_back(tail(chunked));
+      return track;
+    }
+    {
+      boost::mutex::scoped_lock locked(lock);
+      waiting.push_back(track);
+    }
+    work.notify_all();
+    return track;
+  }
+
+  /**
+   * The next piece of track to send, if there's one ready. Hang on
+   * to it until it's been sent. Returns false if there isn't one,
+   * with finished set if there won't be any more; otherwise the
+   * listener gets called when there is.
+   */
+
+  bool take(const TrackPtr &track, Chunk &chunk, bool &finished)
+  {
+    {
+      boost::mutex::scoped_lock locked(lock);
+      finished = track->complete();
+      if (track->ready.empty()) {
+        return false;
+      }
+      chunk = track->ready.front();
+      track->ready.pop_front();
+    }
+    // That might be room for another one
+    work.notify_all();
+    return true;
+  }
+
+  /**
+   * Stop working on track and never call its listener again. Any
+   * satellite in the middle of being rendered gets thrown away.
+   */
+
+  void cancel(const TrackPtr &track)
+  {
+    boost::mutex::scoped_lock locked(lock);
+    track->cancelled = true;
+    track->ready.clear();
+    waiting.remove(track);
+  }
+
+  unsigned int size() const
+  {
+    return threadCount;
+  }
+
+};
+
+#endif
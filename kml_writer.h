@@ -0,0 +1,450 @@
+/**
+ * KmlWriter builds the KML document (and the HTTP header for it)
+ * the demo server sends out. It writes into a byte buffer that it
+ * keeps between responses, so once it's grown to fit a document it
+ * doesn't allocate any more. The fixed parts of the document are
+ * copied in as-is, and numbers get formatted with a fixed number of
+ * decimal places by hand instead of going through iostreams.
+ *
+ * To build a response:
+ * 1) clear()
+ * 2) beginDocument(), a placemark() for each satellite, endDocument()
+ * 3) httpHeader() to fill in the header for what's in the body
+ * 4) Send headerData() and data(). Don't touch the writer again
+ *    until they've gone out, since they aren't copied.
+ *
+ * Tracks over a time range go out in pieces, since they're too big
+ * to render in one go: streamHeader() first, then
+ * beginTrackDocument(), a trackPlacemark() for each satellite and
+ * endDocument(), each sent as soon as it's written.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _H_KML_WRITER
+#define _H_KML_WRITER
+
+#include <string>
+#include <vector>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+class KmlWriter {
+  std::vector<char> body;
+  size_t used;
+  char header[256];
+  size_t headerLength;
+
+  /**
+   * Make room for length more bytes and hand back where they go.
+   */
+
+  char *reserve(size_t length)
+  {
+    if (used + length > body.size()) {
+      size_t grow = body.size() * 2;
+      body.resize(grow > used + length ? grow : used + length + 4096);
+    }
+    return &body[used];
+  }
+
+ public:
+
+  /**
+   * Digits after the decimal point. 7 places of a degree is about a
+   * centimeter, and altitudes are in meters, so 3 places is a mm.
+   */
+  enum { DEGREE_DECIMALS = 7, METER_DECIMALS = 3 };
+
+  /**
+   * The longest thing formatFixed will write.
+   */
+  enum { MAX_NUMBER = 48 };
+
+  /**
+   * The longest thing formatTime will write.
+   */
+  enum { MAX_TIME = 32 };
+
+  KmlWriter() : used(0), headerLength(0)
+  {
+  }
+
+  void clear()
+  {
+    used = 0;
+    headerLength = 0;
+  }
+
+  void append(const char *text, size_t length)
+  {
+    memcpy(reserve(length), text, length);
+    used += length;
+  }
+
+  /**
+   * For string literals, so their length is worked out when it's
+   * compiled.
+   */
+
+  template <size_t N>
+  void append(const char (&text)[N])
+  {
+    append(text, N - 1);
+  }
+
+  void appendFixed(double value, int decimals)
+  {
+    used += formatFixed(reserve(MAX_NUMBER), value, decimals);
+  }
+
+  void appendTime(double time)
+  {
+    used += formatTime(reserve(MAX_TIME), time);
+  }
+
+  /**
+   * Copy text in, escaping anything XML would choke on.
+   */
+
+  void appendEscaped(const std::string &text)
+  {
+    for (size_t i = 0; i < text.size(); i++) {
+      switch (text[i]) {
+      case '&':
+        append("&amp;");
+        break;
+      case '<':
+        append("&lt;");
+        break;
+      case '>':
+        append("&gt;");
+        break;
+      default:
+        *reserve(1) = text[i];
+        used++;
+      }
+    }
+  }
+
+  void beginDocument()
+  {
+    append("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+           "<kml xmlns=\"http://www.opengis.net/kml/2.2\">\n"
+           "<Document>\n");
+  }
+
+  /**
+   * One point. KML wants longitude first, then latitude (both in
+   * degrees), then altitude in meters.
+   */
+
+  void placemark(const std::string &name, double longitude, double latitude, double altitude)
+  {
+    append("<Placemark>\n"
+           "   <name>");
+    appendEscaped(name);
+    append("</name>\n"
+           "   <description>GPS Satellite</description>\n"
+           "   <Point>\n"
+           "      <extrude>1</extrude>\n"
+           "      <altitudeMode>relativeToGround</altitudeMode>\n"
+           "      <coordinates>");
+    appendFixed(longitude, DEGREE_DECIMALS);
+    append(",");
+    appendFixed(latitude, DEGREE_DECIMALS);
+    append(",");
+    appendFixed(altitude, METER_DECIMALS);
+    append("</coordinates>\n"
+           "   </Point>\n"
+           "</Placemark>\n");
+  }
+
+  /**
+   * Same as beginDocument, with the namespace gx:Track lives in.
+   */
+
+  void beginTrackDocument()
+  {
+    append("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+           "<kml xmlns=\"http://www.opengis.net/kml/2.2\" xmlns:gx=\"http://www.google.com/kml/ext/2.2\">\n"
+           "<Document>\n");
+  }
+
+  /**
+   * Where one satellite was at count times, as a gx:Track. KML wants
+   * all the times first and then all the coordinates, in the same
+   * order. The TimeSpan is what google earth's time slider uses to
+   * decide when to show it.
+   */
+
+  void trackPlacemark(const std::string &name, const double *times, const double *longitude,
+                      const double *latitude, const double *altitude, size_t count)
+  {
+    if (count == 0) {
+      return;
+    }
+    append("<Placemark>\n"
+           "   <name>");
+    appendEscaped(name);
+    append("</name>\n"
+           "   <description>GPS Satellite</description>\n"
+           "   <TimeSpan><begin>");
+    appendTime(times[0]);
+    append("</begin><end>");
+    appendTime(times[count - 1]);
+    append("</end></TimeSpan>\n"
+           "   <gx:Track>\n"
+           "      <altitudeMode>absolute</altitudeMode>\n");
+    for (size_t i = 0; i < count; i++) {
+      append("      <when>");
+      appendTime(times[i]);
+      append("</when>\n");
+    }
+    for (size_t i = 0; i < count; i++) {
+      append("      <gx:coord>");
+      appendFixed(longitude[i], DEGREE_DECIMALS);
+      append(" ");
+      appendFixed(latitude[i], DEGREE_DECIMALS);
+      append(" ");
+      appendFixed(altitude[i], METER_DECIMALS);
+      append("</gx:coord>\n");
+    }
+    append("   </gx:Track>\n"
+           "</Placemark>\n");
+  }
+
+  void endDocument()
+  {
+    append("</Document>\n"
+           "</kml>\n");
+  }
+
+  /**
+   * The same thing as plain text, for anybody who asks for CSV: a
+   * line of column names, then a row for each satellite.
+   */
+
+  void beginCsv()
+  {
+    append("name,time,longitude,latitude,altitude\n");
+  }
+
+  void csvRow(const std::string &name, double time, double longitude, double latitude, double altitude)
+  {
+    append(name.data(), name.size());
+    append(",");
+    appendTime(time);
+    append(",");
+    appendFixed(longitude, DEGREE_DECIMALS);
+    append(",");
+    appendFixed(latitude, DEGREE_DECIMALS);
+    append(",");
+    appendFixed(altitude, METER_DECIMALS);
+    append("\n");
+  }
+
+  /**
+   * Fill in the HTTP header for what's in the body now, which is KML
+   * unless csv says it's CSV.
+   */
+
+  void httpHeader(bool keepAlive, bool csv = false)
+  {
+    static const char start[] = "HTTP/1.1 200 OK\r\n"
+      "Content-Type: application/vnd.google-earth.kml+xml\r\n"
+      "Content-Length: ";
+    static const char csvStart[] = "HTTP/1.1 200 OK\r\n"
+      "Content-Type: text/csv\r\n"
+      "Content-Length: ";
+    static const char alive[] = "\r\nConnection: keep-alive\r\n\r\n";
+    static const char closing[] = "\r\nConnection: close\r\n\r\n";
+    if (csv) {
+      memcpy(header, csvStart, sizeof(csvStart) - 1);
+      headerLength = sizeof(csvStart) - 1;
+    } else {
+      memcpy(header, start, sizeof(start) - 1);
+      headerLength = sizeof(start) - 1;
+    }
+    headerLength += formatFixed(header + headerLength, (double) used, 0);
+    if (keepAlive) {
+      memcpy(header + headerLength, alive, sizeof(alive) - 1);
+      headerLength += sizeof(alive) - 1;
+    } else {
+      memcpy(header + headerLength, closing, sizeof(closing) - 1);
+      headerLength += sizeof(closing) - 1;
+    }
+  }
+
+  /**
+   * Fill in the HTTP header for a response whose length isn't known
+   * when it starts. HTTP/1.1 clients get it chunked, and can keep the
+   * connection. Anybody else gets it as-is, and the end of the
+   * response is when we hang up.
+   */
+
+  void streamHeader(bool chunked, bool keepAlive)
+  {
+    static const char start[] = " 200 OK\r\n"
+      "Content-Type: application/vnd.google-earth.kml+xml\r\n";
+    static const char chunking[] = "Transfer-Encoding: chunked\r\n";
+    static const char alive[] = "Connection: keep-alive\r\n\r\n";
+    static const char closing[] = "Connection: close\r\n\r\n";
+    memcpy(header, chunked ? "HTTP/1.1" : "HTTP/1.0", 8);
+    headerLength = 8;
+    memcpy(header + headerLength, start, sizeof(start) - 1);
+    headerLength += sizeof(start) - 1;
+    if (chunked) {
+      memcpy(header + headerLength, chunking, sizeof(chunking) - 1);
+      headerLength += sizeof(chunking) - 1;
+    }
+    if (chunked && keepAlive) {
+      memcpy(header + headerLength, alive, sizeof(alive) - 1);
+      headerLength += sizeof(alive) - 1;
+    } else {
+      memcpy(header + headerLength, closing, sizeof(closing) - 1);
+      headerLength += sizeof(closing) - 1;
+    }
+  }
+
+  const char *data() const
+  {
+    return used ? &body[0] : "";
+  }
+
+  size_t size() const
+  {
+    return used;
+  }
+
+  const char *headerData() const
+  {
+    return header;
+  }
+
+  size_t headerSize() const
+  {
+    return headerLength;
+  }
+
+  /**
+   * Write value into out rounded to decimals places (0 to 9) and
+   * return how many characters that took. It's never more than
+   * MAX_NUMBER, and there's no terminating null. The rounding is
+   * done in one multiply, so the last digit can be off by one from
+   * what printf would give you when the value is right on a half,
+   * which doesn't matter at these precisions. Values too big to
+   * scale into 64 bits get handed to snprintf.
+   */
+
+  static size_t formatFixed(char *out, double value, int decimals)
+  {
+    static const unsigned long long powers[] = { 1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL };
+    if (decimals < 0) {
+      decimals = 0;
+    } else if (decimals > 9) {
+      decimals = 9;
+    }
+    unsigned long long scale = powers[decimals];
+    double magnitude = value < 0 ? -value : value;
+    if (!(magnitude * scale < 9.0e18)) {
+      // Too big, or not a number
+      char buffer[512];
+      int length = snprintf(buffer, sizeof(buffer), "%.*g", 17, value);
+      if (length > MAX_NUMBER) {
+        length = MAX_NUMBER;
+      }
+      memcpy(out, buffer, length);
+      return length;
+    }
+    unsigned long long scaled = (unsigned long long) (magnitude * scale + 0.5);
+    char digits[24];
+    int count = 0;
+    do {
+      digits[count++] = '0' + (char) (scaled % 10);
+      scaled /= 10;
+    } while (scaled > 0 || count <= decimals);
+
+    char *p = out;
+    // Only a minus sign if there's something nonzero after it
+    if (value < 0) {
+      for (int i = 0; i < count; i++) {
+        if (digits[i] != '0') {
+          *p++ = '-';
+          break;
+        }
+      }
+    }
+    while (count > decimals) {
+      *p++ = digits[--count];
+    }
+    if (decimals > 0) {
+      *p++ = '.';
+      while (count > 0) {
+        *p++ = digits[--count];
+      }
+    }
+    return p - out;
+  }
+
+  /**
+   * Write time (seconds since 1970, UTC) into out the way KML wants
+   * it, 2011-10-01T00:00:00Z, with milliseconds if it isn't a whole
+   * second. Returns how many characters that took, which is never
+   * more than MAX_TIME. There's no terminating null.
+   */
+
+  static size_t formatTime(char *out, double time)
+  {
+    double whole = floor(time);
+    long millis = (long) ((time - whole) * 1000.0 + 0.5);
+    if (millis >= 1000) {
+      whole += 1.0;
+      millis -= 1000;
+    }
+    time_t seconds = (time_t) whole;
+    struct tm broken;
+    gmtime_r(&seconds, &broken);
+    int fields[] = { broken.tm_mon + 1, broken.tm_mday, broken.tm_hour, broken.tm_min, broken.tm_sec };
+    static const char separators[] = "-T::Z";
+    char *p = out;
+    int year = broken.tm_year + 1900;
+    if (year < 0 || year > 9999) {
+      // Not something KML can say
+      year = year < 0 ? 0 : 9999;
+    }
+    *p++ = '0' + (char) (year / 1000);
+    *p++ = '0' + (char) (year / 100 % 10);
+    *p++ = '0' + (char) (year / 10 % 10);
+    *p++ = '0' + (char) (year % 10);
+    *p++ = '-';
+    for (int i = 0; i < 5; i++) {
+      *p++ = '0' + (char) (fields[i] / 10);
+      *p++ = '0' + (char) (fields[i] % 10);
+      if (i == 4 && millis > 0) {
+        *p++ = '.';
+        *p++ = '0' + (char) (millis / 100);
+        *p++ = '0' + (char) (millis / 10 % 10);
+        *p++ = '0' + (char) (millis % 10);
+      }
+      *p++ = separators[i];
+    }
+    return p - out;
+  }
+
+};
+
+#endif
@@ -0,0 +1,128 @@
+/**
+ * Look angles: setting up the observers, the plain version of the
+ * loop, and picking which version to run.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "look_angles.h"
+#include "look_angles_kernel.h"
+
+size_t lookAnglesScalar(const LookAngleColumns &observers, double sx, double sy, double sz, double sinMask,
+                        size_t *index, double *azimuth, double *elevation, double *range)
+{
+  return lookAnglesLoop<ScalarLanes>(observers, sx, sy, sz, sinMask, index, azimuth, elevation, range);
+}
+
+LookAngles::LookAngles(Implementation use, double ae, double ee) : use(resolve(use)), ae(ae), ee(ee)
+{
+}
+
+size_t LookAngles::addObserver(const std::string &name, double lat, double lon, double alt)
+{
+  const double DEG_TO_RAD = 0.01745329251994329577;
+  size_t index = observerNames.size();
+  observerNames.push_back(name);
+  if (index == x.size()) {
+    // Out of room, so add another row of padding. The padding is all
+    // zeros, which is harmless, and never makes it into the results.
+    std::vector<double> *columns[] = { &x, &y, &z, &eastX, &eastY, &northX, &northY, &northZ, &upX, &upY, &upZ };
+    for (int i = 0; i < 11; i++) {
+      columns[i]->resize(index + LOOK_ANGLE_PADDING, 0.0);
+    }
+  }
+
+  Latlong ll(lat, lon, alt);
+  Ecef position(ll, ae, ee);
+  double sinLat = sin(lat * DEG_TO_RAD);
+  double cosLat = cos(lat * DEG_TO_RAD);
+  double sinLon = sin(lon * DEG_TO_RAD);
+  double cosLon = cos(lon * DEG_TO_RAD);
+  x[index] = position.getX();
+  y[index] = position.getY();
+  z[index] = position.getZ();
+  eastX[index] = -sinLon;
+  eastY[index] = cosLon;
+  northX[index] = -sinLat * cosLon;
+  northY[index] = -sinLat * sinLon;
+  northZ[index] = cosLat;
+  upX[index] = cosLat * cosLon;
+  upY[index] = cosLat * sinLon;
+  upZ[index] = sinLat;
+  return index;
+}
+
+void LookAngles::clearObservers()
+{
+  observerNames.clear();
+  std::vector<double> *columns[] = { &x, &y, &z, &eastX, &eastY, &northX, &northY, &northZ, &upX, &upY, &upZ };
+  for (int i = 0; i < 11; i++) {
+    columns[i]->clear();
+  }
+}
+
+void LookAngles::setSatellites(const std::vector<std::string> &names, const std::vector<double> &x,
+                               const std::vector<double> &y, const std::vector<double> &z)
+{
+  satelliteNames = names;
+  satX = x;
+  satY = y;
+  satZ = z;
+}
+
+size_t LookAngles::compute(double elevationMask, LookAngleResults &results) const
+{
+  const double DEG_TO_RAD = 0.01745329251994329577;
+  results.clear();
+  size_t count = observerNames.size();
+  if (count == 0) {
+    return 0;
+  }
+
+  LookAngleColumns observers = { &x[0], &y[0], &z[0], &eastX[0], &eastY[0],
+                                 &northX[0], &northY[0], &northZ[0], &upX[0], &upY[0], &upZ[0], count };
+  double sinMask = sin(elevationMask * DEG_TO_RAD);
+  size_t found = 0;
+  for (size_t s = 0; s < satelliteNames.size(); s++) {
+    // Room for every observer to see this one, trimmed back afterwards
+    results.observer.resize(found + count);
+    results.azimuth.resize(found + count);
+    results.elevation.resize(found + count);
+    results.range.resize(found + count);
+    size_t *index = &results.observer[found];
+    double *azimuth = &results.azimuth[found];
+    double *elevation = &results.elevation[found];
+    double *range = &results.range[found];
+
+    size_t visible;
+    switch (use) {
+    case AVX512:
+      visible = lookAnglesAvx512(observers, satX[s], satY[s], satZ[s], sinMask, index, azimuth, elevation, range);
+      break;
+    case AVX2:
+      visible = lookAnglesAvx2(observers, satX[s], satY[s], satZ[s], sinMask, index, azimuth, elevation, range);
+      break;
+    default:
+      visible = lookAnglesScalar(observers, satX[s], satY[s], satZ[s], sinMask, index, azimuth, elevation, range);
+    }
+    found += visible;
+    results.satellite.resize(found, s);
+  }
+
+  results.observer.resize(found);
+  results.azimuth.resize(found);
+  results.elevation.resize(found);
+  results.range.resize(found);
+  return found;
+}
@@ -0,0 +1,176 @@
+/**
+ * LookAngles answers "what can each ground station see right now,
+ * and where should it point?" for a lot of ground stations at once.
+ * Observers get added once, which works out their ECEF position and
+ * the rotation into their local east/north/up frame. Then for a set
+ * of satellite positions, compute() finds the azimuth, elevation and
+ * range from every observer to every satellite above the elevation
+ * mask.
+ *
+ * The observers are kept a column per number (all the x's together,
+ * all the y's together, and so on) so the work is done 4 or 8
+ * observers at a time on CPUs with AVX2 or AVX-512, the same way
+ * GeodeticBatch does it.
+ *
+ * Azimuth is in degrees clockwise from north, 0 to 360. Elevation is
+ * in degrees above the horizon, and range is in meters.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _H_LOOK_ANGLES
+#define _H_LOOK_ANGLES
+
+#include "coordinates.h"
+#include "ephemeris_cache.h"
+#include "orbit_interpolator.h"
+#include "simd_dispatch.h"
+#include <math.h>
+#include <string>
+#include <vector>
+
+/**
+ * What compute() found, one entry per observer/satellite pair that
+ * made it over the mask. observer and satellite are indexes, see
+ * LookAngles::observerName and LookAngles::satelliteName. They come
+ * out grouped by satellite, in the order the satellites were given.
+ */
+
+struct LookAngleResults {
+  std::vector<size_t> observer;
+  std::vector<size_t> satellite;
+  std::vector<double> azimuth;
+  std::vector<double> elevation;
+  std::vector<double> range;
+
+  size_t size() const
+  {
+    return observer.size();
+  }
+
+  void clear()
+  {
+    observer.clear();
+    satellite.clear();
+    azimuth.clear();
+    elevation.clear();
+    range.clear();
+  }
+
+};
+
+class LookAngles : public SimdDispatch {
+  Implementation use;
+  double ae;
+  double ee;
+
+  std::vector<std::string> observerNames;
+  // Observer columns, padded out to a multiple of LOOK_ANGLE_PADDING
+  std::vector<double> x, y, z;
+  std::vector<double> eastX, eastY;
+  std::vector<double> northX, northY, northZ;
+  std::vector<double> upX, upY, upZ;
+
+  std::vector<std::string> satelliteNames;
+  std::vector<double> satX, satY, satZ;
+
+ public:
+
+  /**
+   * ae and ee are the ellipsoid the observers' latitudes and
+   * altitudes are on, WGS84 by default like Latlong.
+   */
+
+  LookAngles(Implementation use = AUTO, double ae = 6378137.0, double ee = 0.00669437999014);
+
+  /**
+   * Add an observer at lat and lon in degrees and alt meters above
+   * the ellipsoid. Returns its index.
+   */
+
+  size_t addObserver(const std::string &name, double lat, double lon, double alt);
+
+  void clearObservers();
+
+  size_t observerCount() const
+  {
+    return observerNames.size();
+  }
+
+  const std::string &observerName(size_t index) const
+  {
+    return observerNames[index];
+  }
+
+  /**
+   * Replace the satellites with the given ECEF positions
+   */
+
+  void setSatellites(const std::vector<std::string> &names, const std::vector<double> &x,
+                     const std::vector<double> &y, const std::vector<double> &z);
+
+  /**
+   * Replace the satellites with everything in cache at time. Like
+   * the KML snapshots, satellites with no data to interpolate from
+   * use their closest point before time, and ones with nothing at
+   * all are left out. Returns how many there are.
+   */
+
+  size_t loadSatellites(EphemerisCache &cache, double time, OrbitInterpolator &interpolator)
+  {
+    std::vector<std::string> names;
+    std::vector<std::string> found;
+    std::vector<double> sx, sy, sz;
+    cache.satelliteNames(names);
+    EphemerisLine interpolated(0, 0, 0, 0, 0, 0);
+    std::vector<std::string>::iterator name = names.begin();
+    while (name != names.end()) {
+      EphemerisLine *current = &interpolated;
+      if (!cache.interpolate(*name, time, interpolated, interpolator)) {
+        current = cache.get(*name, time);
+      }
+      if (NULL != current) {
+        found.push_back(*name);
+        sx.push_back(current->getPosition().getX());
+        sy.push_back(current->getPosition().getY());
+        sz.push_back(current->getPosition().getZ());
+      }
+      name++;
+    }
+    setSatellites(found, sx, sy, sz);
+    return found.size();
+  }
+
+  size_t satelliteCount() const
+  {
+    return satelliteNames.size();
+  }
+
+  const std::string &satelliteName(size_t index) const
+  {
+    return satelliteNames[index];
+  }
+
+  /**
+   * Fill results with every observer/satellite pair where the
+   * satellite is at least elevationMask degrees above the observer's
+   * horizon, and return how many there were. results is cleared
+   * first, but keeps its memory, so reusing one doesn't allocate.
+   */
+
+  size_t compute(double elevationMask, LookAngleResults &results) const;
+
+};
+
+#endif
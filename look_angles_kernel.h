@@ -0,0 +1,124 @@
+/**
+ * Look angles from a row of observers to one satellite, written once
+ * for any of the lanes in simd_lanes.h. Only look_angles.cpp and the
+ * instruction set specific look_angles_*.cpp files should include
+ * this, and it sticks to plain arrays so none of the code built
+ * with AVX turned on is shared with the rest of the program.
+ *
+ * For each observer, with d the satellite's position minus the
+ * observer's (ECEF, meters):
+ *
+ *   east  = d . east row
+ *   north = d . north row
+ *   up    = d . up row
+ *   range = |d|
+ *   elevation = atan2(up, sqrt(east^2 + north^2))
+ *   azimuth   = atan2(east, north), clockwise from north
+ *
+ * The satellite is above the mask when up >= sin(mask) * range, so
+ * a row of observers that can't see it is thrown out before any of
+ * the atan2s get done.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _H_LOOK_ANGLES_KERNEL
+#define _H_LOOK_ANGLES_KERNEL
+
+#include "simd_lanes.h"
+#include <stddef.h>
+
+/**
+ * The observers, one array per column. Every array is padded out
+ * to a multiple of LOOK_ANGLE_PADDING, so a full row can always be
+ * loaded; only the first count are real.
+ */
+
+enum { LOOK_ANGLE_PADDING = 8 };
+
+struct LookAngleColumns {
+  const double *x, *y, *z;
+  const double *eastX, *eastY;
+  const double *northX, *northY, *northZ;
+  const double *upX, *upY, *upZ;
+  size_t count;
+};
+
+/**
+ * Every observer that can see the satellite at (sx, sy, sz) gets
+ * its index, azimuth and elevation (degrees) and range (meters)
+ * written to the next spot in the output arrays, which need room
+ * for all of the observers. Returns how many that was.
+ */
+
+template <typename L>
+static inline size_t lookAnglesLoop(const LookAngleColumns &observers, double sx, double sy, double sz,
+                                    double sinMask, size_t *index, double *azimuth, double *elevation,
+                                    double *range)
+{
+  typedef typename L::Value V;
+  const double RAD_TO_DEG = 57.29577951308232087680;
+  V satX = L::set(sx);
+  V satY = L::set(sy);
+  V satZ = L::set(sz);
+  V limit = L::set(sinMask);
+  size_t visible = 0;
+
+  for (size_t i = 0; i < observers.count; i += L::WIDTH) {
+    V dx = satX - L::load(observers.x + i);
+    V dy = satY - L::load(observers.y + i);
+    V dz = satZ - L::load(observers.z + i);
+    V up = dx * L::load(observers.upX + i) + dy * L::load(observers.upY + i) + dz * L::load(observers.upZ + i);
+    V r = L::sqrt(dx * dx + dy * dy + dz * dz);
+    V margin = up - limit * r;
+    if (!L::any(L::greaterEqual(margin, L::set(0.0)))) {
+      continue;
+    }
+
+    V east = dx * L::load(observers.eastX + i) + dy * L::load(observers.eastY + i);
+    V north = dx * L::load(observers.northX + i) + dy * L::load(observers.northY + i) + dz * L::load(observers.northZ + i);
+    V el = atan2Lanes<L>(up, L::sqrt(east * east + north * north)) * L::set(RAD_TO_DEG);
+    V az = atan2Lanes<L>(east, north) * L::set(RAD_TO_DEG);
+    az = L::select(L::less(az, L::set(0.0)), az + L::set(360.0), az);
+
+    double row[4][L::WIDTH];
+    L::store(row[0], margin);
+    L::store(row[1], az);
+    L::store(row[2], el);
+    L::store(row[3], r);
+    for (size_t j = 0; j < (size_t) L::WIDTH && i + j < observers.count; j++) {
+      if (row[0][j] >= 0.0) {
+        index[visible] = i + j;
+        azimuth[visible] = row[1][j];
+        elevation[visible] = row[2][j];
+        range[visible] = row[3][j];
+        visible++;
+      }
+    }
+  }
+  return visible;
+}
+
+/**
+ * One of these per instruction set, each in its own object file
+ */
+
+size_t lookAnglesScalar(const LookAngleColumns &observers, double sx, double sy, double sz, double sinMask,
+                        size_t *index, double *azimuth, double *elevation, double *range);
+size_t lookAnglesAvx2(const LookAngleColumns &observers, double sx, double sy, double sz, double sinMask,
+                      size_t *index, double *azimuth, double *elevation, double *range);
+size_t lookAnglesAvx512(const LookAngleColumns &observers, double sx, double sy, double sz, double sinMask,
+                        size_t *index, double *azimuth, double *elevation, double *range);
+
+#endif
@@ -0,0 +1,123 @@
+/**
+ * MappedFile maps a whole file read-only into memory and unmaps it
+ * when it goes away. The kernel pages it in as you touch it, and
+ * every process mapping the same file shares the same pages.
+ *
+ * It can also be mapped copy-on-write, for when something wants to
+ * hand out non-const pointers into the file. The pages are still
+ * shared until somebody writes to one, and then that process gets
+ * its own copy of just that page. Nothing ever goes back to the
+ * file.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _H_MAPPED_FILE
+#define _H_MAPPED_FILE
+
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+class MappedFile {
+  const char *data;
+  size_t length;
+
+  // Not copyable, it owns the mapping
+  MappedFile(const MappedFile &);
+  MappedFile &operator=(const MappedFile &);
+
+ public:
+
+  MappedFile() : data((const char *) NULL), length(0)
+  {
+  }
+
+  ~MappedFile()
+  {
+    close();
+  }
+
+  /**
+   * Map filename. Returns false if it can't be opened or mapped.
+   * sequential tells the kernel you're going to read it front to
+   * back, so it can read ahead aggressively. copyOnWrite maps it so
+   * the memory can be written to (see above.)
+   */
+
+  bool open(const std::string &filename, bool sequential = false, bool copyOnWrite = false)
+  {
+    close();
+    int fdes = ::open(filename.c_str(), O_RDONLY);
+    if (0 > fdes) {
+      return false;
+    }
+    struct stat info;
+    if (0 > fstat(fdes, &info) || info.st_size == 0) {
+      ::close(fdes);
+      return false;
+    }
+    void *mapped;
+    if (copyOnWrite) {
+      mapped = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fdes, 0);
+    } else {
+      mapped = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fdes, 0);
+    }
+    ::close(fdes); // The mapping holds its own reference
+    if (MAP_FAILED == mapped) {
+      return false;
+    }
+    if (sequential) {
+      madvise(mapped, info.st_size, MADV_SEQUENTIAL);
+    }
+    data = (const char *) mapped;
+    length = info.st_size;
+    return true;
+  }
+
+  void close()
+  {
+    if (data) {
+      munmap((void *) data, length);
+      data = (const char *) NULL;
+      length = 0;
+    }
+  }
+
+  const char *begin() const
+  {
+    return data;
+  }
+
+  const char *end() const
+  {
+    return data + length;
+  }
+
+  size_t size() const
+  {
+    return length;
+  }
+
+  bool isOpen() const
+  {
+    return data != NULL;
+  }
+
+};
+
+#endif
@@ -0,0 +1,218 @@
+/**
+ * Where Btree and TimeTree get the memory for their nodes. A tree
+ * takes one of these as a template parameter:
+ *
+ * NodeArena (the default) carves nodes out of big slabs, keeps the
+ * ones that get removed on a free list for the next add, and hands
+ * all the slabs back at once when the tree goes away. A tree with a
+ * few million epochs in it is a few hundred allocations instead of a
+ * few million, its nodes sit next to each other in memory, and
+ * tearing it down doesn't have to visit every node.
+ *
+ * NodeHeap just uses new and delete for every node, like the trees
+ * always used to.
+ *
+ * Either one has to provide:
+ *
+ *   NodeX(size_t nodeSize, size_t alignment)
+ *                           every node is nodeSize bytes, and starts
+ *                           on a multiple of alignment (a power of 2)
+ *   void *allocate()        memory for one node
+ *   void deallocate(void *) give one back
+ *   void releaseAll()       give everything back, whether or not it
+ *                           was deallocated
+ *   BULK_RELEASE            true if releaseAll frees everything on its
+ *                           own, so the tree can skip deallocating
+ *                           each node when it's destroyed
+ *
+ * Neither one is thread safe; neither is the tree.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _H_NODE_ALLOCATOR
+#define _H_NODE_ALLOCATOR
+
+#include <new>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+class NodeArena {
+  /**
+   * Slabs start small, so a tree with three things in it doesn't
+   * take a megabyte, and double up to MAX_SLAB_NODES.
+   */
+  enum { FIRST_SLAB_NODES = 64, MAX_SLAB_NODES = 65536 };
+
+  struct FreeNode {
+    FreeNode *next;
+  };
+
+  size_t nodeSize;
+  size_t alignment;
+  // As they came from operator new, before lining them up
+  std::vector<char *> slabs;
+  size_t slabNodes;
+  // Unused nodes at the end of the newest slab
+  char *fresh;
+  size_t freshLeft;
+  FreeNode *freeList;
+  size_t live;
+
+  // Not copyable, it owns the slabs
+  NodeArena(const NodeArena &);
+  NodeArena &operator=(const NodeArena &);
+
+  void newSlab()
+  {
+    if (slabNodes < MAX_SLAB_NODES && !slabs.empty()) {
+      slabNodes *= 2;
+    }
+    char *slab = (char *) ::operator new(nodeSize * slabNodes + alignment);
+    slabs.push_back(slab);
+    fresh = (char *) (((uintptr_t) slab + alignment - 1) & ~(uintptr_t) (alignment - 1));
+    freshLeft = slabNodes;
+  }
+
+ public:
+  enum { BULK_RELEASE = true };
+
+  /**
+   * nodeSize gets rounded up to a multiple of alignment, which is by
+   * default enough for anything that's likely to be in a node. Ask
+   * for 64 to start every node on a cache line.
+   */
+
+  NodeArena(size_t nodeSize, size_t alignment = 2 * sizeof(void *)) : alignment(alignment), slabNodes(FIRST_SLAB_NODES), fresh((char *) NULL), freshLeft(0), freeList((FreeNode *) NULL), live(0)
+  {
+    if (this->alignment < sizeof(FreeNode)) {
+      this->alignment = sizeof(FreeNode);
+    }
+    if (nodeSize < sizeof(FreeNode)) {
+      nodeSize = sizeof(FreeNode);
+    }
+    this->nodeSize = (nodeSize + this->alignment - 1) / this->alignment * this->alignment;
+  }
+
+  ~NodeArena()
+  {
+    releaseAll();
+  }
+
+  void *allocate()
+  {
+    live++;
+    if (freeList) {
+      FreeNode *node = freeList;
+      freeList = node->next;
+      return node;
+    }
+    if (freshLeft == 0) {
+      newSlab();
+    }
+    void *node = fresh;
+    fresh += nodeSize;
+    freshLeft--;
+    return node;
+  }
+
+  void deallocate(void *node)
+  {
+    FreeNode *freed = (FreeNode *) node;
+    freed->next = freeList;
+    freeList = freed;
+    live--;
+  }
+
+  void releaseAll()
+  {
+    std::vector<char *>::iterator slab = slabs.begin();
+    while (slab != slabs.end()) {
+      ::operator delete(*slab);
+      slab++;
+    }
+    slabs.clear();
+    slabNodes = FIRST_SLAB_NODES;
+    fresh = (char *) NULL;
+    freshLeft = 0;
+    freeList = (FreeNode *) NULL;
+    live = 0;
+  }
+
+  /**
+   * How many nodes are handed out right now
+   */
+
+  size_t allocated() const
+  {
+    return live;
+  }
+
+  /**
+   * How many slabs there are. Mostly for testing.
+   */
+
+  size_t slabCount() const
+  {
+    return slabs.size();
+  }
+
+};
+
+class NodeHeap {
+  size_t nodeSize;
+  size_t alignment;
+
+ public:
+  enum { BULK_RELEASE = false };
+
+  NodeHeap(size_t nodeSize, size_t alignment = 2 * sizeof(void *)) : nodeSize(nodeSize), alignment(alignment)
+  {
+  }
+
+  void *allocate()
+  {
+    if (alignment <= 2 * sizeof(void *)) {
+      return ::operator new(nodeSize);
+    }
+    void *node;
+    if (posix_memalign(&node, alignment, nodeSize) != 0) {
+      throw std::bad_alloc();
+    }
+    return node;
+  }
+
+  void deallocate(void *node)
+  {
+    if (alignment <= 2 * sizeof(void *)) {
+      ::operator delete(node);
+    } else {
+      free(node);
+    }
+  }
+
+  /**
+   * The heap doesn't keep track, so the tree has to deallocate every
+   * node itself.
+   */
+
+  void releaseAll()
+  {
+  }
+
+};
+
+#endif
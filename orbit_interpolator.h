@@ -0,0 +1,245 @@
+/**
+ * Interpolates satellite positions and velocities between ephemeris
+ * epochs, so you can ask where a satellite is at exactly some time
+ * instead of where it was at the last data point.
+ *
+ * Two methods are supported:
+ *
+ * LAGRANGE fits a polynomial through N points (9 to 11 is the usual
+ * choice for 15 minute SP3 data) and applies the same weights to
+ * the positions and to the velocities.
+ *
+ * HERMITE fits a polynomial through the positions AND the velocities
+ * of N points, so it needs fewer points for the same accuracy. The
+ * velocity it returns is the derivative of the position polynomial.
+ *
+ * The weights only depend on where the requested time falls relative
+ * to the epochs in the window, so they're cached. Satellites from
+ * the same SP3 file share an epoch grid, so if you ask for all of
+ * them at the same time the weights get computed once and reused
+ * for the rest. Keep one interpolator per thread; it isn't safe to
+ * share one.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _H_ORBIT_INTERPOLATOR
+#define _H_ORBIT_INTERPOLATOR
+
+#include "ephemeris_line.h"
+#include "epoch_index.h"
+#include <stddef.h>
+
+class OrbitInterpolator {
+ public:
+  enum Method { LAGRANGE, HERMITE };
+  enum { MIN_POINTS = 2, MAX_POINTS = 11 };
+
+  /**
+   * Sp3Reader multiplies everything by 1000 to get from km to
+   * meters, but SP3 velocities are in decimeters per second, so
+   * one unit of a stored velocity is 1/10000 of a meter per second.
+   * Hermite needs real units to relate velocity to position. If you
+   * fill your lines some other way, pass your own scale.
+   */
+
+  static double sp3VelocityScale()
+  {
+    return 0.0001;
+  }
+
+ private:
+  Method method;
+  int points;
+  double velocityScale;
+
+  /**
+   * The weights, and what they were computed for. A query only
+   * recomputes them if any of these are different.
+   */
+  bool haveWeights;
+  int cachedCount;
+  double cachedOffset;
+  double cachedStep;
+  double cachedNodes[MAX_POINTS];
+
+  // Contribution of each point's position and velocity to the
+  // interpolated position and velocity
+  double posFromPos[MAX_POINTS];
+  double posFromVel[MAX_POINTS];
+  double velFromPos[MAX_POINTS];
+  double velFromVel[MAX_POINTS];
+
+  /**
+   * Lagrange basis polynomial j for the nodes, and its derivative,
+   * at s. The derivative is built up with the product rule one
+   * factor at a time, so it doesn't blow up when s lands on a node.
+   */
+
+  static void basis(const double *nodes, int count, int j, double s, double &value, double &derivative)
+  {
+    value = 1.0;
+    derivative = 0.0;
+    for (int m = 0; m < count; m++) {
+      if (m == j) {
+        continue;
+      }
+      double denominator = nodes[j] - nodes[m];
+      derivative = derivative * (s - nodes[m]) / denominator + value / denominator;
+      value = value * (s - nodes[m]) / denominator;
+    }
+  }
+
+  void computeWeights(const double *nodes, int count, double s, double step)
+  {
+    for (int j = 0; j < count; j++) {
+      double l, dl;
+      basis(nodes, count, j, s, l, dl);
+      if (method == LAGRANGE) {
+        posFromPos[j] = l;
+        posFromVel[j] = 0.0;
+        velFromPos[j] = 0.0;
+        velFromVel[j] = l;
+      } else {
+        // Derivative of basis j at its own node
+        double c = 0.0;
+        for (int m = 0; m < count; m++) {
+          if (m != j) {
+            c += 1.0 / (nodes[j] - nodes[m]);
+          }
+        }
+        double d = s - nodes[j];
+        double h = (1.0 - 2.0 * d * c) * l * l;
+        double dh = -2.0 * c * l * l + (1.0 - 2.0 * d * c) * 2.0 * l * dl;
+        double k = d * l * l;
+        double dk = l * l + d * 2.0 * l * dl;
+        // s is in steps, so velocities get multiplied by the step
+        // going in and positions divided by it coming out
+        posFromPos[j] = h;
+        posFromVel[j] = k * step * velocityScale;
+        velFromPos[j] = dh / (step * velocityScale);
+        velFromVel[j] = dk;
+      }
+    }
+  }
+
+ public:
+
+  OrbitInterpolator(Method method = LAGRANGE, int points = 9, double velocityScale = sp3VelocityScale()) : method(method), points(points), velocityScale(velocityScale), haveWeights(false)
+  {
+    if (this->points < MIN_POINTS) {
+      this->points = MIN_POINTS;
+    }
+    if (this->points > MAX_POINTS) {
+      this->points = MAX_POINTS;
+    }
+  }
+
+  Method getMethod()
+  {
+    return method;
+  }
+
+  int getPoints()
+  {
+    return points;
+  }
+
+  /**
+   * Interpolate the lines at time. times and lines are parallel
+   * arrays sorted by time, like the ones in an EpochIndex. Returns
+   * false if time is outside the data (this doesn't extrapolate)
+   * or there aren't at least two lines.
+   */
+
+  bool interpolate(const double *times, EphemerisLine *lines, size_t count, double time, EphemerisLine &result)
+  {
+    if (count < MIN_POINTS || time < times[0] || time > times[count - 1]) {
+      return false;
+    }
+    int n = (count < (size_t) points) ? (int) count : points;
+    long at = EpochIndex<EphemerisLine>::floorSearch(times, count, time);
+    // Center the window on the requested time as best we can
+    long start = at + 1 - n / 2;
+    if (start < 0) {
+      start = 0;
+    }
+    if (start > (long) count - n) {
+      start = (long) count - n;
+    }
+
+    const double *windowTimes = times + start;
+    EphemerisLine *window = lines + start;
+    double step = (windowTimes[n - 1] - windowTimes[0]) / (double) (n - 1);
+    double offset = (time - windowTimes[0]) / step;
+    double nodes[MAX_POINTS];
+    for (int j = 0; j < n; j++) {
+      nodes[j] = (windowTimes[j] - windowTimes[0]) / step;
+    }
+
+    bool same = haveWeights && cachedCount == n && cachedOffset == offset && cachedStep == step;
+    for (int j = 0; same && j < n; j++) {
+      same = (cachedNodes[j] == nodes[j]);
+    }
+    if (!same) {
+      computeWeights(nodes, n, offset, step);
+      for (int j = 0; j < n; j++) {
+        cachedNodes[j] = nodes[j];
+      }
+      cachedCount = n;
+      cachedOffset = offset;
+      cachedStep = step;
+      haveWeights = true;
+    }
+
+    double x = 0.0, y = 0.0, z = 0.0, dx = 0.0, dy = 0.0, dz = 0.0;
+    if (method == LAGRANGE) {
+      for (int j = 0; j < n; j++) {
+        Ecef &p = window[j].getPosition();
+        x += posFromPos[j] * p.getX();
+        y += posFromPos[j] * p.getY();
+        z += posFromPos[j] * p.getZ();
+        dx += velFromVel[j] * window[j].getDx();
+        dy += velFromVel[j] * window[j].getDy();
+        dz += velFromVel[j] * window[j].getDz();
+      }
+    } else {
+      for (int j = 0; j < n; j++) {
+        Ecef &p = window[j].getPosition();
+        double vx = window[j].getDx();
+        double vy = window[j].getDy();
+        double vz = window[j].getDz();
+        x += posFromPos[j] * p.getX() + posFromVel[j] * vx;
+        y += posFromPos[j] * p.getY() + posFromVel[j] * vy;
+        z += posFromPos[j] * p.getZ() + posFromVel[j] * vz;
+        dx += velFromPos[j] * p.getX() + velFromVel[j] * vx;
+        dy += velFromPos[j] * p.getY() + velFromVel[j] * vy;
+        dz += velFromPos[j] * p.getZ() + velFromVel[j] * vz;
+      }
+    }
+    result = EphemerisLine(x, y, z, dx, dy, dz, time);
+    return true;
+  }
+
+  bool interpolate(EpochIndex<EphemerisLine> &index, double time, EphemerisLine &result)
+  {
+    if (index.empty()) {
+      return false;
+    }
+    return interpolate(index.timeData(), index.valueData(), index.size(), time, result);
+  }
+
+};
+
+#endif
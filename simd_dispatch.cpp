@@ -0,0 +1,63 @@
+/**
+ * Finding out what the CPU can do
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "simd_dispatch.h"
+
+bool SimdDispatch::supported(Implementation use)
+{
+  __builtin_cpu_init();
+  switch (use) {
+  case AUTO:
+  case SCALAR:
+    return true;
+  case AVX2:
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  case AVX512:
+    return __builtin_cpu_supports("avx512f");
+  }
+  return false;
+}
+
+SimdDispatch::Implementation SimdDispatch::best()
+{
+  // Checking the CPU is cheap, but not free, so only do it once
+  static Implementation found = supported(AVX512) ? AVX512 : (supported(AVX2) ? AVX2 : SCALAR);
+  return found;
+}
+
+SimdDispatch::Implementation SimdDispatch::resolve(Implementation use)
+{
+  if (use == AUTO || !supported(use)) {
+    return best();
+  }
+  return use;
+}
+
+const char *SimdDispatch::name(Implementation use)
+{
+  switch (use) {
+  case AUTO:
+    return name(best());
+  case SCALAR:
+    return "scalar";
+  case AVX2:
+    return "avx2";
+  case AVX512:
+    return "avx512";
+  }
+  return "unknown";
+}
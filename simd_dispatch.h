@@ -0,0 +1,54 @@
+/**
+ * SimdDispatch works out which of the instruction sets in
+ * simd_lanes.h this CPU can run, so the batch code (GeodeticBatch,
+ * LookAngles) can pick the fastest version of itself at run time.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _H_SIMD_DISPATCH
+#define _H_SIMD_DISPATCH
+
+class SimdDispatch {
+ public:
+
+  /**
+   * Which code to run. AUTO picks the fastest one this CPU can do.
+   */
+  enum Implementation { AUTO, SCALAR, AVX2, AVX512 };
+
+  /**
+   * True if this CPU (and this build) can run use.
+   */
+
+  static bool supported(Implementation use);
+
+  /**
+   * What AUTO turns into on this CPU
+   */
+
+  static Implementation best();
+
+  /**
+   * use, unless it's AUTO or this CPU can't run it, in which case
+   * best()
+   */
+
+  static Implementation resolve(Implementation use);
+
+  static const char *name(Implementation use);
+
+};
+
+#endif
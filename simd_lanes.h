@@ -0,0 +1,170 @@
+/**
+ * Thin wrappers around a row of doubles, so a loop can be written
+ * once as a template and compiled for plain doubles, AVX2 (4 at a
+ * time) or AVX-512 (8 at a time.) g++ already knows how to +, -, *
+ * and / its vector types, so the wrappers only have to fill in
+ * the rest: loads, stores, constants, sqrt, compares and picking
+ * between two values by a mask.
+ *
+ * The AVX2 and AVX-512 lanes only exist when the file including
+ * this one is compiled with -mavx2 -mfma or -mavx512f. Only include
+ * this from the .cpp file for that instruction set, and only call
+ * into that file after checking the CPU has it (see simd_dispatch.h.)
+ * Templates using these should be static, so each instruction
+ * set's copy stays in its own object file and the linker can't
+ * swap in one the CPU can't run.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _H_SIMD_LANES
+#define _H_SIMD_LANES
+
+#include <math.h>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+/**
+ * One double at a time. This is what runs on CPUs without AVX2,
+ * and what the vector versions get checked against.
+ */
+
+struct ScalarLanes {
+  typedef double Value;
+  typedef bool Mask;
+  enum { WIDTH = 1 };
+
+  static Value load(const double *p) { return *p; }
+  static void store(double *p, Value v) { *p = v; }
+  static Value set(double v) { return v; }
+  static Value sqrt(Value v) { return ::sqrt(v); }
+  static Value abs(Value v) { return fabs(v); }
+  static Value min(Value a, Value b) { return a < b ? a : b; }
+  static Value max(Value a, Value b) { return a > b ? a : b; }
+  static Mask greater(Value a, Value b) { return a > b; }
+  static Mask less(Value a, Value b) { return a < b; }
+  static Mask greaterEqual(Value a, Value b) { return a >= b; }
+  static bool any(Mask m) { return m; }
+  static Mask equal(Value a, Value b) { return a == b; }
+  static Value select(Mask m, Value ifTrue, Value ifFalse) { return m ? ifTrue : ifFalse; }
+  static Value copySign(Value magnitude, Value sign) { return copysign(magnitude, sign); }
+};
+
+#ifdef __AVX2__
+
+struct Avx2Lanes {
+  typedef __m256d Value;
+  typedef __m256d Mask;
+  enum { WIDTH = 4 };
+
+  static Value load(const double *p) { return _mm256_loadu_pd(p); }
+  static void store(double *p, Value v) { _mm256_storeu_pd(p, v); }
+  static Value set(double v) { return _mm256_set1_pd(v); }
+  static Value sqrt(Value v) { return _mm256_sqrt_pd(v); }
+  static Value abs(Value v) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), v); }
+  static Value min(Value a, Value b) { return _mm256_min_pd(a, b); }
+  static Value max(Value a, Value b) { return _mm256_max_pd(a, b); }
+  static Mask greater(Value a, Value b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+  static Mask less(Value a, Value b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+  static Mask greaterEqual(Value a, Value b) { return _mm256_cmp_pd(a, b, _CMP_GE_OQ); }
+  static bool any(Mask m) { return _mm256_movemask_pd(m) != 0; }
+  static Mask equal(Value a, Value b) { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+  static Value select(Mask m, Value ifTrue, Value ifFalse) { return _mm256_blendv_pd(ifFalse, ifTrue, m); }
+  static Value copySign(Value magnitude, Value sign)
+  {
+    return _mm256_or_pd(abs(magnitude), _mm256_and_pd(sign, _mm256_set1_pd(-0.0)));
+  }
+};
+
+#endif
+
+#ifdef __AVX512F__
+
+struct Avx512Lanes {
+  typedef __m512d Value;
+  typedef __mmask8 Mask;
+  enum { WIDTH = 8 };
+
+  static Value load(const double *p) { return _mm512_loadu_pd(p); }
+  static void store(double *p, Value v) { _mm512_storeu_pd(p, v); }
+  static Value set(double v) { return _mm512_set1_pd(v); }
+  static Value sqrt(Value v) { return _mm512_sqrt_pd(v); }
+  static Value abs(Value v) { return _mm512_abs_pd(v); }
+  static Value min(Value a, Value b) { return _mm512_min_pd(a, b); }
+  static Value max(Value a, Value b) { return _mm512_max_pd(a, b); }
+  static Mask greater(Value a, Value b) { return _mm512_cmp_pd_mask(a, b, _CMP_GT_OQ); }
+  static Mask less(Value a, Value b) { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+  static Mask greaterEqual(Value a, Value b) { return _mm512_cmp_pd_mask(a, b, _CMP_GE_OQ); }
+  static bool any(Mask m) { return m != 0; }
+  static Mask equal(Value a, Value b) { return _mm512_cmp_pd_mask(a, b, _CMP_EQ_OQ); }
+  static Value select(Mask m, Value ifTrue, Value ifFalse) { return _mm512_mask_blend_pd(m, ifFalse, ifTrue); }
+  static Value copySign(Value magnitude, Value sign)
+  {
+    // The pd and/or need AVX512DQ, so go through the integer ones
+    __m512i signBit = _mm512_set1_epi64(0x8000000000000000LL);
+    __m512i bits = _mm512_or_si512(_mm512_castpd_si512(abs(magnitude)),
+                                   _mm512_and_si512(_mm512_castpd_si512(sign), signBit));
+    return _mm512_castsi512_pd(bits);
+  }
+};
+
+#endif
+
+/**
+ * atan2 for a row of lanes, Cephes style: get the ratio into
+ * [0, 1], reduce it again around tan(pi/8), evaluate a rational
+ * polynomial, and put the octant back. Good to a couple of ulps,
+ * which is way past what a coordinate needs.
+ */
+
+template <typename L>
+static inline typename L::Value atan2Lanes(typename L::Value y, typename L::Value x)
+{
+  typedef typename L::Value V;
+  typedef typename L::Mask M;
+  const double PIO4 = 7.85398163397448309616E-1;
+  const double PIO2 = 1.57079632679489661923E0;
+  const double PI = 3.14159265358979323846E0;
+  const double MOREBITS = 6.123233995736765886130E-17;
+
+  V ay = L::abs(y);
+  V ax = L::abs(x);
+  V hi = L::max(ay, ax);
+  V lo = L::min(ay, ax);
+  M zero = L::equal(hi, L::set(0.0));
+  V t = lo / L::select(zero, L::set(1.0), hi);
+
+  // atan(t) for t in [0, 1]
+  M reduce = L::greater(t, L::set(0.66));
+  V base = L::select(reduce, L::set(PIO4), L::set(0.0));
+  V extra = L::select(reduce, L::set(0.5 * MOREBITS), L::set(0.0));
+  t = L::select(reduce, (t - L::set(1.0)) / (t + L::set(1.0)), t);
+  V z = t * t;
+  V p = (((L::set(-8.750608600031904122785E-1) * z + L::set(-1.615753718733365076637E1)) * z +
+          L::set(-7.500855792314704667340E1)) * z + L::set(-1.228866684490136173410E2)) * z +
+    L::set(-6.485021904942025371773E1);
+  V q = ((((z + L::set(2.485846490142306297962E1)) * z + L::set(1.650270098316988542046E2)) * z +
+          L::set(4.328810604912902668951E2)) * z + L::set(4.853903996359136964868E2)) * z +
+    L::set(1.945506571482613964425E2);
+  V angle = base + ((t * (z * p / q) + t) + extra);
+
+  // Back out to the right octant and quadrant
+  angle = L::select(L::greater(ay, ax), L::set(PIO2) - angle, angle);
+  angle = L::select(L::less(x, L::set(0.0)), L::set(PI) - angle, angle);
+  return L::copySign(angle, y);
+}
+
+#endif
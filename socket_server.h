@@ -4,6 +4,9 @@
  * to service the connection. I could have used boost::asio or
  * something, but it seems like overkill.
  *
+ * A thread per connection is fine for a handful of clients. If
+ * you've got thousands, use EpollServer (epoll_server.h) instead.
+ *
  * Copyright 2011 Bruce Ide
  * Licensed under the Apache License, Version 2.0 (the "License");
  * you may not use this file except in compliance with the License.
@@ -95,25 +98,24 @@ class SocketServer {
         timeval tv;
         tv.tv_sec = 1;
         tv.tv_usec = 0;
+        FD_ZERO(&set);
         FD_SET(sock, &set);
         
-        char buf[BUFFER_SIZE];
         sockaddr_in incoming_address;
-        socklen_t size;
-        select(sock + 1, &set, NULL, NULL, &tv);
-        if (FD_ISSET(sock, &set)) {
+        socklen_t size = sizeof(incoming_address);
+        if (0 < select(sock + 1, &set, NULL, NULL, &tv) && FD_ISSET(sock, &set)) {
           int fdes = accept(sock, (sockaddr *) &incoming_address, &size);
           if (0 > fdes) {
             perror("Error while accepting connections");
             // Going to treat this as non-fatal
           } else {
             ServiceClass serveit(owner, fdes);
-            boost::thread *thrd = new boost::thread(serveit);
-            thrd->detach(); // I don't really care what it does now
+            boost::thread thrd(serveit);
+            thrd.detach(); // I don't really care what it does now
           }
         }
       }
-      
+      close(sock);
     }
 
   };
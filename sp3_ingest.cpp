@@ -0,0 +1,100 @@
+/**
+ * sp3_ingest reads SP3 ephemeris files once and writes them out as a
+ * snapshot file (see ephemeris_snapshot.h) that demo can map and
+ * serve from straight away, instead of parsing them every time it
+ * starts.
+ *
+ * To run:
+ *   ./sp3_ingest output.snap filename|directory [filename|directory...]
+ *
+ * Inputs can be snapshots too, so adding a new day to an existing
+ * snapshot is:
+ *   ./sp3_ingest new.snap old.snap today.eph
+ * Where inputs have the same satellite at the same time, the later
+ * one wins, same as demo.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ephemeris_cache.h"
+#include "ephemeris_snapshot.h"
+#include "sp3_loader.h"
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char *argv[])
+{
+  if (argc < 3) {
+    std::cout << "usage: sp3_ingest output.snap filename|directory [filename|directory...]" << std::endl;
+    std::cout << "Inputs are SP3-format ephemeris files, directories of them, or" << std::endl;
+    std::cout << "snapshots. If inputs overlap, the later one wins." << std::endl;
+    return 1;
+  }
+
+  std::string output(argv[1]);
+  try {
+    EphemerisCache cache;
+    // Snapshots go in as they're found. SP3 files go in a loader, and
+    // each run of them gets loaded before the next snapshot, so the
+    // order on the command line is the order things win in.
+    Sp3Loader *loader = new Sp3Loader();
+    size_t loaded = 0;
+    size_t duplicates = 0;
+    size_t failed = 0;
+    for (int i = 2; i <= argc; i++) {
+      bool snapshot = i < argc && EphemerisSnapshot::isSnapshot(argv[i]);
+      if ((i == argc || snapshot) && loader->fileCount() > 0) {
+        std::cout << "Reading " << loader->fileCount() << " ephemeris files..." << std::endl;
+        loaded += loader->load(cache);
+        duplicates += loader->duplicateCount();
+        failed += loader->failedCount();
+        delete loader;
+        loader = new Sp3Loader();
+      }
+      if (i == argc) {
+        break;
+      }
+      if (snapshot) {
+        // Mapping replaces whole satellites, so once there's something
+        // to keep, the snapshot gets merged in instead.
+        std::vector<std::string> names;
+        cache.satelliteNames(names);
+        std::cout << "Reading snapshot " << argv[i] << std::endl;
+        if (names.empty()) {
+          cache.mapSnapshot(argv[i], true);
+        } else {
+          cache.mergeSnapshot(argv[i], true);
+        }
+      } else if (!loader->addPath(argv[i])) {
+        std::cout << "Can't find " << argv[i] << std::endl;
+      }
+    }
+    delete loader;
+    std::cout << loaded << " records, " << duplicates << " duplicates, " << failed << " unreadable files." << std::endl;
+
+    std::vector<std::string> names;
+    cache.satelliteNames(names);
+    std::cout << "Writing " << names.size() << " satellites to " << output << "..." << std::endl;
+    cache.saveSnapshot(output);
+
+    EphemerisSnapshot check;
+    check.open(output, true);
+    std::cout << "done. " << output << " checks out." << std::endl;
+  } catch (std::string &error) {
+    std::cout << error << std::endl;
+    return 1;
+  }
+  return 0;
+}
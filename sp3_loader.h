@@ -0,0 +1,271 @@
+/**
+ * Sp3Loader reads a whole pile of SP3 files into one EphemerisCache
+ * using a bunch of threads. Give it files, or directories full of
+ * files, and tell it to load.
+ *
+ * Each worker thread grabs the next file off the list and reads it
+ * into its own staging buffer, so the workers never wait on each
+ * other. Once everything is read, the records are sorted out per
+ * satellite and each satellite gets merged into the cache in one go.
+ *
+ * Files covering overlapping days will have some of the same epochs.
+ * Those don't throw; the record from the file added LAST wins, so
+ * add older files first and newer ones (or newer solutions) after.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _H_SP3_LOADER
+#define _H_SP3_LOADER
+
+#include "ephemeris_cache.h"
+#include "sp3_mapped_reader.h"
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+
+class Sp3Loader {
+
+  /**
+   * A record and where it came from (which file, and how far into
+   * it), so duplicates can be sorted out after all the workers are
+   * done. Where the same time shows up twice, the one that came last
+   * sorts last.
+   */
+
+  struct StagedRecord {
+    Sp3Record record;
+    size_t file;
+    size_t position;
+
+    bool operator<(const StagedRecord &rhs) const
+    {
+      if (record.time != rhs.record.time) {
+        return record.time < rhs.record.time;
+      }
+      if (file != rhs.file) {
+        return file < rhs.file;
+      }
+      return position < rhs.position;
+    }
+  };
+
+  typedef std::vector<StagedRecord> StagingBuffer;
+
+  class Worker;
+  friend class Worker;
+
+  /**
+   * One of these per thread. It keeps taking files until there
+   * aren't any left, tagging everything it reads with the file's
+   * position in the list.
+   */
+
+  class Worker : public Sp3RecordListener {
+    Sp3Loader *owner;
+    StagingBuffer *staging;
+    size_t currentFile;
+    size_t position;
+
+  public:
+    Worker(Sp3Loader *owner, StagingBuffer *staging) : owner(owner), staging(staging), currentFile(0), position(0)
+    {
+    }
+
+    void notify(std::vector<Sp3Record> &records)
+    {
+      std::vector<Sp3Record>::iterator it = records.begin();
+      while (it != records.end()) {
+        StagedRecord staged;
+        staged.record = *it;
+        staged.file = currentFile;
+        staged.position = position++;
+        staging->push_back(staged);
+        it++;
+      }
+    }
+
+    void operator()()
+    {
+      while (owner->nextFile(currentFile)) {
+        position = 0;
+        Sp3MappedReader reader(owner->files[currentFile], this);
+        if (!reader.read()) {
+          owner->fileFailed();
+        }
+      }
+    }
+  };
+
+  std::vector<std::string> files;
+  boost::mutex fileLock;
+  size_t next;
+  size_t failed;
+  size_t duplicates;
+
+  bool nextFile(size_t &file)
+  {
+    boost::mutex::scoped_lock lock(fileLock);
+    if (next >= files.size()) {
+      return false;
+    }
+    file = next++;
+    return true;
+  }
+
+  void fileFailed()
+  {
+    boost::mutex::scoped_lock lock(fileLock);
+    failed++;
+  }
+
+ public:
+
+  Sp3Loader() : next(0), failed(0), duplicates(0)
+  {
+  }
+
+  /**
+   * Add a file, or every file in a directory (in name order, so
+   * date-named files go in oldest first.) Hidden files are skipped.
+   * Returns false if the path doesn't exist.
+   */
+
+  bool addPath(const std::string &path)
+  {
+    struct stat info;
+    if (0 > stat(path.c_str(), &info)) {
+      return false;
+    }
+    if (!S_ISDIR(info.st_mode)) {
+      files.push_back(path);
+      return true;
+    }
+    DIR *dir = opendir(path.c_str());
+    if (!dir) {
+      return false;
+    }
+    std::vector<std::string> found;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+      if (entry->d_name[0] == '.') {
+        continue;
+      }
+      std::string full = path + "/" + entry->d_name;
+      if (0 == stat(full.c_str(), &info) && S_ISREG(info.st_mode)) {
+        found.push_back(full);
+      }
+    }
+    closedir(dir);
+    std::sort(found.begin(), found.end());
+    files.insert(files.end(), found.begin(), found.end());
+    return true;
+  }
+
+  size_t fileCount()
+  {
+    return files.size();
+  }
+
+  /**
+   * Read all the files with up to threads threads and put what's in
+   * them into cache. Returns the number of records that went into
+   * the cache.
+   */
+
+  size_t load(EphemerisCache &cache, unsigned int threads = boost::thread::hardware_concurrency())
+  {
+    next = failed = duplicates = 0;
+    if (threads == 0) {
+      threads = 1;
+    }
+    if (threads > files.size()) {
+      threads = files.size();
+    }
+
+    std::vector<StagingBuffer> staging(threads);
+    boost::thread_group workers;
+    for (unsigned int i = 0; i < threads; i++) {
+      workers.create_thread(Worker(this, &staging[i]));
+    }
+    workers.join_all();
+
+    // Sort everything out by satellite
+    typedef std::map<std::string, StagingBuffer> SatelliteRecords;
+    SatelliteRecords bySatellite;
+    for (unsigned int i = 0; i < threads; i++) {
+      StagingBuffer::iterator it = staging[i].begin();
+      while (it != staging[i].end()) {
+        bySatellite[it->record.satellite].push_back(*it);
+        it++;
+      }
+      StagingBuffer().swap(staging[i]); // Give the memory back as we go
+    }
+
+    size_t loaded = 0;
+    std::vector<double> times;
+    std::vector<EphemerisLine> lines;
+    SatelliteRecords::iterator sat = bySatellite.begin();
+    while (sat != bySatellite.end()) {
+      StagingBuffer &records = sat->second;
+      std::sort(records.begin(), records.end());
+      times.clear();
+      lines.clear();
+      times.reserve(records.size());
+      lines.reserve(records.size());
+      for (size_t i = 0; i < records.size(); i++) {
+        // Same time as the next one means it shows up again later on
+        if (i + 1 < records.size() && records[i + 1].record.time == records[i].record.time) {
+          duplicates++;
+          continue;
+        }
+        times.push_back(records[i].record.time);
+        lines.push_back(records[i].record.line());
+      }
+      StagingBuffer().swap(records);
+      // The whole satellite goes in at once, merged with what's there
+      duplicates += cache.putAll(sat->first, &times[0], &lines[0], times.size());
+      loaded += times.size();
+      sat++;
+    }
+    return loaded;
+  }
+
+  /**
+   * How many epochs showed up more than once (including ones that
+   * were already in the cache) on the last load.
+   */
+
+  size_t duplicateCount()
+  {
+    return duplicates;
+  }
+
+  /**
+   * How many files couldn't be read on the last load.
+   */
+
+  size_t failedCount()
+  {
+    return failed;
+  }
+
+};
+
+#endif
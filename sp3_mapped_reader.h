@@ -0,0 +1,345 @@
+/**
+ * Sp3MappedReader reads the same SP3 files Sp3Reader does, but a
+ * lot faster. It maps the file into memory, picks the numbers
+ * straight out of their fixed-width columns with its own number
+ * parser, works out epoch times with arithmetic instead of timegm
+ * and hands complete records to a listener in batches instead of
+ * one setter call at a time.
+ *
+ * Like Sp3Reader it ignores the header and only reports a record
+ * once it has both the position (P) and velocity (V) line for a
+ * satellite. Positions and velocities get multiplied by 1000 the
+ * same way, so the two readers produce exactly the same lines.
+ *
+ * To read a file:
+ * 1) Create a Sp3RecordListener that puts the records somewhere,
+ *    say, an EphemerisCache
+ * 2) Create a Sp3MappedReader for the file and the listener
+ * 3) Tell the reader to read the file.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _H_SP3_MAPPED_READER
+#define _H_SP3_MAPPED_READER
+
+#include "ephemeris_line.h"
+#include "mapped_file.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * One satellite at one epoch. The name is whatever was in columns
+ * 2-4 of the P line with the spaces taken out ("1" for "P  1",
+ * "G01" for "PG01"), same as Sp3Reader gives you.
+ */
+
+struct Sp3Record {
+  char satellite[4];
+  double time;
+  double x, y, z;
+  double dx, dy, dz;
+
+  EphemerisLine line() const
+  {
+    return EphemerisLine(x, y, z, dx, dy, dz, time);
+  }
+
+  std::string name() const
+  {
+    return std::string(satellite);
+  }
+};
+
+class Sp3RecordListener {
+ public:
+  virtual ~Sp3RecordListener() {}
+  virtual void notify(std::vector<Sp3Record> &records) = 0;
+};
+
+class Sp3MappedReader {
+  std::string filename;
+  Sp3RecordListener *listener;
+  size_t batchSize;
+  std::vector<Sp3Record> batch;
+  double currentTime;
+  // False after an epoch line that couldn't be read, until a good one
+  bool haveTime;
+  Sp3Record pending;
+  bool havePosition;
+  size_t unreadable;
+
+  enum { FIELD_WIDTH = 14, FIRST_FIELD = 4 };
+
+  void flush()
+  {
+    if (!batch.empty()) {
+      listener->notify(batch);
+      batch.clear();
+    }
+  }
+
+  /**
+   * Pull the satellite name out of columns 2-4. Returns false if
+   * there's nothing there.
+   */
+
+  static bool readName(const char *line, const char *end, char *name)
+  {
+    int length = 0;
+    for (const char *p = line + 1; p < line + 4 && p < end; p++) {
+      if (*p != ' ') {
+        name[length++] = *p;
+      }
+    }
+    name[length] = '\0';
+    return length > 0;
+  }
+
+  /**
+   * Read the three 14 column wide numbers after the name, and
+   * convert them from km (or dm/s) the same way Sp3Reader does.
+   */
+
+  static bool readTriple(const char *line, const char *end, double &a, double &b, double &c)
+  {
+    const char *field = line + FIRST_FIELD;
+    if (field + 3 * FIELD_WIDTH > end) {
+      return false;
+    }
+    if (!parseNumber(field, field + FIELD_WIDTH, a) ||
+        !parseNumber(field + FIELD_WIDTH, field + 2 * FIELD_WIDTH, b) ||
+        !parseNumber(field + 2 * FIELD_WIDTH, field + 3 * FIELD_WIDTH, c)) {
+      return false;
+    }
+    a *= 1000;
+    b *= 1000;
+    c *= 1000;
+    return true;
+  }
+
+  /**
+   * Epoch lines look like "*  2011 10  1  0  0   .00000000". The
+   * columns are fixed, but the numbers are also space separated,
+   * so just read them in order.
+   */
+
+  bool readTime(const char *line, const char *end)
+  {
+    double fields[6];
+    const char *p = line + 1;
+    for (int i = 0; i < 6; i++) {
+      while (p < end && *p == ' ') {
+        p++;
+      }
+      const char *start = p;
+      while (p < end && *p != ' ') {
+        p++;
+      }
+      if (start == p || !parseNumber(start, p, fields[i])) {
+        return false;
+      }
+    }
+    currentTime = epochTime((int) fields[0], (int) fields[1], (int) fields[2], (int) fields[3], (int) fields[4], fields[5]);
+    return true;
+  }
+
+  /**
+   * Without a good epoch there's no telling when a record is for, so
+   * it gets counted and dropped.
+   */
+
+  void readPosition(const char *line, const char *end)
+  {
+    if (!haveTime) {
+      unreadable++;
+      havePosition = false;
+      return;
+    }
+    havePosition = readName(line, end, pending.satellite) &&
+      readTriple(line, end, pending.x, pending.y, pending.z);
+    pending.time = currentTime;
+  }
+
+  void readVelocity(const char *line, const char *end)
+  {
+    char name[4];
+    if (havePosition && readName(line, end, name) && 0 == strcmp(name, pending.satellite) &&
+        readTriple(line, end, pending.dx, pending.dy, pending.dz)) {
+      batch.push_back(pending);
+      if (batch.size() >= batchSize) {
+        flush();
+      }
+    }
+    havePosition = false;
+  }
+
+ public:
+  enum { DEFAULT_BATCH = 4096 };
+
+  Sp3MappedReader(const std::string &filename, Sp3RecordListener *listener = NULL, size_t batchSize = DEFAULT_BATCH) : filename(filename), listener(listener), batchSize(batchSize), currentTime(0.0), haveTime(false), havePosition(false), unreadable(0)
+  {
+    if (this->batchSize == 0) {
+      this->batchSize = 1;
+    }
+  }
+
+  void registerListener(Sp3RecordListener *l)
+  {
+    listener = l;
+  }
+
+  /**
+   * Read the whole file. Returns false if it couldn't be opened.
+   */
+
+  bool read()
+  {
+    MappedFile file;
+    if (!file.open(filename, true)) {
+      std::cout << "Unable to open" << filename << std::endl;
+      return false;
+    }
+    batch.reserve(batchSize);
+    currentTime = 0.0;
+    haveTime = false;
+    havePosition = false;
+    unreadable = 0;
+    const char *p = file.begin();
+    const char *fileEnd = file.end();
+    while (p < fileEnd) {
+      const char *lineEnd = (const char *) memchr(p, '\n', fileEnd - p);
+      if (!lineEnd) {
+        lineEnd = fileEnd;
+      }
+      const char *end = lineEnd;
+      if (end > p && end[-1] == '\r') {
+        end--;
+      }
+      switch (*p) {
+      case '*':
+        haveTime = readTime(p, end);
+        havePosition = false;
+        break;
+      case 'P':
+        readPosition(p, end);
+        break;
+      case 'V':
+        readVelocity(p, end);
+        break;
+      }
+      p = lineEnd + 1;
+    }
+    flush();
+    return true;
+  }
+
+  /**
+   * How many records the last read dropped because they came under
+   * an epoch line it couldn't read (or before any epoch line.)
+   */
+
+  size_t unreadableCount() const
+  {
+    return unreadable;
+  }
+
+  /**
+   * parseNumber reads a plain decimal number ("  -4.783560",
+   * "   .00000000", "2011") from between start and end, ignoring
+   * spaces around it. SP3 never uses exponents. The digits are
+   * collected into an integer and divided by a power of ten once,
+   * which gives the same correctly rounded answer strtod would as
+   * long as there are no more than 15 digits. Longer numbers are
+   * handed off to strtod.
+   */
+
+  static bool parseNumber(const char *start, const char *end, double &value)
+  {
+    static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15 };
+    const char *p = start;
+    while (p < end && *p == ' ') {
+      p++;
+    }
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+      negative = (*p == '-');
+      p++;
+    }
+    unsigned long long mantissa = 0;
+    int digits = 0;
+    int fraction = 0;
+    bool seenPoint = false;
+    for (; p < end; p++) {
+      if (*p >= '0' && *p <= '9') {
+        mantissa = mantissa * 10 + (*p - '0');
+        digits++;
+        if (seenPoint) {
+          fraction++;
+        }
+      } else if (*p == '.' && !seenPoint) {
+        seenPoint = true;
+      } else {
+        break;
+      }
+    }
+    while (p < end && *p == ' ') {
+      p++;
+    }
+    if (digits == 0 || p != end) {
+      return false;
+    }
+    if (digits > 15) {
+      char buffer[64];
+      size_t length = (end - start < (long) sizeof(buffer) - 1) ? end - start : sizeof(buffer) - 1;
+      memcpy(buffer, start, length);
+      buffer[length] = '\0';
+      value = strtod(buffer, NULL);
+      return true;
+    }
+    value = (double) mantissa / powers[fraction];
+    if (negative) {
+      value = -value;
+    }
+    return true;
+  }
+
+  /**
+   * Seconds since the POSIX epoch for a UTC date and time, without
+   * going through timegm (or the timezone.) Days from the civil
+   * date are counted in 400 year eras, which is what makes the
+   * leap years come out right. Whole and fractional seconds get
+   * added the same way Sp3Reader does it, so the times match it
+   * exactly.
+   */
+
+  static double epochTime(int year, int month, int day, int hour, int minute, double seconds)
+  {
+    year -= (month <= 2) ? 1 : 0;
+    long era = (year >= 0 ? year : year - 399) / 400;
+    long yearOfEra = year - era * 400;
+    long dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    long dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    long days = era * 146097 + dayOfEra - 719468;
+    long whole = (long) seconds;
+    long total = days * 86400 + hour * 3600 + minute * 60 + whole;
+    return (double) total + (seconds - whole);
+  }
+
+};
+
+#endif
@@ -0,0 +1,429 @@
+/**
+ * Tests for the B+tree. Most of them run the same adds and removes
+ * through a std::map and check the tree always agrees with it.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bplus_tree.h"
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <cppunit/extensions/HelperMacros.h>
+
+/**
+ * Lets the test look at the nodes
+ */
+
+template <typename KeyType, typename ValType>
+class InspectableTree : public BplusTree<KeyType, ValType> {
+  typedef BplusTree<KeyType, ValType> Base;
+ public:
+  InspectableTree(ValType nf) : Base(nf)
+  {
+  }
+
+  /**
+   * Every key in the tree is in its place: inner node keys sorted,
+   * everything under a child between the separators around it, no
+   * empty nodes, and the count right.
+   */
+
+  bool check()
+  {
+    if (!this->root) {
+      return this->levels == 0 && this->entries == 0;
+    }
+    size_t count = 0;
+    return checkNode(this->root, 0, (KeyType *) NULL, (KeyType *) NULL, count) && count == this->entries;
+  }
+
+  bool checkNode(typename Base::Node *node, int level, KeyType *low, KeyType *high, size_t &count)
+  {
+    if (level == this->levels - 1) {
+      typename Base::Leaf *leaf = static_cast<typename Base::Leaf *>(node);
+      for (int i = 0; i < leaf->count; i++) {
+        KeyType &key = leaf->entries[i].first;
+        if ((low && key < *low) || (high && !(key < *high)) || (i > 0 && !(leaf->entries[i - 1].first < key))) {
+          return false;
+        }
+      }
+      count += leaf->count;
+      return leaf->count > 0;
+    }
+    typename Base::Inner *inner = static_cast<typename Base::Inner *>(node);
+    if (inner->count < 1 || inner->count > Base::INNER_KEYS) {
+      return false;
+    }
+    for (int i = 0; i <= inner->count; i++) {
+      KeyType *below = i > 0 ? &inner->keys[i - 1] : low;
+      KeyType *above = i < inner->count ? &inner->keys[i] : high;
+      if (below && above && !(*below < *above)) {
+        return false;
+      }
+      if (!checkNode(inner->children[i], level + 1, below, above, count)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  size_t innerSize()
+  {
+    return sizeof(typename Base::Inner);
+  }
+
+  size_t leafSize()
+  {
+    return sizeof(typename Base::Leaf);
+  }
+
+  bool rootAligned()
+  {
+    return ((size_t) this->root % Base::CACHE_LINE) == 0;
+  }
+};
+
+/**
+ * Takes count entries from visitRange, then asks it to stop
+ */
+
+struct StopAfter {
+  int count;
+  int seen;
+
+  StopAfter(int count) : count(count), seen(0)
+  {
+  }
+
+  bool operator()(std::pair<int, int> &)
+  {
+    return ++seen < count;
+  }
+};
+
+class BplusTreeTest : public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(BplusTreeTest);
+  CPPUNIT_TEST(testAdd);
+  CPPUNIT_TEST(testKeySearch);
+  CPPUNIT_TEST(testLayout);
+  CPPUNIT_TEST(testInOrder);
+  CPPUNIT_TEST(testRandom);
+  CPPUNIT_TEST(testRemoveAll);
+  CPPUNIT_TEST(testFindRange);
+  CPPUNIT_TEST(testStringKeys);
+  CPPUNIT_TEST(testCursors);
+  CPPUNIT_TEST_SUITE_END();
+
+  /**
+   * Everything in expected is in tree, in order, and nothing else
+   */
+
+  template <typename Tree, typename Map>
+  void compare(Tree &tree, Map &expected)
+  {
+    CPPUNIT_ASSERT(tree.check());
+    CPPUNIT_ASSERT_EQUAL(expected.size(), tree.size());
+    if (expected.empty()) {
+      return;
+    }
+    typename Tree::RangeType range;
+    tree.findRange(range, expected.begin()->first, expected.rbegin()->first);
+    CPPUNIT_ASSERT_EQUAL(expected.size(), range.size());
+    typename Map::iterator entry = expected.begin();
+    for (size_t i = 0; i < range.size(); i++, entry++) {
+      CPPUNIT_ASSERT(entry->first == range[i]->first);
+      CPPUNIT_ASSERT(entry->second == range[i]->second);
+    }
+  }
+
+public:
+
+  void testAdd()
+  {
+    BplusTree<int,int> tree(0);
+    tree.add(2,3);
+    CPPUNIT_ASSERT(tree.find(2) == 3);
+    tree.add(1,2);
+    tree.add(3,4);
+    CPPUNIT_ASSERT(tree.find(1) == 2);
+    CPPUNIT_ASSERT(tree.find(3) == 4);
+    CPPUNIT_ASSERT(tree.find(4) == tree.NOT_FOUND);
+    CPPUNIT_ASSERT_THROW(tree.add(3, 5), std::string);
+    CPPUNIT_ASSERT_EQUAL(1, tree.begin());
+    CPPUNIT_ASSERT_EQUAL(3, tree.end());
+    CPPUNIT_ASSERT_EQUAL(3, tree.remove(2));
+    CPPUNIT_ASSERT(tree.find(2) == tree.NOT_FOUND);
+    CPPUNIT_ASSERT(tree.remove(2) == tree.NOT_FOUND);
+
+    BplusTree<int,int> empty(0);
+    CPPUNIT_ASSERT_THROW(empty.begin(), std::string);
+    CPPUNIT_ASSERT(empty.find(1) == empty.NOT_FOUND);
+  }
+
+  /**
+   * The SSE2 searches get the same answers as the plain one
+   */
+
+  void testKeySearch()
+  {
+    double doubles[15];
+    int ints[21];
+    for (int i = 0; i < 15; i++) {
+      doubles[i] = i * 2.0;
+    }
+    for (int i = 0; i < 21; i++) {
+      ints[i] = i * 2;
+    }
+    for (int count = 0; count <= 15; count++) {
+      for (double key = -1.0; key <= 31.0; key += 0.5) {
+        int expected = 0;
+        for (int i = 0; i < count; i++) {
+          expected += doubles[i] <= key;
+        }
+        CPPUNIT_ASSERT_EQUAL(expected, BplusKeySearch<double>::upperBound(doubles, count, key));
+      }
+    }
+    for (int count = 0; count <= 21; count++) {
+      for (int key = -1; key <= 43; key++) {
+        int expected = 0;
+        for (int i = 0; i < count; i++) {
+          expected += ints[i] <= key;
+        }
+        CPPUNIT_ASSERT_EQUAL(expected, BplusKeySearch<int>::upperBound(ints, count, key));
+      }
+    }
+  }
+
+  void testLayout()
+  {
+    typedef BplusTree<double, void *> PointerTree;
+    InspectableTree<double, void *> tree((void *) NULL);
+    CPPUNIT_ASSERT(tree.innerSize() <= (size_t) PointerTree::INNER_BYTES);
+    CPPUNIT_ASSERT(tree.leafSize() <= (size_t) PointerTree::LEAF_BYTES);
+    CPPUNIT_ASSERT_EQUAL(15, (int) PointerTree::INNER_KEYS);
+    CPPUNIT_ASSERT_EQUAL(30, (int) PointerTree::LEAF_ENTRIES);
+    for (int i = 0; i < 1000; i++) {
+      tree.add(i, (void *) NULL);
+    }
+    CPPUNIT_ASSERT(tree.rootAligned());
+  }
+
+  /**
+   * Keys in order, like an SP3 file, fill the leaves all the way
+   */
+
+  void testInOrder()
+  {
+    InspectableTree<double, int> tree(-1);
+    std::map<double, int> expected;
+    int count = 100000;
+    for (int i = 0; i < count; i++) {
+      tree.add(i * 900.0, i);
+      expected[i * 900.0] = i;
+    }
+    compare(tree, expected);
+    typedef BplusTree<double, int> IntTree;
+    int perLeaf = IntTree::LEAF_ENTRIES;
+    CPPUNIT_ASSERT_EQUAL((size_t) (count + perLeaf - 1) / perLeaf, tree.leafCount());
+    CPPUNIT_ASSERT(tree.height() <= 5);
+    for (int i = 0; i < count; i++) {
+      CPPUNIT_ASSERT_EQUAL(i, tree.find(i * 900.0));
+      CPPUNIT_ASSERT_EQUAL(-1, tree.find(i * 900.0 + 1.0));
+    }
+  }
+
+  void testRandom()
+  {
+    InspectableTree<int, int> tree(-1);
+    std::map<int, int> expected;
+    srand(9);
+    for (int i = 0; i < 300000; i++) {
+      int key = rand() % 20000;
+      if (rand() % 2) {
+        if (expected.find(key) == expected.end()) {
+          tree.add(key, i);
+          expected[key] = i;
+        } else {
+          CPPUNIT_ASSERT_THROW(tree.add(key, i), std::string);
+        }
+      } else {
+        std::map<int, int>::iterator found = expected.find(key);
+        CPPUNIT_ASSERT_EQUAL(found == expected.end() ? -1 : found->second, tree.remove(key));
+        if (found != expected.end()) {
+          expected.erase(found);
+        }
+      }
+      if (i % 20000 == 0) {
+        compare(tree, expected);
+      }
+    }
+    compare(tree, expected);
+    for (int key = 0; key < 20000; key++) {
+      std::map<int, int>::iterator found = expected.find(key);
+      CPPUNIT_ASSERT_EQUAL(found == expected.end() ? -1 : found->second, tree.find(key));
+    }
+  }
+
+  /**
+   * Emptying it out, from the front and from the middle, has to
+   * borrow and merge all the way up and shrink the root
+   */
+
+  void testRemoveAll()
+  {
+    InspectableTree<int, int> tree(-1);
+    std::map<int, int> expected;
+    for (int i = 0; i < 50000; i++) {
+      tree.add(i, i);
+      expected[i] = i;
+    }
+    int height = tree.height();
+    for (int i = 0; i < 50000; i += 2) {
+      CPPUNIT_ASSERT_EQUAL(i, tree.remove(i));
+      expected.erase(i);
+    }
+    compare(tree, expected);
+    for (int i = 25001; i < 50000; i += 2) {
+      CPPUNIT_ASSERT_EQUAL(i, tree.remove(i));
+      expected.erase(i);
+    }
+    compare(tree, expected);
+    for (int i = 1; i < 25000; i += 2) {
+      CPPUNIT_ASSERT_EQUAL(i, tree.remove(i));
+      expected.erase(i);
+      if (i % 997 == 0) {
+        compare(tree, expected);
+      }
+    }
+    compare(tree, expected);
+    CPPUNIT_ASSERT_EQUAL(0, tree.height());
+    CPPUNIT_ASSERT(height > 2);
+    // And it still works after that
+    tree.add(5, 5);
+    CPPUNIT_ASSERT_EQUAL(5, tree.find(5));
+  }
+
+  void testFindRange()
+  {
+    BplusTree<int,int> tree(0);
+    for (int i = 0; i < 1000; i += 10) {
+      tree.add(i, i + 1);
+    }
+    BplusTree<int,int>::RangeType range;
+    tree.findRange(range, 15, 95);
+    CPPUNIT_ASSERT_EQUAL((size_t) 8, range.size());
+    CPPUNIT_ASSERT_EQUAL(20, range.front()->first);
+    CPPUNIT_ASSERT_EQUAL(90, range.back()->first);
+    range.clear();
+    tree.findRange(range, 990, 5000);
+    CPPUNIT_ASSERT_EQUAL((size_t) 1, range.size());
+    range.clear();
+    tree.findRange(range, 2000, 5000);
+    CPPUNIT_ASSERT(range.empty());
+    range.clear();
+    tree.findRange(range, -5, 0);
+    CPPUNIT_ASSERT_EQUAL((size_t) 1, range.size());
+    CPPUNIT_ASSERT_EQUAL(1, range[0]->second);
+  }
+
+  /**
+   * Keys without an SSE2 search, and that need destructors run
+   */
+
+  void testStringKeys()
+  {
+    InspectableTree<std::string, std::string> tree("");
+    std::map<std::string, std::string> expected;
+    for (int i = 0; i < 5000; i++) {
+      char key[16];
+      snprintf(key, sizeof(key), "G%05d", (i * 7919) % 5000);
+      tree.add(key, std::string(key) + "!");
+      expected[key] = std::string(key) + "!";
+    }
+    compare(tree, expected);
+    for (int i = 0; i < 5000; i += 3) {
+      char key[16];
+      snprintf(key, sizeof(key), "G%05d", i);
+      CPPUNIT_ASSERT_EQUAL(std::string(key) + "!", tree.remove(key));
+      expected.erase(key);
+    }
+    compare(tree, expected);
+  }
+
+  typedef BplusTree<int,int> Tree;
+
+  /**
+   * Cursors both ways over random ranges, checked against std::map,
+   * including ranges that start or end between keys, past either
+   * end, or have nothing in them
+   */
+
+  void testCursors()
+  {
+    Tree tree(-1);
+    std::map<int, int> expected;
+    srand(9);
+    for (int i = 0; i < 5000; i++) {
+      int key = (rand() % 20000) * 10;
+      if (expected.insert(std::make_pair(key, i)).second) {
+        tree.add(key, i);
+      }
+    }
+    for (int run = 0; run < 500; run++) {
+      int start = rand() % 210000 - 5000;
+      int end = start + rand() % (run < 450 ? 2000 : 250000);
+      std::map<int, int>::iterator low = expected.lower_bound(start);
+      std::map<int, int>::iterator high = expected.upper_bound(end);
+
+      Tree::Cursor cursor = tree.range(start, end);
+      std::map<int, int>::iterator check = low;
+      for (; !cursor.done(); ++cursor, ++check) {
+        CPPUNIT_ASSERT(check != high);
+        CPPUNIT_ASSERT_EQUAL(check->first, cursor->first);
+        CPPUNIT_ASSERT_EQUAL(check->second, (*cursor).second);
+      }
+      CPPUNIT_ASSERT(check == high);
+
+      Tree::ReverseCursor reverse = tree.reverseRange(start, end);
+      check = high;
+      for (; !reverse.done(); ++reverse) {
+        CPPUNIT_ASSERT(check != low);
+        --check;
+        CPPUNIT_ASSERT_EQUAL(check->first, reverse->first);
+      }
+      CPPUNIT_ASSERT(check == low);
+    }
+
+    // Cursors write through to the tree
+    Tree::Cursor first = tree.range(expected.begin()->first, expected.begin()->first);
+    first->second = 12345;
+    CPPUNIT_ASSERT_EQUAL(12345, tree.find(expected.begin()->first));
+
+    // A visitor that quits early only sees what it asked for
+    StopAfter stop(10);
+    CPPUNIT_ASSERT_EQUAL((size_t) 10, tree.visitRange(0, 300000, stop));
+    CPPUNIT_ASSERT_EQUAL(10, stop.seen);
+    StopAfter all(1000000);
+    CPPUNIT_ASSERT_EQUAL(expected.size(), tree.visitRange(-1, 300000, all));
+
+    Tree empty(-1);
+    CPPUNIT_ASSERT(empty.range(0, 10).done());
+    CPPUNIT_ASSERT(empty.reverseRange(0, 10).done());
+  }
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(BplusTreeTest);
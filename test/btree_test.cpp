@@ -16,9 +16,35 @@
  */
 
 #include "btree.h"
+#include <boost/type_traits/is_polymorphic.hpp>
+#include <iterator>
+#include <map>
+#include <math.h>
+#include <set>
+#include <stdlib.h>
+#include <utility>
+#include <vector>
 
 #include <cppunit/extensions/HelperMacros.h>
 
+/**
+ * Takes count entries from visitRange, then asks it to stop
+ */
+
+struct StopAfter {
+  int count;
+  int seen;
+
+  StopAfter(int count) : count(count), seen(0)
+  {
+  }
+
+  bool operator()(std::pair<int, int> &)
+  {
+    return ++seen < count;
+  }
+};
+
 class BtreeTest : public CppUnit::TestFixture {
 
   CPPUNIT_TEST_SUITE(BtreeTest);
@@ -27,6 +53,14 @@ class BtreeTest : public CppUnit::TestFixture {
   CPPUNIT_TEST(testRemove);
   CPPUNIT_TEST(testFindRange);
   CPPUNIT_TEST(testBalance);
+  CPPUNIT_TEST(testRandomAddRemove);
+  CPPUNIT_TEST(testScaling);
+  CPPUNIT_TEST(testBulkLoad);
+  CPPUNIT_TEST(testMergeSorted);
+  CPPUNIT_TEST(testCursors);
+  CPPUNIT_TEST(testLookups);
+  CPPUNIT_TEST(testRankSelect);
+  CPPUNIT_TEST(testStablePointers);
  
   CPPUNIT_TEST_SUITE_END();
 
@@ -92,6 +126,417 @@ public:
     CPPUNIT_ASSERT(tree.isBalanced());
   }
 
+  /**
+   * An AVL tree with n nodes is never more than about 1.44 log2(n)
+   * high
+   */
+
+  bool heightOk(int height, size_t count)
+  {
+    return height <= 1.45 * log((double) count + 2.0) / log(2.0);
+  }
+
+  /**
+   * Lots of adds and removes at random, checked against std::set,
+   * with the tree staying balanced the whole way (and without
+   * rebalance() being called.)
+   */
+
+  void testRandomAddRemove()
+  {
+    Btree<int,int> tree(-1);
+    std::set<int> expected;
+    srand(5);
+    for (int i = 0; i < 200000; i++) {
+      int key = rand() % 5000;
+      if (rand() % 3) {
+        if (expected.insert(key).second) {
+          tree.add(key, key * 2);
+        } else {
+          CPPUNIT_ASSERT_THROW(tree.add(key, 0), std::string);
+        }
+      } else {
+        int found = tree.remove(key);
+        CPPUNIT_ASSERT_EQUAL(expected.erase(key) ? key * 2 : -1, found);
+      }
+      if (i % 10000 == 0) {
+        CPPUNIT_ASSERT(heightOk(tree.height(), expected.size()));
+        CPPUNIT_ASSERT(tree.isBalanced());
+      }
+    }
+    for (int key = 0; key < 5000; key++) {
+      CPPUNIT_ASSERT_EQUAL(expected.count(key) ? key * 2 : -1, tree.find(key));
+    }
+    Btree<int,int>::RangeType range;
+    tree.findRange(range, tree.begin(), tree.end());
+    CPPUNIT_ASSERT_EQUAL(expected.size(), range.size());
+    std::set<int>::iterator key = expected.begin();
+    for (size_t i = 0; i < range.size(); i++, key++) {
+      CPPUNIT_ASSERT_EQUAL(*key, range[i]->first);
+    }
+  }
+
+  /**
+   * Keys in order, the way ingest adds epochs, at 10^6 and 10^7. The
+   * heights are what show it stays log n; timing it is no good as a
+   * pass/fail on a busy machine.
+   */
+
+  void testScaling()
+  {
+    int sizes[] = { 1000000, 10000000 };
+    for (int run = 0; run < 2; run++) {
+      Btree<int,int> tree(-1);
+      for (int i = 0; i < sizes[run]; i++) {
+        tree.add(i, i);
+      }
+      CPPUNIT_ASSERT(heightOk(tree.height(), sizes[run]));
+      for (int i = 0; i < sizes[run]; i += 9973) {
+        CPPUNIT_ASSERT_EQUAL(i, tree.find(i));
+      }
+      // Take out every other one from the front half
+      for (int i = 0; i < sizes[run] / 2; i += 2) {
+        CPPUNIT_ASSERT_EQUAL(i, tree.remove(i));
+      }
+      CPPUNIT_ASSERT(heightOk(tree.height(), sizes[run] - sizes[run] / 4));
+      CPPUNIT_ASSERT_EQUAL(-1, tree.find(0));
+      CPPUNIT_ASSERT_EQUAL(1, tree.find(1));
+    }
+  }
+
+  /**
+   * A perfectly balanced tree of n nodes is ceil(log2(n + 1)) high
+   */
+
+  int perfectHeight(size_t count)
+  {
+    int height = 0;
+    while (count) {
+      count /= 2;
+      height++;
+    }
+    return height;
+  }
+
+  typedef std::vector<std::pair<int, int> > Pairs;
+
+  void testBulkLoad()
+  {
+    size_t sizes[] = { 0, 1, 2, 3, 7, 8, 1000, 1000000 };
+    for (int run = 0; run < 8; run++) {
+      Pairs sorted;
+      for (size_t i = 0; i < sizes[run]; i++) {
+        sorted.push_back(std::make_pair((int) i * 3, (int) i));
+      }
+      Btree<int,int> tree(-1);
+      tree.bulkLoad(sorted.begin(), sorted.end());
+      CPPUNIT_ASSERT_EQUAL(perfectHeight(sizes[run]), tree.height());
+      if (sizes[run] == 0) {
+        CPPUNIT_ASSERT_THROW(tree.begin(), std::string);
+        continue;
+      }
+      CPPUNIT_ASSERT(tree.isBalanced());
+      CPPUNIT_ASSERT_EQUAL(0, tree.begin());
+      CPPUNIT_ASSERT_EQUAL(((int) sizes[run] - 1) * 3, tree.end());
+      for (size_t i = 0; i < sizes[run]; i += 1 + sizes[run] / 1000) {
+        CPPUNIT_ASSERT_EQUAL((int) i, tree.find((int) i * 3));
+        CPPUNIT_ASSERT_EQUAL(-1, tree.find((int) i * 3 + 1));
+      }
+      Btree<int,int>::RangeType range;
+      tree.findRange(range, tree.begin(), tree.end());
+      CPPUNIT_ASSERT_EQUAL(sizes[run], range.size());
+
+      // It has to keep working as an AVL tree afterward
+      for (size_t i = 0; i < sizes[run]; i += 2) {
+        CPPUNIT_ASSERT_EQUAL((int) i, tree.remove((int) i * 3));
+      }
+      tree.add(1, 1);
+      CPPUNIT_ASSERT(tree.isBalanced());
+      CPPUNIT_ASSERT(heightOk(tree.height(), sizes[run] / 2 + 1));
+      CPPUNIT_ASSERT_EQUAL(1, tree.find(1));
+    }
+
+    // Only into an empty tree, and only sorted
+    Pairs sorted;
+    sorted.push_back(std::make_pair(1, 1));
+    sorted.push_back(std::make_pair(2, 2));
+    Btree<int,int> tree(-1);
+    tree.add(5, 5);
+    CPPUNIT_ASSERT_THROW(tree.bulkLoad(sorted.begin(), sorted.end()), std::string);
+    Btree<int,int> unsorted(-1);
+    sorted.push_back(std::make_pair(2, 3));
+    CPPUNIT_ASSERT_THROW(unsorted.bulkLoad(sorted.begin(), sorted.end()), std::string);
+    CPPUNIT_ASSERT_EQUAL(0, unsorted.height());
+    CPPUNIT_ASSERT_EQUAL(-1, unsorted.find(1));
+  }
+
+  /**
+   * Merge a sorted run into a tree that was built up with adds, and
+   * check against std::set
+   */
+
+  void testMergeSorted()
+  {
+    Btree<int,int> tree(-1);
+    std::set<int> expected;
+    srand(7);
+    for (int i = 0; i < 20000; i++) {
+      int key = rand() % 100000;
+      if (expected.insert(key).second) {
+        tree.add(key, key * 2);
+      }
+    }
+    Pairs more;
+    for (int key = 0; key < 100000; key += 7) {
+      if (!expected.count(key)) {
+        more.push_back(std::make_pair(key, key * 2));
+        expected.insert(key);
+      }
+    }
+    tree.mergeSorted(more.begin(), more.end());
+    CPPUNIT_ASSERT(tree.isBalanced());
+    CPPUNIT_ASSERT_EQUAL(perfectHeight(expected.size()), tree.height());
+    Btree<int,int>::RangeType range;
+    tree.findRange(range, tree.begin(), tree.end());
+    CPPUNIT_ASSERT_EQUAL(expected.size(), range.size());
+    std::set<int>::iterator key = expected.begin();
+    for (size_t i = 0; i < range.size(); i++, key++) {
+      CPPUNIT_ASSERT_EQUAL(*key, range[i]->first);
+      CPPUNIT_ASSERT_EQUAL(*key * 2, range[i]->second);
+    }
+
+    // A key that's already there, or an unsorted run, leaves the tree
+    // the way it was
+    Pairs clash;
+    clash.push_back(std::make_pair(-5, 0));
+    clash.push_back(std::make_pair(*expected.begin(), 0));
+    CPPUNIT_ASSERT_THROW(tree.mergeSorted(clash.begin(), clash.end()), std::string);
+    Pairs backward;
+    backward.push_back(std::make_pair(200001, 0));
+    backward.push_back(std::make_pair(200000, 0));
+    CPPUNIT_ASSERT_THROW(tree.mergeSorted(backward.begin(), backward.end()), std::string);
+    CPPUNIT_ASSERT_EQUAL(-1, tree.find(-5));
+    CPPUNIT_ASSERT_EQUAL(-1, tree.find(200001));
+    CPPUNIT_ASSERT_EQUAL(*expected.begin() * 2, tree.find(*expected.begin()));
+    range.clear();
+    tree.findRange(range, -10, 300000);
+    CPPUNIT_ASSERT_EQUAL(expected.size(), range.size());
+
+    // Merging onto the end, the way a new day of epochs shows up
+    Pairs later;
+    for (int key = 100000; key < 150000; key++) {
+      later.push_back(std::make_pair(key, key * 2));
+    }
+    tree.mergeSorted(later.begin(), later.end());
+    CPPUNIT_ASSERT_EQUAL(149999, tree.end());
+    CPPUNIT_ASSERT_EQUAL(299998, tree.find(149999));
+    CPPUNIT_ASSERT(tree.isBalanced());
+  }
+
+  typedef Btree<int,int> Tree;
+
+  /**
+   * Cursors both ways over random ranges, checked against std::map,
+   * including ranges that start or end between keys, past either
+   * end, or have nothing in them
+   */
+
+  void testCursors()
+  {
+    Tree tree(-1);
+    std::map<int, int> expected;
+    srand(9);
+    for (int i = 0; i < 5000; i++) {
+      int key = (rand() % 20000) * 10;
+      if (expected.insert(std::make_pair(key, i)).second) {
+        tree.add(key, i);
+      }
+    }
+    for (int run = 0; run < 500; run++) {
+      int start = rand() % 210000 - 5000;
+      int end = start + rand() % (run < 450 ? 2000 : 250000);
+      std::map<int, int>::iterator low = expected.lower_bound(start);
+      std::map<int, int>::iterator high = expected.upper_bound(end);
+
+      Tree::Cursor cursor = tree.range(start, end);
+      std::map<int, int>::iterator check = low;
+      for (; !cursor.done(); ++cursor, ++check) {
+        CPPUNIT_ASSERT(check != high);
+        CPPUNIT_ASSERT_EQUAL(check->first, cursor->first);
+        CPPUNIT_ASSERT_EQUAL(check->second, (*cursor).second);
+      }
+      CPPUNIT_ASSERT(check == high);
+
+      Tree::ReverseCursor reverse = tree.reverseRange(start, end);
+      check = high;
+      for (; !reverse.done(); ++reverse) {
+        CPPUNIT_ASSERT(check != low);
+        --check;
+        CPPUNIT_ASSERT_EQUAL(check->first, reverse->first);
+      }
+      CPPUNIT_ASSERT(check == low);
+    }
+
+    // Cursors write through to the tree
+    Tree::Cursor first = tree.range(expected.begin()->first, expected.begin()->first);
+    first->second = 12345;
+    CPPUNIT_ASSERT_EQUAL(12345, tree.find(expected.begin()->first));
+
+    // A visitor that quits early only sees what it asked for
+    StopAfter stop(10);
+    CPPUNIT_ASSERT_EQUAL((size_t) 10, tree.visitRange(0, 300000, stop));
+    CPPUNIT_ASSERT_EQUAL(10, stop.seen);
+    StopAfter all(1000000);
+    CPPUNIT_ASSERT_EQUAL(expected.size(), tree.visitRange(-1, 300000, all));
+
+    Tree empty(-1);
+    CPPUNIT_ASSERT(empty.range(0, 10).done());
+    CPPUNIT_ASSERT(empty.reverseRange(0, 10).done());
+  }
+
+  typedef BtreeNode<int,int> Node;
+
+  /**
+   * Exact, floor and ceil lookups against std::set, and the nodes
+   * don't carry a vtable around
+   */
+
+  void testLookups()
+  {
+    CPPUNIT_ASSERT(!boost::is_polymorphic<Node>::value);
+    Tree tree(-1);
+    CPPUNIT_ASSERT_EQUAL(-1, tree.floor(5));
+    CPPUNIT_ASSERT_EQUAL(-1, tree.ceil(5));
+    std::set<int> keys;
+    srand(13);
+    for (int i = 0; i < 20000; i++) {
+      int key = rand() % 100000;
+      if (keys.insert(key).second) {
+        tree.add(key, key);
+      }
+    }
+    for (int key = -10; key < 100010; key++) {
+      std::set<int>::iterator above = keys.lower_bound(key);
+      int ceil = above == keys.end() ? -1 : *above;
+      int exact = ceil == key ? key : -1;
+      int floor = -1;
+      if (exact != -1) {
+        floor = key;
+      } else if (above != keys.begin()) {
+        floor = *--above;
+      }
+      CPPUNIT_ASSERT_EQUAL(exact, tree.find(key));
+      CPPUNIT_ASSERT_EQUAL(floor, tree.floor(key));
+      CPPUNIT_ASSERT_EQUAL(ceil, tree.ceil(key));
+    }
+  }
+
+  /**
+   * rank, select and countRange against std::set, after adds,
+   * removes (which rotate) and a merge (which relinks everything)
+   */
+
+  void checkCounts(Tree &tree, std::set<int> &expected)
+  {
+    CPPUNIT_ASSERT_EQUAL(expected.size(), tree.size());
+    size_t k = 0;
+    for (std::set<int>::iterator key = expected.begin(); key != expected.end(); key++, k++) {
+      CPPUNIT_ASSERT_EQUAL(*key, tree.select(k)->first);
+      CPPUNIT_ASSERT_EQUAL(k, tree.rank(*key));
+      CPPUNIT_ASSERT_EQUAL(k + 1, tree.rank(*key + 1));
+    }
+    CPPUNIT_ASSERT(tree.select(expected.size()) == NULL);
+    for (int i = 0; i < 2000; i++) {
+      int start = rand() % 22000 - 1000;
+      int end = start + rand() % 3000 - 100;
+      size_t count = 0;
+      if (!(end < start)) {
+        count = std::distance(expected.lower_bound(start), expected.upper_bound(end));
+      }
+      CPPUNIT_ASSERT_EQUAL(count, tree.countRange(start, end));
+    }
+  }
+
+  void testRankSelect()
+  {
+    Tree tree(-1);
+    std::set<int> expected;
+    CPPUNIT_ASSERT_EQUAL((size_t) 0, tree.size());
+    CPPUNIT_ASSERT(tree.select(0) == NULL);
+    CPPUNIT_ASSERT_EQUAL((size_t) 0, tree.countRange(0, 10));
+    srand(23);
+    for (int i = 0; i < 30000; i++) {
+      int key = (rand() % 10000) * 2;
+      if (rand() % 3) {
+        if (expected.insert(key).second) {
+          tree.add(key, key);
+        }
+      } else {
+        expected.erase(key);
+        tree.remove(key);
+      }
+    }
+    checkCounts(tree, expected);
+
+    Pairs odd;
+    for (int key = 1; key < 20000; key += 6) {
+      odd.push_back(std::make_pair(key, key));
+      expected.insert(key);
+    }
+    tree.mergeSorted(odd.begin(), odd.end());
+    checkCounts(tree, expected);
+  }
+
+  /**
+   * Taking a key out doesn't move anybody else's pair, even the one
+   * that takes its place in the tree. NodeHeap frees nodes right
+   * away, so a pair that went with the wrong node would be gone.
+   */
+
+  void testStablePointers()
+  {
+    typedef Btree<int, int, NodeHeap> HeapTree;
+    HeapTree tree(-1);
+    for (int i = 0; i < 7; i++) {
+      tree.add(i, i * 10);
+    }
+    HeapTree::RangeType range;
+    tree.findRange(range, 0, 6);
+    std::pair<int, int> *four = range[4];
+    tree.remove(3);
+    CPPUNIT_ASSERT_EQUAL(4, four->first);
+    CPPUNIT_ASSERT_EQUAL(40, four->second);
+    CPPUNIT_ASSERT(tree.select(3) == four);
+
+    srand(29);
+    for (int i = 0; i < 2000; i++) {
+      int key = 7 + rand() % 5000;
+      if (tree.find(key) == -1) {
+        tree.add(key, i);
+      }
+    }
+    range.clear();
+    tree.findRange(range, tree.begin(), tree.end());
+    std::map<int, std::pair<int, int> *> held;
+    for (size_t i = 0; i < range.size(); i++) {
+      held[range[i]->first] = range[i];
+    }
+    while (held.size() > 10) {
+      std::map<int, std::pair<int, int> *>::iterator gone = held.begin();
+      std::advance(gone, rand() % held.size());
+      int value = gone->second->second;
+      CPPUNIT_ASSERT_EQUAL(value, tree.remove(gone->first));
+      held.erase(gone);
+      std::map<int, std::pair<int, int> *>::iterator it = held.begin();
+      for (size_t rank = 0; it != held.end(); it++, rank++) {
+        CPPUNIT_ASSERT_EQUAL(it->first, it->second->first);
+        CPPUNIT_ASSERT(tree.select(rank) == it->second);
+      }
+      CPPUNIT_ASSERT_EQUAL(held.size(), tree.size());
+      CPPUNIT_ASSERT(tree.isBalanced());
+    }
+  }
+
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(BtreeTest);
@@ -0,0 +1,346 @@
+/**
+ * Tests for ChebyshevOrbit and ChebyshevEphemeris: how close the
+ * fits come, and that every instruction set gets the same answers.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "chebyshev_orbit.h"
+#include "ephemeris_cache.h"
+#include "ephemeris_line.h"
+#include "sp3_loader.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <cppunit/extensions/HelperMacros.h>
+
+class ChebyshevOrbitTest : public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(ChebyshevOrbitTest);
+  CPPUNIT_TEST(testPolynomial);
+  CPPUNIT_TEST(testSp3File);
+  CPPUNIT_TEST(testHeldOut);
+  CPPUNIT_TEST(testImplementations);
+  CPPUNIT_TEST(testEdges);
+  CPPUNIT_TEST(testUnaligned);
+  CPPUNIT_TEST_SUITE_END();
+
+  EphemerisCache cache;
+
+  void load()
+  {
+    std::vector<std::string> names;
+    cache.satelliteNames(names);
+    if (names.empty()) {
+      Sp3Loader loader;
+      CPPUNIT_ASSERT(loader.addPath("nga16556.eph"));
+      CPPUNIT_ASSERT(loader.load(cache) > 0);
+    }
+  }
+
+  static double distance(EphemerisLine &a, EphemerisLine &b)
+  {
+    double dx = a.getPosition().getX() - b.getPosition().getX();
+    double dy = a.getPosition().getY() - b.getPosition().getY();
+    double dz = a.getPosition().getZ() - b.getPosition().getZ();
+    return sqrt(dx * dx + dy * dy + dz * dz);
+  }
+
+  /**
+   * In meters per second
+   */
+
+  static double speedDifference(EphemerisLine &a, EphemerisLine &b)
+  {
+    double dx = a.getDx() - b.getDx();
+    double dy = a.getDy() - b.getDy();
+    double dz = a.getDz() - b.getDz();
+    return sqrt(dx * dx + dy * dy + dz * dz) * OrbitInterpolator::sp3VelocityScale();
+  }
+
+public:
+
+  /**
+   * A cubic in each axis with matching velocities fits exactly, and
+   * comes back exactly in between the epochs too
+   */
+
+  void testPolynomial()
+  {
+    EpochIndex<EphemerisLine> epochs;
+    for (int i = 0; i <= 24; i++) {
+      double t = i * 900.0;
+      double s = t / 1000.0;
+      EphemerisLine line(1e7 + 3e5 * s - 2e3 * s * s + 7 * s * s * s,
+                         -2e7 + 1e5 * s + 5e2 * s * s,
+                         4e6 - 8e4 * s - 30 * s * s * s,
+                         (3e5 - 4e3 * s + 21 * s * s) / 1000.0 / 0.0001,
+                         (1e5 + 1e3 * s) / 1000.0 / 0.0001,
+                         (-8e4 - 90 * s * s) / 1000.0 / 0.0001, t);
+      epochs.add(t, line);
+    }
+    ChebyshevOrbit orbit(5);
+    CPPUNIT_ASSERT_EQUAL((size_t) 1, orbit.fit(epochs));
+    CPPUNIT_ASSERT(orbit.maxPositionError() < 1e-6);
+    CPPUNIT_ASSERT(orbit.maxVelocityError() < 1e-9);
+    EphemerisLine result(0, 0, 0, 0, 0, 0);
+    CPPUNIT_ASSERT(orbit.evaluate(5000.0, result));
+    double s = 5.0;
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1e7 + 3e5 * s - 2e3 * s * s + 7 * s * s * s, result.getPosition().getX(), 1e-6);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(4e6 - 8e4 * s - 30 * s * s * s, result.getPosition().getZ(), 1e-6);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL((3e5 - 4e3 * s + 21 * s * s) / 1000.0 / 0.0001, result.getDx(), 1e-6);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(5000.0, result.getTime(), 0.0);
+  }
+
+  /**
+   * A day of 15 minute NGA epochs, at the default degree and span:
+   * four 6 hour segments a satellite, fit to about a centimeter.
+   * In between the epochs it agrees with Lagrange interpolation to
+   * better than that.
+   */
+
+  void testSp3File()
+  {
+    load();
+    ChebyshevEphemeris ephemeris;
+    std::vector<std::string> names;
+    cache.satelliteNames(names);
+    CPPUNIT_ASSERT_EQUAL(names.size(), ephemeris.fit(cache));
+    CPPUNIT_ASSERT_EQUAL(names.size(), ephemeris.size());
+    CPPUNIT_ASSERT(ephemeris.maxPositionError() < 0.05);
+    CPPUNIT_ASSERT(ephemeris.maxVelocityError() < 0.001);
+    const ChebyshevOrbit *orbit = ephemeris.find(names[0]);
+    CPPUNIT_ASSERT(orbit != NULL);
+    CPPUNIT_ASSERT_EQUAL((size_t) 4, orbit->segmentCount());
+    CPPUNIT_ASSERT_EQUAL((size_t) 25, orbit->segment(0).samples);
+    CPPUNIT_ASSERT_EQUAL(orbit->segment(0).end, orbit->segment(1).start);
+    CPPUNIT_ASSERT(ephemeris.find("nobody") == NULL);
+    // A lot smaller than the epochs
+    CPPUNIT_ASSERT(ephemeris.bytes() * 3 < names.size() * 96 * (sizeof(double) + sizeof(EphemerisLine)));
+
+    OrbitInterpolator lagrange(OrbitInterpolator::LAGRANGE, 11);
+    double start = 1317427200.0;
+    for (size_t i = 0; i < names.size(); i++) {
+      orbit = ephemeris.find(names[i]);
+      for (double time = start + 2000.0; time < start + 84000.0; time += 997.0) {
+        EphemerisLine expected(0, 0, 0, 0, 0, 0);
+        EphemerisLine result(0, 0, 0, 0, 0, 0);
+        CPPUNIT_ASSERT(cache.interpolate(names[i], time, expected, lagrange));
+        CPPUNIT_ASSERT(orbit->evaluate(time, result));
+        CPPUNIT_ASSERT(distance(expected, result) < 0.05);
+        CPPUNIT_ASSERT(speedDifference(expected, result) < 0.001);
+      }
+    }
+
+    // All of them at once come out the same as one at a time
+    std::vector<std::string> found;
+    std::vector<EphemerisLine> lines;
+    CPPUNIT_ASSERT_EQUAL(names.size(), ephemeris.evaluate(start + 12345.0, found, lines));
+    CPPUNIT_ASSERT(found == names);
+    for (size_t i = 0; i < names.size(); i++) {
+      EphemerisLine one(0, 0, 0, 0, 0, 0);
+      ephemeris.find(names[i])->evaluate(start + 12345.0, one);
+      CPPUNIT_ASSERT(distance(one, lines[i]) < 1e-6);
+    }
+  }
+
+  /**
+   * The fit error only says how well it matches the epochs it saw.
+   * Fit every other epoch, and check it against the ones it didn't.
+   */
+
+  void testHeldOut()
+  {
+    load();
+    std::vector<std::string> names;
+    cache.satelliteNames(names);
+    for (size_t n = 0; n < names.size(); n++) {
+      EpochIndex<EphemerisLine> all;
+      CPPUNIT_ASSERT(cache.copy(names[n], all));
+      CPPUNIT_ASSERT_EQUAL((size_t) 96, all.size());
+      EpochIndex<EphemerisLine> half;
+      for (size_t i = 0; i < all.size(); i += 2) {
+        half.add(all.time(i), all.value(i));
+      }
+      ChebyshevOrbit orbit;
+      orbit.fit(half);
+      for (size_t i = 1; i + 1 < all.size(); i += 2) {
+        EphemerisLine result(0, 0, 0, 0, 0, 0);
+        CPPUNIT_ASSERT(orbit.evaluate(all.time(i), result));
+        CPPUNIT_ASSERT(distance(all.value(i), result) < 0.5);
+        CPPUNIT_ASSERT(speedDifference(all.value(i), result) < 0.002);
+      }
+    }
+  }
+
+  /**
+   * Every instruction set gets the same answers, for sorted times,
+   * shuffled ones (lanes in different segments), lots of
+   * satellites, and every leftover row size
+   */
+
+  void testImplementations()
+  {
+    load();
+    ChebyshevEphemeris ephemeris;
+    ephemeris.fit(cache);
+    std::vector<std::string> names;
+    ephemeris.satelliteNames(names);
+    const ChebyshevOrbit *orbit = ephemeris.find(names[3]);
+
+    srand(11);
+    std::vector<double> times;
+    double start = 1317427200.0;
+    for (int i = 0; i < 1001; i++) {
+      times.push_back(start - 600.0 + i * 87.0);
+    }
+    std::vector<double> shuffled(times);
+    for (size_t i = shuffled.size() - 1; i > 0; i--) {
+      std::swap(shuffled[i], shuffled[rand() % (i + 1)]);
+    }
+    std::vector<const ChebyshevOrbit *> orbits;
+    for (size_t i = 0; i < names.size(); i++) {
+      orbits.push_back(ephemeris.find(names[i]));
+    }
+    orbits.push_back((const ChebyshevOrbit *) NULL);
+
+    ChebyshevOrbit::Implementation all[] = { ChebyshevOrbit::SCALAR, ChebyshevOrbit::AVX2, ChebyshevOrbit::AVX512, ChebyshevOrbit::AUTO };
+    for (int use = 0; use < 4; use++) {
+      if (!ChebyshevOrbit::supported(all[use])) {
+        continue;
+      }
+      for (int pass = 0; pass < 2; pass++) {
+        std::vector<double> &in = pass ? shuffled : times;
+        size_t n = in.size();
+        std::vector<double> v(6 * n);
+        size_t found = orbit->evaluate(&in[0], n, &v[0], &v[n], &v[2 * n], &v[3 * n], &v[4 * n], &v[5 * n], all[use]);
+        size_t expected = 0;
+        for (size_t i = 0; i < n; i++) {
+          EphemerisLine one(0, 0, 0, 0, 0, 0);
+          if (!orbit->evaluate(in[i], one, ChebyshevOrbit::SCALAR)) {
+            CPPUNIT_ASSERT(v[i] != v[i] && v[4 * n + i] != v[4 * n + i]);
+            continue;
+          }
+          expected++;
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(one.getPosition().getX(), v[i], 1e-6);
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(one.getPosition().getY(), v[n + i], 1e-6);
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(one.getPosition().getZ(), v[2 * n + i], 1e-6);
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(one.getDx(), v[3 * n + i], 1e-6);
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(one.getDz(), v[5 * n + i], 1e-6);
+        }
+        CPPUNIT_ASSERT_EQUAL(expected, found);
+        CPPUNIT_ASSERT(expected > 900 && expected < n);
+      }
+
+      for (size_t count = 0; count <= orbits.size(); count++) {
+        std::vector<double> v(6 * count + 1, -1.0);
+        size_t found = ChebyshevOrbit::evaluate(&orbits[0], count, start + 4321.0, &v[0], &v[count], &v[2 * count],
+                                                &v[3 * count], &v[4 * count], &v[5 * count], all[use]);
+        CPPUNIT_ASSERT_EQUAL(count < orbits.size() ? count : count - 1, found);
+        for (size_t i = 0; i < found; i++) {
+          EphemerisLine one(0, 0, 0, 0, 0, 0);
+          orbits[i]->evaluate(start + 4321.0, one, ChebyshevOrbit::SCALAR);
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(one.getPosition().getY(), v[count + i], 1e-6);
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(one.getDy(), v[4 * count + i], 1e-6);
+        }
+        // Nothing written past the end
+        CPPUNIT_ASSERT_EQUAL(-1.0, v[6 * count]);
+      }
+    }
+  }
+
+  /**
+   * Not much data, gaps, and times outside it all
+   */
+
+  void testEdges()
+  {
+    ChebyshevOrbit orbit;
+    EphemerisLine result(0, 0, 0, 0, 0, 0);
+    CPPUNIT_ASSERT_EQUAL((size_t) 0, orbit.fit((const double *) NULL, (EphemerisLine *) NULL, 0));
+    CPPUNIT_ASSERT(!orbit.evaluate(0.0, result));
+    CPPUNIT_ASSERT_EQUAL((size_t) 0, orbit.fit(cache, "nobody"));
+
+    // One epoch is good for exactly that time
+    EpochIndex<EphemerisLine> epochs;
+    epochs.add(100.0, EphemerisLine(1.0, 2.0, 3.0, 10.0, 20.0, 30.0, 100.0));
+    CPPUNIT_ASSERT_EQUAL((size_t) 1, orbit.fit(epochs));
+    CPPUNIT_ASSERT(orbit.evaluate(100.0, result));
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(2.0, result.getPosition().getY(), 1e-9);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(30.0, result.getDz(), 1e-9);
+    CPPUNIT_ASSERT(!orbit.evaluate(100.5, result));
+
+    // A straight line with a day missing in the middle. The epoch
+    // on the boundary before the gap doesn't get a segment of its
+    // own.
+    epochs = EpochIndex<EphemerisLine>();
+    double span = orbit.getSpan();
+    for (int i = 0; i <= 8; i++) {
+      double t = span + i * 2700.0;
+      epochs.add(t, EphemerisLine(t, 0.0, -t, 10000.0, 0.0, -10000.0, t));
+    }
+    for (int i = 0; i < 4; i++) {
+      double t = 6 * span + i * 2700.0;
+      epochs.add(t, EphemerisLine(t, 0.0, -t, 10000.0, 0.0, -10000.0, t));
+    }
+    CPPUNIT_ASSERT_EQUAL((size_t) 2, orbit.fit(epochs));
+    CPPUNIT_ASSERT_EQUAL((size_t) 9, orbit.segment(0).samples);
+    CPPUNIT_ASSERT_EQUAL(2 * span, orbit.segment(0).end);
+    CPPUNIT_ASSERT_EQUAL(6 * span, orbit.segment(1).start);
+    CPPUNIT_ASSERT(orbit.maxPositionError() < 1e-6);
+    CPPUNIT_ASSERT(orbit.evaluate(span + 1000.0, result));
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(span + 1000.0, result.getPosition().getX(), 1e-6);
+    CPPUNIT_ASSERT(orbit.evaluate(2 * span, result));
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(-2 * span, result.getPosition().getZ(), 1e-6);
+    CPPUNIT_ASSERT_EQUAL(-1L, orbit.find(3 * span));
+    CPPUNIT_ASSERT(!orbit.evaluate(3 * span, result));
+    CPPUNIT_ASSERT(!orbit.evaluate(span - 1.0, result));
+    CPPUNIT_ASSERT(orbit.evaluate(6 * span + 8100.0, result));
+    CPPUNIT_ASSERT(!orbit.evaluate(6 * span + 8101.0, result));
+  }
+
+  /**
+   * Epochs that don't land on the segment boundaries, and a span
+   * that isn't a whole number of steps. Neighbouring segments still
+   * share an epoch, so everything from the first epoch to the last
+   * is covered.
+   */
+
+  void testUnaligned()
+  {
+    double spans[] = { 6 * 3600.0, 5000.0 };
+    double firsts[] = { 450.0, 0.0 };
+    for (int run = 0; run < 2; run++) {
+      EpochIndex<EphemerisLine> epochs;
+      for (int i = 0; i < 96; i++) {
+        double t = firsts[run] + i * 900.0;
+        epochs.add(t, EphemerisLine(t, 0.0, -t, 10000.0, 0.0, -10000.0, t));
+      }
+      ChebyshevOrbit orbit(14, spans[run]);
+      CPPUNIT_ASSERT(orbit.fit(epochs) > 1);
+      for (size_t i = 0; i + 1 < orbit.segmentCount(); i++) {
+        CPPUNIT_ASSERT_EQUAL(orbit.segment(i).end, orbit.segment(i + 1).start);
+      }
+      EphemerisLine result(0, 0, 0, 0, 0, 0);
+      for (double t = epochs.time(0); t <= epochs.end(); t += 150.0) {
+        CPPUNIT_ASSERT(orbit.evaluate(t, result));
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(t, result.getPosition().getX(), 1e-6);
+      }
+      CPPUNIT_ASSERT(orbit.evaluate(21600.0, result));
+    }
+  }
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ChebyshevOrbitTest);
@@ -0,0 +1,171 @@
+/**
+ * Tests for CompressedEpochBlock. Whatever goes in has to come back
+ * out bit for bit, and real orbits have to come out a lot smaller.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "compressed_epoch_block.h"
+#include "ephemeris_line.h"
+#include "epoch_index.h"
+#include "sp3_mapped_reader.h"
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+class CompressedEpochBlockTest : public CppUnit::TestFixture, public Sp3RecordListener {
+  CPPUNIT_TEST_SUITE(CompressedEpochBlockTest);
+  CPPUNIT_TEST(testEmpty);
+  CPPUNIT_TEST(testSp3File);
+  CPPUNIT_TEST(testSmoothOrbit);
+  CPPUNIT_TEST(testAwkwardValues);
+  CPPUNIT_TEST_SUITE_END();
+
+  typedef std::map<std::string, EpochIndex<EphemerisLine> > Satellites;
+  Satellites satellites;
+
+  /**
+   * Pack epochs, unpack them, and check every bit came back. Returns
+   * how many bytes it took.
+   */
+
+  size_t roundTrip(const std::vector<double> &times, const std::vector<EphemerisLine> &lines)
+  {
+    CompressedEpochBlock block;
+    block.encode(&times[0], &lines[0], times.size());
+    CPPUNIT_ASSERT_EQUAL(times.size(), block.size());
+    CPPUNIT_ASSERT_EQUAL(times.front(), block.begin());
+    CPPUNIT_ASSERT_EQUAL(times.back(), block.end());
+    EpochIndex<EphemerisLine> out;
+    block.decode(out);
+    CPPUNIT_ASSERT_EQUAL(times.size(), out.size());
+    for (size_t i = 0; i < times.size(); i++) {
+      CPPUNIT_ASSERT(0 == memcmp(&times[i], &out.timeData()[i], sizeof(double)));
+      CPPUNIT_ASSERT(0 == memcmp((const void *) &lines[i], (const void *) &out.value(i), sizeof(EphemerisLine)));
+    }
+    return block.bytes();
+  }
+
+public:
+
+  void notify(std::vector<Sp3Record> &records)
+  {
+    for (size_t i = 0; i < records.size(); i++) {
+      satellites[records[i].name()].put(records[i].time, records[i].line());
+    }
+  }
+
+  void testEmpty()
+  {
+    CompressedEpochBlock block;
+    block.encode((const double *) NULL, (const EphemerisLine *) NULL, 0);
+    CPPUNIT_ASSERT(block.empty());
+    EpochIndex<EphemerisLine> out;
+    block.decode(out);
+    CPPUNIT_ASSERT(out.empty());
+  }
+
+  /**
+   * A day of 15 minute epochs from NGA. Prediction doesn't get as
+   * close that far apart, so it's about 3 to 1.
+   */
+
+  void testSp3File()
+  {
+    satellites.clear();
+    Sp3MappedReader reader("nga16556.eph", this);
+    CPPUNIT_ASSERT(reader.read());
+    CPPUNIT_ASSERT(!satellites.empty());
+    size_t raw = 0;
+    size_t packed = 0;
+    Satellites::iterator sat = satellites.begin();
+    for (; sat != satellites.end(); sat++) {
+      EpochIndex<EphemerisLine> &epochs = sat->second;
+      std::vector<double> times(epochs.timeData(), epochs.timeData() + epochs.size());
+      std::vector<EphemerisLine> lines(epochs.valueData(), epochs.valueData() + epochs.size());
+      packed += roundTrip(times, lines);
+      raw += epochs.size() * (sizeof(double) + sizeof(EphemerisLine));
+    }
+    CPPUNIT_ASSERT(raw > packed * 5 / 2);
+  }
+
+  /**
+   * Five minute epochs of a GPS-like orbit, written to the mm like an
+   * SP3 file would. That's what the archive will mostly be, and it
+   * should be at least 5 to 1.
+   */
+
+  void testSmoothOrbit()
+  {
+    std::vector<double> times;
+    std::vector<EphemerisLine> lines;
+    double rate = 2 * M_PI / 43082.0;
+    double radius = 26560000.0;
+    for (int i = 0; i < 288; i++) {
+      double time = 1317427200.0 + i * 300.0;
+      double angle = rate * time;
+      double v[6] = {
+        radius * cos(angle), radius * sin(angle) * 0.5, radius * sin(angle) * 0.866,
+        -radius * rate * sin(angle) * 10000, radius * rate * cos(angle) * 5000, radius * rate * cos(angle) * 8660
+      };
+      for (int c = 0; c < 6; c++) {
+        v[c] = (double) llround(v[c] / 1000 * 1e6) / 1e6 * 1000;
+      }
+      times.push_back(time);
+      lines.push_back(EphemerisLine(v[0], v[1], v[2], v[3], v[4], v[5], time));
+    }
+    size_t packed = roundTrip(times, lines);
+    CPPUNIT_ASSERT(times.size() * (sizeof(double) + sizeof(EphemerisLine)) > packed * 5);
+  }
+
+  /**
+   * Nothing about these is decimal or smooth, and some of them aren't
+   * even numbers
+   */
+
+  void testAwkwardValues()
+  {
+    std::vector<double> times;
+    std::vector<EphemerisLine> lines;
+    double nan = std::numeric_limits<double>::quiet_NaN();
+    double infinity = std::numeric_limits<double>::infinity();
+    double tiny = std::numeric_limits<double>::denorm_min();
+    double odd[] = { nan, infinity, -infinity, tiny, -0.0, 1e300, -1e-300, 0.1, 1.0 / 3.0 };
+    srand(23);
+    double time = -1000.5;
+    for (int i = 0; i < 500; i++) {
+      time += (rand() % 1000) / 7.0 + 0.001;
+      double v[7];
+      for (int c = 0; c < 7; c++) {
+        v[c] = (rand() % 4 == 0) ? odd[rand() % 9] : (rand() - RAND_MAX / 2) * 1e-3 * (c + 1);
+      }
+      times.push_back(time);
+      lines.push_back(EphemerisLine(v[0], v[1], v[2], v[3], v[4], v[5], v[6]));
+    }
+    roundTrip(times, lines);
+
+    // And just one
+    times.erase(times.begin() + 1, times.end());
+    lines.erase(lines.begin() + 1, lines.end());
+    roundTrip(times, lines);
+  }
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CompressedEpochBlockTest);
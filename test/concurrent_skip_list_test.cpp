@@ -0,0 +1,219 @@
+/**
+ * Tests for ConcurrentSkipList: first on its own against std::map,
+ * then with several threads adding, removing and reading at once.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "concurrent_skip_list.h"
+#include <boost/atomic.hpp>
+#include <boost/thread/thread.hpp>
+#include <map>
+#include <stdlib.h>
+#include <string>
+#include <cppunit/extensions/HelperMacros.h>
+
+class ConcurrentSkipListTest : public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(ConcurrentSkipListTest);
+  CPPUNIT_TEST(testAgainstMap);
+  CPPUNIT_TEST(testTimeTree);
+  CPPUNIT_TEST(testConcurrentAdds);
+  CPPUNIT_TEST(testConcurrentRemoves);
+  CPPUNIT_TEST_SUITE_END();
+
+  enum { WRITERS = 4, READERS = 3, KEYS = 40000 };
+
+  typedef ConcurrentSkipList<int, int> List;
+
+  /**
+   * Every key's value is ten times the key, so anything a reader gets
+   * back says which key it came from
+   */
+
+  class Writer {
+    List *list;
+    int id;
+    bool removing;
+  public:
+    Writer(List *list, int id, bool removing) : list(list), id(id), removing(removing)
+    {
+    }
+
+    void operator()()
+    {
+      for (int key = id; key < KEYS; key += WRITERS) {
+        if (!removing) {
+          list->add(key, key * 10);
+        } else if (key % 100 != 0) {
+          // Take out the odd ones and put the even ones back in
+          if (key % 2) {
+            list->remove(key);
+          } else {
+            list->remove(key);
+            list->add(key, key * 10);
+          }
+        }
+      }
+    }
+  };
+
+  /**
+   * Keeps doing floor lookups, and checks they come back with a key
+   * no later than the one asked for, and no earlier than a multiple
+   * of 100 that was already there
+   */
+
+  class Reader {
+    List *list;
+    boost::atomic<bool> *done;
+    boost::atomic<long> *errors;
+    int seed;
+  public:
+    Reader(List *list, boost::atomic<bool> *done, boost::atomic<long> *errors, int seed) : list(list), done(done), errors(errors), seed(seed)
+    {
+    }
+
+    void operator()()
+    {
+      unsigned int state = seed;
+      while (!done->load()) {
+        int key = rand_r(&state) % (KEYS + 100);
+        int stable = key < KEYS ? key / 100 * 100 : (KEYS - 1) / 100 * 100;
+        bool stableThere = list->find(stable) != -1;
+        int found = list->floor(key);
+        if (found == -1) {
+          if (stableThere) {
+            (*errors)++;
+          }
+          continue;
+        }
+        if (found % 10 != 0 || found / 10 > key || (stableThere && found / 10 < stable)) {
+          (*errors)++;
+        }
+      }
+    }
+  };
+
+public:
+
+  void testAgainstMap()
+  {
+    List list(-1);
+    std::map<int, int> expected;
+    CPPUNIT_ASSERT_EQUAL(-1, list.floor(3));
+    CPPUNIT_ASSERT_EQUAL(-1, list.ceil(3));
+    srand(19);
+    for (int i = 0; i < 50000; i++) {
+      int key = rand() % 5000;
+      int action = rand() % 3;
+      if (action == 0) {
+        CPPUNIT_ASSERT_EQUAL(expected.count(key) ? expected[key] : -1, list.remove(key));
+        expected.erase(key);
+      } else if (expected.count(key)) {
+        CPPUNIT_ASSERT_THROW(list.add(key, i), std::string);
+      } else {
+        list.add(key, i);
+        expected[key] = i;
+      }
+    }
+    CPPUNIT_ASSERT_EQUAL(expected.size(), list.size());
+    for (int key = -1; key <= 5001; key++) {
+      std::map<int, int>::iterator above = expected.lower_bound(key);
+      int ceil = above == expected.end() ? -1 : above->second;
+      int exact = (above != expected.end() && above->first == key) ? above->second : -1;
+      int floor = exact;
+      if (floor == -1 && above != expected.begin()) {
+        floor = (--above)->second;
+      }
+      CPPUNIT_ASSERT_EQUAL(exact, list.find(key));
+      CPPUNIT_ASSERT_EQUAL(floor, list.floor(key));
+      CPPUNIT_ASSERT_EQUAL(ceil, list.ceil(key));
+    }
+  }
+
+  void testTimeTree()
+  {
+    ConcurrentTimeTree<double, int> tree(0);
+    tree.add(2.0, 2);
+    tree.add(4.0, 4);
+    tree.add(6.0, 6);
+    CPPUNIT_ASSERT_EQUAL(0, tree.find(1.0));
+    CPPUNIT_ASSERT_EQUAL(2, tree.find(3.5));
+    CPPUNIT_ASSERT_EQUAL(6, tree.find(42.0));
+    CPPUNIT_ASSERT_EQUAL(4, tree.remove(4.0));
+    CPPUNIT_ASSERT_EQUAL(2, tree.find(5.0));
+  }
+
+  void testConcurrentAdds()
+  {
+    List list(-1);
+    boost::atomic<bool> done(false);
+    boost::atomic<long> errors(0);
+    boost::thread_group readers;
+    for (int i = 0; i < READERS; i++) {
+      readers.create_thread(Reader(&list, &done, &errors, i + 1));
+    }
+    boost::thread_group writers;
+    for (int i = 0; i < WRITERS; i++) {
+      writers.create_thread(Writer(&list, i, false));
+    }
+    writers.join_all();
+    done.store(true);
+    readers.join_all();
+    CPPUNIT_ASSERT_EQUAL(0L, errors.load());
+    CPPUNIT_ASSERT_EQUAL((size_t) KEYS, list.size());
+    for (int key = 0; key < KEYS; key++) {
+      CPPUNIT_ASSERT_EQUAL(key * 10, list.find(key));
+    }
+  }
+
+  /**
+   * Writers take keys out and put them back while readers look. The
+   * multiples of 100 never go anywhere.
+   */
+
+  void testConcurrentRemoves()
+  {
+    List list(-1);
+    for (int key = 0; key < KEYS; key++) {
+      list.add(key, key * 10);
+    }
+    boost::atomic<bool> done(false);
+    boost::atomic<long> errors(0);
+    boost::thread_group readers;
+    for (int i = 0; i < READERS; i++) {
+      readers.create_thread(Reader(&list, &done, &errors, i + 10));
+    }
+    boost::thread_group writers;
+    for (int i = 0; i < WRITERS; i++) {
+      writers.create_thread(Writer(&list, i, true));
+    }
+    writers.join_all();
+    done.store(true);
+    readers.join_all();
+    CPPUNIT_ASSERT_EQUAL(0L, errors.load());
+    for (int key = 0; key < KEYS; key++) {
+      bool kept = key % 100 == 0 || key % 2 == 0;
+      CPPUNIT_ASSERT_EQUAL(kept ? key * 10 : -1, list.find(key));
+    }
+    CPPUNIT_ASSERT_EQUAL((size_t) KEYS / 2, list.size());
+
+    // Nobody's reading any more, so everything removed can go
+    list.reclaim();
+    CPPUNIT_ASSERT_EQUAL((size_t) 0, list.pendingReclaim());
+  }
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ConcurrentSkipListTest);
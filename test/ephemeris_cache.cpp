@@ -19,14 +19,128 @@
 #include <cppunit/extensions/HelperMacros.h>
 #include "ephemeris_cache.h"
 #include "ephemeris_line.h"
+#include "sp3_loader.h"
 
+#include <boost/atomic.hpp>
+#include <boost/thread/thread.hpp>
 #include <string>
+#include <vector>
+#include <stdio.h>
+#include <unistd.h>
 
 class EphemerisCacheTest : public CppUnit::TestFixture {
   CPPUNIT_TEST_SUITE(EphemerisCacheTest);
   CPPUNIT_TEST(testTwoPoints);
+  CPPUNIT_TEST(testDuplicate);
+  CPPUNIT_TEST(testPutAll);
+  CPPUNIT_TEST(testAdopt);
+  CPPUNIT_TEST(testConcurrentReaders);
+  CPPUNIT_TEST(testConcurrentColdReaders);
+  CPPUNIT_TEST(testHeldLine);
+  CPPUNIT_TEST(testColdTier);
+  CPPUNIT_TEST(testAllCold);
   CPPUNIT_TEST_SUITE_END();
 
+  enum { WRITES = 20000, READERS = 3, COLD_EPOCHS = 4 * 288 };
+
+  /**
+   * Keeps reading the latest line it knows has been written, and
+   * checks it got the line it should have. Every line's x is the
+   * same as its time, so a torn or stale line will show up.
+   */
+
+  class Reader {
+    EphemerisCache *cache;
+    boost::atomic<long> *written;
+    boost::atomic<bool> *done;
+    boost::atomic<long> *errors;
+  public:
+    Reader(EphemerisCache *cache, boost::atomic<long> *written, boost::atomic<bool> *done, boost::atomic<long> *errors) : cache(cache), written(written), done(done), errors(errors)
+    {
+    }
+
+    void operator()()
+    {
+      std::string sat("Sat");
+      EphemerisLine interpolated(0, 0, 0, 0, 0, 0);
+      while (!done->load()) {
+        long latest = written->load();
+        if (latest < 0) {
+          continue;
+        }
+        double time = latest + 0.5;
+        EphemerisLine *line = cache->get(sat, time);
+        if (line == NULL || line->getTime() < latest || line->getPosition().getX() != line->getTime()) {
+          (*errors)++;
+        }
+        if (latest > 10 && (!cache->interpolate(sat, latest - 5.5, interpolated) ||
+                            fabs(interpolated.getPosition().getX() - (latest - 5.5)) > 0.000001)) {
+          (*errors)++;
+        }
+      }
+    }
+  };
+
+  /**
+   * Keeps reading and interpolating in the cold part, where every
+   * line's x is its time over 300
+   */
+
+  class ColdReader {
+    EphemerisCache *cache;
+    boost::atomic<bool> *done;
+    boost::atomic<long> *errors;
+  public:
+    ColdReader(EphemerisCache *cache, boost::atomic<bool> *done, boost::atomic<long> *errors) : cache(cache), done(done), errors(errors)
+    {
+    }
+
+    void operator()()
+    {
+      std::string sat("Sat");
+      EphemerisLine interpolated(0, 0, 0, 0, 0, 0);
+      for (long k = 7; !done->load(); k += 97) {
+        double time = (k % (COLD_EPOCHS - 1)) * 300.0 + 150.0;
+        EphemerisLine *line = cache->get(sat, time);
+        if (line == NULL || line->getPosition().getX() != ::floor(time / 300.0)) {
+          (*errors)++;
+        }
+        if (!cache->interpolate(sat, time, interpolated) ||
+            fabs(interpolated.getPosition().getX() - time / 300.0) > 0.000001) {
+          (*errors)++;
+        }
+      }
+      cache->quiesce();
+    }
+  };
+
+  /**
+   * Gets one line, waits while the test rewrites the satellite
+   * underneath it, then checks the line's still what it was
+   */
+
+  class Holder {
+    EphemerisCache *cache;
+    boost::atomic<int> *stage;
+    boost::atomic<bool> *ok;
+  public:
+    Holder(EphemerisCache *cache, boost::atomic<int> *stage, boost::atomic<bool> *ok) : cache(cache), stage(stage), ok(ok)
+    {
+    }
+
+    void operator()()
+    {
+      std::string sat("Sat");
+      EphemerisLine *line = cache->get(sat, 50.0);
+      stage->store(1);
+      while (stage->load() != 2) {
+        boost::this_thread::yield();
+      }
+      ok->store(line && line->getTime() == 50.0 && line->getPosition().getX() == 50.0);
+      cache->quiesce();
+    }
+  };
+
 public:
   void testTwoPoints()
   {
@@ -50,6 +164,314 @@ public:
     check = cache.get(foo, 20.0);
     CPPUNIT_ASSERT(NULL == check);
   }
+
+  void testDuplicate()
+  {
+    EphemerisCache cache;
+    std::string foo("Foo");
+    cache.add(foo, new EphemerisLine(Ecef(1,2,3), 4, 5, 6, 1.5));
+    cache.add(foo, new EphemerisLine(Ecef(1,2,3), 4, 5, 6, 3.0));
+    EphemerisLine again(Ecef(7,8,9), 10, 11, 12, 1.5);
+    bool threw = false;
+    try {
+      cache.add(foo, again);
+    } catch (std::string &e) {
+      threw = true;
+    }
+    CPPUNIT_ASSERT(threw);
+    CPPUNIT_ASSERT(cache.get(foo, 1.5)->getDx() == 4);
+    CPPUNIT_ASSERT(cache.put(foo, again));
+    CPPUNIT_ASSERT(cache.get(foo, 1.5)->getDx() == 10);
+    CPPUNIT_ASSERT(cache.get(foo, 3.0)->getDx() == 4);
+  }
+
+  /**
+   * A run that overlaps what's there, some of it cold, goes in with
+   * the new lines winning
+   */
+
+  void testPutAll()
+  {
+    EphemerisCache cache;
+    std::string sat("Sat");
+    for (int i = 0; i < 100; i++) {
+      EphemerisLine line(i, 0, 0, 0, 0, 0, i);
+      cache.add(sat, line);
+    }
+    CPPUNIT_ASSERT_EQUAL((size_t) 30, cache.compressBefore(30.0));
+    std::vector<double> times;
+    std::vector<EphemerisLine> lines;
+    for (int i = 20; i < 150; i++) {
+      times.push_back(i);
+      lines.push_back(EphemerisLine(i + 1000, 0, 0, 0, 0, 0, i));
+    }
+    CPPUNIT_ASSERT_EQUAL((size_t) 80, cache.putAll(sat, &times[0], &lines[0], times.size()));
+    CPPUNIT_ASSERT_EQUAL(10.0, cache.get(sat, 10.5)->getPosition().getX());
+    CPPUNIT_ASSERT_EQUAL(1025.0, cache.get(sat, 25.5)->getPosition().getX());
+    CPPUNIT_ASSERT_EQUAL(1060.0, cache.get(sat, 60.5)->getPosition().getX());
+    CPPUNIT_ASSERT_EQUAL(1149.0, cache.get(sat, 149.5)->getPosition().getX());
+    EpochIndex<EphemerisLine> all;
+    CPPUNIT_ASSERT(cache.copy(sat, all));
+    CPPUNIT_ASSERT_EQUAL((size_t) 150, all.size());
+
+    // Out of order doesn't put anything
+    std::swap(times[0], times[1]);
+    CPPUNIT_ASSERT_THROW(cache.putAll(sat, &times[0], &lines[0], times.size()), std::string);
+    CPPUNIT_ASSERT_EQUAL(1020.0, cache.get(sat, 20.5)->getPosition().getX());
+
+    // A new satellite is just an append
+    std::string other("Other");
+    CPPUNIT_ASSERT_EQUAL((size_t) 0, cache.putAll(other, &times[2], &lines[2], 10));
+    CPPUNIT_ASSERT_EQUAL(1022.0, cache.get(other, 22.5)->getPosition().getX());
+  }
+
+  void testAdopt()
+  {
+    EphemerisCache cache;
+    EphemerisCache incoming;
+    std::string foo("Foo");
+    std::string bar("Bar");
+    cache.add(foo, new EphemerisLine(Ecef(1,2,3), 4, 5, 6, 1.5));
+    cache.add(bar, new EphemerisLine(Ecef(1,2,3), 4, 5, 6, 1.5));
+    incoming.add(foo, new EphemerisLine(Ecef(7,8,9), 10, 11, 12, 100.0));
+    cache.adopt(incoming);
+    CPPUNIT_ASSERT(cache.get(foo, 1.5) == NULL);
+    CPPUNIT_ASSERT(cache.get(foo, 100.0)->getDx() == 10);
+    CPPUNIT_ASSERT(cache.get(bar, 1.5)->getDx() == 4);
+    std::vector<std::string> names;
+    incoming.satelliteNames(names);
+    CPPUNIT_ASSERT(names.empty());
+    cache.satelliteNames(names);
+    CPPUNIT_ASSERT(names.size() == 2);
+  }
+
+  /**
+   * One thread appends while several read. Every so often the
+   * writer also replaces a line in the middle, which makes the cache
+   * copy the arrays out from under the readers.
+   */
+
+  void testConcurrentReaders()
+  {
+    EphemerisCache cache;
+    std::string sat("Sat");
+    boost::atomic<long> written(-1);
+    boost::atomic<bool> done(false);
+    boost::atomic<long> errors(0);
+    boost::thread_group readers;
+    for (int i = 0; i < READERS; i++) {
+      readers.create_thread(Reader(&cache, &written, &done, &errors));
+    }
+    for (long i = 0; i < WRITES; i++) {
+      EphemerisLine line(i, 0, 0, 0, 0, 0, i);
+      cache.add(sat, line);
+      if (i % 1000 == 999) {
+        EphemerisLine replacement(i / 2, 0, 0, 0, 0, 0, i / 2);
+        CPPUNIT_ASSERT(cache.put(sat, replacement));
+      }
+      written.store(i);
+    }
+    done.store(true);
+    readers.join_all();
+    CPPUNIT_ASSERT(errors.load() == 0);
+    CPPUNIT_ASSERT(cache.get(sat, WRITES)->getTime() == WRITES - 1);
+  }
+
+  /**
+   * Readers in the cold part while the writer appends and repacks
+   * cold days under them, with an LRU small enough that they're
+   * always throwing days out
+   */
+
+  void testConcurrentColdReaders()
+  {
+    EphemerisCache cache;
+    std::string sat("Sat");
+    for (long i = 0; i < COLD_EPOCHS + 288; i++) {
+      EphemerisLine line(i, 0, 0, 0, 0, 0, i * 300.0);
+      cache.add(sat, line);
+    }
+    CPPUNIT_ASSERT_EQUAL((size_t) COLD_EPOCHS, cache.compressBefore(COLD_EPOCHS * 300.0));
+    cache.setColdCacheBlocks(1);
+    boost::atomic<bool> done(false);
+    boost::atomic<long> errors(0);
+    boost::thread_group readers;
+    for (int i = 0; i < READERS; i++) {
+      readers.create_thread(ColdReader(&cache, &done, &errors));
+    }
+    for (long i = 0; i < WRITES / 10; i++) {
+      long next = COLD_EPOCHS + 288 + i;
+      EphemerisLine line(next, 0, 0, 0, 0, 0, next * 300.0);
+      cache.add(sat, line);
+      // Same line again, but its day gets packed up anew
+      long old = (i * 37) % COLD_EPOCHS;
+      EphemerisLine same(old, 0, 0, 0, 0, 0, old * 300.0);
+      CPPUNIT_ASSERT(cache.put(sat, same));
+    }
+    done.store(true);
+    readers.join_all();
+    CPPUNIT_ASSERT_EQUAL(0L, errors.load());
+  }
+
+  /**
+   * A line stays put until the thread that got it calls in again,
+   * however many times the satellite gets copied and however often
+   * the writer reclaims in the meantime.
+   */
+
+  void testHeldLine()
+  {
+    EphemerisCache cache;
+    std::string sat("Sat");
+    for (long i = 0; i < 100; i++) {
+      EphemerisLine line(i, 0, 0, 0, 0, 0, i);
+      cache.add(sat, line);
+    }
+    boost::atomic<int> stage(0);
+    boost::atomic<bool> ok(false);
+    boost::thread holder(Holder(&cache, &stage, &ok));
+    while (stage.load() != 1) {
+      boost::this_thread::yield();
+    }
+    // Replacing a line in the middle copies the arrays every time
+    for (long i = 0; i < 500; i++) {
+      EphemerisLine line(-1, 0, 0, 0, 0, 0, i % 100);
+      cache.put(sat, line);
+      cache.reclaim();
+    }
+    stage.store(2);
+    holder.join();
+    CPPUNIT_ASSERT(ok.load());
+    cache.reclaim();
+    CPPUNIT_ASSERT_EQUAL(-1.0, cache.get(sat, 50.0)->getPosition().getX());
+  }
+
+  /**
+   * Every lookup from before the data to past the end has to come out
+   * the same whether any of it is cold or not
+   */
+
+  void compare(EphemerisCache &expected, EphemerisCache &actual, double from, double to, double step)
+  {
+    std::vector<std::string> names;
+    expected.satelliteNames(names);
+    for (size_t i = 0; i < names.size(); i++) {
+      CPPUNIT_ASSERT_EQUAL(expected.getDataInterval(names[i]), actual.getDataInterval(names[i]));
+      for (double time = from; time < to; time += step) {
+        EphemerisLine *want = expected.get(names[i], time);
+        double wantTime = want ? want->getTime() : -1.0;
+        double wantDx = want ? want->getDx() : -1.0;
+        EphemerisLine *got = actual.get(names[i], time);
+        CPPUNIT_ASSERT_EQUAL(wantTime, got ? got->getTime() : -1.0);
+        CPPUNIT_ASSERT_EQUAL(wantDx, got ? got->getDx() : -1.0);
+        EphemerisLine wantFit(0, 0, 0, 0, 0, 0);
+        EphemerisLine gotFit(0, 0, 0, 0, 0, 0);
+        bool fitted = expected.interpolate(names[i], time, wantFit);
+        CPPUNIT_ASSERT_EQUAL(fitted, actual.interpolate(names[i], time, gotFit));
+        if (fitted) {
+          CPPUNIT_ASSERT_EQUAL(wantFit.getPosition().getX(), gotFit.getPosition().getX());
+          CPPUNIT_ASSERT_EQUAL(wantFit.getDz(), gotFit.getDz());
+        }
+      }
+    }
+  }
+
+  /**
+   * A day from NGA, half of it cold
+   */
+
+  void testColdTier()
+  {
+    EphemerisCache plain;
+    EphemerisCache cold;
+    Sp3Loader loader;
+    CPPUNIT_ASSERT(loader.addPath("nga16556.eph"));
+    loader.load(plain);
+    loader.load(cold);
+    std::vector<std::string> names;
+    cold.satelliteNames(names);
+    CPPUNIT_ASSERT(!names.empty());
+    std::string sat(names[0]);
+    // 2011-10-01 00:00 UTC, 96 epochs 15 minutes apart
+    double start = 1317427200.0;
+    double middle = start + 12 * 3600.0 + 450.0;
+
+    CPPUNIT_ASSERT_EQUAL((size_t) 0, cold.coldBytes());
+    size_t moved = cold.compressBefore(middle);
+    CPPUNIT_ASSERT_EQUAL(names.size() * 49, moved);
+    CPPUNIT_ASSERT(cold.coldBytes() > 0);
+    CPPUNIT_ASSERT(cold.coldBytes() * 5 / 2 < moved * (sizeof(double) + sizeof(EphemerisLine)));
+    compare(plain, cold, start - 1000.0, start + 87000.0, 97.0);
+
+    // An LRU of one still works, it just unpacks a lot
+    cold.setColdCacheBlocks(1);
+    compare(plain, cold, start - 1000.0, start + 87000.0, 1297.0);
+
+    // Adds in the cold part go in the cold part
+    EphemerisLine extra(1, 2, 3, 4, 5, 6, start + 100.0);
+    cold.add(sat, extra);
+    CPPUNIT_ASSERT_EQUAL(4.0, cold.get(sat, start + 200.0)->getDx());
+    CPPUNIT_ASSERT_THROW(cold.add(sat, extra), std::string);
+    EphemerisLine replacement(1, 2, 3, 7, 5, 6, start + 100.0);
+    CPPUNIT_ASSERT(cold.put(sat, replacement));
+    CPPUNIT_ASSERT_EQUAL(7.0, cold.get(sat, start + 200.0)->getDx());
+    CPPUNIT_ASSERT(plain.put(sat, replacement) == false);
+    compare(plain, cold, start - 1000.0, start + 87000.0, 311.0);
+
+    // Snapshots come out the same whether it's cold or not
+    char plainName[] = "/tmp/ephemeris_cache_testXXXXXX";
+    char coldName[] = "/tmp/ephemeris_cache_testXXXXXX";
+    close(mkstemp(plainName));
+    close(mkstemp(coldName));
+    plain.saveSnapshot(plainName);
+    cold.saveSnapshot(coldName);
+    EphemerisSnapshot plainFile;
+    EphemerisSnapshot coldFile;
+    plainFile.open(plainName, true);
+    coldFile.open(coldName, true);
+    unlink(plainName);
+    unlink(coldName);
+    CPPUNIT_ASSERT_EQUAL(plainFile.satelliteCount(), coldFile.satelliteCount());
+    for (size_t i = 0; i < plainFile.satelliteCount(); i++) {
+      CPPUNIT_ASSERT_EQUAL(plainFile.count(i), coldFile.count(i));
+      CPPUNIT_ASSERT(0 == memcmp(plainFile.times(i), coldFile.times(i), plainFile.count(i) * sizeof(double)));
+      CPPUNIT_ASSERT(0 == memcmp(plainFile.lines(i), coldFile.lines(i), plainFile.count(i) * sizeof(EphemerisLine)));
+    }
+
+    // Moving more later picks up where it left off
+    cold.compressBefore(start + 20 * 3600.0);
+    compare(plain, cold, start - 1000.0, start + 87000.0, 311.0);
+  }
+
+  /**
+   * With everything cold, the last line is still only good for one
+   * interval past the end
+   */
+
+  void testAllCold()
+  {
+    EphemerisCache cache;
+    std::string sat("Sat");
+    for (int i = 0; i < 1000; i++) {
+      EphemerisLine line(i, 0, 0, 0, 0, 0, i * 300.0);
+      cache.add(sat, line);
+    }
+    CPPUNIT_ASSERT_EQUAL((size_t) 1000, cache.compressBefore(1e12));
+    CPPUNIT_ASSERT_EQUAL(300.0, cache.getDataInterval(sat));
+    CPPUNIT_ASSERT_EQUAL(999.0 * 300.0, cache.get(sat, 999.0 * 300.0 + 299.0)->getTime());
+    CPPUNIT_ASSERT(cache.get(sat, 999.0 * 300.0 + 301.0) == NULL);
+    CPPUNIT_ASSERT(cache.get(sat, -1.0) == NULL);
+    CPPUNIT_ASSERT_EQUAL(500.0, cache.get(sat, 500.0 * 300.0 + 10.0)->getPosition().getX());
+    EphemerisLine fitted(0, 0, 0, 0, 0, 0);
+    CPPUNIT_ASSERT(cache.interpolate(sat, 500.5 * 300.0, fitted));
+    CPPUNIT_ASSERT(fabs(fitted.getPosition().getX() - 500.5) < 1e-6);
+
+    // Appending after it all went cold goes back in the usual place
+    EphemerisLine line(1000, 0, 0, 0, 0, 0, 1000 * 300.0);
+    cache.add(sat, line);
+    CPPUNIT_ASSERT_EQUAL(1000.0 * 300.0, cache.get(sat, 1e6)->getTime());
+    CPPUNIT_ASSERT_EQUAL(999.0 * 300.0, cache.get(sat, 999.5 * 300.0)->getTime());
+  }
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(EphemerisCacheTest);
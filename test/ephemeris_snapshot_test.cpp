@@ -0,0 +1,298 @@
+/**
+ * Tests for snapshot files: a cache served from a mapped snapshot
+ * has to answer the same as the cache it was saved from, and a bad
+ * file has to be turned away.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ephemeris_cache.h"
+#include "ephemeris_line.h"
+#include "ephemeris_snapshot.h"
+#include "sp3_loader.h"
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+class EphemerisSnapshotTest : public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(EphemerisSnapshotTest);
+  CPPUNIT_TEST(testRoundTrip);
+  CPPUNIT_TEST(testLoadedFile);
+  CPPUNIT_TEST(testChangeAfterMapping);
+  CPPUNIT_TEST(testMergeDays);
+  CPPUNIT_TEST(testBadFiles);
+  CPPUNIT_TEST_SUITE_END();
+
+  std::string filename;
+
+  /**
+   * Every line's x is its time, so it's easy to tell which one came
+   * back
+   */
+
+  void addLine(EphemerisCache &cache, const std::string &sat, double time)
+  {
+    EphemerisLine line(time, time * 2, time * 3, 1.0, 2.0, 3.0, time);
+    cache.add(sat, line);
+  }
+
+  void compare(EphemerisCache &expected, EphemerisCache &actual, double from, double to, double step)
+  {
+    std::vector<std::string> names;
+    std::vector<std::string> mappedNames;
+    expected.satelliteNames(names);
+    actual.satelliteNames(mappedNames);
+    CPPUNIT_ASSERT(names == mappedNames);
+    for (size_t i = 0; i < names.size(); i++) {
+      CPPUNIT_ASSERT_EQUAL(expected.getDataInterval(names[i]), actual.getDataInterval(names[i]));
+      for (double time = from; time < to; time += step) {
+        EphemerisLine *want = expected.get(names[i], time);
+        double wantTime = want ? want->getTime() : -1.0;
+        double wantX = want ? want->getPosition().getX() : -1.0;
+        EphemerisLine *got = actual.get(names[i], time);
+        CPPUNIT_ASSERT_EQUAL(wantTime, got ? got->getTime() : -1.0);
+        CPPUNIT_ASSERT_EQUAL(wantX, got ? got->getPosition().getX() : -1.0);
+        EphemerisLine wantFit(0, 0, 0, 0, 0, 0);
+        EphemerisLine gotFit(0, 0, 0, 0, 0, 0);
+        bool fitted = expected.interpolate(names[i], time, wantFit);
+        CPPUNIT_ASSERT_EQUAL(fitted, actual.interpolate(names[i], time, gotFit));
+        if (fitted) {
+          CPPUNIT_ASSERT_EQUAL(wantFit.getPosition().getX(), gotFit.getPosition().getX());
+        }
+      }
+    }
+  }
+
+  /**
+   * Flip one byte of the file
+   */
+
+  void corrupt(long at)
+  {
+    FILE *file = fopen(filename.c_str(), "r+b");
+    fseek(file, at, SEEK_SET);
+    int byte = fgetc(file);
+    fseek(file, at, SEEK_SET);
+    fputc(byte ^ 0xff, file);
+    fclose(file);
+  }
+
+public:
+
+  void setUp()
+  {
+    char buffer[] = "/tmp/ephemeris_snapshot_testXXXXXX";
+    int fdes = mkstemp(buffer);
+    close(fdes);
+    filename = buffer;
+  }
+
+  void tearDown()
+  {
+    unlink(filename.c_str());
+  }
+
+  void testRoundTrip()
+  {
+    EphemerisCache cache;
+    for (int i = 0; i < 500; i++) {
+      addLine(cache, "Even", 1000.0 + i * 900.0);
+    }
+    // Not evenly spaced, so lookups have to search
+    for (int i = 0; i < 300; i++) {
+      addLine(cache, "Odd", 1000.0 + i * i * 7.0);
+    }
+    addLine(cache, "Single", 5000.0);
+    cache.saveSnapshot(filename);
+
+    CPPUNIT_ASSERT(EphemerisSnapshot::isSnapshot(filename));
+    EphemerisSnapshot file;
+    file.open(filename, true);
+    CPPUNIT_ASSERT_EQUAL((size_t) 3, file.satelliteCount());
+    CPPUNIT_ASSERT_EQUAL(std::string("Even"), file.name(0));
+    CPPUNIT_ASSERT(file.regular(0));
+    CPPUNIT_ASSERT(!file.regular(1));
+    CPPUNIT_ASSERT_EQUAL((size_t) 300, file.count(1));
+    CPPUNIT_ASSERT_EQUAL(0, (int) ((size_t) file.times(1) % EphemerisSnapshot::ALIGNMENT));
+    CPPUNIT_ASSERT_EQUAL(0, (int) ((size_t) file.lines(1) % EphemerisSnapshot::ALIGNMENT));
+
+    EphemerisCache mapped;
+    mapped.mapSnapshot(filename);
+    compare(cache, mapped, 0.0, 1000.0 + 300 * 300 * 7.0, 311.0);
+  }
+
+  void testLoadedFile()
+  {
+    EphemerisCache cache;
+    Sp3Loader loader;
+    CPPUNIT_ASSERT(loader.addPath("nga16556.eph"));
+    CPPUNIT_ASSERT(loader.load(cache) > 0);
+    cache.saveSnapshot(filename);
+
+    EphemerisCache mapped;
+    mapped.mapSnapshot(filename, true);
+    // From an hour before the data starts to a day past where it ends
+    EphemerisSnapshot file;
+    file.open(filename);
+    double start = file.times(0)[0];
+    compare(cache, mapped, start - 3600.0, start + 2 * 86400.0, 123.0);
+  }
+
+  /**
+   * Adding to a mapped satellite copies it out of the file first. The
+   * file never changes.
+   */
+
+  void testChangeAfterMapping()
+  {
+    EphemerisCache cache;
+    for (int i = 0; i < 100; i++) {
+      addLine(cache, "Sat", i * 10.0);
+    }
+    addLine(cache, "Other", 1.0);
+    cache.saveSnapshot(filename);
+
+    EphemerisCache mapped;
+    mapped.mapSnapshot(filename);
+    CPPUNIT_ASSERT_THROW(addLine(mapped, "Sat", 500.0), std::string);
+    addLine(mapped, "Sat", 1000.0);
+    addLine(mapped, "Sat", 505.0);
+    EphemerisLine moved(-1, -1, -1, 0, 0, 0, 200.0);
+    CPPUNIT_ASSERT(mapped.put("Sat", moved));
+    CPPUNIT_ASSERT_EQUAL(1000.0, mapped.get("Sat", 1001.0)->getTime());
+    CPPUNIT_ASSERT_EQUAL(505.0, mapped.get("Sat", 506.0)->getTime());
+    CPPUNIT_ASSERT_EQUAL(-1.0, mapped.get("Sat", 200.0)->getPosition().getX());
+    CPPUNIT_ASSERT_EQUAL(490.0, mapped.get("Sat", 491.0)->getTime());
+    CPPUNIT_ASSERT_EQUAL(1.0, mapped.get("Other", 2.0)->getTime());
+
+    // Writing through a line from the mapping doesn't reach the file
+    EphemerisCache other;
+    other.mapSnapshot(filename);
+    other.get("Other", 1.0)->setTime(77.0);
+    EphemerisSnapshot file;
+    file.open(filename, true);
+    CPPUNIT_ASSERT_EQUAL(200.0, file.lines(1)[20].getPosition().getX());
+    CPPUNIT_ASSERT_EQUAL(1.0, file.lines(0)[0].getTime());
+
+    // Mapping again replaces what's there
+    mapped.mapSnapshot(filename);
+    CPPUNIT_ASSERT_EQUAL(990.0, mapped.get("Sat", 995.0)->getTime());
+    CPPUNIT_ASSERT_EQUAL(200.0, mapped.get("Sat", 200.0)->getPosition().getX());
+
+    // And adopting a mapped cache keeps the file around
+    EphemerisCache adopter;
+    adopter.adopt(other);
+    CPPUNIT_ASSERT_EQUAL(300.0, adopter.get("Sat", 305.0)->getTime());
+  }
+
+  /**
+   * Two days in two snapshots, the way sp3_ingest builds them up. The
+   * second gets merged in, so the first day's data stays.
+   */
+
+  void testMergeDays()
+  {
+    char buffer[] = "/tmp/ephemeris_snapshot_testXXXXXX";
+    int fdes = mkstemp(buffer);
+    close(fdes);
+    std::string secondDay(buffer);
+
+    EphemerisCache expected;
+    EphemerisCache first;
+    for (int i = 0; i <= 96; i++) {
+      addLine(first, "Sat", i * 900.0);
+    }
+    addLine(first, "First", 10.0);
+    first.saveSnapshot(filename);
+    EphemerisCache second;
+    for (int i = 96; i <= 192; i++) {
+      addLine(second, "Sat", i * 900.0);
+    }
+    // Both days have midnight; the second one's should win
+    EphemerisLine midnight(-1, -1, -1, 0, 0, 0, 86400.0);
+    second.put("Sat", midnight);
+    addLine(second, "Second", 90000.0);
+    second.saveSnapshot(secondDay);
+    for (int i = 0; i <= 192; i++) {
+      addLine(expected, "Sat", i * 900.0);
+    }
+    expected.put("Sat", midnight);
+    addLine(expected, "First", 10.0);
+    addLine(expected, "Second", 90000.0);
+
+    EphemerisCache merged;
+    merged.mapSnapshot(filename, true);
+    merged.mergeSnapshot(secondDay, true);
+    compare(expected, merged, -900.0, 200000.0, 311.0);
+    CPPUNIT_ASSERT_EQUAL(-1.0, merged.get("Sat", 86400.0)->getPosition().getX());
+
+    // A bad file doesn't touch what's there
+    corrupt(100);
+    CPPUNIT_ASSERT_THROW(merged.mergeSnapshot(filename, true), std::string);
+    compare(expected, merged, -900.0, 200000.0, 311.0);
+    unlink(secondDay.c_str());
+  }
+
+  void testBadFiles()
+  {
+    EphemerisCache cache;
+    for (int i = 0; i < 100; i++) {
+      addLine(cache, "Sat", i * 10.0);
+    }
+    cache.saveSnapshot(filename);
+
+    // Data damage only shows up when asked to verify
+    corrupt(4096);
+    EphemerisCache mapped;
+    mapped.mapSnapshot(filename);
+    CPPUNIT_ASSERT_THROW(mapped.mapSnapshot(filename, true), std::string);
+    corrupt(4096);
+    mapped.mapSnapshot(filename, true);
+
+    // The header and directory are always checked
+    corrupt(100);
+    CPPUNIT_ASSERT_THROW(mapped.mapSnapshot(filename), std::string);
+    corrupt(100);
+    corrupt(8);
+    CPPUNIT_ASSERT_THROW(mapped.mapSnapshot(filename), std::string);
+    corrupt(8);
+
+    // A truncated copy. Truncating the file mapped itself would pull
+    // the pages out from under the cache, which is why the writer
+    // always replaces files instead of rewriting them.
+    std::vector<char> bytes(2000);
+    FILE *in = fopen(filename.c_str(), "rb");
+    CPPUNIT_ASSERT_EQUAL(bytes.size(), fread(&bytes[0], 1, bytes.size(), in));
+    fclose(in);
+    unlink(filename.c_str());
+    FILE *out = fopen(filename.c_str(), "wb");
+    fwrite(&bytes[0], 1, bytes.size(), out);
+    fclose(out);
+    CPPUNIT_ASSERT_THROW(mapped.mapSnapshot(filename), std::string);
+
+    // Not a snapshot at all
+    CPPUNIT_ASSERT(!EphemerisSnapshot::isSnapshot("nga16556.eph"));
+    CPPUNIT_ASSERT_THROW(mapped.mapSnapshot("nga16556.eph"), std::string);
+    CPPUNIT_ASSERT_THROW(mapped.mapSnapshot("/nonexistent/file"), std::string);
+
+    // None of that touched what was already there
+    CPPUNIT_ASSERT_EQUAL(990.0, mapped.get("Sat", 995.0)->getTime());
+  }
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(EphemerisSnapshotTest);
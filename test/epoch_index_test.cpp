@@ -0,0 +1,110 @@
+/**
+ * Tests for EpochIndex
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "epoch_index.h"
+#include <math.h>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class EpochIndexTest : public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(EpochIndexTest);
+
+  CPPUNIT_TEST(testFind);
+  CPPUNIT_TEST(testIrregular);
+  CPPUNIT_TEST(testOutOfOrder);
+  CPPUNIT_TEST(testDuplicate);
+
+  CPPUNIT_TEST_SUITE_END();
+
+  EpochIndex<int> index;
+
+public:
+
+  void setUp()
+  {
+    index = EpochIndex<int>();
+    index.add(2, 2);
+    index.add(4, 4);
+    index.add(6, 6);
+    index.add(8, 8);
+  }
+
+  /**
+   * Same finds the time tree test does, so the two had
+   * better agree.
+   */
+
+  void testFind() 
+  {
+    CPPUNIT_ASSERT(index.isRegular());
+    CPPUNIT_ASSERT(index.find(1) == index.NOT_FOUND);
+    CPPUNIT_ASSERT(index.value(index.find(2)) == 2);
+    CPPUNIT_ASSERT(index.value(index.find(3)) == 2);
+    CPPUNIT_ASSERT(index.value(index.find(4)) == 4);
+    CPPUNIT_ASSERT(index.value(index.find(5)) == 4);
+    CPPUNIT_ASSERT(index.value(index.find(6)) == 6);
+    CPPUNIT_ASSERT(index.value(index.find(7)) == 6);
+    CPPUNIT_ASSERT(index.value(index.find(8)) == 8);
+    CPPUNIT_ASSERT(index.value(index.find(9)) == 8);
+    CPPUNIT_ASSERT(index.value(index.find(42)) == 8);
+    CPPUNIT_ASSERT(index.interval() == 2.0);
+    CPPUNIT_ASSERT(index.find(nan("")) == index.NOT_FOUND);
+  }
+
+  void testIrregular()
+  {
+    index.add(9, 9);
+    CPPUNIT_ASSERT(!index.isRegular());
+    CPPUNIT_ASSERT(index.value(index.find(7)) == 6);
+    CPPUNIT_ASSERT(index.value(index.find(8.5)) == 8);
+    CPPUNIT_ASSERT(index.value(index.find(9)) == 9);
+    CPPUNIT_ASSERT(index.value(index.find(100)) == 9);
+    CPPUNIT_ASSERT(index.find(1.9) == index.NOT_FOUND);
+  }
+
+  void testOutOfOrder()
+  {
+    index.add(5, 5);
+    index.add(0, 0);
+    CPPUNIT_ASSERT(index.size() == 6);
+    CPPUNIT_ASSERT(index.begin() == 0);
+    CPPUNIT_ASSERT(index.end() == 8);
+    CPPUNIT_ASSERT(index.value(index.find(1)) == 0);
+    CPPUNIT_ASSERT(index.value(index.find(4.5)) == 4);
+    CPPUNIT_ASSERT(index.value(index.find(5.5)) == 5);
+    CPPUNIT_ASSERT(index.value(index.find(6)) == 6);
+    for (size_t i = 1; i < index.size(); i++) {
+      CPPUNIT_ASSERT(index.time(i - 1) < index.time(i));
+    }
+  }
+
+  void testDuplicate()
+  {
+    bool threw = false;
+    try {
+      index.add(4, 40);
+    } catch (std::string &e) {
+      threw = true;
+    }
+    CPPUNIT_ASSERT(threw);
+    CPPUNIT_ASSERT(index.size() == 4);
+    CPPUNIT_ASSERT(index.value(index.find(4)) == 4);
+  }
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(EpochIndexTest);
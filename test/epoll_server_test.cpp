@@ -0,0 +1,411 @@
+/**
+ * Make sure the Epoll Server works
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "epoll_server.h"
+#include <boost/atomic.hpp>
+#include <boost/thread/thread.hpp>
+#include <stdio.h>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <cppunit/extensions/HelperMacros.h>
+
+class EpollServerTest : public CppUnit::TestFixture {
+
+  CPPUNIT_TEST_SUITE(EpollServerTest);
+  CPPUNIT_TEST(testEcho);
+  CPPUNIT_TEST(testManyClients);
+  CPPUNIT_TEST(testPipelined);
+  CPPUNIT_TEST(testPartial);
+  CPPUNIT_TEST(testReference);
+  CPPUNIT_TEST(testSendFile);
+  CPPUNIT_TEST(testCloseWhenDone);
+  CPPUNIT_TEST(testHalfClose);
+  CPPUNIT_TEST(testClientHalfClose);
+  CPPUNIT_TEST(testInputLimit);
+  CPPUNIT_TEST(testIdle);
+  CPPUNIT_TEST(testStreaming);
+  CPPUNIT_TEST(testResume);
+  CPPUNIT_TEST(testResumeAfterHalfClose);
+  CPPUNIT_TEST(testReusePort);
+  CPPUNIT_TEST_SUITE_END();
+
+  enum { PORT = 12346, STREAM_CHUNKS = 100, CHUNK_SIZE = 1000 };
+
+  /**
+   * Echoes a line at a time. "quit" gets a "bye" and a hang up, and
+   * "stream" gets STREAM_CHUNKS chunks of CHUNK_SIZE x's, one at a
+   * time as the last one goes out. "later" gets a "later" once
+   * another thread says it's ready.
+   */
+
+  static int file;
+  static boost::atomic<bool> laterReady;
+  static boost::thread *laterThread;
+
+  class EchoHandler;
+
+  /**
+   * Says the answer to "later" is ready, after a bit
+   */
+
+  class Later {
+    EpollServer<EchoHandler> *owner;
+    int fdes;
+  public:
+    Later(EpollServer<EchoHandler> *owner, int fdes) : owner(owner), fdes(fdes)
+    {
+    }
+
+    void operator()()
+    {
+      boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+      laterReady = true;
+      owner->resume(fdes);
+    }
+  };
+
+  class EchoHandler {
+    EpollServer<EchoHandler> *owner;
+    int fdes;
+    int chunksLeft;
+    bool waitingLater;
+  public:
+    EchoHandler(EpollServer<EchoHandler> *owner, int fdes) : owner(owner), fdes(fdes), chunksLeft(0), waitingLater(false)
+    {
+    }
+
+    size_t received(const char *data, size_t length, EpollOutput &out)
+    {
+      // Like the demo handler, one referenced answer at a time
+      if (out.pending() > 0) {
+        return 0;
+      }
+      const char *newline = (const char *) memchr(data, '\n', length);
+      if (!newline) {
+        return 0;
+      }
+      std::string line(data, newline - data);
+      if (line == "quit") {
+        out.write("bye\n");
+        out.closeWhenDone();
+      } else if (line == "ref") {
+        static const char referenced[] = "referenced";
+        out.write("[");
+        out.reference(referenced, sizeof(referenced) - 1);
+        out.write("]\n");
+      } else if (line == "file") {
+        out.write("<");
+        out.sendFile(file, 2, 5);
+        out.write(">\n");
+      } else if (line == "stream") {
+        chunksLeft = STREAM_CHUNKS;
+        writable(out);
+      } else if (line == "later") {
+        waitingLater = true;
+        out.expectMore();
+        laterThread = new boost::thread(Later(owner, fdes));
+      } else {
+        out.write(line + "\n");
+      }
+      return newline - data + 1;
+    }
+
+    bool writable(EpollOutput &out)
+    {
+      if (waitingLater) {
+        if (!laterReady) {
+          return false;
+        }
+        waitingLater = false;
+        out.expectMore(false);
+        out.write("later\n");
+        return true;
+      }
+      if (chunksLeft == 0) {
+        return false;
+      }
+      out.write(std::string(CHUNK_SIZE, 'x'));
+      if (--chunksLeft == 0) {
+        out.closeWhenDone();
+      }
+      return true;
+    }
+  };
+
+  int connectTo(int port)
+  {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    CPPUNIT_ASSERT(0 < sock);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    addr.sin_port = htons(port);
+    addr.sin_family = AF_INET;
+    CPPUNIT_ASSERT(0 == connect(sock, (sockaddr *) &addr, sizeof(sockaddr_in)));
+    return sock;
+  }
+
+  void sendString(int sock, const std::string &data)
+  {
+    CPPUNIT_ASSERT(data.size() == (size_t) send(sock, data.data(), data.size(), MSG_NOSIGNAL));
+  }
+
+  std::string readLine(int sock)
+  {
+    std::string line;
+    char c;
+    while (1 == recv(sock, &c, 1, 0) && c != '\n') {
+      line += c;
+    }
+    return line;
+  }
+
+  std::string readAll(int sock)
+  {
+    std::string data;
+    char buf[4096];
+    ssize_t got;
+    while (0 < (got = recv(sock, buf, sizeof(buf), 0))) {
+      data.append(buf, got);
+    }
+    return data;
+  }
+
+public:
+
+  void testEcho()
+  {
+    EpollServer<EchoHandler> server(PORT, 2);
+    server.start();
+    CPPUNIT_ASSERT(server.ready());
+    int sock = connectTo(PORT);
+    sendString(sock, "Foo!\n");
+    CPPUNIT_ASSERT(readLine(sock) == "Foo!");
+    sendString(sock, "Bar!\n");
+    CPPUNIT_ASSERT(readLine(sock) == "Bar!");
+    close(sock);
+  }
+
+  void testManyClients()
+  {
+    EpollServer<EchoHandler> server(PORT, 2);
+    server.start();
+    std::vector<int> socks;
+    for (int i = 0; i < 200; i++) {
+      socks.push_back(connectTo(PORT));
+    }
+    for (size_t i = 0; i < socks.size(); i++) {
+      std::ostringstream line;
+      line << "client " << i << "\n";
+      sendString(socks[i], line.str());
+    }
+    for (size_t i = 0; i < socks.size(); i++) {
+      std::ostringstream expected;
+      expected << "client " << i;
+      CPPUNIT_ASSERT(readLine(socks[i]) == expected.str());
+      close(socks[i]);
+    }
+  }
+
+  void testPipelined()
+  {
+    EpollServer<EchoHandler> server(PORT, 1);
+    server.start();
+    int sock = connectTo(PORT);
+    sendString(sock, "one\ntwo\nthree\nquit\n");
+    CPPUNIT_ASSERT(readAll(sock) == "one\ntwo\nthree\nbye\n");
+    close(sock);
+  }
+
+  void testPartial()
+  {
+    EpollServer<EchoHandler> server(PORT, 1);
+    server.start();
+    int sock = connectTo(PORT);
+    sendString(sock, "Fo");
+    boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+    sendString(sock, "o!\n");
+    CPPUNIT_ASSERT(readLine(sock) == "Foo!");
+    close(sock);
+  }
+
+  void testReference()
+  {
+    EpollServer<EchoHandler> server(PORT, 1);
+    server.start();
+    int sock = connectTo(PORT);
+    sendString(sock, "ref\nFoo!\nref\nquit\n");
+    CPPUNIT_ASSERT(readAll(sock) == "[referenced]\nFoo!\n[referenced]\nbye\n");
+    close(sock);
+  }
+
+  void testSendFile()
+  {
+    file = fileno(tmpfile());
+    CPPUNIT_ASSERT(10 == write(file, "0123456789", 10));
+    EpollServer<EchoHandler> server(PORT, 1);
+    server.start();
+    int sock = connectTo(PORT);
+    sendString(sock, "file\nFoo!\nfile\nquit\n");
+    CPPUNIT_ASSERT(readAll(sock) == "<23456>\nFoo!\n<23456>\nbye\n");
+    close(sock);
+  }
+
+  void testCloseWhenDone()
+  {
+    EpollServer<EchoHandler> server(PORT, 1);
+    server.start();
+    int sock = connectTo(PORT);
+    sendString(sock, "quit\n");
+    CPPUNIT_ASSERT(readAll(sock) == "bye\n");
+    close(sock);
+  }
+
+  void testHalfClose()
+  {
+    EpollServer<EchoHandler> server(PORT, 1);
+    server.start();
+    int sock = connectTo(PORT);
+    // The server hangs up with some of this still unread, which
+    // shouldn't cost us the reply
+    sendString(sock, "quit\n" + std::string(10000, 'z'));
+    CPPUNIT_ASSERT(readAll(sock) == "bye\n");
+    // Only the server's sending side is shut, so it still reads
+    sendString(sock, "still here\n");
+    close(sock);
+  }
+
+  void testClientHalfClose()
+  {
+    EpollServer<EchoHandler> server(PORT, 1);
+    server.start();
+    int sock = connectTo(PORT);
+    sendString(sock, "one\ntwo\n");
+    shutdown(sock, SHUT_WR);
+    CPPUNIT_ASSERT(readAll(sock) == "one\ntwo\n");
+    close(sock);
+  }
+
+  void testInputLimit()
+  {
+    EpollServer<EchoHandler> server(PORT, 1);
+    server.setInputLimit(64);
+    server.start();
+    int sock = connectTo(PORT);
+    sendString(sock, std::string(200, 'a'));
+    // No newline and too much of it, so it gets hung up on
+    CPPUNIT_ASSERT(readAll(sock) == "");
+    close(sock);
+  }
+
+  /**
+   * Idle connections still get hung up on, even though the loop only
+   * looks for them once a second
+   */
+
+  void testIdle()
+  {
+    EpollServer<EchoHandler> server(PORT, 1);
+    server.setIdleSeconds(1);
+    server.start();
+    int sock = connectTo(PORT);
+    timeval wait = { 10, 0 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &wait, sizeof(wait));
+    sendString(sock, "hello\n");
+    CPPUNIT_ASSERT(readLine(sock) == "hello");
+    // A timeout would be -1
+    char c;
+    CPPUNIT_ASSERT_EQUAL((ssize_t) 0, recv(sock, &c, 1, 0));
+    close(sock);
+  }
+
+  void testStreaming()
+  {
+    EpollServer<EchoHandler> server(PORT, 1);
+    server.start();
+    int sock = connectTo(PORT);
+    sendString(sock, "stream\n");
+    std::string data = readAll(sock);
+    CPPUNIT_ASSERT_EQUAL((size_t) STREAM_CHUNKS * CHUNK_SIZE, data.size());
+    CPPUNIT_ASSERT(data == std::string(STREAM_CHUNKS * CHUNK_SIZE, 'x'));
+    close(sock);
+  }
+
+  /**
+   * Nothing's sent until the other thread says so, and a resume for
+   * a connection that isn't there doesn't hurt anything
+   */
+
+  void testResume()
+  {
+    EpollServer<EchoHandler> server(PORT, 2);
+    server.start();
+    laterReady = false;
+    int sock = connectTo(PORT);
+    server.resume(sock + 1000);
+    sendString(sock, "later\n");
+    CPPUNIT_ASSERT(readLine(sock) == "later");
+    CPPUNIT_ASSERT(laterReady);
+    laterThread->join();
+    delete laterThread;
+    laterThread = (boost::thread *) NULL;
+    sendString(sock, "Foo!\nquit\n");
+    CPPUNIT_ASSERT(readAll(sock) == "Foo!\nbye\n");
+    close(sock);
+  }
+
+  /**
+   * A client that shuts its side as soon as it's asked still gets an
+   * answer that isn't ready yet, then gets hung up on
+   */
+
+  void testResumeAfterHalfClose()
+  {
+    EpollServer<EchoHandler> server(PORT, 1);
+    server.start();
+    laterReady = false;
+    int sock = connectTo(PORT);
+    sendString(sock, "later\n");
+    shutdown(sock, SHUT_WR);
+    CPPUNIT_ASSERT(readAll(sock) == "later\n");
+    laterThread->join();
+    delete laterThread;
+    laterThread = (boost::thread *) NULL;
+    close(sock);
+  }
+
+  void testReusePort()
+  {
+    EpollServer<EchoHandler> server(PORT, 3, true);
+    server.start();
+    for (int i = 0; i < 20; i++) {
+      int sock = connectTo(PORT);
+      sendString(sock, "Foo!\nquit\n");
+      CPPUNIT_ASSERT(readAll(sock) == "Foo!\nbye\n");
+      close(sock);
+    }
+  }
+
+};
+
+int EpollServerTest::file = -1;
+boost::atomic<bool> EpollServerTest::laterReady(false);
+boost::thread *EpollServerTest::laterThread = (boost::thread *) NULL;
+
+CPPUNIT_TEST_SUITE_REGISTRATION(EpollServerTest);
@@ -0,0 +1,133 @@
+/**
+ * Tests for FrozenTree. Lookups have to come out the same as the
+ * tree it was frozen from.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "btree.h"
+#include "frozen_tree.h"
+#include "time_tree.h"
+#include <stdlib.h>
+#include <string>
+#include <utility>
+#include <vector>
+#include <cppunit/extensions/HelperMacros.h>
+
+class FrozenTreeTest : public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(FrozenTreeTest);
+  CPPUNIT_TEST(testEverySize);
+  CPPUNIT_TEST(testFreezeBtree);
+  CPPUNIT_TEST(testFreezeTimeTree);
+  CPPUNIT_TEST(testLoad);
+  CPPUNIT_TEST_SUITE_END();
+
+  typedef Btree<int,int> Tree;
+  typedef FrozenTree<int,int> Frozen;
+
+  /**
+   * Every lookup for every key from below the smallest to past the
+   * biggest, frozen against the tree
+   */
+
+  void compare(Tree &tree, Frozen &frozen, int low, int high)
+  {
+    for (int key = low; key <= high; key++) {
+      CPPUNIT_ASSERT_EQUAL(tree.find(key), frozen.find(key));
+      CPPUNIT_ASSERT_EQUAL(tree.floor(key), frozen.floor(key));
+      CPPUNIT_ASSERT_EQUAL(tree.ceil(key), frozen.ceil(key));
+    }
+  }
+
+public:
+
+  /**
+   * Sizes all around the powers of 2, where the last level goes from
+   * full to nearly empty
+   */
+
+  void testEverySize()
+  {
+    for (int size = 0; size <= 70; size++) {
+      Tree tree(-1);
+      for (int i = 0; i < size; i++) {
+        tree.add(i * 2, i);
+      }
+      Frozen frozen(-1);
+      frozen.freeze(tree);
+      CPPUNIT_ASSERT_EQUAL((size_t) size, frozen.size());
+      compare(tree, frozen, -3, size * 2 + 3);
+    }
+  }
+
+  void testFreezeBtree()
+  {
+    Tree tree(-1);
+    srand(17);
+    for (int i = 0; i < 100000; i++) {
+      int key = rand() % 1000000;
+      try {
+        tree.add(key, key / 3);
+      } catch (std::string &) {
+        // Already there
+      }
+    }
+    Frozen frozen(-1);
+    frozen.freeze(tree);
+    compare(tree, frozen, -10, 1000010);
+
+    // It's a copy, so changing the tree doesn't change it
+    tree.add(-5, 5);
+    CPPUNIT_ASSERT_EQUAL(-1, frozen.find(-5));
+  }
+
+  void testFreezeTimeTree()
+  {
+    TimeTree<double, int> tree(-1);
+    for (int i = 0; i < 2880; i++) {
+      tree.add(1317427200.0 + i * 300.0, i);
+    }
+    FrozenTimeTree<double, int> frozen(-1);
+    frozen.freeze(tree);
+    for (double time = 1317427000.0; time < 1317427200.0 + 2881 * 300.0; time += 37.5) {
+      CPPUNIT_ASSERT_EQUAL(tree.find(time), frozen.find(time));
+    }
+    CPPUNIT_ASSERT_EQUAL(-1, frozen.find(1317427199.0));
+    CPPUNIT_ASSERT_EQUAL(2879, frozen.find(1e12));
+  }
+
+  void testLoad()
+  {
+    typedef std::vector<std::pair<std::string, int> > Pairs;
+    Pairs sorted;
+    sorted.push_back(std::make_pair(std::string("G01"), 1));
+    sorted.push_back(std::make_pair(std::string("G05"), 5));
+    sorted.push_back(std::make_pair(std::string("R12"), 12));
+    FrozenTree<std::string, int> frozen(0);
+    frozen.load(sorted.begin(), sorted.end());
+    CPPUNIT_ASSERT_EQUAL(5, frozen.find("G05"));
+    CPPUNIT_ASSERT_EQUAL(0, frozen.find("G04"));
+    CPPUNIT_ASSERT_EQUAL(1, frozen.floor("G04"));
+    CPPUNIT_ASSERT_EQUAL(12, frozen.ceil("G06"));
+    CPPUNIT_ASSERT_EQUAL(12, frozen.floor("Z"));
+
+    sorted.push_back(std::make_pair(std::string("E11"), 11));
+    CPPUNIT_ASSERT_THROW(frozen.load(sorted.begin(), sorted.end()), std::string);
+    CPPUNIT_ASSERT_EQUAL((size_t) 3, frozen.size());
+    CPPUNIT_ASSERT_EQUAL(12, frozen.find("R12"));
+  }
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(FrozenTreeTest);
@@ -0,0 +1,187 @@
+/**
+ * Make sure the batch geodetic conversion agrees with Latlong, on
+ * every instruction set this CPU can run.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "coordinates.h"
+#include "geodetic.h"
+#include "simd_lanes.h"
+#include <math.h>
+#include <stdlib.h>
+#include <vector>
+#include <cppunit/extensions/HelperMacros.h>
+
+class GeodeticTest : public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(GeodeticTest);
+  CPPUNIT_TEST(testAtan2);
+  CPPUNIT_TEST(testAgainstLatlong);
+  CPPUNIT_TEST(testSpecialPoints);
+  CPPUNIT_TEST(testOddCounts);
+  CPPUNIT_TEST_SUITE_END();
+
+  enum { POINTS = 10007 };
+
+  std::vector<double> x, y, z;
+
+  double random(double low, double high)
+  {
+    return low + (high - low) * ((double) rand() / RAND_MAX);
+  }
+
+  /**
+   * Points all over, from a little underground out past GPS orbits
+   */
+
+  void makePoints()
+  {
+    srand(42);
+    x.clear();
+    y.clear();
+    z.clear();
+    for (int i = 0; i < POINTS; i++) {
+      Latlong ll(random(-90.0, 90.0), random(-180.0, 180.0), random(-1000.0, 30000000.0));
+      Ecef ecef(ll);
+      x.push_back(ecef.getX());
+      y.push_back(ecef.getY());
+      z.push_back(ecef.getZ());
+    }
+  }
+
+  /**
+   * Compare every point with Latlong, to a millimeter. A degree of
+   * latitude is about 111 km at the surface, and a lot more out
+   * where the satellites are, so angles are checked by how far
+   * apart they put the point.
+   */
+
+  void checkAgainstLatlong(GeodeticBatch::Implementation use)
+  {
+    size_t count = x.size();
+    std::vector<double> lat(count), lon(count), alt(count);
+    GeodeticBatch::convert(&x[0], &y[0], &z[0], count, &lat[0], &lon[0], &alt[0], 6378137.0, 0.00669437999014, use);
+    for (size_t i = 0; i < count; i++) {
+      Ecef ecef(x[i], y[i], z[i]);
+      Latlong expected(ecef);
+      double radius = sqrt(x[i] * x[i] + y[i] * y[i] + z[i] * z[i]);
+      double p = sqrt(x[i] * x[i] + y[i] * y[i]);
+      double toMeters = M_PI / 180.0;
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(expected.getAlt(), alt[i], 0.001);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(0.0, (expected.getLat() - lat[i]) * toMeters * radius, 0.001);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(0.0, (expected.getLong() - lon[i]) * toMeters * p, 0.001);
+    }
+  }
+
+  /**
+   * Turn the answers back into ECEF and make sure they land within
+   * a millimeter of where they started. This doesn't depend on
+   * Latlong, which loses a few digits right next to the poles
+   * (asin of something very close to 1.)
+   */
+
+  void checkRoundTrip(GeodeticBatch::Implementation use)
+  {
+    size_t count = x.size();
+    std::vector<double> lat(count), lon(count), alt(count);
+    GeodeticBatch::convert(&x[0], &y[0], &z[0], count, &lat[0], &lon[0], &alt[0], 6378137.0, 0.00669437999014, use);
+    for (size_t i = 0; i < count; i++) {
+      Latlong ll(lat[i], lon[i], alt[i]);
+      Ecef back(ll);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(x[i], back.getX(), 0.001);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(y[i], back.getY(), 0.001);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(z[i], back.getZ(), 0.001);
+    }
+  }
+
+public:
+
+  void testAtan2()
+  {
+    srand(7);
+    for (int i = 0; i < 100000; i++) {
+      double a = random(-1.0, 1.0) * pow(10.0, random(-5.0, 8.0));
+      double b = random(-1.0, 1.0) * pow(10.0, random(-5.0, 8.0));
+      double expected = atan2(a, b);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(expected, atan2Lanes<ScalarLanes>(a, b), 4e-16 * fabs(expected) + 1e-300);
+    }
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.0, atan2Lanes<ScalarLanes>(0.0, 1.0), 0.0);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.0, atan2Lanes<ScalarLanes>(0.0, 0.0), 0.0);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(M_PI / 2, atan2Lanes<ScalarLanes>(1.0, 0.0), 1e-16);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(-M_PI / 2, atan2Lanes<ScalarLanes>(-1.0, 0.0), 1e-16);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(M_PI, atan2Lanes<ScalarLanes>(0.0, -1.0), 1e-16);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(M_PI * 0.75, atan2Lanes<ScalarLanes>(1.0, -1.0), 1e-16);
+  }
+
+  void testAgainstLatlong()
+  {
+    makePoints();
+    GeodeticBatch::Implementation all[] = { GeodeticBatch::SCALAR, GeodeticBatch::AVX2, GeodeticBatch::AVX512, GeodeticBatch::AUTO };
+    for (int i = 0; i < 4; i++) {
+      if (GeodeticBatch::supported(all[i])) {
+        checkAgainstLatlong(all[i]);
+        checkRoundTrip(all[i]);
+      }
+    }
+  }
+
+  void testSpecialPoints()
+  {
+    x.clear();
+    y.clear();
+    z.clear();
+    double points[][3] = {
+      { 6378137.0, 0.0, 0.0 },        // Equator, prime meridian
+      { -6378137.0, 0.0, 0.0 },       // Equator, other side
+      { 0.0, 6378137.0, 0.0 },
+      { 0.0, -26560000.0, 0.0 },
+      { 1.0, 0.0, 6356752.3142 },     // Just about on the north pole
+      { 1.0, 0.0, -26000000.0 },      // Way over the south pole
+      { 4000000.0, 3000000.0, 3500000.0 },
+    };
+    for (int i = 0; i < 7; i++) {
+      x.push_back(points[i][0]);
+      y.push_back(points[i][1]);
+      z.push_back(points[i][2]);
+    }
+    checkRoundTrip(GeodeticBatch::SCALAR);
+    checkRoundTrip(GeodeticBatch::AUTO);
+  }
+
+  /**
+   * Everything but full rows goes through the padding, so try all
+   * the leftovers
+   */
+
+  void testOddCounts()
+  {
+    makePoints();
+    for (size_t count = 0; count <= 17; count++) {
+      std::vector<double> lat(count + 1, -1.0), lon(count + 1, -1.0), alt(count + 1, -1.0);
+      std::vector<double> lat2(count + 1), lon2(count + 1), alt2(count + 1);
+      GeodeticBatch::convert(&x[0], &y[0], &z[0], count, &lat[0], &lon[0], &alt[0]);
+      GeodeticBatch::convert(&x[0], &y[0], &z[0], count, &lat2[0], &lon2[0], &alt2[0], 6378137.0, 0.00669437999014, GeodeticBatch::SCALAR);
+      for (size_t i = 0; i < count; i++) {
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(lat2[i], lat[i], 1e-10);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(lon2[i], lon[i], 1e-10);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(alt2[i], alt[i], 1e-6);
+      }
+      // Nothing written past the end
+      CPPUNIT_ASSERT(lat[count] == -1.0 && lon[count] == -1.0 && alt[count] == -1.0);
+    }
+  }
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(GeodeticTest);
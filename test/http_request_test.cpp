@@ -0,0 +1,273 @@
+/**
+ * Make sure HTTP requests get picked apart right, however they
+ * arrive, and that broken ones get turned down.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "http_request.h"
+#include <string>
+#include <vector>
+#include <cppunit/extensions/HelperMacros.h>
+
+class HttpRequestTest : public CppUnit::TestFixture {
+
+  CPPUNIT_TEST_SUITE(HttpRequestTest);
+  CPPUNIT_TEST(testSimple);
+  CPPUNIT_TEST(testIncremental);
+  CPPUNIT_TEST(testPipelined);
+  CPPUNIT_TEST(testKeepAlive);
+  CPPUNIT_TEST(testBody);
+  CPPUNIT_TEST(testQuery);
+  CPPUNIT_TEST(testValues);
+  CPPUNIT_TEST(testNotNumbers);
+  CPPUNIT_TEST(testBad);
+  CPPUNIT_TEST_SUITE_END();
+
+  HttpRequest::Status parse(HttpRequest &request, const std::string &text)
+  {
+    return request.parse(text.data(), text.size());
+  }
+
+  bool bad(const std::string &text)
+  {
+    HttpRequest request;
+    return HttpRequest::BAD == parse(request, text);
+  }
+
+  std::string value(const HttpRequest &request, const char *name)
+  {
+    HttpRequest::Slice found;
+    CPPUNIT_ASSERT(request.parameter(name, found));
+    return std::string(found.data, found.length);
+  }
+
+public:
+
+  void testSimple()
+  {
+    HttpRequest request;
+    std::string text = "GET / HTTP/1.1\r\nHost: 127.0.0.1:12345\r\nAccept: */*\r\n\r\n";
+    CPPUNIT_ASSERT(HttpRequest::COMPLETE == parse(request, text));
+    CPPUNIT_ASSERT_EQUAL(text.size(), request.size());
+    CPPUNIT_ASSERT(request.method() == "GET");
+    CPPUNIT_ASSERT(request.path() == "/");
+    CPPUNIT_ASSERT(request.http11());
+    CPPUNIT_ASSERT(request.keepAlive());
+    CPPUNIT_ASSERT_EQUAL((size_t) 0, request.parameterSize());
+    CPPUNIT_ASSERT(!request.has("t"));
+
+    // Bare newlines work too. The path points into the text, so it has to stay put.
+    request.reset();
+    std::string bare = "GET /track HTTP/1.0\nHost: x\n\n";
+    CPPUNIT_ASSERT(HttpRequest::COMPLETE == parse(request, bare));
+    CPPUNIT_ASSERT(request.path() == "/track");
+    CPPUNIT_ASSERT(!request.http11());
+  }
+
+  /**
+   * A byte at a time, into a buffer that moves every time
+   */
+
+  void testIncremental()
+  {
+    HttpRequest request;
+    std::string text = "GET /?t=1317427200&sats=1,2 HTTP/1.1\r\nConnection: close\r\n\r\n";
+    for (size_t i = 1; i < text.size(); i++) {
+      std::vector<char> moved(text.begin(), text.begin() + i);
+      CPPUNIT_ASSERT(HttpRequest::INCOMPLETE == request.parse(&moved[0], moved.size()));
+    }
+    std::vector<char> all(text.begin(), text.end());
+    CPPUNIT_ASSERT(HttpRequest::COMPLETE == request.parse(&all[0], all.size()));
+    CPPUNIT_ASSERT_EQUAL(text.size(), request.size());
+    CPPUNIT_ASSERT(request.path() == "/");
+    CPPUNIT_ASSERT(!request.keepAlive());
+    CPPUNIT_ASSERT(value(request, "sats") == "1,2");
+    // Asking again before reset is the same answer
+    CPPUNIT_ASSERT(HttpRequest::COMPLETE == request.parse(&all[0], all.size()));
+  }
+
+  void testPipelined()
+  {
+    std::string first = "GET /?t=1 HTTP/1.1\r\n\r\n";
+    std::string second = "\r\nGET /track?begin=2 HTTP/1.1\r\n\r\n";
+    std::string third = "GET /?t=3 HT";
+    std::string text = first + second + third;
+    HttpRequest request;
+    CPPUNIT_ASSERT(HttpRequest::COMPLETE == parse(request, text));
+    CPPUNIT_ASSERT_EQUAL(first.size(), request.size());
+    CPPUNIT_ASSERT(value(request, "t") == "1");
+    text = text.substr(request.size());
+    request.reset();
+    // The stray blank line in front belongs to the second one
+    CPPUNIT_ASSERT(HttpRequest::COMPLETE == parse(request, text));
+    CPPUNIT_ASSERT_EQUAL(second.size(), request.size());
+    CPPUNIT_ASSERT(request.path() == "/track");
+    CPPUNIT_ASSERT(!request.has("t"));
+    CPPUNIT_ASSERT(value(request, "begin") == "2");
+    text = text.substr(request.size());
+    request.reset();
+    CPPUNIT_ASSERT(HttpRequest::INCOMPLETE == parse(request, text));
+  }
+
+  void testKeepAlive()
+  {
+    HttpRequest request;
+    parse(request, "GET / HTTP/1.0\r\n\r\n");
+    CPPUNIT_ASSERT(!request.keepAlive());
+    request.reset();
+    parse(request, "GET / HTTP/1.0\r\nconnection: Keep-Alive\r\n\r\n");
+    CPPUNIT_ASSERT(request.keepAlive());
+    request.reset();
+    parse(request, "GET / HTTP/1.1\r\nConnection:CLOSE\r\n\r\n");
+    CPPUNIT_ASSERT(!request.keepAlive());
+    request.reset();
+    parse(request, "GET / HTTP/1.1\r\nConnection: upgrade, close \r\n\r\n");
+    CPPUNIT_ASSERT(!request.keepAlive());
+    request.reset();
+    // Not a token of its own
+    parse(request, "GET / HTTP/1.1\r\nConnection: closed\r\n\r\n");
+    CPPUNIT_ASSERT(request.keepAlive());
+  }
+
+  void testBody()
+  {
+    HttpRequest request;
+    std::string head = "GET / HTTP/1.1\r\nContent-Length: 5\r\n\r\n";
+    CPPUNIT_ASSERT(HttpRequest::INCOMPLETE == parse(request, head + "abc"));
+    CPPUNIT_ASSERT(HttpRequest::COMPLETE == parse(request, head + "abcdeGET"));
+    CPPUNIT_ASSERT_EQUAL(head.size() + 5, request.size());
+    CPPUNIT_ASSERT_EQUAL((size_t) 5, request.contentLength());
+  }
+
+  void testQuery()
+  {
+    HttpRequest request;
+    std::string text = "GET /?t=2011-10-01T00%3A00%3A00Z&sats=1%2C2,+3&bbox=1,2,3,4&format=kml&t=5&flag&&x=%41#frag HTTP/1.1\r\n\r\n";
+    CPPUNIT_ASSERT(HttpRequest::COMPLETE == parse(request, text));
+    CPPUNIT_ASSERT(request.path() == "/");
+    CPPUNIT_ASSERT_EQUAL((size_t) 7, request.parameterSize());
+    // The last one wins
+    CPPUNIT_ASSERT(value(request, "t") == "5");
+    CPPUNIT_ASSERT(value(request, "sats") == "1,2, 3");
+    // Names don't care about case
+    CPPUNIT_ASSERT(value(request, "BBOX") == "1,2,3,4");
+    CPPUNIT_ASSERT(value(request, "format") == "kml");
+    CPPUNIT_ASSERT(value(request, "flag") == "");
+    CPPUNIT_ASSERT(value(request, "x") == "A");
+    CPPUNIT_ASSERT(!request.has("frag"));
+    CPPUNIT_ASSERT(!request.has("y"));
+  }
+
+  void testValues()
+  {
+    HttpRequest request;
+    parse(request, "GET /?a=1317427200&b=2011-10-01T00:00:00Z&c=2011-10-01T00:01&d=12x&e=2011-13-01T00:00:00Z"
+          "&sats=G01,,G02,G03&box=170,-10,-170,10&far=0,10,10,0&few=1,2,3 HTTP/1.1\r\n\r\n");
+    double number;
+    CPPUNIT_ASSERT(request.time("a", number));
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1317427200.0, number, 0.0);
+    CPPUNIT_ASSERT(request.time("b", number));
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1317427200.0, number, 0.0);
+    CPPUNIT_ASSERT(request.time("c", number));
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1317427260.0, number, 0.0);
+    CPPUNIT_ASSERT(!request.number("d", number));
+    CPPUNIT_ASSERT(!request.time("d", number));
+    CPPUNIT_ASSERT(!request.time("e", number));
+    CPPUNIT_ASSERT(!request.time("missing", number));
+
+    HttpRequest::Slice items[2];
+    CPPUNIT_ASSERT_EQUAL((size_t) 3, request.list("sats", items, 2));
+    CPPUNIT_ASSERT(items[0] == "G01");
+    CPPUNIT_ASSERT(items[1] == "G02");
+
+    double west, south, east, north;
+    // Across the 180th meridian is fine
+    CPPUNIT_ASSERT(request.box("box", west, south, east, north));
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(170.0, west, 0.0);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(-10.0, south, 0.0);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(-170.0, east, 0.0);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(10.0, north, 0.0);
+    // South of north isn't
+    CPPUNIT_ASSERT(!request.box("far", west, south, east, north));
+    CPPUNIT_ASSERT(!request.box("few", west, south, east, north));
+  }
+
+  /**
+   * strtod would take all of these, but none of them is a time or a
+   * step anybody meant
+   */
+
+  void testNotNumbers()
+  {
+    HttpRequest request;
+    parse(request, "GET /?a=inf&b=-infinity&c=nan&d=0x1p4&e=%205&f=1e999&g=&h=e5"
+          "&i=%2B1.5&j=.5&k=-2e3&box=inf,-10,-170,10 HTTP/1.1\r\n\r\n");
+    const char *bad[] = { "a", "b", "c", "d", "e", "f", "g", "h" };
+    double number = 7.0;
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+      CPPUNIT_ASSERT(!request.number(bad[i], number));
+      CPPUNIT_ASSERT(!request.time(bad[i], number));
+    }
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(7.0, number, 0.0);
+    CPPUNIT_ASSERT(request.number("i", number));
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1.5, number, 0.0);
+    CPPUNIT_ASSERT(request.number("j", number));
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.5, number, 0.0);
+    CPPUNIT_ASSERT(request.time("k", number));
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(-2000.0, number, 0.0);
+    double west, south, east, north;
+    CPPUNIT_ASSERT(!request.box("box", west, south, east, north));
+  }
+
+  void testBad()
+  {
+    CPPUNIT_ASSERT(bad("GET /\r\n\r\n"));
+    CPPUNIT_ASSERT(bad("GET / HTTP/2.0\r\n\r\n"));
+    CPPUNIT_ASSERT(bad("GET http://example.com/ HTTP/1.1\r\n\r\n"));
+    CPPUNIT_ASSERT(bad("get / HTTP/1.1\r\n\r\n"));
+    // High bytes are just bytes, not letters or digits
+    CPPUNIT_ASSERT(bad("G\xc9T / HTTP/1.1\r\n\r\n"));
+    CPPUNIT_ASSERT(bad("GET / HTTP/1.\xb1\r\n\r\n"));
+    CPPUNIT_ASSERT(bad("GET / HTTP/1.1\r\nContent-Length: \xb5\r\n\r\n"));
+    CPPUNIT_ASSERT(bad("GET /?t=%\xc1\xc1 HTTP/1.1\r\n\r\n"));
+    CPPUNIT_ASSERT(bad("GET  / HTTP/1.1\r\n\r\n"));
+    CPPUNIT_ASSERT(bad("GET / HTTP/1.1\r\nHost\r\n\r\n"));
+    CPPUNIT_ASSERT(bad("GET / HTTP/1.1\r\nHost: x\r\n  folded\r\n\r\n"));
+    CPPUNIT_ASSERT(bad("GET / HTTP/1.1\r\nContent-Length: 5x\r\n\r\n"));
+    CPPUNIT_ASSERT(bad("GET / HTTP/1.1\r\nContent-Length: 5\r\nContent-Length: 6\r\n\r\n"));
+    CPPUNIT_ASSERT(bad("GET / HTTP/1.1\r\nContent-Length: 99999999999999999999999\r\n\r\n"));
+    CPPUNIT_ASSERT(bad("GET / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"));
+    CPPUNIT_ASSERT(bad("GET /?t=%4 HTTP/1.1\r\n\r\n"));
+    CPPUNIT_ASSERT(bad("GET /?t=%zz HTTP/1.1\r\n\r\n"));
+
+    std::string many = "GET /?";
+    for (int i = 0; i <= HttpRequest::MAX_PARAMETERS; i++) {
+      many += "a=1&";
+    }
+    CPPUNIT_ASSERT(bad(many + " HTTP/1.1\r\n\r\n"));
+    CPPUNIT_ASSERT(bad("GET /?t=" + std::string(HttpRequest::MAX_QUERY, '1') + " HTTP/1.1\r\n\r\n"));
+
+    // Too much header gets turned down before it ends
+    HttpRequest request;
+    std::string huge = "GET / HTTP/1.1\r\nX-Padding: " + std::string(HttpRequest::MAX_HEADER_BYTES, 'x');
+    CPPUNIT_ASSERT(HttpRequest::BAD == parse(request, huge));
+    CPPUNIT_ASSERT(std::string(request.error()) == "request headers too long");
+    request.reset();
+    CPPUNIT_ASSERT(HttpRequest::INCOMPLETE == parse(request, huge.substr(0, 100)));
+  }
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(HttpRequestTest);
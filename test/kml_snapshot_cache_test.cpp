@@ -0,0 +1,200 @@
+/**
+ * Make sure prerendered KML snapshots match what gets rendered
+ * directly, and that the render thread stays ahead of the clock.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kml_snapshot_cache.h"
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <math.h>
+#include <string>
+#include <unistd.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+class KmlSnapshotCacheTest : public CppUnit::TestFixture {
+
+  CPPUNIT_TEST_SUITE(KmlSnapshotCacheTest);
+  CPPUNIT_TEST(testSnapshot);
+  CPPUNIT_TEST(testBuckets);
+  CPPUNIT_TEST(testRenderAhead);
+  CPPUNIT_TEST(testSelection);
+  CPPUNIT_TEST_SUITE_END();
+
+  enum { STEP = 900, POINTS = 200 };
+
+  /**
+   * Two satellites going around in circles, 900 seconds apart,
+   * starting at start.
+   */
+
+  void fill(EphemerisCache &cache, double start)
+  {
+    const char *names[] = { "G01", "G02" };
+    for (int sat = 0; sat < 2; sat++) {
+      for (int i = 0; i < POINTS; i++) {
+        double t = start + i * STEP;
+        double angle = t / 43080.0 * 2.0 * M_PI + sat;
+        EphemerisLine line(26560000.0 * cos(angle), 26560000.0 * sin(angle), 1000.0 * sat, 0, 0, 0, t);
+        cache.add(names[sat], line);
+      }
+    }
+  }
+
+  std::string fileContents(const KmlSnapshotCache::SnapshotPtr &snapshot)
+  {
+    if (snapshot->fileDescriptor() < 0) {
+      return std::string(snapshot->body(), snapshot->size());
+    }
+    std::string contents(snapshot->size(), '\0');
+    CPPUNIT_ASSERT((ssize_t) contents.size() == pread(snapshot->fileDescriptor(), &contents[0], contents.size(), 0));
+    return contents;
+  }
+
+public:
+
+  void testSnapshot()
+  {
+    EphemerisCache cache;
+    fill(cache, 1000000.0);
+    KmlSnapshotCache snapshots(&cache, 10.0, 0.0);
+    double when = 1000000.0 + 50 * STEP + 5.0;
+    KmlSnapshotCache::SnapshotPtr snapshot = snapshots.get(when);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1000000.0 + 50 * STEP, snapshot->time(), 0.0);
+
+    // Same thing rendered by hand
+    KmlWriter kml;
+    OrbitInterpolator interpolator;
+    EphemerisLine line(0, 0, 0, 0, 0, 0);
+    kml.beginDocument();
+    const char *names[] = { "G01", "G02" };
+    for (int sat = 0; sat < 2; sat++) {
+      CPPUNIT_ASSERT(cache.interpolate(names[sat], snapshot->time(), line, interpolator));
+      double x = line.getPosition().getX(), y = line.getPosition().getY(), z = line.getPosition().getZ();
+      double lat, lon, alt;
+      GeodeticBatch::convert(&x, &y, &z, 1, &lat, &lon, &alt);
+      kml.placemark(names[sat], lon, lat, alt);
+    }
+    kml.endDocument();
+    CPPUNIT_ASSERT(std::string(kml.data(), kml.size()) == fileContents(snapshot));
+    kml.httpHeader(true);
+    CPPUNIT_ASSERT(std::string(kml.headerData(), kml.headerSize()) == snapshot->header(true));
+    kml.httpHeader(false);
+    CPPUNIT_ASSERT(std::string(kml.headerData(), kml.headerSize()) == snapshot->header(false));
+  }
+
+  void testBuckets()
+  {
+    EphemerisCache cache;
+    fill(cache, 1000000.0);
+    KmlSnapshotCache snapshots(&cache, 10.0, 0.0);
+    double when = 1000000.0 + 20 * STEP;
+    CPPUNIT_ASSERT(!snapshots.ready(when));
+    KmlSnapshotCache::SnapshotPtr first = snapshots.get(when);
+    CPPUNIT_ASSERT(snapshots.ready(when + 9.0));
+    // Anything in the same bucket is the same snapshot
+    CPPUNIT_ASSERT(first == snapshots.get(when + 9.0));
+    CPPUNIT_ASSERT_EQUAL((size_t) 1, snapshots.renderCount());
+    KmlSnapshotCache::SnapshotPtr second = snapshots.get(when + 10.0);
+    CPPUNIT_ASSERT(first != second);
+    CPPUNIT_ASSERT_EQUAL((size_t) 2, snapshots.renderCount());
+    // Old ones eventually get dropped, but whoever has one keeps it
+    for (int i = 2; i < 2 + KmlSnapshotCache::MAX_SNAPSHOTS; i++) {
+      snapshots.get(when + i * 10.0);
+    }
+    CPPUNIT_ASSERT(!snapshots.ready(when));
+    CPPUNIT_ASSERT(fileContents(first).size() == first->size());
+  }
+
+  void testRenderAhead()
+  {
+    EphemerisCache cache;
+    double start = (double) time(NULL) - 100 * STEP;
+    fill(cache, start);
+    KmlSnapshotCache snapshots(&cache, 2.0, -50.0 * STEP);
+    snapshots.start();
+    int waited = 0;
+    while (!(snapshots.ready(snapshots.now()) && snapshots.ready(snapshots.now() + 2.0)) && waited < 100) {
+      boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+      waited++;
+    }
+    CPPUNIT_ASSERT(snapshots.ready(snapshots.now()));
+    CPPUNIT_ASSERT(snapshots.ready(snapshots.now() + 2.0));
+    size_t rendered = snapshots.renderCount();
+    // Handing out the current one doesn't render anything
+    CPPUNIT_ASSERT(std::string::npos != fileContents(snapshots.current()).find("<name>G02</name>"));
+    CPPUNIT_ASSERT(snapshots.renderCount() <= rendered + 1); // Unless the clock just ticked over
+    snapshots.stop();
+  }
+
+  /**
+   * Only the satellites asked for, only inside the box, and the
+   * whole lot when nothing's asked for is the same as a snapshot
+   */
+
+  void testSelection()
+  {
+    EphemerisCache cache;
+    fill(cache, 1000000.0);
+    KmlSnapshotCache snapshots(&cache, 10.0, 0.0);
+    double when = 1000000.0 + 50 * STEP;
+    KmlSelection selection;
+    KmlWriter kml;
+    OrbitInterpolator interpolator;
+    selection.time = when;
+    snapshots.write(selection, kml, interpolator);
+    CPPUNIT_ASSERT(std::string(kml.data(), kml.size()) == fileContents(snapshots.get(when)));
+
+    selection.names.push_back("G02");
+    selection.names.push_back("G99");
+    snapshots.write(selection, kml, interpolator);
+    std::string out(kml.data(), kml.size());
+    CPPUNIT_ASSERT(std::string::npos == out.find("<name>G01</name>"));
+    CPPUNIT_ASSERT(std::string::npos != out.find("<name>G02</name>"));
+    CPPUNIT_ASSERT(std::string::npos == out.find("<name>G99</name>"));
+
+    // A box around where G02 is, then one on the other side of the world
+    EphemerisLine line(0, 0, 0, 0, 0, 0);
+    CPPUNIT_ASSERT(cache.interpolate("G02", when, line, interpolator));
+    double x = line.getPosition().getX(), y = line.getPosition().getY(), z = line.getPosition().getZ();
+    double lat, lon, alt;
+    GeodeticBatch::convert(&x, &y, &z, 1, &lat, &lon, &alt);
+    selection.names.clear();
+    selection.boxed = true;
+    selection.west = lon - 1.0;
+    selection.east = lon + 1.0;
+    selection.south = lat - 1.0;
+    selection.north = lat + 1.0;
+    selection.csv = true;
+    snapshots.write(selection, kml, interpolator);
+    out = std::string(kml.data(), kml.size());
+    CPPUNIT_ASSERT(0 == out.find("name,time,longitude,latitude,altitude\n"));
+    CPPUNIT_ASSERT(std::string::npos == out.find("G01,"));
+    CPPUNIT_ASSERT(std::string::npos != out.find("G02,"));
+    selection.west = lon + 179.0;
+    selection.east = lon + 181.0;
+    if (selection.west > 180.0) {
+      selection.west -= 360.0;
+    }
+    if (selection.east > 180.0) {
+      selection.east -= 360.0;
+    }
+    snapshots.write(selection, kml, interpolator);
+    out = std::string(kml.data(), kml.size());
+    CPPUNIT_ASSERT(std::string::npos == out.find("G02,"));
+  }
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(KmlSnapshotCacheTest);
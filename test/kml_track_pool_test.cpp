@@ -0,0 +1,332 @@
+/**
+ * Make sure tracks come out whole, the same however many threads
+ * render them, and that the workers don't get too far ahead of
+ * whoever's sending.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kml_track_pool.h"
+#include "sp3_loader.h"
+#include <boost/atomic.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <algorithm>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <cppunit/extensions/HelperMacros.h>
+
+class KmlTrackPoolTest : public CppUnit::TestFixture {
+
+  CPPUNIT_TEST_SUITE(KmlTrackPoolTest);
+  CPPUNIT_TEST(testCheck);
+  CPPUNIT_TEST(testTrack);
+  CPPUNIT_TEST(testThreadsAgree);
+  CPPUNIT_TEST(testReadAhead);
+  CPPUNIT_TEST(testCancel);
+  CPPUNIT_TEST(testUnchunked);
+  CPPUNIT_TEST_SUITE_END();
+
+  EphemerisCache cache;
+
+  // 2011-10-01T00:00:00Z, the start of the test file
+  static const double START;
+
+  class CountingListener : public KmlTrackListener {
+  public:
+    boost::atomic<int> calls;
+
+    CountingListener() : calls(0)
+    {
+    }
+
+    void trackReady()
+    {
+      calls++;
+    }
+  };
+
+  void load()
+  {
+    std::vector<std::string> names;
+    cache.satelliteNames(names);
+    if (names.empty()) {
+      Sp3Loader loader;
+      CPPUNIT_ASSERT(loader.addPath("nga16556.eph"));
+      CPPUNIT_ASSERT(loader.load(cache) > 0);
+    }
+  }
+
+  /**
+   * Everything the track comes to, waiting for the workers as needed
+   */
+
+  std::string collect(KmlTrackPool &pool, const KmlTrackPool::TrackPtr &track)
+  {
+    std::string all;
+    KmlTrackPool::Chunk chunk;
+    bool finished = false;
+    while (!finished) {
+      if (pool.take(track, chunk, finished)) {
+        all += *chunk;
+      } else if (!finished) {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+      }
+    }
+    return all;
+  }
+
+  /**
+   * Undo the chunked encoding after the header. Fails if it isn't
+   * right, or doesn't end with the zero length chunk.
+   */
+
+  std::string unchunk(const std::string &response)
+  {
+    size_t at = response.find("\r\n\r\n");
+    CPPUNIT_ASSERT(std::string::npos != at);
+    at += 4;
+    std::string body;
+    while (true) {
+      size_t lineEnd = response.find("\r\n", at);
+      CPPUNIT_ASSERT(std::string::npos != lineEnd);
+      size_t length = strtoul(response.substr(at, lineEnd - at).c_str(), NULL, 16);
+      at = lineEnd + 2;
+      if (length == 0) {
+        CPPUNIT_ASSERT(at + 2 == response.size());
+        return body;
+      }
+      CPPUNIT_ASSERT(at + length + 2 <= response.size());
+      body += response.substr(at, length);
+      CPPUNIT_ASSERT(response.compare(at + length, 2, "\r\n") == 0);
+      at += length + 2;
+    }
+  }
+
+  /**
+   * The Placemarks in body, sorted so the order they were finished in
+   * doesn't matter
+   */
+
+  std::vector<std::string> placemarks(const std::string &body)
+  {
+    std::vector<std::string> found;
+    size_t at = 0;
+    while (std::string::npos != (at = body.find("<Placemark>", at))) {
+      size_t end = body.find("</Placemark>", at);
+      CPPUNIT_ASSERT(std::string::npos != end);
+      found.push_back(body.substr(at, end - at));
+      at = end;
+    }
+    std::sort(found.begin(), found.end());
+    return found;
+  }
+
+  static size_t count(const std::string &text, const std::string &what)
+  {
+    size_t found = 0;
+    for (size_t at = text.find(what); std::string::npos != at; at = text.find(what, at + 1)) {
+      found++;
+    }
+    return found;
+  }
+
+public:
+
+  void testCheck()
+  {
+    size_t points;
+    CPPUNIT_ASSERT(KmlTrackPool::check(0.0, 3600.0, 60.0, points).empty());
+    CPPUNIT_ASSERT_EQUAL((size_t) 61, points);
+    CPPUNIT_ASSERT(KmlTrackPool::check(0.0, 0.0, 60.0, points).empty());
+    CPPUNIT_ASSERT_EQUAL((size_t) 1, points);
+    // A week at 30 seconds is fine, a week at a millisecond isn't
+    CPPUNIT_ASSERT(KmlTrackPool::check(0.0, 7 * 86400.0, 30.0, points).empty());
+    CPPUNIT_ASSERT_EQUAL((size_t) 20161, points);
+    CPPUNIT_ASSERT(!KmlTrackPool::check(0.0, 7 * 86400.0, 0.001, points).empty());
+    CPPUNIT_ASSERT(!KmlTrackPool::check(3600.0, 0.0, 60.0, points).empty());
+    CPPUNIT_ASSERT(!KmlTrackPool::check(0.0, 3600.0, 0.0, points).empty());
+    CPPUNIT_ASSERT(!KmlTrackPool::check(0.0, 3600.0, -1.0, points).empty());
+    CPPUNIT_ASSERT(!KmlTrackPool::check(0.0, NAN, 60.0, points).empty());
+    CPPUNIT_ASSERT_EQUAL((size_t) 0, points);
+    // inf - inf is NaN, not a huge count
+    CPPUNIT_ASSERT(!KmlTrackPool::check(INFINITY, INFINITY, 30.0, points).empty());
+    CPPUNIT_ASSERT_EQUAL((size_t) 0, points);
+    CPPUNIT_ASSERT(!KmlTrackPool::check(-INFINITY, 0.0, 30.0, points).empty());
+    CPPUNIT_ASSERT(!KmlTrackPool::check(0.0, 3600.0, INFINITY, points).empty());
+  }
+
+  /**
+   * Two hours at a minute: a Placemark per satellite with 121 times
+   * and places, and the places are where the cache says
+   */
+
+  void testTrack()
+  {
+    load();
+    std::vector<std::string> names;
+    cache.satelliteNames(names);
+    KmlTrackPool pool(&cache, 4);
+    pool.start();
+    CountingListener listener;
+    KmlTrackPool::TrackPtr track = pool.submit(START, START + 7200.0, 60.0, true, true, &listener);
+    std::string response = collect(pool, track);
+    CPPUNIT_ASSERT(0 == response.find("HTTP/1.1 200 OK\r\n"));
+    CPPUNIT_ASSERT(std::string::npos != response.find("Transfer-Encoding: chunked\r\n"));
+    CPPUNIT_ASSERT(std::string::npos != response.find("Connection: keep-alive\r\n\r\n"));
+    // Once per satellite
+    CPPUNIT_ASSERT_EQUAL((int) names.size(), (int) listener.calls);
+
+    std::string body = unchunk(response);
+    CPPUNIT_ASSERT(std::string::npos != body.find("xmlns:gx=\"http://www.google.com/kml/ext/2.2\""));
+    CPPUNIT_ASSERT(body.size() - 7 == body.rfind("</kml>\n"));
+    std::vector<std::string> found = placemarks(body);
+    CPPUNIT_ASSERT_EQUAL(names.size(), found.size());
+    for (size_t i = 0; i < found.size(); i++) {
+      CPPUNIT_ASSERT_EQUAL((size_t) 121, count(found[i], "<when>"));
+      CPPUNIT_ASSERT_EQUAL((size_t) 121, count(found[i], "<gx:coord>"));
+      CPPUNIT_ASSERT(std::string::npos != found[i].find("<TimeSpan><begin>2011-10-01T00:00:00Z</begin><end>2011-10-01T02:00:00Z</end></TimeSpan>"));
+    }
+
+    // The same place worked out by hand, for the middle of the range
+    EphemerisLine line(0, 0, 0, 0, 0, 0);
+    CPPUNIT_ASSERT(cache.interpolate(names[0], START + 3600.0, line));
+    double x = line.getPosition().getX(), y = line.getPosition().getY(), z = line.getPosition().getZ();
+    double lat, lon, alt;
+    GeodeticBatch::convert(&x, &y, &z, 1, &lat, &lon, &alt);
+    KmlWriter expected;
+    expected.append("<gx:coord>");
+    expected.appendFixed(lon, KmlWriter::DEGREE_DECIMALS);
+    expected.append(" ");
+    expected.appendFixed(lat, KmlWriter::DEGREE_DECIMALS);
+    expected.append(" ");
+    expected.appendFixed(alt, KmlWriter::METER_DECIMALS);
+    expected.append("</gx:coord>");
+    std::string place(expected.data(), expected.size());
+    size_t mine = body.find("<name>" + names[0] + "</name>");
+    CPPUNIT_ASSERT(std::string::npos != mine);
+    size_t coords = body.find("<gx:coord>", mine);
+    // The 61st place is an hour in
+    for (int i = 0; i < 60; i++) {
+      coords = body.find("<gx:coord>", coords + 1);
+    }
+    CPPUNIT_ASSERT(body.compare(coords, place.size(), place) == 0);
+  }
+
+  void testThreadsAgree()
+  {
+    load();
+    std::vector<std::string> bodies;
+    unsigned int threads[] = { 1, 3, 8 };
+    for (int i = 0; i < 3; i++) {
+      KmlTrackPool pool(&cache, threads[i]);
+      pool.start();
+      CountingListener listener;
+      KmlTrackPool::TrackPtr track = pool.submit(START + 100.0, START + 86400.0, 300.0, true, false, &listener);
+      std::string body = unchunk(collect(pool, track));
+      std::vector<std::string> found = placemarks(body);
+      std::string joined;
+      for (size_t j = 0; j < found.size(); j++) {
+        joined += found[j];
+      }
+      bodies.push_back(joined);
+    }
+    CPPUNIT_ASSERT(!bodies[0].empty());
+    CPPUNIT_ASSERT(bodies[0] == bodies[1]);
+    CPPUNIT_ASSERT(bodies[0] == bodies[2]);
+  }
+
+  /**
+   * Nobody's sending, so the workers stop once they're as far ahead
+   * as they're allowed to be. Taking one lets them do one more.
+   */
+
+  void testReadAhead()
+  {
+    load();
+    std::vector<std::string> names;
+    cache.satelliteNames(names);
+    CPPUNIT_ASSERT(names.size() > 8);
+    KmlTrackPool pool(&cache, 2);
+    pool.start();
+    CountingListener listener;
+    KmlTrackPool::TrackPtr track = pool.submit(START, START + 3600.0, 60.0, true, true, &listener);
+    // The header's ready right away
+    KmlTrackPool::Chunk chunk;
+    bool finished;
+    CPPUNIT_ASSERT(pool.take(track, chunk, finished));
+    CPPUNIT_ASSERT(0 == chunk->find("HTTP/1.1 200 OK"));
+    boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+    int ahead = 2 + KmlTrackPool::READ_AHEAD;
+    CPPUNIT_ASSERT_EQUAL(ahead, (int) listener.calls);
+
+    CPPUNIT_ASSERT(pool.take(track, chunk, finished));
+    CPPUNIT_ASSERT(!finished);
+    boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+    CPPUNIT_ASSERT_EQUAL(ahead + 1, (int) listener.calls);
+    collect(pool, track);
+    CPPUNIT_ASSERT_EQUAL((int) names.size(), (int) listener.calls);
+  }
+
+  /**
+   * Cancelled tracks don't hold up anybody else, and their listener
+   * doesn't hear about them again
+   */
+
+  void testCancel()
+  {
+    load();
+    KmlTrackPool pool(&cache, 2);
+    pool.start();
+    CountingListener cancelled;
+    KmlTrackPool::TrackPtr track = pool.submit(START, START + 86400.0, 30.0, true, true, &cancelled);
+    pool.cancel(track);
+    int calls = cancelled.calls;
+
+    CountingListener listener;
+    KmlTrackPool::TrackPtr other = pool.submit(START, START + 3600.0, 60.0, true, true, &listener);
+    std::string body = unchunk(collect(pool, other));
+    CPPUNIT_ASSERT(!placemarks(body).empty());
+    pool.stop();
+    CPPUNIT_ASSERT_EQUAL(calls, (int) cancelled.calls);
+    KmlTrackPool::Chunk chunk;
+    bool finished;
+    CPPUNIT_ASSERT(!pool.take(track, chunk, finished));
+  }
+
+  /**
+   * For HTTP/1.0, no chunks and no keeping the connection. Nothing
+   * in the range still gets a document.
+   */
+
+  void testUnchunked()
+  {
+    load();
+    KmlTrackPool pool(&cache, 2);
+    pool.start();
+    CountingListener listener;
+    KmlTrackPool::TrackPtr track = pool.submit(START - 86400.0 * 365, START - 86400.0 * 364, 60.0, false, true, &listener);
+    std::string response = collect(pool, track);
+    CPPUNIT_ASSERT(0 == response.find("HTTP/1.0 200 OK\r\n"));
+    CPPUNIT_ASSERT(std::string::npos == response.find("Transfer-Encoding"));
+    CPPUNIT_ASSERT(std::string::npos != response.find("Connection: close\r\n\r\n<?xml"));
+    CPPUNIT_ASSERT(std::string::npos == response.find("<Placemark>"));
+    CPPUNIT_ASSERT(response.size() - 7 == response.rfind("</kml>\n"));
+  }
+
+};
+
+const double KmlTrackPoolTest::START = 1317427200.0;
+
+CPPUNIT_TEST_SUITE_REGISTRATION(KmlTrackPoolTest);
@@ -0,0 +1,198 @@
+/**
+ * Check the KML writer's output and number formatting
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kml_writer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <cppunit/extensions/HelperMacros.h>
+
+class KmlWriterTest : public CppUnit::TestFixture {
+
+  CPPUNIT_TEST_SUITE(KmlWriterTest);
+  CPPUNIT_TEST(testFormatFixed);
+  CPPUNIT_TEST(testFormatMatchesPrintf);
+  CPPUNIT_TEST(testPlacemark);
+  CPPUNIT_TEST(testHeader);
+  CPPUNIT_TEST(testReuse);
+  CPPUNIT_TEST(testFormatTime);
+  CPPUNIT_TEST(testTrackPlacemark);
+  CPPUNIT_TEST(testStreamHeader);
+  CPPUNIT_TEST(testCsv);
+  CPPUNIT_TEST_SUITE_END();
+
+  std::string fixed(double value, int decimals)
+  {
+    char buffer[KmlWriter::MAX_NUMBER];
+    size_t length = KmlWriter::formatFixed(buffer, value, decimals);
+    return std::string(buffer, length);
+  }
+
+  std::string time(double value)
+  {
+    char buffer[KmlWriter::MAX_TIME];
+    size_t length = KmlWriter::formatTime(buffer, value);
+    return std::string(buffer, length);
+  }
+
+public:
+
+  void testFormatFixed()
+  {
+    CPPUNIT_ASSERT(fixed(0.0, 3) == "0.000");
+    CPPUNIT_ASSERT(fixed(1.5, 0) == "2");
+    CPPUNIT_ASSERT(fixed(42.0, 0) == "42");
+    CPPUNIT_ASSERT(fixed(-122.4194155, 7) == "-122.4194155");
+    CPPUNIT_ASSERT(fixed(0.05, 1) == "0.1");
+    CPPUNIT_ASSERT(fixed(-0.04, 1) == "0.0"); // No "-0.0"
+    CPPUNIT_ASSERT(fixed(20200000.1234, 3) == "20200000.123");
+    CPPUNIT_ASSERT(fixed(9.9999999, 3) == "10.000");
+    CPPUNIT_ASSERT(fixed(1e300, 3) == "1.0000000000000001e+300");
+  }
+
+  void testFormatMatchesPrintf()
+  {
+    srand(1);
+    for (int i = 0; i < 100000; i++) {
+      double value = ((double) rand() / RAND_MAX - 0.5) * 360.0;
+      char expected[64];
+      snprintf(expected, sizeof(expected), "%.7f", value);
+      std::string got = fixed(value, 7);
+      // Off by one in the last place at most, when it's right on a half
+      double diff = atof(got.c_str()) - atof(expected);
+      CPPUNIT_ASSERT(diff < 1.5e-7 && diff > -1.5e-7);
+      CPPUNIT_ASSERT(got.size() == strlen(expected) || got.size() + 1 == strlen(expected) || got.size() == strlen(expected) + 1);
+    }
+  }
+
+  void testPlacemark()
+  {
+    KmlWriter kml;
+    kml.placemark("G<1>", -80.5, 25.25, 20200000.0);
+    std::string out(kml.data(), kml.size());
+    // Longitude comes first
+    CPPUNIT_ASSERT(std::string::npos != out.find("<coordinates>-80.5000000,25.2500000,20200000.000</coordinates>"));
+    CPPUNIT_ASSERT(std::string::npos != out.find("<name>G&lt;1&gt;</name>"));
+  }
+
+  void testHeader()
+  {
+    KmlWriter kml;
+    kml.beginDocument();
+    kml.placemark("G01", 1.0, 2.0, 3.0);
+    kml.endDocument();
+    kml.httpHeader(true);
+    std::string header(kml.headerData(), kml.headerSize());
+    char expected[64];
+    snprintf(expected, sizeof(expected), "Content-Length: %lu\r\n", (unsigned long) kml.size());
+    CPPUNIT_ASSERT(0 == header.find("HTTP/1.1 200 OK\r\n"));
+    CPPUNIT_ASSERT(std::string::npos != header.find(expected));
+    CPPUNIT_ASSERT(std::string::npos != header.find("Connection: keep-alive\r\n\r\n"));
+    kml.httpHeader(false);
+    header = std::string(kml.headerData(), kml.headerSize());
+    CPPUNIT_ASSERT(std::string::npos != header.find("Connection: close\r\n\r\n"));
+  }
+
+  void testReuse()
+  {
+    KmlWriter kml;
+    for (int i = 0; i < 1000; i++) {
+      kml.placemark("G01", 1.0, 2.0, 3.0);
+    }
+    size_t big = kml.size();
+    const char *buffer = kml.data();
+    kml.clear();
+    CPPUNIT_ASSERT_EQUAL((size_t) 0, kml.size());
+    for (int i = 0; i < 1000; i++) {
+      kml.placemark("G01", 1.0, 2.0, 3.0);
+    }
+    // Same size, same memory, nothing reallocated
+    CPPUNIT_ASSERT_EQUAL(big, kml.size());
+    CPPUNIT_ASSERT(buffer == kml.data());
+  }
+
+  void testFormatTime()
+  {
+    CPPUNIT_ASSERT(time(0.0) == "1970-01-01T00:00:00Z");
+    CPPUNIT_ASSERT(time(1317427200.0) == "2011-10-01T00:00:00Z");
+    CPPUNIT_ASSERT(time(1317427200.0 + 86399.0) == "2011-10-01T23:59:59Z");
+    CPPUNIT_ASSERT(time(951782400.0) == "2000-02-29T00:00:00Z");
+    CPPUNIT_ASSERT(time(1317427200.25) == "2011-10-01T00:00:00.250Z");
+    // Rounds up into the next second
+    CPPUNIT_ASSERT(time(1317427200.9999) == "2011-10-01T00:00:01Z");
+  }
+
+  void testTrackPlacemark()
+  {
+    KmlWriter kml;
+    double times[] = { 1317427200.0, 1317427230.0 };
+    double lon[] = { -80.5, -80.25 };
+    double lat[] = { 25.25, 25.5 };
+    double alt[] = { 20200000.0, 20200001.0 };
+    kml.trackPlacemark("G&1", times, lon, lat, alt, 2);
+    std::string out(kml.data(), kml.size());
+    CPPUNIT_ASSERT(std::string::npos != out.find("<name>G&amp;1</name>"));
+    CPPUNIT_ASSERT(std::string::npos != out.find("<TimeSpan><begin>2011-10-01T00:00:00Z</begin><end>2011-10-01T00:00:30Z</end></TimeSpan>"));
+    // All the times, then all the places
+    size_t lastWhen = out.find("<when>2011-10-01T00:00:30Z</when>");
+    size_t firstCoord = out.find("<gx:coord>-80.5000000 25.2500000 20200000.000</gx:coord>");
+    CPPUNIT_ASSERT(std::string::npos != lastWhen);
+    CPPUNIT_ASSERT(std::string::npos != firstCoord);
+    CPPUNIT_ASSERT(lastWhen < firstCoord);
+    CPPUNIT_ASSERT(std::string::npos != out.find("<gx:coord>-80.2500000 25.5000000 20200001.000</gx:coord>"));
+    // Nothing to say, nothing written
+    kml.clear();
+    kml.trackPlacemark("G01", times, lon, lat, alt, 0);
+    CPPUNIT_ASSERT_EQUAL((size_t) 0, kml.size());
+  }
+
+  void testStreamHeader()
+  {
+    KmlWriter kml;
+    kml.streamHeader(true, true);
+    std::string header(kml.headerData(), kml.headerSize());
+    CPPUNIT_ASSERT(0 == header.find("HTTP/1.1 200 OK\r\n"));
+    CPPUNIT_ASSERT(std::string::npos != header.find("Transfer-Encoding: chunked\r\n"));
+    CPPUNIT_ASSERT(std::string::npos == header.find("Content-Length"));
+    CPPUNIT_ASSERT(header.size() - 26 == header.find("Connection: keep-alive\r\n\r\n"));
+    // Without chunks the only way to say it's done is to hang up
+    kml.streamHeader(false, true);
+    header = std::string(kml.headerData(), kml.headerSize());
+    CPPUNIT_ASSERT(0 == header.find("HTTP/1.0 200 OK\r\n"));
+    CPPUNIT_ASSERT(std::string::npos == header.find("Transfer-Encoding"));
+    CPPUNIT_ASSERT(std::string::npos != header.find("Connection: close\r\n\r\n"));
+  }
+
+  void testCsv()
+  {
+    KmlWriter kml;
+    kml.beginCsv();
+    kml.csvRow("G01", 1317427200.0, -80.5, 25.25, 20200000.0);
+    std::string out(kml.data(), kml.size());
+    CPPUNIT_ASSERT(out == "name,time,longitude,latitude,altitude\n"
+                   "G01,2011-10-01T00:00:00Z,-80.5000000,25.2500000,20200000.000\n");
+    kml.httpHeader(true, true);
+    std::string header(kml.headerData(), kml.headerSize());
+    CPPUNIT_ASSERT(std::string::npos != header.find("Content-Type: text/csv\r\n"));
+    kml.httpHeader(true);
+    header = std::string(kml.headerData(), kml.headerSize());
+    CPPUNIT_ASSERT(std::string::npos != header.find("Content-Type: application/vnd.google-earth.kml+xml\r\n"));
+  }
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(KmlWriterTest);
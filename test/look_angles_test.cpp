@@ -0,0 +1,282 @@
+/**
+ * Check the batch look angles against doing it the long way, one
+ * observer and satellite at a time, on every instruction set this
+ * CPU can run.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "coordinates.h"
+#include "ephemeris_cache.h"
+#include "look_angles.h"
+#include "sp3_loader.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <cppunit/extensions/HelperMacros.h>
+
+class LookAnglesTest : public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(LookAnglesTest);
+  CPPUNIT_TEST(testAgainstReference);
+  CPPUNIT_TEST(testMask);
+  CPPUNIT_TEST(testKnownGeometry);
+  CPPUNIT_TEST(testOddCounts);
+  CPPUNIT_TEST(testLoadSatellites);
+  CPPUNIT_TEST_SUITE_END();
+
+  enum { OBSERVERS = 203, SATELLITES = 32 };
+
+  std::vector<double> lats, lons, alts;
+  std::vector<std::string> names;
+  std::vector<double> sx, sy, sz;
+
+  double random(double low, double high)
+  {
+    return low + (high - low) * ((double) rand() / RAND_MAX);
+  }
+
+  void makeScenario()
+  {
+    srand(11);
+    lats.clear();
+    lons.clear();
+    alts.clear();
+    for (int i = 0; i < OBSERVERS; i++) {
+      lats.push_back(random(-89.0, 89.0));
+      lons.push_back(random(-180.0, 180.0));
+      alts.push_back(random(-100.0, 4000.0));
+    }
+    names.clear();
+    sx.clear();
+    sy.clear();
+    sz.clear();
+    for (int i = 0; i < SATELLITES; i++) {
+      char name[8];
+      snprintf(name, sizeof(name), "G%02d", i + 1);
+      names.push_back(name);
+      Latlong ll(random(-55.0, 55.0), random(-180.0, 180.0), 20200000.0);
+      Ecef ecef(ll);
+      sx.push_back(ecef.getX());
+      sy.push_back(ecef.getY());
+      sz.push_back(ecef.getZ());
+    }
+  }
+
+  void addScenario(LookAngles &angles)
+  {
+    for (size_t i = 0; i < lats.size(); i++) {
+      char name[16];
+      snprintf(name, sizeof(name), "site%d", (int) i);
+      angles.addObserver(name, lats[i], lons[i], alts[i]);
+    }
+    angles.setSatellites(names, sx, sy, sz);
+  }
+
+  /**
+   * One pair the straightforward way
+   */
+
+  void reference(size_t observer, size_t satellite, double &az, double &el, double &range)
+  {
+    Latlong ll(lats[observer], lons[observer], alts[observer]);
+    Ecef site(ll);
+    double dx = sx[satellite] - site.getX();
+    double dy = sy[satellite] - site.getY();
+    double dz = sz[satellite] - site.getZ();
+    double lat = lats[observer] * M_PI / 180.0;
+    double lon = lons[observer] * M_PI / 180.0;
+    double east = -sin(lon) * dx + cos(lon) * dy;
+    double north = -sin(lat) * cos(lon) * dx - sin(lat) * sin(lon) * dy + cos(lat) * dz;
+    double up = cos(lat) * cos(lon) * dx + cos(lat) * sin(lon) * dy + sin(lat) * dz;
+    range = sqrt(dx * dx + dy * dy + dz * dz);
+    el = asin(up / range) * 180.0 / M_PI;
+    az = atan2(east, north) * 180.0 / M_PI;
+    if (az < 0.0) {
+      az += 360.0;
+    }
+  }
+
+  /**
+   * Every pair over the mask shows up exactly once with the right
+   * angles, and nothing under it does
+   */
+
+  void checkAgainstReference(LookAngles::Implementation use, double mask)
+  {
+    LookAngles angles(use);
+    addScenario(angles);
+    LookAngleResults results;
+    size_t found = angles.compute(mask, results);
+    CPPUNIT_ASSERT_EQUAL(found, results.size());
+    CPPUNIT_ASSERT_EQUAL(found, results.satellite.size());
+    CPPUNIT_ASSERT_EQUAL(found, results.range.size());
+
+    std::vector<int> seen(OBSERVERS * SATELLITES, 0);
+    for (size_t i = 0; i < found; i++) {
+      size_t o = results.observer[i];
+      size_t s = results.satellite[i];
+      CPPUNIT_ASSERT(o < OBSERVERS && s < SATELLITES);
+      seen[s * OBSERVERS + o]++;
+      double az, el, range;
+      reference(o, s, az, el, range);
+      CPPUNIT_ASSERT(results.elevation[i] >= mask);
+      CPPUNIT_ASSERT(results.azimuth[i] >= 0.0 && results.azimuth[i] < 360.0);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(range, results.range[i], 1e-6);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(el, results.elevation[i], 1e-9);
+      // Right under the satellite the azimuth doesn't mean much
+      if (el < 89.9) {
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(az, results.azimuth[i], 1e-9);
+      }
+    }
+    for (size_t s = 0; s < SATELLITES; s++) {
+      for (size_t o = 0; o < OBSERVERS; o++) {
+        double az, el, range;
+        reference(o, s, az, el, range);
+        if (fabs(el - mask) > 1e-9) {
+          CPPUNIT_ASSERT_EQUAL(el > mask ? 1 : 0, seen[s * OBSERVERS + o]);
+        }
+      }
+    }
+  }
+
+public:
+
+  void testAgainstReference()
+  {
+    makeScenario();
+    LookAngles::Implementation all[] = { LookAngles::SCALAR, LookAngles::AVX2, LookAngles::AVX512, LookAngles::AUTO };
+    for (int i = 0; i < 4; i++) {
+      if (LookAngles::supported(all[i])) {
+        checkAgainstReference(all[i], 10.0);
+        checkAgainstReference(all[i], 0.0);
+        checkAgainstReference(all[i], -90.0);
+      }
+    }
+  }
+
+  void testMask()
+  {
+    makeScenario();
+    LookAngles angles;
+    addScenario(angles);
+    LookAngleResults results;
+    // Everything is over -90 degrees, and half of them or so are
+    // over the horizon
+    CPPUNIT_ASSERT_EQUAL((size_t) OBSERVERS * SATELLITES, angles.compute(-90.0, results));
+    size_t horizon = angles.compute(0.0, results);
+    CPPUNIT_ASSERT(horizon > 0 && horizon < (size_t) OBSERVERS * SATELLITES);
+    size_t high = angles.compute(45.0, results);
+    CPPUNIT_ASSERT(high < horizon);
+    CPPUNIT_ASSERT_EQUAL((size_t) 0, angles.compute(90.1, results));
+  }
+
+  void testKnownGeometry()
+  {
+    LookAngles::Implementation all[] = { LookAngles::SCALAR, LookAngles::AVX2, LookAngles::AVX512 };
+    for (int i = 0; i < 3; i++) {
+      if (!LookAngles::supported(all[i])) {
+        continue;
+      }
+      LookAngles angles(all[i]);
+      angles.addObserver("equator", 0.0, 0.0, 0.0);
+      std::vector<std::string> satellites;
+      std::vector<double> x, y, z;
+      // Straight up, off to the north, and off to the east
+      satellites.push_back("overhead");
+      x.push_back(6378137.0 + 20000000.0);
+      y.push_back(0.0);
+      z.push_back(0.0);
+      satellites.push_back("north");
+      x.push_back(6378137.0 + 1000.0);
+      y.push_back(0.0);
+      z.push_back(100000.0);
+      satellites.push_back("east");
+      x.push_back(6378137.0 + 1000.0);
+      y.push_back(100000.0);
+      z.push_back(0.0);
+      angles.setSatellites(satellites, x, y, z);
+
+      LookAngleResults results;
+      CPPUNIT_ASSERT_EQUAL((size_t) 3, angles.compute(0.0, results));
+      CPPUNIT_ASSERT_EQUAL(std::string("overhead"), angles.satelliteName(results.satellite[0]));
+      CPPUNIT_ASSERT_EQUAL(std::string("equator"), angles.observerName(results.observer[0]));
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(90.0, results.elevation[0], 1e-9);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(20000000.0, results.range[0], 1e-6);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(0.0, results.azimuth[1], 1e-9);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(90.0, results.azimuth[2], 1e-9);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(atan2(1000.0, 100000.0) * 180.0 / M_PI, results.elevation[2], 1e-9);
+    }
+  }
+
+  /**
+   * Observer counts that don't fill a row only get part of the last
+   * one, and the padding never shows up
+   */
+
+  void testOddCounts()
+  {
+    makeScenario();
+    for (size_t count = 0; count <= 17; count++) {
+      LookAngles angles;
+      LookAngles scalar(LookAngles::SCALAR);
+      for (size_t i = 0; i < count; i++) {
+        angles.addObserver("site", lats[i], lons[i], alts[i]);
+        scalar.addObserver("site", lats[i], lons[i], alts[i]);
+      }
+      angles.setSatellites(names, sx, sy, sz);
+      scalar.setSatellites(names, sx, sy, sz);
+      LookAngleResults results, expected;
+      CPPUNIT_ASSERT_EQUAL(count * SATELLITES, angles.compute(-90.0, results));
+      CPPUNIT_ASSERT_EQUAL(count * SATELLITES, scalar.compute(-90.0, expected));
+      for (size_t i = 0; i < results.size(); i++) {
+        CPPUNIT_ASSERT_EQUAL(expected.observer[i], results.observer[i]);
+        CPPUNIT_ASSERT_EQUAL(expected.satellite[i], results.satellite[i]);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(expected.elevation[i], results.elevation[i], 1e-10);
+      }
+    }
+  }
+
+  void testLoadSatellites()
+  {
+    EphemerisCache cache;
+    Sp3Loader loader;
+    CPPUNIT_ASSERT(loader.addPath("nga16556.eph"));
+    CPPUNIT_ASSERT(loader.load(cache, 1) > 0);
+    std::vector<std::string> all;
+    cache.satelliteNames(all);
+    CPPUNIT_ASSERT(!all.empty());
+
+    // 2011-10-01 03:00 UTC, a few hours into the file
+    double time = 1317427200.0 + 3 * 3600.0;
+    LookAngles angles;
+    angles.addObserver("Colorado Springs", 38.8, -104.8, 1840.0);
+    OrbitInterpolator interpolator;
+    size_t loaded = angles.loadSatellites(cache, time, interpolator);
+    CPPUNIT_ASSERT(loaded > 0);
+    CPPUNIT_ASSERT_EQUAL(loaded, angles.satelliteCount());
+
+    // A GPS constellation always has a handful over the horizon
+    LookAngleResults results;
+    size_t visible = angles.compute(0.0, results);
+    CPPUNIT_ASSERT(visible >= 4 && visible < loaded);
+    for (size_t i = 0; i < visible; i++) {
+      CPPUNIT_ASSERT(results.range[i] > 19000000.0 && results.range[i] < 27000000.0);
+    }
+  }
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(LookAnglesTest);
@@ -0,0 +1,205 @@
+/**
+ * Tests for the node allocators, and the trees sitting on them.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "btree.h"
+#include "node_allocator.h"
+#include "time_tree.h"
+#include <set>
+#include <stdlib.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+/**
+ * A value that keeps count of how many of it there are, to make sure
+ * tearing a tree down runs every destructor.
+ */
+
+class Counted {
+ public:
+  static int alive;
+  int value;
+
+  Counted(int value = 0) : value(value)
+  {
+    alive++;
+  }
+
+  Counted(const Counted &other) : value(other.value)
+  {
+    alive++;
+  }
+
+  ~Counted()
+  {
+    alive--;
+  }
+
+  bool operator==(const Counted &other) const
+  {
+    return value == other.value;
+  }
+
+  bool operator!=(const Counted &other) const
+  {
+    return value != other.value;
+  }
+};
+
+int Counted::alive = 0;
+
+/**
+ * Lets the test see how many nodes the tree has out
+ */
+
+template <typename Allocator>
+class CountingTree : public Btree<int, int, Allocator> {
+ public:
+  CountingTree() : Btree<int, int, Allocator>(-1)
+  {
+  }
+
+  size_t allocated()
+  {
+    return this->nodes.allocated();
+  }
+};
+
+class NodeAllocatorTest : public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(NodeAllocatorTest);
+  CPPUNIT_TEST(testArena);
+  CPPUNIT_TEST(testBigTree);
+  CPPUNIT_TEST(testDestructors);
+  CPPUNIT_TEST(testDuplicate);
+  CPPUNIT_TEST(testTimeTree);
+  CPPUNIT_TEST_SUITE_END();
+
+  /**
+   * Fill tree with count different random keys, and remember them
+   */
+
+  template <typename Tree>
+  void fill(Tree &tree, int count, std::set<int> &keys)
+  {
+    srand(3);
+    while ((int) keys.size() < count) {
+      int key = rand();
+      if (keys.insert(key).second) {
+        tree.add(key, key / 2);
+      }
+    }
+  }
+
+public:
+
+  void testArena()
+  {
+    NodeArena arena(40);
+    std::set<void *> seen;
+    for (int i = 0; i < 960; i++) {
+      void *node = arena.allocate();
+      CPPUNIT_ASSERT(seen.insert(node).second);
+      CPPUNIT_ASSERT((size_t) node % (2 * sizeof(void *)) == 0);
+    }
+    CPPUNIT_ASSERT_EQUAL((size_t) 960, arena.allocated());
+    // 64 + 128 + 256 + 512 nodes
+    CPPUNIT_ASSERT_EQUAL((size_t) 4, arena.slabCount());
+
+    // Freed nodes get handed out again before any new ones
+    void *freed = *seen.begin();
+    arena.deallocate(freed);
+    CPPUNIT_ASSERT_EQUAL((size_t) 959, arena.allocated());
+    CPPUNIT_ASSERT(freed == arena.allocate());
+
+    arena.releaseAll();
+    CPPUNIT_ASSERT_EQUAL((size_t) 0, arena.allocated());
+    CPPUNIT_ASSERT_EQUAL((size_t) 0, arena.slabCount());
+    arena.allocate();
+    CPPUNIT_ASSERT_EQUAL((size_t) 1, arena.slabCount());
+  }
+
+  void testBigTree()
+  {
+    std::set<int> keys;
+    CountingTree<NodeArena> tree;
+    fill(tree, 200000, keys);
+    CPPUNIT_ASSERT_EQUAL(keys.size(), tree.allocated());
+    std::set<int>::iterator key = keys.begin();
+    int removed = 0;
+    while (key != keys.end()) {
+      CPPUNIT_ASSERT_EQUAL(*key / 2, tree.find(*key));
+      if (removed < 1000) {
+        CPPUNIT_ASSERT_EQUAL(*key / 2, tree.remove(*key));
+        CPPUNIT_ASSERT_EQUAL(-1, tree.find(*key));
+        removed++;
+      }
+      key++;
+    }
+    CPPUNIT_ASSERT_EQUAL(keys.size() - removed, tree.allocated());
+  }
+
+  void testDestructors()
+  {
+    Counted::alive = 0;
+    {
+      Btree<int, Counted> arena((Counted(-1)));
+      Btree<int, Counted, NodeHeap> heap((Counted(-1)));
+      for (int i = 0; i < 5000; i++) {
+        arena.add(i, Counted(i));
+        heap.add(i, Counted(i));
+      }
+      CPPUNIT_ASSERT_EQUAL(10002, Counted::alive);
+      CPPUNIT_ASSERT(Counted(17) == arena.remove(17));
+      CPPUNIT_ASSERT(Counted(17) == heap.remove(17));
+      CPPUNIT_ASSERT_EQUAL(10000, Counted::alive);
+    }
+    CPPUNIT_ASSERT_EQUAL(0, Counted::alive);
+  }
+
+  /**
+   * Adding a key that's already there throws, and shouldn't leave a
+   * node behind
+   */
+
+  void testDuplicate()
+  {
+    CountingTree<NodeArena> tree;
+    tree.add(1, 1);
+    tree.add(2, 2);
+    CPPUNIT_ASSERT_THROW(tree.add(2, 3), std::string);
+    CPPUNIT_ASSERT_EQUAL((size_t) 2, tree.allocated());
+    CPPUNIT_ASSERT_EQUAL(2, tree.find(2));
+  }
+
+  void testTimeTree()
+  {
+    TimeTree<int, int> arena(0);
+    TimeTree<int, int, DefaultTimeTreeDeallocator<int>, NodeHeap> heap(0);
+    for (int i = 2; i <= 2000; i += 2) {
+      arena.add(i, i);
+      heap.add(i, i);
+    }
+    for (int i = 2; i <= 2001; i++) {
+      CPPUNIT_ASSERT_EQUAL(i & ~1, arena.find(i));
+      CPPUNIT_ASSERT_EQUAL(i & ~1, heap.find(i));
+    }
+    CPPUNIT_ASSERT_EQUAL(0, arena.find(1));
+    // An empty one has to go away quietly too
+    TimeTree<int, int> empty(0);
+  }
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(NodeAllocatorTest);
@@ -0,0 +1,167 @@
+/**
+ * Tests for the orbit interpolator. These build a circular orbit at
+ * about GPS altitude, where we know exactly where the satellite is
+ * at any time, sample it every 15 minutes like an NGA file does and
+ * check the interpolated positions against the real ones.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "orbit_interpolator.h"
+#include "ephemeris_cache.h"
+#include <math.h>
+#include <string>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class OrbitInterpolatorTest : public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(OrbitInterpolatorTest);
+
+  CPPUNIT_TEST(testLagrange);
+  CPPUNIT_TEST(testHermite);
+  CPPUNIT_TEST(testOnEpoch);
+  CPPUNIT_TEST(testOutside);
+  CPPUNIT_TEST(testSharedGrid);
+
+  CPPUNIT_TEST_SUITE_END();
+
+  EphemerisCache *cache;
+  std::string name;
+
+  /**
+   * Where the test satellite is at time t. Velocities come out in
+   * the same units Sp3Reader stores them in.
+   */
+
+  static EphemerisLine orbit(double t, double phase = 0.0)
+  {
+    double radius = 26560000.0;
+    double rate = 2.0 * M_PI / 43082.0;
+    double tilt = 55.0 * M_PI / 180.0;
+    double a = rate * t + phase;
+    double scale = OrbitInterpolator::sp3VelocityScale();
+    return EphemerisLine(radius * cos(a), radius * sin(a) * cos(tilt), radius * sin(a) * sin(tilt),
+                         -radius * rate * sin(a) / scale,
+                         radius * rate * cos(a) * cos(tilt) / scale,
+                         radius * rate * cos(a) * sin(tilt) / scale, t);
+  }
+
+  static double positionError(EphemerisLine &lhs, EphemerisLine &rhs)
+  {
+    double x = lhs.getPosition().getX() - rhs.getPosition().getX();
+    double y = lhs.getPosition().getY() - rhs.getPosition().getY();
+    double z = lhs.getPosition().getZ() - rhs.getPosition().getZ();
+    return sqrt(x * x + y * y + z * z);
+  }
+
+  static double velocityError(EphemerisLine &lhs, EphemerisLine &rhs)
+  {
+    double x = lhs.getDx() - rhs.getDx();
+    double y = lhs.getDy() - rhs.getDy();
+    double z = lhs.getDz() - rhs.getDz();
+    return sqrt(x * x + y * y + z * z) * OrbitInterpolator::sp3VelocityScale();
+  }
+
+  /**
+   * Worst position and velocity error over one day at 1 Hz-ish
+   * (every 7 seconds, to keep the test quick.)
+   */
+
+  void worstError(OrbitInterpolator &interpolator, double &position, double &velocity)
+  {
+    EphemerisLine result(0, 0, 0, 0, 0, 0);
+    position = velocity = 0.0;
+    for (double t = 0.0; t <= 86400.0; t += 7.0) {
+      CPPUNIT_ASSERT(cache->interpolate(name, t, result, interpolator));
+      EphemerisLine expected = orbit(t);
+      CPPUNIT_ASSERT(result.getTime() == t);
+      position = fmax(position, positionError(result, expected));
+      velocity = fmax(velocity, velocityError(result, expected));
+    }
+  }
+
+public:
+
+  void setUp()
+  {
+    name = "1";
+    cache = new EphemerisCache();
+    for (double t = 0.0; t <= 86400.0; t += 900.0) {
+      cache->add(name, new EphemerisLine(orbit(t)));
+      cache->add("2", new EphemerisLine(orbit(t, 1.0)));
+    }
+  }
+
+  void tearDown()
+  {
+    delete cache;
+  }
+
+  void testLagrange()
+  {
+    for (int points = 9; points <= 11; points++) {
+      OrbitInterpolator interpolator(OrbitInterpolator::LAGRANGE, points);
+      double position, velocity;
+      worstError(interpolator, position, velocity);
+      CPPUNIT_ASSERT(position < 0.01);
+      CPPUNIT_ASSERT(velocity < 0.0001);
+    }
+  }
+
+  void testHermite()
+  {
+    OrbitInterpolator interpolator(OrbitInterpolator::HERMITE, 6);
+    double position, velocity;
+    worstError(interpolator, position, velocity);
+    CPPUNIT_ASSERT(position < 0.01);
+    CPPUNIT_ASSERT(velocity < 0.0001);
+  }
+
+  void testOnEpoch()
+  {
+    EphemerisLine result(0, 0, 0, 0, 0, 0);
+    CPPUNIT_ASSERT(cache->interpolate(name, 1800.0, result));
+    CPPUNIT_ASSERT(equalish(0.000001, result, *cache->get(name, 1800.0)));
+  }
+
+  void testOutside()
+  {
+    EphemerisLine result(0, 0, 0, 0, 0, 0);
+    CPPUNIT_ASSERT(!cache->interpolate(name, -1.0, result));
+    CPPUNIT_ASSERT(!cache->interpolate(name, 86401.0, result));
+    CPPUNIT_ASSERT(!cache->interpolate("Nope", 100.0, result));
+  }
+
+  /**
+   * Reusing weights across satellites had better give the same
+   * answer as starting from scratch.
+   */
+
+  void testSharedGrid()
+  {
+    OrbitInterpolator shared(OrbitInterpolator::HERMITE, 4);
+    EphemerisLine first(0, 0, 0, 0, 0, 0);
+    EphemerisLine second(0, 0, 0, 0, 0, 0);
+    EphemerisLine fresh(0, 0, 0, 0, 0, 0);
+    CPPUNIT_ASSERT(cache->interpolate(name, 4321.0, first, shared));
+    CPPUNIT_ASSERT(cache->interpolate("2", 4321.0, second, shared));
+    OrbitInterpolator other(OrbitInterpolator::HERMITE, 4);
+    CPPUNIT_ASSERT(cache->interpolate("2", 4321.0, fresh, other));
+    CPPUNIT_ASSERT(second == fresh);
+    CPPUNIT_ASSERT(first != second);
+  }
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(OrbitInterpolatorTest);
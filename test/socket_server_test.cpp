@@ -72,7 +72,7 @@ public:
     }
 
     sockaddr_in addr;
-    inet_pton(AF_INET, "127.0.0.1", &addr);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
     addr.sin_port = htons(12345);
     addr.sin_family = AF_INET;
 
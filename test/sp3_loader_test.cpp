@@ -0,0 +1,153 @@
+/**
+ * Tests for the parallel SP3 loader.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sp3_loader.h"
+#include <cppunit/extensions/HelperMacros.h>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+class Sp3LoaderTest : public CppUnit::TestFixture, public Sp3RecordListener {
+
+  CPPUNIT_TEST_SUITE(Sp3LoaderTest);
+  CPPUNIT_TEST(testSameFileTwice);
+  CPPUNIT_TEST(testDirectory);
+  CPPUNIT_TEST(testRepeatsInOneFile);
+  CPPUNIT_TEST_SUITE_END();
+
+  size_t recordCount;
+  std::string directory;
+
+  /**
+   * A tiny SP3 file with one satellite at two epochs, starting
+   * at hour, with x set to value so we can tell them apart.
+   */
+
+  void writeFile(const std::string &name, int hour, double value)
+  {
+    std::ofstream out((directory + "/" + name).c_str());
+    for (int i = 0; i < 2; i++) {
+      out << "*  2011 10  1 " << (hour + i) << "  0   .00000000" << std::endl;
+      out << "P  1" << std::fixed << std::setprecision(6) << std::setw(14) << value << "  13635.225244 -20730.158212     -4.783560" << std::endl;
+      out << "V  1 -26090.984781   3407.283545  -9719.569472      -.016818" << std::endl;
+    }
+    out << "EOF" << std::endl;
+  }
+
+public:
+
+  void setUp()
+  {
+    recordCount = 0;
+    char buffer[] = "/tmp/sp3_loader_testXXXXXX";
+    directory = mkdtemp(buffer);
+  }
+
+  void tearDown()
+  {
+    unlink((directory + "/a.eph").c_str());
+    unlink((directory + "/b.eph").c_str());
+    unlink((directory + "/c.eph").c_str());
+    rmdir(directory.c_str());
+  }
+
+  void notify(std::vector<Sp3Record> &records)
+  {
+    recordCount += records.size();
+  }
+
+  void testSameFileTwice()
+  {
+    Sp3MappedReader reader("nga16556.eph", this);
+    reader.read();
+
+    EphemerisCache cache;
+    Sp3Loader loader;
+    CPPUNIT_ASSERT(loader.addPath("nga16556.eph"));
+    CPPUNIT_ASSERT(loader.addPath("nga16556.eph"));
+    CPPUNIT_ASSERT(!loader.addPath("does_not_exist.eph"));
+    CPPUNIT_ASSERT(loader.load(cache, 2) == recordCount);
+    CPPUNIT_ASSERT(loader.duplicateCount() == recordCount);
+    CPPUNIT_ASSERT(loader.failedCount() == 0);
+    std::vector<std::string> names;
+    cache.satelliteNames(names);
+    CPPUNIT_ASSERT(names.size() == 32);
+
+    // Loading it again into the same cache should replace, not throw
+    CPPUNIT_ASSERT(loader.load(cache, 1) == recordCount);
+  }
+
+  /**
+   * a.eph covers hours 0 and 1, b.eph 1 and 2. b comes after a,
+   * so its hour 1 should win.
+   */
+
+  void testDirectory()
+  {
+    writeFile("a.eph", 0, 1000.0);
+    writeFile("b.eph", 1, 2000.0);
+    EphemerisCache cache;
+    Sp3Loader loader;
+    CPPUNIT_ASSERT(loader.addPath(directory));
+    CPPUNIT_ASSERT(loader.fileCount() == 2);
+    CPPUNIT_ASSERT(loader.load(cache, 4) == 3);
+    CPPUNIT_ASSERT(loader.duplicateCount() == 1);
+    double start = Sp3MappedReader::epochTime(2011, 10, 1, 0, 0, 0.0);
+    std::string name("1");
+    CPPUNIT_ASSERT(cache.get(name, start)->getPosition().getX() == 1000000.0);
+    CPPUNIT_ASSERT(cache.get(name, start + 3600)->getPosition().getX() == 2000000.0);
+    CPPUNIT_ASSERT(cache.get(name, start + 7200)->getPosition().getX() == 2000000.0);
+    CPPUNIT_ASSERT(cache.getDataInterval(name) == 3600.0);
+  }
+
+  /**
+   * Every epoch in c.eph shows up twice, x = minute then x = minute
+   * + 100. The second one is later in the file, so it should win
+   * every time, however the sort shuffles equal times.
+   */
+
+  void testRepeatsInOneFile()
+  {
+    std::ofstream out((directory + "/c.eph").c_str());
+    for (int minute = 0; minute < 60; minute++) {
+      for (int copy = 0; copy < 2; copy++) {
+        out << "*  2011 10  1  0 " << minute << "   .00000000" << std::endl;
+        out << "P  1" << std::fixed << std::setprecision(6) << std::setw(14) << (double) (minute + copy * 100) << "  13635.225244 -20730.158212     -4.783560" << std::endl;
+        out << "V  1 -26090.984781   3407.283545  -9719.569472      -.016818" << std::endl;
+      }
+    }
+    out << "EOF" << std::endl;
+    out.close();
+
+    EphemerisCache cache;
+    Sp3Loader loader;
+    CPPUNIT_ASSERT(loader.addPath(directory + "/c.eph"));
+    CPPUNIT_ASSERT(loader.load(cache, 1) == 60);
+    CPPUNIT_ASSERT(loader.duplicateCount() == 60);
+    double start = Sp3MappedReader::epochTime(2011, 10, 1, 0, 0, 0.0);
+    std::string name("1");
+    for (int minute = 0; minute < 60; minute++) {
+      CPPUNIT_ASSERT_EQUAL((minute + 100) * 1000.0, cache.get(name, start + minute * 60)->getPosition().getX());
+    }
+  }
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Sp3LoaderTest);
@@ -0,0 +1,173 @@
+/**
+ * Tests the memory mapped SP3 reader. The easiest way to know it's
+ * right is to read the same file with Sp3Reader and make sure we
+ * get exactly the same lines out of both.
+ *
+ * Copyright 2011 Bruce Ide
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sp3_mapped_reader.h"
+#include "sp3_reader.h"
+#include <cppunit/extensions/HelperMacros.h>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+class Sp3MappedReaderTest : public CppUnit::TestFixture, public EphemerisBuilderListener, public Sp3RecordListener {
+
+  CPPUNIT_TEST_SUITE(Sp3MappedReaderTest);
+  CPPUNIT_TEST(testSameAsSp3Reader);
+  CPPUNIT_TEST(testParseNumber);
+  CPPUNIT_TEST(testEpochTime);
+  CPPUNIT_TEST(testMissingFile);
+  CPPUNIT_TEST(testBadEpoch);
+  CPPUNIT_TEST_SUITE_END();
+
+  std::vector<EphemerisLine> expectedLines;
+  std::vector<std::string> expectedNames;
+  std::vector<Sp3Record> records;
+  int batches;
+
+public:
+
+  void setUp()
+  {
+    batches = 0;
+  }
+
+  void notify(EphemerisLine &data, std::string &satelliteName)
+  {
+    expectedLines.push_back(data);
+    expectedNames.push_back(satelliteName);
+  }
+
+  void notify(std::vector<Sp3Record> &batch)
+  {
+    records.insert(records.end(), batch.begin(), batch.end());
+    batches++;
+  }
+
+  void testSameAsSp3Reader()
+  {
+    EphemerisLineBuilder builder;
+    builder.registerListener(this);
+    Sp3Reader reader("nga16556.eph", &builder);
+    reader.read();
+
+    Sp3MappedReader mapped("nga16556.eph", this, 100);
+    CPPUNIT_ASSERT(mapped.read());
+    CPPUNIT_ASSERT(expectedLines.size() > 0);
+    CPPUNIT_ASSERT(records.size() == expectedLines.size());
+    CPPUNIT_ASSERT(batches == (int) (records.size() + 99) / 100);
+    for (size_t i = 0; i < records.size(); i++) {
+      EphemerisLine line = records[i].line();
+      CPPUNIT_ASSERT(records[i].name() == expectedNames[i]);
+      CPPUNIT_ASSERT(line == expectedLines[i]);
+      CPPUNIT_ASSERT(line.getTime() == expectedLines[i].getTime());
+    }
+  }
+
+  void testParseNumber()
+  {
+    std::string fields[] = { "  13635.225244", "-20730.158212 ", "     -.016818", "   .00000000", "2011", "+1.5" };
+    double expected[] = { 13635.225244, -20730.158212, -.016818, 0.0, 2011.0, 1.5 };
+    for (int i = 0; i < 6; i++) {
+      double value;
+      const char *start = fields[i].c_str();
+      CPPUNIT_ASSERT(Sp3MappedReader::parseNumber(start, start + fields[i].size(), value));
+      CPPUNIT_ASSERT(value == expected[i]);
+    }
+    std::string bad[] = { "      ", " 12x4", "-" };
+    for (int i = 0; i < 3; i++) {
+      double value;
+      const char *start = bad[i].c_str();
+      CPPUNIT_ASSERT(!Sp3MappedReader::parseNumber(start, start + bad[i].size(), value));
+    }
+  }
+
+  /**
+   * Check the date arithmetic against timegm over a range that
+   * includes some leap years and a century that isn't one.
+   */
+
+  void testEpochTime()
+  {
+    for (int year = 1899; year <= 2101; year += 3) {
+      for (int month = 1; month <= 12; month++) {
+        int days[] = { 1, 28, 29 };
+        for (int d = 0; d < 3; d++) {
+          struct tm convertTime;
+          memset(&convertTime, '\0', sizeof(struct tm));
+          convertTime.tm_year = year - 1900;
+          convertTime.tm_mon = month - 1;
+          convertTime.tm_mday = days[d];
+          convertTime.tm_hour = 13;
+          convertTime.tm_min = 45;
+          convertTime.tm_sec = 30;
+          double expected = (double) timegm(&convertTime) + 0.25;
+          CPPUNIT_ASSERT(Sp3MappedReader::epochTime(year, month, days[d], 13, 45, 30.25) == expected);
+        }
+      }
+    }
+  }
+
+  void testMissingFile()
+  {
+    Sp3MappedReader mapped("does_not_exist.eph", this);
+    CPPUNIT_ASSERT(!mapped.read());
+    CPPUNIT_ASSERT(records.empty());
+  }
+
+  /**
+   * Records under an epoch line that doesn't read (or before any
+   * epoch line) get dropped and counted, not given the last good
+   * epoch's time.
+   */
+
+  void testBadEpoch()
+  {
+    char filename[] = "/tmp/sp3_mapped_reader_testXXXXXX";
+    int fdes = mkstemp(filename);
+    const char *text =
+      "P  3   9499.209153  13635.225244 -20730.158212     -4.783560\n"
+      "V  3 -26090.984781   3407.283545  -9719.569472      -.016818\n"
+      "*  2011 10  1  0  0   .00000000\n"
+      "P  1   9499.209153  13635.225244 -20730.158212     -4.783560\n"
+      "V  1 -26090.984781   3407.283545  -9719.569472      -.016818\n"
+      "*  2011 10  1  0 1x   .00000000\n"
+      "P  1   9499.209153  13635.225244 -20730.158212     -4.783560\n"
+      "V  1 -26090.984781   3407.283545  -9719.569472      -.016818\n"
+      "P  2  14281.651964 -14148.133525  17177.701859    358.657622\n"
+      "V  2 -26090.984781   3407.283545  -9719.569472      -.016818\n"
+      "*  2011 10  1  0 30   .00000000\n"
+      "P  1   9499.209153  13635.225244 -20730.158212     -4.783560\n"
+      "V  1 -26090.984781   3407.283545  -9719.569472      -.016818\n";
+    CPPUNIT_ASSERT(write(fdes, text, strlen(text)) == (ssize_t) strlen(text));
+    close(fdes);
+
+    Sp3MappedReader mapped(filename, this);
+    CPPUNIT_ASSERT(mapped.read());
+    unlink(filename);
+    CPPUNIT_ASSERT_EQUAL((size_t) 2, records.size());
+    CPPUNIT_ASSERT_EQUAL((size_t) 3, mapped.unreadableCount());
+    double start = Sp3MappedReader::epochTime(2011, 10, 1, 0, 0, 0.0);
+    CPPUNIT_ASSERT_EQUAL(start, records[0].time);
+    CPPUNIT_ASSERT_EQUAL(start + 1800.0, records[1].time);
+  }
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Sp3MappedReaderTest);
@@ -16,6 +16,8 @@
  */
 
 #include "time_tree.h"
+#include <utility>
+#include <vector>
 
 #include <cppunit/extensions/HelperMacros.h>
 
@@ -23,6 +25,7 @@ class TimeTreeTest : public CppUnit::TestFixture {
   CPPUNIT_TEST_SUITE(TimeTreeTest);
 
   CPPUNIT_TEST(testFind);
+  CPPUNIT_TEST(testBulkLoad);
 
   CPPUNIT_TEST_SUITE_END();
 
@@ -46,6 +49,41 @@ public:
     CPPUNIT_ASSERT(tree.find(8) == 8);
     CPPUNIT_ASSERT(tree.find(9) == 8);
     CPPUNIT_ASSERT(tree.find(42) == 8);
+
+    // Same lookup through the Btree it is
+    Btree<int, int, NodeArena, BtreeFloor> &base = tree;
+    CPPUNIT_ASSERT(base.find(3) == 2);
+    CPPUNIT_ASSERT(base.find(1) == base.NOT_FOUND);
+  }
+
+  /**
+   * Nodes from bulkLoad and mergeSorted have to be TimeTree nodes, so
+   * find still gets the closest earlier one
+   */
+
+  void testBulkLoad()
+  {
+    typedef std::vector<std::pair<int, int> > Pairs;
+    Pairs epochs;
+    for (int i = 2; i <= 8; i += 2) {
+      epochs.push_back(std::make_pair(i, i));
+    }
+    TimeTree<int,int> tree(0);
+    tree.bulkLoad(epochs.begin(), epochs.end());
+    CPPUNIT_ASSERT(tree.find(1) == tree.NOT_FOUND);
+    CPPUNIT_ASSERT(tree.find(3) == 2);
+    CPPUNIT_ASSERT(tree.find(7) == 6);
+    CPPUNIT_ASSERT(tree.find(42) == 8);
+
+    Pairs later;
+    later.push_back(std::make_pair(5, 5));
+    later.push_back(std::make_pair(10, 10));
+    tree.mergeSorted(later.begin(), later.end());
+    CPPUNIT_ASSERT(tree.find(5) == 5);
+    CPPUNIT_ASSERT(tree.find(6) == 6);
+    CPPUNIT_ASSERT(tree.find(9) == 8);
+    CPPUNIT_ASSERT(tree.find(42) == 10);
+    CPPUNIT_ASSERT(tree.isBalanced());
   }
 
 };
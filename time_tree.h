@@ -23,45 +23,16 @@
  * A find on 1 should return NOT_FOUND but any larger value than
  * 8 will always return 8, so if you want the top value to expire
  * at some time, you'll need to handle that in your code.
+ *
+ * Like Btree, the nodes come from an Allocator (node_allocator.h.)
+ * A TimeTree is a Btree whose Lookup is BtreeFloor, so find does the
+ * same thing whether you call it through a TimeTree or a Btree.
  */
 
-#include "btree.h"
-
-template <typename KeyType, typename ValType, typename Deallocator> class TimeTree;
-
-template <typename KeyType, typename ValType>
-  class TimeTreeNode : public BtreeNode<KeyType, ValType> {
-  typedef TimeTreeNode<KeyType, ValType> MyBtreeNode;
-  typedef Btree<KeyType,ValType> MyBtree;
-
- public:
+#ifndef _H_TIME_TREE
+#define _H_TIME_TREE
 
- TimeTreeNode(KeyType key, ValType val, MyBtree *owner) : BtreeNode<KeyType,ValType>(key,val,owner)
-    {
-    }
-
-  ValType find(KeyType toFind) {
-    if (toFind < this->keyVal.first) {
-      if (this->left) {
-        return this->left->find(toFind);
-      } else {
-        return this->owner->NOT_FOUND;
-      }
-    } else if (this->keyVal.first < toFind) {
-      ValType anyMoreRight = this->owner->NOT_FOUND;
-      if (this->right) {
-        anyMoreRight = this->right->find(toFind);
-      }
-      if (anyMoreRight != this->owner->NOT_FOUND) {
-        return anyMoreRight;
-      } else {
-        return this->keyVal.second;
-      }
-    } else {
-      return this->keyVal.second;
-    }
-  }
-};
+#include "btree.h"
 
 /**
  * I don't mind allocating things to go in time trees, but sometimes
@@ -76,53 +47,32 @@ class DefaultTimeTreeDeallocator {
   void operator()(ValType value) {}; // Do Nothing
 };
 
-template <typename KeyType, typename ValType, typename Deallocator = DefaultTimeTreeDeallocator<ValType> >
-class TimeTree : public Btree<KeyType, ValType>
+template <typename KeyType, typename ValType, typename Deallocator = DefaultTimeTreeDeallocator<ValType>, typename Allocator = NodeArena>
+class TimeTree : public Btree<KeyType, ValType, Allocator, BtreeFloor>
 {
-  friend class TimeTreeNode<KeyType,ValType>;
-  typedef TimeTreeNode<KeyType, ValType> NodeType;
+  typedef Btree<KeyType, ValType, Allocator, BtreeFloor> MyBtree;
 
  public:
   /**
    * Create with the value to be used for "Not Found"
    */
 
-  TimeTree(ValType nf) : Btree<KeyType, ValType>(nf)
+  TimeTree(ValType nf) : MyBtree(nf)
     {
     }
 
   virtual ~TimeTree()
   {
-    typename Btree<KeyType,ValType>::RangeType range;
-    typename Btree<KeyType,ValType>::RangeType::iterator iter;
     Deallocator dealloc;
-    findRange(range, this->begin(), this->end());
-    iter = range.begin();
-    while(iter != range.end()) {
-      dealloc((*iter)->second);
-      iter++;
-    }
-  }
-  
-  virtual void add(KeyType key, ValType val) throw(std::string)
-  {
     if (this->firstAdd) {
-      this->firstAdd = false;
-      this->lowest = key;
-      this->highest = key;
-    }
-    if (key < this->lowest) {
-      this->lowest = key;
+      return; // begin() and end() throw on an empty tree
     }
-    if (key > this->highest) {
-      this->highest = key;
-    }
-    TimeTreeNode<KeyType, ValType> *toAdd = new TimeTreeNode<KeyType,ValType>(key,val,this);
-    if (this->root) {
-      this->root->add(toAdd);
-    } else {
-      this->root = toAdd;
+    typename MyBtree::Cursor cursor = this->range(this->begin(), this->end());
+    for (; !cursor.done(); ++cursor) {
+      dealloc(cursor->second);
     }
   }
 
 };
+
+#endif